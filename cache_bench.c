@@ -0,0 +1,144 @@
+/*
+=======================
+Cache Hit Ratio Benchmark
+=======================
+Replays a key access trace against the hash table in cache mode and reports
+the hit ratio of each eviction/admission policy at a few cache sizes.
+
+Every access is a getItem; a miss is followed by an insertItem of the key, as
+a read-through cache would do.
+
+Usage:
+    ./cache_bench              synthetic trace (Zipfian hot set plus scans)
+    ./cache_bench TRACE_FILE   trace with one decimal key per line
+*/
+
+#include "hash_table.h"
+#include "workload.h"
+
+#include <stdlib.h>   // For malloc and free
+#include <stdio.h>    // For printf and file reading
+
+
+/** The number of distinct keys in the hot set of the synthetic trace */
+#define HOT_KEYS        100000
+/** The number of accesses in the synthetic trace */
+#define TRACE_LENGTH    4000000
+/** The synthetic trace contains a scan of SCAN_LENGTH new keys every
+    SCAN_EVERY accesses */
+#define SCAN_EVERY      200000
+#define SCAN_LENGTH     50000
+
+/** The number of buckets of the table under test, read by bucketHash */
+static unsigned int numBuckets;
+
+/**
+ * bucketHash
+ *
+ * Hash function handed to the table: mix the key, then reduce it to a bucket.
+ */
+static unsigned int bucketHash(unsigned int key) {
+    return scrambleKey(key) % numBuckets;
+}
+
+/**
+ * makeSyntheticTrace
+ *
+ * Build a trace where most accesses follow a Zipfian distribution over the
+ * hot set, interrupted by scans that touch never-seen keys exactly once.
+ */
+static unsigned int* makeSyntheticTrace(size_t* length) {
+    unsigned int* trace = (unsigned int*)malloc(TRACE_LENGTH * sizeof(unsigned int));
+    ZipfianGenerator* zipf = createZipfian(HOT_KEYS, 0.9);
+    unsigned long long state = 88172645463325252ULL;
+    unsigned int nextScanKey = HOT_KEYS;
+    size_t i = 0;
+    while (i < TRACE_LENGTH) {
+        if (i % SCAN_EVERY == SCAN_EVERY - SCAN_LENGTH) {
+            // a batch job touching every key of its range once
+            size_t j;
+            for (j = 0; j < SCAN_LENGTH && i < TRACE_LENGTH; ++j) {
+                trace[i++] = nextScanKey++;
+            }
+        } else {
+            trace[i++] = (unsigned int)nextZipfian(zipf, &state);
+        }
+    }
+    destroyZipfian(zipf);
+    *length = TRACE_LENGTH;
+    return trace;
+}
+
+/**
+ * readTrace
+ *
+ * Read a trace file with one decimal key per line.
+ */
+static unsigned int* readTrace(const char* path, size_t* length) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        printf("Cannot open trace file %s\n", path);
+        exit(1);
+    }
+    size_t capacity = 1 << 20;
+    size_t count = 0;
+    unsigned int* trace = (unsigned int*)malloc(capacity * sizeof(unsigned int));
+    unsigned int key;
+    while (fscanf(file, "%u", &key) == 1) {
+        if (count == capacity) {
+            capacity *= 2;
+            trace = (unsigned int*)realloc(trace, capacity * sizeof(unsigned int));
+        }
+        trace[count++] = key;
+    }
+    fclose(file);
+    *length = count;
+    return trace;
+}
+
+/**
+ * replay
+ *
+ * Run the trace through a cache of the given size and return the hit ratio.
+ */
+static double replay(const unsigned int* trace, size_t length,
+                     unsigned int capacity, unsigned int sketchCounters) {
+    numBuckets = capacity;
+    HashTable* ht = createHashTable(bucketHash, numBuckets);
+    enableHashTableCache(ht, capacity, sketchCounters, 0);
+
+    size_t hits = 0;
+    size_t i;
+    for (i = 0; i < length; ++i) {
+        if (getItem(ht, trace[i])) {
+            ++hits;
+        } else {
+            // the table frees the value if it rejects or evicts it
+            insertItem(ht, trace[i], malloc(sizeof(int)));
+        }
+    }
+    destroyHashTable(ht);
+    return (double)hits / length;
+}
+
+int main(int argc, char** argv) {
+    size_t length;
+    unsigned int* trace = argc > 1 ? readTrace(argv[1], &length)
+                                   : makeSyntheticTrace(&length);
+    if (length == 0) {
+        printf("The trace is empty\n");
+        return 1;
+    }
+    printf("trace: %zu accesses\n\n", length);
+    printf("%10s  %14s  %14s\n", "capacity", "no filter", "TinyLFU");
+
+    unsigned int capacities[] = { 1000, 5000, 20000, 50000 };
+    size_t i;
+    for (i = 0; i < sizeof(capacities) / sizeof(capacities[0]); ++i) {
+        double plain = replay(trace, length, capacities[i], 0);
+        double tinyLfu = replay(trace, length, capacities[i], 4 * capacities[i]);
+        printf("%10u  %13.2f%%  %13.2f%%\n", capacities[i], 100 * plain, 100 * tinyLfu);
+    }
+    free(trace);
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ Count-min sketch with 4-bit counters and periodic aging, in the style of the
+ TinyLFU paper (Einziger, Friedman & Manes). See frequency_sketch.h.
+
+ Counters are packed sixteen to a 64-bit word. Each of the four rows is
+ indexed by a different hash of the key.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "frequency_sketch.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc and free
+#include <stdint.h>   // For uint64_t
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The number of rows, each using its own hash of the key */
+#define SKETCH_DEPTH  4
+
+/** The largest value a 4-bit counter can hold */
+#define COUNTER_MAX   15
+
+/**
+ * This structure represents a frequency sketch.
+ */
+struct _FrequencySketch {
+  /** The counters, SKETCH_DEPTH rows of num_words words each */
+  uint64_t* table;
+
+  /** The number of 64-bit words per row (a power of 2) */
+  unsigned int num_words;
+
+  /** The number of keys recorded since the last aging */
+  unsigned int samples;
+
+  /** The number of keys recorded between two agings */
+  unsigned int aging_period;
+};
+
+/** Odd multipliers giving each row an independent hash of the key */
+static const uint64_t rowSeeds[SKETCH_DEPTH] = {
+  0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+  0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+};
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* counterIndex
+*
+* Helper function that computes which counter of the row the key maps to.
+*
+* @param sketch The pointer to the sketch
+* @param key The key
+* @param row The row number
+* @return The index of the counter within the row, in units of counters
+*/
+static unsigned int counterIndex(FrequencySketch* sketch, unsigned int key, int row) {
+    // the high half of a multiplicative hash is well mixed
+    uint64_t h = ((uint64_t)key + 1) * rowSeeds[row];
+    return (unsigned int)(h >> 32) & (sketch->num_words * 16 - 1);
+}
+
+/**
+* ageSketch
+*
+* Helper function that halves every counter, dropping the low bit of each
+* nibble in one mask-and-shift per word.
+*
+* @param sketch The pointer to the sketch
+*/
+static void ageSketch(FrequencySketch* sketch) {
+    unsigned int i;
+    for (i = 0; i < SKETCH_DEPTH * sketch->num_words; ++i) {
+        sketch->table[i] = (sketch->table[i] >> 1) & 0x7777777777777777ULL;
+    }
+    sketch->samples = 0;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+FrequencySketch* createFrequencySketch(unsigned int numCounters, unsigned int agingPeriod) {
+    FrequencySketch* sketch = (FrequencySketch*)malloc(sizeof(FrequencySketch));
+
+    // Round the row up to a power of 2 number of words
+    unsigned int words = 1;
+    while (words * 16 < numCounters) words <<= 1;
+
+    sketch->num_words = words;
+    sketch->table = (uint64_t*)calloc(SKETCH_DEPTH * words, sizeof(uint64_t));
+    sketch->samples = 0;
+    sketch->aging_period = agingPeriod;
+    return sketch;
+}
+
+void destroyFrequencySketch(FrequencySketch* sketch) {
+    free(sketch->table);
+    free(sketch);
+}
+
+void recordFrequency(FrequencySketch* sketch, unsigned int key) {
+    int row;
+    for (row = 0; row < SKETCH_DEPTH; ++row) {
+        unsigned int index = counterIndex(sketch, key, row);
+        uint64_t* word = &sketch->table[row * sketch->num_words + index / 16];
+        unsigned int shift = (index % 16) * 4;
+        // saturate instead of wrapping around
+        if (((*word >> shift) & COUNTER_MAX) != COUNTER_MAX) {
+            *word += 1ULL << shift;
+        }
+    }
+    if (++sketch->samples >= sketch->aging_period) ageSketch(sketch);
+}
+
+unsigned long long frequencySketchMemoryUsage(FrequencySketch* sketch) {
+    return sizeof(FrequencySketch) + SKETCH_DEPTH * sketch->num_words * sizeof(uint64_t);
+}
+
+unsigned int estimateFrequency(FrequencySketch* sketch, unsigned int key) {
+    unsigned int estimate = COUNTER_MAX;
+    int row;
+    for (row = 0; row < SKETCH_DEPTH; ++row) {
+        unsigned int index = counterIndex(sketch, key, row);
+        uint64_t word = sketch->table[row * sketch->num_words + index / 16];
+        unsigned int count = (word >> ((index % 16) * 4)) & COUNTER_MAX;
+        if (count < estimate) estimate = count;
+    }
+    return estimate;
+}
@@ -0,0 +1,71 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef FREQUENCYSKETCH_H
+#define FREQUENCYSKETCH_H
+
+/****************************************************************************
+ * Frequency Sketch
+ *
+ * This module is private to the hash table implementation. It is a count-min
+ * sketch of 4-bit counters that estimates how often each key has been seen
+ * recently, as used by the TinyLFU admission policy of the cache mode.
+ *
+ * Every key updates one counter in each of four rows. The estimate is the
+ * smallest of those four counters, which can overestimate (because of
+ * collisions) but never underestimates. Once agingPeriod keys have been
+ * recorded, every counter is halved so that old popularity fades away.
+ ***************************************************************************/
+
+/**
+ * This defines a type that is a _FrequencySketch struct. The definition for
+ * _FrequencySketch is implemented in frequency_sketch.c.
+ */
+typedef struct _FrequencySketch FrequencySketch;
+
+/**
+ * createFrequencySketch
+ *
+ * Creates a sketch with room for at least numCounters counters per row.
+ *
+ * @param numCounters The number of counters per row, rounded up to a power of 2.
+ * @param agingPeriod The number of recorded keys after which counters are halved (> 0).
+ * @return a pointer to the new sketch
+ */
+FrequencySketch* createFrequencySketch(unsigned int numCounters, unsigned int agingPeriod);
+
+/**
+ * destroyFrequencySketch
+ *
+ * @param sketch The pointer to the sketch.
+ */
+void destroyFrequencySketch(FrequencySketch* sketch);
+
+/**
+ * recordFrequency
+ *
+ * Record one occurrence of the key.
+ *
+ * @param sketch The pointer to the sketch.
+ * @param key The key that was seen.
+ */
+void recordFrequency(FrequencySketch* sketch, unsigned int key);
+
+/**
+ * estimateFrequency
+ *
+ * @param sketch The pointer to the sketch.
+ * @param key The key to look up.
+ * @return the estimated number of recent occurrences of the key, at most 15
+ */
+unsigned int estimateFrequency(FrequencySketch* sketch, unsigned int key);
+
+/**
+ * frequencySketchMemoryUsage
+ *
+ * @param sketch The pointer to the sketch.
+ * @return the number of bytes allocated for the sketch
+ */
+unsigned long long frequencySketchMemoryUsage(FrequencySketch* sketch);
+
+#endif
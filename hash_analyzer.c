@@ -0,0 +1,419 @@
+/*
+=======================
+Hash Function Analyzer
+=======================
+Measures how well a HashFunction spreads a sample of keys before it is handed
+to createHashTable, and recommends a bucket count for it.
+
+The function is either one of the built-in ones or a symbol loaded from a
+shared object; it must have the HashFunction signature. The table uses what
+the function returns as the bucket index, so the analyzer reduces every result
+modulo the bucket count exactly like an application passing that bucket count
+would have to. A function that already reduces (key % 3) is analyzed as is.
+
+Reports:
+    occupancy   chi-square of the bucket counts against a uniform spread,
+                and how many standard deviations it is from the expected value
+    chains      longest chain against the longest one expected from a truly
+                random function, and the mean probes of a successful lookup
+    avalanche   for each input bit, how often each output bit flips; an ideal
+                function flips every output bit half of the time. The 32x32
+                matrix prints the bias |2p - 1| of each cell as a digit 0-9,
+                "." for less than 5%
+    speed       hashes per second over the sample
+    buckets     the power of two and the prime closest to keys / load factor,
+                with the chi-square each gives, and which one to use
+
+Usage:
+    ./hash_analyzer [-f NAME | -l LIBRARY.so:SYMBOL]
+                    [-k KEY_FILE | -g sequential|strided|random] [-n KEYS]
+                    [-s STRIDE] [-b BUCKETS] [-L LOAD_FACTOR]
+
+    -f  built-in function: identity, knuth, fmix32, fnv1a (default fmix32)
+    -l  load SYMBOL from the shared object LIBRARY.so instead
+    -k  read keys from a file, one per line (decimal, or hex with 0x)
+    -g  generate keys instead (default sequential)
+    -n  number of generated keys (default 1000000)
+    -s  distance between strided keys (default 64)
+    -b  bucket count for the occupancy and chain reports (default: the
+        recommended one)
+    -L  target load factor for the recommendation (default 1.0)
+*/
+
+#include "workload.h"
+
+#include <stdlib.h>   // For malloc, free and strtoul
+#include <stdio.h>    // For printf and file reading
+#include <string.h>   // For strcmp and strrchr
+#include <math.h>     // For sqrt and exp
+#include <time.h>     // For clock_gettime
+#include <unistd.h>   // For getopt
+#include <dlfcn.h>    // For dlopen and dlsym
+
+
+/** The signature of a hash function, as in hash_table.h */
+typedef unsigned int (*HashFunction)(unsigned int key);
+
+/** The number of random keys whose bits are flipped for the avalanche test */
+#define AVALANCHE_KEYS  20000
+/** Benchmark the function for at least this many nanoseconds */
+#define SPEED_NS        200000000ULL
+
+/**
+ * identityHash
+ *
+ * The key itself, as a naive key % numBuckets table would use.
+ */
+static unsigned int identityHash(unsigned int key) {
+    return key;
+}
+
+/**
+ * knuthHash
+ *
+ * Knuth's multiplicative hash. The high bits are good, the low ones are not.
+ */
+static unsigned int knuthHash(unsigned int key) {
+    return key * 2654435761u;
+}
+
+/**
+ * fmix32Hash
+ *
+ * The murmur3 finalizer the benchmarks use.
+ */
+static unsigned int fmix32Hash(unsigned int key) {
+    return scrambleKey(key);
+}
+
+/**
+ * fnv1aHash
+ *
+ * FNV-1a over the four bytes of the key, least significant first.
+ */
+static unsigned int fnv1aHash(unsigned int key) {
+    unsigned int hash = 2166136261u;
+    int i;
+    for (i = 0; i < 4; ++i) {
+        hash ^= (key >> (8 * i)) & 0xFF;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/** The built-in functions, selected with -f */
+static const struct {
+  const char* name;
+  HashFunction function;
+} builtins[] = {
+  { "identity", identityHash },
+  { "knuth", knuthHash },
+  { "fmix32", fmix32Hash },
+  { "fnv1a", fnv1aHash },
+};
+
+/**
+ * nowNs
+ *
+ * @return the monotonic clock in nanoseconds
+ */
+static unsigned long long nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * loadFunction
+ *
+ * Resolve "LIBRARY.so:SYMBOL". The library is never closed.
+ *
+ * @return the function, or NULL after printing why
+ */
+static HashFunction loadFunction(const char* spec) {
+    char* path = strdup(spec);
+    char* colon = strrchr(path, ':');
+    if (!colon) {
+        printf("Expected LIBRARY.so:SYMBOL, got %s\n", spec);
+        free(path);
+        return NULL;
+    }
+    *colon = '\0';
+    HashFunction function = NULL;
+    void* library = dlopen(path, RTLD_NOW);
+    if (!library) {
+        printf("%s\n", dlerror());
+    } else {
+        *(void**)&function = dlsym(library, colon + 1);
+        if (!function) printf("%s\n", dlerror());
+    }
+    free(path);
+    return function;
+}
+
+/**
+ * readKeys
+ *
+ * Read one key per line.
+ *
+ * @return the keys, or NULL if the file cannot be read
+ */
+static unsigned int* readKeys(const char* path, size_t* count) {
+    FILE* file = fopen(path, "r");
+    if (!file) return NULL;
+    size_t capacity = 1024;
+    unsigned int* keys = (unsigned int*)malloc(capacity * sizeof(unsigned int));
+    char line[64];
+    *count = 0;
+    while (fgets(line, sizeof(line), file)) {
+        char* end;
+        unsigned long key = strtoul(line, &end, 0);
+        if (end == line) continue;
+        if (*count == capacity) {
+            capacity *= 2;
+            keys = (unsigned int*)realloc(keys, capacity * sizeof(unsigned int));
+        }
+        keys[(*count)++] = (unsigned int)key;
+    }
+    fclose(file);
+    return keys;
+}
+
+/**
+ * isPrime
+ */
+static int isPrime(unsigned int n) {
+    unsigned int d;
+    if (n < 2) return 0;
+    for (d = 2; (unsigned long long)d * d <= n; ++d) {
+        if (n % d == 0) return 0;
+    }
+    return 1;
+}
+
+/**
+ * Bucket statistics of one bucket count.
+ */
+typedef struct {
+  double chi_square;
+  /** How many standard deviations chi_square is above its expected value */
+  double deviation;
+  unsigned int longest;
+  unsigned int empty;
+  /** The mean number of entries visited by a successful lookup */
+  double probes;
+} Occupancy;
+
+/**
+ * measureOccupancy
+ *
+ * Count how many keys land in each of buckets buckets.
+ */
+static Occupancy measureOccupancy(HashFunction function, const unsigned int* keys,
+                                  size_t count, unsigned int buckets) {
+    unsigned int* chains = (unsigned int*)calloc(buckets, sizeof(unsigned int));
+    size_t i;
+    for (i = 0; i < count; ++i) chains[function(keys[i]) % buckets]++;
+
+    Occupancy result = { 0, 0, 0, 0, 0 };
+    double expected = (double)count / buckets;
+    double probes = 0;
+    unsigned int b;
+    for (b = 0; b < buckets; ++b) {
+        double difference = chains[b] - expected;
+        result.chi_square += difference * difference / expected;
+        if (chains[b] > result.longest) result.longest = chains[b];
+        if (chains[b] == 0) result.empty++;
+        probes += (double)chains[b] * (chains[b] + 1) / 2;
+    }
+    double freedom = buckets - 1;
+    result.deviation = freedom > 0 ? (result.chi_square - freedom) / sqrt(2 * freedom) : 0;
+    result.probes = count ? probes / count : 0;
+    free(chains);
+    return result;
+}
+
+/**
+ * expectedLongest
+ *
+ * The longest chain a random function would most likely produce: the
+ * smallest length such that fewer than half a bucket is expected to hold more
+ * keys, with Poisson distributed chain lengths.
+ */
+static unsigned int expectedLongest(size_t count, unsigned int buckets) {
+    double mean = (double)count / buckets;
+    double term = exp(-mean);           // P(X = 0)
+    double atMost = term;               // P(X <= k)
+    unsigned int k = 0;
+    while (buckets * (1 - atMost) >= 0.5 && k < count) {
+        ++k;
+        term *= mean / k;
+        atMost += term;
+    }
+    return k;
+}
+
+/**
+ * printAvalanche
+ *
+ * Flip each input bit of random keys and print how biased each output bit
+ * is. Returns nothing; prints the matrix and the worst and mean bias.
+ */
+static void printAvalanche(HashFunction function) {
+    static unsigned int flips[32][32];
+    unsigned long long seed = 0x2545F4914F6CDD1DULL;
+    int in, out, k;
+    memset(flips, 0, sizeof(flips));
+    for (k = 0; k < AVALANCHE_KEYS; ++k) {
+        unsigned int key = (unsigned int)nextRandom(&seed);
+        unsigned int hash = function(key);
+        for (in = 0; in < 32; ++in) {
+            unsigned int changed = hash ^ function(key ^ (1u << in));
+            for (out = 0; out < 32; ++out) flips[in][out] += (changed >> out) & 1;
+        }
+    }
+
+    double worst = 0, total = 0;
+    printf("avalanche bias, rows = input bit 0..31, columns = output bit 0..31:\n");
+    for (in = 0; in < 32; ++in) {
+        printf("  %2d ", in);
+        for (out = 0; out < 32; ++out) {
+            double bias = fabs(2.0 * flips[in][out] / AVALANCHE_KEYS - 1);
+            if (bias > worst) worst = bias;
+            total += bias;
+            int digit = (int)(bias * 10);
+            putchar(bias < 0.05 ? '.' : '0' + (digit > 9 ? 9 : digit));
+        }
+        putchar('\n');
+    }
+    printf("  worst bias %.3f, mean bias %.3f (random: about %.3f)\n",
+           worst, total / 1024, sqrt(2.0 / (3.14159265 * AVALANCHE_KEYS)));
+}
+
+/**
+ * measureSpeed
+ *
+ * @return hashes per second over the sample
+ */
+static double measureSpeed(HashFunction function, const unsigned int* keys, size_t count) {
+    volatile unsigned int sink = 0;
+    unsigned long long hashed = 0;
+    unsigned long long start = nowNs(), elapsed;
+    do {
+        unsigned int sum = 0;
+        size_t i;
+        for (i = 0; i < count; ++i) sum += function(keys[i]);
+        sink += sum;
+        hashed += count;
+        elapsed = nowNs() - start;
+    } while (elapsed < SPEED_NS);
+    (void)sink;
+    return hashed * 1e9 / elapsed;
+}
+
+int main(int argc, char** argv) {
+    HashFunction function = fmix32Hash;
+    const char* functionName = "fmix32";
+    const char* keyFile = NULL;
+    const char* generator = "sequential";
+    size_t count = 1000000;
+    unsigned int stride = 64;
+    unsigned int buckets = 0;
+    double loadFactor = 1.0;
+
+    int option;
+    size_t i;
+    while ((option = getopt(argc, argv, "f:l:k:g:n:s:b:L:")) != -1) {
+        switch (option) {
+        case 'f':
+            function = NULL;
+            for (i = 0; i < sizeof(builtins) / sizeof(builtins[0]); ++i) {
+                if (strcmp(builtins[i].name, optarg) == 0) function = builtins[i].function;
+            }
+            if (!function) { printf("Unknown function %s\n", optarg); return 1; }
+            functionName = optarg;
+            break;
+        case 'l':
+            function = loadFunction(optarg);
+            if (!function) return 1;
+            functionName = optarg;
+            break;
+        case 'k': keyFile = optarg; break;
+        case 'g': generator = optarg; break;
+        case 'n': count = strtoull(optarg, NULL, 10); break;
+        case 's': stride = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'b': buckets = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'L': loadFactor = atof(optarg); break;
+        default:
+            printf("Usage: %s [-f NAME | -l LIBRARY.so:SYMBOL] "
+                   "[-k KEY_FILE | -g sequential|strided|random] [-n KEYS] "
+                   "[-s STRIDE] [-b BUCKETS] [-L LOAD_FACTOR]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the key sample
+    unsigned int* keys;
+    if (keyFile) {
+        keys = readKeys(keyFile, &count);
+        if (!keys) { printf("Cannot read %s\n", keyFile); return 1; }
+    } else {
+        unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+        keys = (unsigned int*)malloc((count ? count : 1) * sizeof(unsigned int));
+        for (i = 0; i < count; ++i) {
+            if (strcmp(generator, "strided") == 0) keys[i] = (unsigned int)(i * stride);
+            else if (strcmp(generator, "random") == 0) keys[i] = (unsigned int)nextRandom(&seed);
+            else keys[i] = (unsigned int)i;
+        }
+        if (strcmp(generator, "strided") && strcmp(generator, "random") &&
+            strcmp(generator, "sequential")) {
+            printf("Unknown generator %s\n", generator);
+            free(keys);
+            return 1;
+        }
+    }
+    if (count == 0 || loadFactor <= 0) {
+        printf("Need at least one key and a positive load factor\n");
+        free(keys);
+        return 1;
+    }
+    printf("function %s, %zu keys (%s)\n\n", functionName, count,
+           keyFile ? keyFile : generator);
+
+    // the two candidate bucket counts
+    double wanted = count / loadFactor;
+    unsigned int powerOfTwo = 1;
+    while (powerOfTwo < wanted && powerOfTwo < 0x80000000u) powerOfTwo <<= 1;
+    unsigned int prime = wanted < 2 ? 2 : (unsigned int)wanted;
+    while (!isPrime(prime)) ++prime;
+    Occupancy atPower = measureOccupancy(function, keys, count, powerOfTwo);
+    Occupancy atPrime = measureOccupancy(function, keys, count, prime);
+    // a power of two only sees the low bits; take it unless it is clearly
+    // worse, since reducing by it is a mask instead of a division
+    unsigned int recommended = atPower.deviation < 3 || atPower.deviation <= atPrime.deviation
+                             ? powerOfTwo : prime;
+    if (buckets == 0) buckets = recommended;
+
+    Occupancy occupancy = measureOccupancy(function, keys, count, buckets);
+    printf("occupancy over %u buckets (load factor %.2f):\n", buckets, (double)count / buckets);
+    printf("  chi-square %.1f for %u degrees of freedom, %+.1f standard deviations%s\n",
+           occupancy.chi_square, buckets - 1, occupancy.deviation,
+           occupancy.deviation > 3 ? "  <- not uniform" : "");
+    printf("  empty buckets %u (random: about %.0f)\n", occupancy.empty,
+           buckets * exp(-(double)count / buckets));
+    printf("  longest chain %u (random: about %u), %.2f probes per successful lookup "
+           "(random: about %.2f)\n\n", occupancy.longest, expectedLongest(count, buckets),
+           occupancy.probes, 1 + (count - 1) / (2.0 * buckets));
+
+    printAvalanche(function);
+    printf("\nspeed: %.1f million hashes per second\n\n",
+           measureSpeed(function, keys, count) / 1e6);
+
+    printf("bucket count for load factor %.2f:\n", loadFactor);
+    printf("  power of two %10u: %+8.1f standard deviations\n", powerOfTwo, atPower.deviation);
+    printf("  prime        %10u: %+8.1f standard deviations\n", prime, atPrime.deviation);
+    printf("  recommended: %u\n", recommended);
+
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,234 @@
+/*
+ Hash sets: key-only chains linked by 32-bit indices, as in
+ HT_LAYOUT_COMPACT, and set algebra that walks two sets bucket by bucket.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_set.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, realloc and free
+#include <stdio.h>    // For printf
+#include <string.h>   // For memcpy
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The index that ends a chain or the free list */
+#define NIL             0xFFFFFFFFu
+
+/** The number of keys the pool starts with */
+#define INITIAL_KEYS    16
+
+/**
+ * A key of the set, 8 bytes.
+ */
+typedef struct {
+  /** The key */
+  unsigned int key;
+
+  /** The index of the next key of the chain (or of the free list), or NIL */
+  unsigned int next;
+} SetEntry;
+
+struct _HashSet {
+  /** The hash function pointer */
+  HashFunction hash;
+
+  /** The number of buckets */
+  unsigned int num_buckets;
+
+  /** The index of the first key of each bucket, or NIL */
+  unsigned int* heads;
+
+  /** The pool of keys */
+  SetEntry* entries;
+
+  /** The number of keys the pool has room for */
+  unsigned int capacity;
+
+  /** The number of keys of the pool handed out so far, free or not */
+  unsigned int used;
+
+  /** The first entry of the list of removed keys, or NIL */
+  unsigned int free_list;
+
+  /** The number of keys in the set */
+  unsigned int num_keys;
+};
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* pushKey
+*
+* Helper function that adds a key known to be absent to a bucket.
+*/
+static void pushKey(HashSet* set, unsigned int bucketIndex, unsigned int key) {
+    unsigned int index = set->free_list;
+    if (index != NIL) {
+        set->free_list = set->entries[index].next;
+    } else {
+        if (set->used == set->capacity) {
+            // indices stay valid when the pool moves
+            set->capacity *= 2;
+            set->entries = (SetEntry*)realloc(set->entries, set->capacity * sizeof(SetEntry));
+        }
+        index = set->used++;
+    }
+    set->entries[index].key = key;
+    set->entries[index].next = set->heads[bucketIndex];
+    set->heads[bucketIndex] = index;
+    set->num_keys++;
+}
+
+/**
+* inBucket
+*
+* @return 1 if a bucket holds a key
+*/
+static int inBucket(HashSet* set, unsigned int bucketIndex, unsigned int key) {
+    unsigned int index;
+    for (index = set->heads[bucketIndex]; index != NIL; index = set->entries[index].next) {
+        if (set->entries[index].key == key) return 1;
+    }
+    return 0;
+}
+
+/**
+* sameBuckets
+*
+* @return 1 if every key is in the same bucket of both sets
+*/
+static int sameBuckets(HashSet* a, HashSet* b) {
+    return a->hash == b->hash && a->num_buckets == b->num_buckets;
+}
+
+/**
+* copySet
+*
+* Helper function that creates a copy of a set, pool and all.
+*/
+static HashSet* copySet(HashSet* set) {
+    HashSet* copy = (HashSet*)malloc(sizeof(HashSet));
+    *copy = *set;
+    copy->heads = (unsigned int*)malloc(set->num_buckets * sizeof(unsigned int));
+    memcpy(copy->heads, set->heads, set->num_buckets * sizeof(unsigned int));
+    copy->entries = (SetEntry*)malloc(set->capacity * sizeof(SetEntry));
+    memcpy(copy->entries, set->entries, set->used * sizeof(SetEntry));
+    return copy;
+}
+
+/**
+* filterSet
+*
+* Helper function behind setIntersection and setDifference: the keys of a
+* that are (keep = 1) or are not (keep = 0) in b.
+*/
+static HashSet* filterSet(HashSet* a, HashSet* b, int keep) {
+    HashSet* result = createHashSet(a->hash, a->num_buckets);
+    int walk = sameBuckets(a, b);
+    unsigned int i, index;
+    for (i = 0; i < a->num_buckets; ++i) {
+        for (index = a->heads[i]; index != NIL; index = a->entries[index].next) {
+            unsigned int key = a->entries[index].key;
+            // side by side, the key can only be in the same bucket of b
+            int inB = walk ? inBucket(b, i, key) : setContains(b, key);
+            if (inB == keep) pushKey(result, i, key);
+        }
+    }
+    return result;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+HashSet* createHashSet(HashFunction hashFunction, unsigned int numBuckets) {
+    if (numBuckets == 0) {
+        printf("Hash set has to contain at least 1 bucket...\n");
+        exit(1);
+    }
+    HashSet* set = (HashSet*)malloc(sizeof(HashSet));
+    set->hash = hashFunction;
+    set->num_buckets = numBuckets;
+    set->heads = (unsigned int*)malloc(numBuckets * sizeof(unsigned int));
+    unsigned int i;
+    for (i = 0; i < numBuckets; ++i) set->heads[i] = NIL;
+    set->capacity = INITIAL_KEYS;
+    set->entries = (SetEntry*)malloc(set->capacity * sizeof(SetEntry));
+    set->used = 0;
+    set->free_list = NIL;
+    set->num_keys = 0;
+    return set;
+}
+
+void destroyHashSet(HashSet* set) {
+    free(set->heads);
+    free(set->entries);
+    free(set);
+}
+
+int setInsert(HashSet* set, unsigned int key) {
+    unsigned int bucketIndex = set->hash(key);
+    if (inBucket(set, bucketIndex, key)) return 0;
+    pushKey(set, bucketIndex, key);
+    return 1;
+}
+
+int setContains(HashSet* set, unsigned int key) {
+    return inBucket(set, set->hash(key), key);
+}
+
+int setRemove(HashSet* set, unsigned int key) {
+    unsigned int* link = &set->heads[set->hash(key)];
+    while (*link != NIL && set->entries[*link].key != key) link = &set->entries[*link].next;
+    if (*link == NIL) return 0;
+    unsigned int index = *link;
+    *link = set->entries[index].next;
+    set->entries[index].next = set->free_list;
+    set->free_list = index;
+    set->num_keys--;
+    return 1;
+}
+
+unsigned int setSize(HashSet* set) {
+    return set->num_keys;
+}
+
+HashSet* setUnion(HashSet* a, HashSet* b) {
+    // start from a copy of a, then add what b has on top
+    HashSet* result = copySet(a);
+    int walk = sameBuckets(a, b);
+    unsigned int i, index;
+    for (i = 0; i < b->num_buckets; ++i) {
+        for (index = b->heads[i]; index != NIL; index = b->entries[index].next) {
+            unsigned int key = b->entries[index].key;
+            if (!walk) setInsert(result, key);
+            else if (!inBucket(a, i, key)) pushKey(result, i, key);
+        }
+    }
+    return result;
+}
+
+HashSet* setIntersection(HashSet* a, HashSet* b) {
+    return filterSet(a, b, 1);
+}
+
+HashSet* setDifference(HashSet* a, HashSet* b) {
+    return filterSet(a, b, 0);
+}
+
+unsigned long long hashSetMemoryUsage(HashSet* set) {
+    return sizeof(HashSet) +
+           (unsigned long long)set->num_buckets * sizeof(unsigned int) +
+           (unsigned long long)set->capacity * sizeof(SetEntry);
+}
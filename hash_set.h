@@ -0,0 +1,127 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef HASHSET_H
+#define HASHSET_H
+
+#include "hash_table.h"  // For HashFunction
+
+/****************************************************************************
+ * Hash Sets
+ *
+ * A set of unsigned int keys, for tables that only track membership and
+ * would otherwise store a dummy value per key in a HashTable. It uses the
+ * same HashFunction contract, and the chains of HT_LAYOUT_COMPACT without
+ * the value array: 8 bytes per key in one contiguous pool, and no value to
+ * allocate.
+ *
+ * The set algebra functions build a new set. When both sets have the same
+ * hash function and bucket count, a key can only be in the same bucket of
+ * both, so they walk the two bucket arrays side by side, compare short
+ * chains and append to the same bucket of the result, without hashing a
+ * single key. Otherwise they fall back to looking each key up.
+ ***************************************************************************/
+/**
+ * This defines a type that is a _HashSet struct. The definition for
+ * _HashSet is implemented in hash_set.c.
+ */
+typedef struct _HashSet HashSet;
+
+/**
+ * createHashSet
+ *
+ * Creates an empty set.
+ *
+ * @param myHashFunc The pointer to the custom hash function.
+ * @param numBuckets The number of buckets available in the set.
+ * @return a pointer to the new set
+ */
+HashSet* createHashSet(HashFunction myHashFunc, unsigned int numBuckets);
+
+/**
+ * destroyHashSet
+ *
+ * Frees the set.
+ *
+ * @param mySet The pointer to the set.
+ */
+void destroyHashSet(HashSet* mySet);
+
+/**
+ * setInsert
+ *
+ * Adds a key to the set.
+ *
+ * @param mySet The pointer to the set.
+ * @param key The key to add.
+ * @return 1 if the key was added, 0 if it was already present
+ */
+int setInsert(HashSet* mySet, unsigned int key);
+
+/**
+ * setContains
+ *
+ * @param mySet The pointer to the set.
+ * @param key The key to look for.
+ * @return 1 if the key is in the set, 0 otherwise
+ */
+int setContains(HashSet* mySet, unsigned int key);
+
+/**
+ * setRemove
+ *
+ * Takes a key out of the set.
+ *
+ * @param mySet The pointer to the set.
+ * @param key The key to remove.
+ * @return 1 if the key was removed, 0 if it was not present
+ */
+int setRemove(HashSet* mySet, unsigned int key);
+
+/**
+ * setSize
+ *
+ * @param mySet The pointer to the set.
+ * @return the number of keys in the set
+ */
+unsigned int setSize(HashSet* mySet);
+
+/**
+ * setUnion
+ *
+ * @param a The pointer to a set.
+ * @param b The pointer to another set.
+ * @return a new set of the keys in a or b, with the hash function and
+ *         bucket count of a
+ */
+HashSet* setUnion(HashSet* a, HashSet* b);
+
+/**
+ * setIntersection
+ *
+ * @param a The pointer to a set.
+ * @param b The pointer to another set.
+ * @return a new set of the keys in both a and b, with the hash function and
+ *         bucket count of a
+ */
+HashSet* setIntersection(HashSet* a, HashSet* b);
+
+/**
+ * setDifference
+ *
+ * @param a The pointer to a set.
+ * @param b The pointer to another set.
+ * @return a new set of the keys in a but not in b, with the hash function
+ *         and bucket count of a
+ */
+HashSet* setDifference(HashSet* a, HashSet* b);
+
+/**
+ * hashSetMemoryUsage
+ *
+ * @param mySet The pointer to the set.
+ * @return the bytes allocated by the set
+ */
+unsigned long long hashSetMemoryUsage(HashSet* mySet);
+
+#endif
@@ -62,6 +62,83 @@ Naming conventions in this file:
 ***************************************************************************/
 #include <stdlib.h>   // For malloc and free
 #include <stdio.h>    // For printf
+#include <string.h>   // For memmove
+#include <time.h>     // For clock_gettime
+#include <sys/random.h>   // For getrandom
+#include <pthread.h>  // For the threads of bulkBuildHashTable
+#include "timing_wheel.h"
+#include "frequency_sketch.h"
+#include "trace_recorder.h"
+#include "latency_recorder.h"
+#include "tree_bin.h"
+#include "siphash.h"
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Tuning Constants
+***************************************************************************/
+/** The maximum amount of expiration work done by one call to tickHashTable */
+#define EXPIRE_WORK_PER_TICK  1024
+
+/** The number of entries looked at to choose a victim in cache mode */
+#define EVICTION_SAMPLES      5
+
+/** A chain that grows longer than this is moved into a tree bin */
+#define TREEIFY_THRESHOLD     8
+
+/** A tree bin that shrinks below this goes back to being a chain. The gap
+    with TREEIFY_THRESHOLD keeps a bucket from flipping back and forth. */
+#define UNTREEIFY_THRESHOLD   6
+
+/** An insert into a bucket holding at least FLOOD_MIN_LENGTH entries, and
+    FLOOD_RATIO times more than the average bucket, is treated as a hash
+    flooding attack. A random hash function gets nowhere near either. */
+#define FLOOD_MIN_LENGTH      64
+#define FLOOD_RATIO           16
+
+/** The number of entries moved to the new buckets by each operation while
+    the table is being rehashed. Empty buckets count as a tenth of an entry. */
+#define REHASH_WORK_PER_STEP  64
+
+/** The number of values a key's run has room for when it is created in
+    multimap mode; it doubles when full */
+#define RUN_INITIAL_ROOM      2
+
+/** A scan cursor of a chained table holds a bucket index in its low 32
+    bits, SCAN_OLD_PHASE while the old buckets of a rehash are walked, and
+    from SCAN_EPOCH_SHIFT up the reseed count the walk was planned for */
+#define SCAN_OLD_PHASE        (1ULL << 32)
+#define SCAN_EPOCH_SHIFT      33
+
+/** The operations timed when latency recording is enabled */
+enum {
+  LATENCY_INSERT,
+  LATENCY_INSERT_TTL,
+  LATENCY_GET,
+  LATENCY_REMOVE,
+  LATENCY_DELETE,
+  LATENCY_TICK,
+  NUM_LATENCY_OPS
+};
+
+/** The names printed by dumpHashTableLatency, indexed by operation */
+static const char* const latencyOpNames[NUM_LATENCY_OPS] = {
+  "insertItem", "insertItemTTL", "getItem", "removeItem", "deleteItem", "tickHashTable"
+};
+
+/** The engine of each layout, indexed by HashTableLayout. The chained layout
+    is implemented by this file. */
+static const HashTableEngine* const layoutEngines[] = {
+  NULL,
+  &compactEngine,
+  &unrolledEngine,
+  &inlineEngine,
+  &hopscotchEngine,
+  &linearEngine,
+  &extendibleEngine,
+  &countingEngine
+};
 
 
 /****************************************************************************
@@ -75,16 +152,114 @@ Naming conventions in this file:
  * This structure represents an a hash table.
  * Use "HashTable" instead when you are creating a new variable. [See top comments]
  */
+typedef struct _BucketArray BucketArray;
+
+/**
+ * A bucket: the head of its chain, and a tag byte for each entry of the
+ * chain. A tag is 7 bits of a hash of the key with the high bit set, so an
+ * unused byte (0) never matches. Chains hold at most TREEIFY_THRESHOLD = 8
+ * entries, so the tags cover every entry, and a key whose tag is not among
+ * them is known to be missing without reading a single entry.
+ */
+typedef struct {
+  /** The first entry of the chain, or NULL */
+  HashTableEntry* head;
+
+  /** The tags of the entries of the chain, in no particular order, packed
+      one per byte; 0 for a treeified bucket */
+  unsigned long long tags;
+} Bucket;
+
+/**
+ * An array of buckets, together with the way keys are mapped onto it.
+ */
+struct _BucketArray {
+  /** The array of buckets, each the head of a singly linked list, whose nodes
+      are HashTableEntry objects, and the tags of those nodes */
+  Bucket* buckets;
+
+  /** The tree bin of each bucket whose chain grew too long, or NULL for the
+      buckets that are plain chains. A treeified bucket keeps its entries in
+      the bin only, and its chain head stays NULL. The array itself is only
+      allocated when the first bucket is treeified. */
+  TreeBin** bins;
+
+  /** 0 if the user's hash function places the keys, 1 if they are placed by
+      SipHash with the seed below */
+  int keyed;
+
+  /** The secret SipHash seed, when keyed */
+  unsigned long long seed[2];
+};
+
 struct _HashTable {
-  /** The array of pointers to the head of a singly linked list, whose nodes
-      are HashTableEntry objects */
-  HashTableEntry** buckets;
+  /** The buckets new entries go to */
+  BucketArray table;
+
+  /** While the table is being rehashed after a reseed, the buckets entries
+      are moved out of; their buckets field is NULL otherwise */
+  BucketArray old_table;
+
+  /** The next bucket of old_table to move to table */
+  unsigned int rehash_index;
+
+  /** The number of times a hash flooding attack made the table reseed */
+  unsigned int num_reseeds;
 
   /** The hash function pointer */
   HashFunction hash;
 
   /** The number of buckets in the hash table */
   unsigned int num_buckets;
+
+  /** The timing wheel tracking entries with a TTL, or NULL if no entry was
+      ever inserted with a TTL */
+  TimingWheel* wheel;
+
+  /** The number of entries currently stored */
+  unsigned int num_entries;
+
+  /** The maximum number of entries in cache mode, or 0 if unbounded */
+  unsigned int capacity;
+
+  /** The access frequency sketch used for TinyLFU admission in cache mode,
+      or NULL if every new entry is admitted */
+  FrequencySketch* sketch;
+
+  /** The state of the random generator used to sample eviction victims */
+  unsigned int random_state;
+
+  /** The recorder of public operations, or NULL when not tracing */
+  TraceRecorder* trace;
+
+  /** The latency histograms of public operations, or NULL when disabled */
+  LatencyRecorder* latency;
+
+  /** The engine implementing a layout other than HT_LAYOUT_CHAINED, in which
+      case the bucket arrays are unused, or NULL */
+  const HashTableEngine* engine;
+
+  /** The table created by the engine */
+  void* engine_state;
+
+  /** 1 if a key may hold several values, in which case the value of each
+      entry is the ValueRun of its key, 0 otherwise */
+  int multimap;
+
+  /** The bytes allocated for the ValueRuns in multimap mode */
+  unsigned long long run_bytes;
+
+  /** The size of the values stored inline by insertItemCopy, or 0 if the
+      values are pointers */
+  unsigned int value_size;
+
+  /** The entries allocated at once by bulkBuildHashTable, which are freed
+      with the table rather than one by one, or NULL */
+  HashTableEntry* arena;
+
+  /** The number of entries in the arena, and how many of them are in use */
+  unsigned int arena_size;
+  unsigned int arena_live;
 };
 
 /**
@@ -98,6 +273,13 @@ struct _HashTableEntry {
   /** The value associated with this hash table entry */
   void* value;
 
+  /** The time in milliseconds at which this entry expires, or 0 if the
+      entry never expires */
+  unsigned long long expire_at;
+
+  /** The timer of the entry in the timing wheel, or NULL if it has none */
+  Timer* timer;
+
   /**
   * A pointer pointing to the next hash table entry
   * NULL means there is no next entry (i.e. this is the tail)
@@ -105,6 +287,130 @@ struct _HashTableEntry {
   HashTableEntry* next;
 };
 
+/**
+ * The values of a key in multimap mode, in insertion order. The key keeps a
+ * single entry, whose value points to its run, so duplicates stay out of the
+ * chains, tags and tree bins, and the values of a key are read from one
+ * contiguous array. Taking the first value only moves the start of the run,
+ * and the room it frees is reclaimed when the run fills up.
+ */
+typedef struct {
+  /** The number of values */
+  unsigned int count;
+
+  /** The number of values there is room for */
+  unsigned int room;
+
+  /** The position in values of the first value */
+  unsigned int first;
+
+  /** The values, from values[first] on */
+  void* values[];
+} ValueRun;
+
+/**
+ * Parallel arrays of keys and values, grown as entries are appended; what
+ * freezeHashTable collects before building the frozen table.
+ */
+typedef struct {
+  unsigned int* keys;
+  void** values;
+  unsigned int count;
+  unsigned int room;
+} EntryList;
+
+
+/**
+ * The work shared by the threads of a bulkBuildHashTable.
+ */
+typedef struct {
+  /** The table being built, whose arena holds an entry per key */
+  HashTable* table;
+
+  /** The input */
+  const unsigned int* keys;
+  void* const* values;
+  unsigned int num_keys;
+
+  /** The bucket of each key, from the hash function called once per key */
+  unsigned int* buckets;
+
+  /** The number of threads, which is also the number of partitions; only
+      known once every thread that could be created was */
+  unsigned int num_threads;
+
+  /** counts[t * num_threads + p] is the number of keys of thread t's share
+      of the input that go to partition p */
+  unsigned int* counts;
+
+  /** Where each partition starts in the arena */
+  unsigned int* starts;
+
+  /** Held while the threads are created, so none starts before
+      num_threads and barrier are set */
+  pthread_mutex_t start;
+
+  /** Holds the threads between the passes */
+  pthread_barrier_t barrier;
+} BulkBuild;
+
+/**
+ * One thread of a bulkBuildHashTable.
+ */
+typedef struct {
+  BulkBuild* build;
+
+  /** The thread's share of the input, and its partition */
+  unsigned int index;
+
+  pthread_t thread;
+
+  /** The number of buckets of the partition that became tree bins */
+  unsigned int bins;
+
+  /** The number of keys of the partition that replaced an earlier value */
+  unsigned int duplicates;
+} BulkWorker;
+
+/**
+ * The position of an iteration. For the chained layout it walks the bucket
+ * arrays itself; the other layouts keep their position in an EnginePosition.
+ */
+struct _HashTableIterator {
+  /** The table iterated over */
+  HashTable* table;
+
+  /** The bucket array being walked, or NULL once every entry was returned */
+  BucketArray* array;
+
+  /** The bucket being walked */
+  unsigned int bucket;
+
+  /** The tree bin of the bucket, or NULL if the bucket is a chain */
+  TreeBin* bin;
+
+  /** The position of the current entry in the bin */
+  unsigned int bin_index;
+
+  /** The link to the current entry in the chain: the bucket head or the
+      next field of the entry before it */
+  HashTableEntry** link;
+
+  /** The entry of the pair last returned, or NULL */
+  HashTableEntry* current;
+
+  /** 1 if the current entry was erased, in which case the bin position or
+      the link already designate the entry after it. For other layouts, 1
+      when there is no pair to erase */
+  int erased;
+
+  /** In multimap mode, the position in the current entry's run of the next
+      value to return */
+  unsigned int run_next;
+
+  /** For other layouts, the position in the engine's buckets */
+  EnginePosition at;
+};
 
 /****************************************************************************
 * Private Functions
@@ -131,26 +437,100 @@ static HashTableEntry* createHashTableEntry(unsigned int key, void* value) {
     // Initialize the components of the new HashTableEntry struct
     newEntry -> key = key;              // key
     newEntry -> value = value;          // value
+    newEntry -> expire_at = 0;          // never expires
+    newEntry -> timer = NULL;           // no timer either
     newEntry -> next = NULL;            // next entry = NULL
 
     return newEntry;                    // return the pointer to this hash table entry
 }
 
 /**
-* findItem
+* bucketOf
 *
-* Helper function that checks whether there exists the hash table entry that
-* contains a specific key.
+* Helper function that maps a key to its bucket in one of the bucket arrays.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+* @param key The key
+* @return The index of the key's bucket
+*/
+static unsigned int bucketOf(HashTable* hashTable, BucketArray* array, unsigned int key) {
+    if (!array->keyed) return hashTable->hash(key);
+    return (unsigned int)(sipHash13(&key, sizeof(key), array->seed) % hashTable->num_buckets);
+}
+
+/**
+* keyTag
+*
+* Helper function that computes the tag of a key for the bucket tag bytes:
+* the top 7 bits of a multiplicative hash, with the high bit set.
+*
+* @param key The key
+* @return The tag, between 0x80 and 0xFF
+*/
+static unsigned char keyTag(unsigned int key) {
+    return (unsigned char)(((key * 2654435769u) >> 25) | 0x80);
+}
+
+/**
+* hasTag
+*
+* Helper function that compares a tag with the 8 tags of a bucket at once,
+* with the SWAR zero byte test on a 64-bit word.
+*
+* @param tags The tags of the bucket
+* @param tag The tag to look for
+* @return Nonzero if one of the bucket's tags equals tag
+*/
+static unsigned long long hasTag(unsigned long long tags, unsigned char tag) {
+    unsigned long long x = tags ^ (0x0101010101010101ULL * tag);
+    return (x - 0x0101010101010101ULL) & ~x & 0x8080808080808080ULL;
+}
+
+/**
+* dropTag
+*
+* Helper function that removes one occurrence of a tag from a bucket's tags.
+* Equal tags are interchangeable, so any occurrence will do.
+*
+* @param tags The tags of the bucket
+* @param tag The tag of the entry that left the bucket
+* @return The remaining tags
+*/
+static unsigned long long dropTag(unsigned long long tags, unsigned char tag) {
+    int shift;
+    for (shift = 0; shift < 64; shift += 8) {
+        if (((tags >> shift) & 0xFF) == tag) {
+            // close the gap by moving the higher bytes down
+            unsigned long long low = tags & ((1ULL << shift) - 1);
+            unsigned long long high = shift + 8 < 64 ? (tags >> (shift + 8)) << shift : 0;
+            return low | high;
+        }
+    }
+    return tags;
+}
+
+/**
+* findInArray
+*
+* Helper function that looks for the entry of a key in one bucket array.
 *
 * @param hashTable The pointer to the hash table.
+* @param array The bucket array
 * @param key The key corresponds to the hash table entry
-* @return The pointer to the hash table entry, or NULL if key does not exist
+* @return The pointer to the hash table entry, or NULL if key is not there
 */
-static HashTableEntry* findItem(HashTable* hashTable, unsigned int key) {
+static HashTableEntry* findInArray(HashTable* hashTable, BucketArray* array, unsigned int key) {
     // retrieve key from hashTable for buckets's index
-    unsigned int index = hashTable->hash(key);
+    unsigned int index = bucketOf(hashTable, array, key);
+    // a crowded bucket is searched by bisection
+    if (array->bins && array->bins[index]) {
+        return (HashTableEntry*)treeBinFind(array->bins[index], key);
+    }
+    // a key whose tag is not in the bucket is missing, no need to walk
+    if (!hasTag(array->buckets[index].tags, keyTag(key))) return NULL;
     // initialize thisNode as the head of the bucket
-    HashTableEntry* thisNode = hashTable->buckets[index];
+    HashTableEntry* thisNode = array->buckets[index].head;
     // while thisNode is not NULL
     while (thisNode) {
         if (thisNode->key == key) return thisNode;  // if key is the same, return that entry
@@ -160,187 +540,1786 @@ static HashTableEntry* findItem(HashTable* hashTable, unsigned int key) {
     return NULL;
 }
 
-/****************************************************************************
-* Public Interface Functions
+/**
+* findItem
 *
-* These functions implement the public interface as specified in the header
-* file, and make use of the private functions and hidden definitions in the
-* above sections.
-****************************************************************************/
-// The createHashTable is provided for you as a starting point.
-HashTable* createHashTable(HashFunction hashFunction, unsigned int numBuckets) {
-  // The hash table has to contain at least one bucket. Exit gracefully if
-  // this condition is not met.
-  if (numBuckets==0) {
-    printf("Hash table has to contain at least 1 bucket...\n");
-    exit(1);
-  }
-
-  // Allocate memory for the new HashTable struct on heap.
-  HashTable* newTable = (HashTable*)malloc(sizeof(HashTable));
-
-  // Initialize the components of the new HashTable struct.
-  newTable->hash = hashFunction;
-  newTable->num_buckets = numBuckets;
-  newTable->buckets = (HashTableEntry**)malloc(numBuckets*sizeof(HashTableEntry*));
-
-  // As the new buckets contain indeterminant values, init each bucket as NULL.
-  unsigned int i;
-  for (i=0; i<numBuckets; ++i) {
-    newTable->buckets[i] = NULL;
-  }
+* Helper function that checks whether there exists the hash table entry that
+* contains a specific key.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key corresponds to the hash table entry
+* @return The pointer to the hash table entry, or NULL if key does not exist
+*/
+static HashTableEntry* findItem(HashTable* hashTable, unsigned int key) {
+    HashTableEntry* thisNode = findInArray(hashTable, &hashTable->table, key);
+    // during a rehash, the key may not have been moved yet
+    if (!thisNode && hashTable->old_table.buckets) {
+        thisNode = findInArray(hashTable, &hashTable->old_table, key);
+    }
+    return thisNode;
+}
 
-  // Return the new HashTable struct.
-  return newTable;
+/**
+* currentTime
+*
+* Helper function that reads the monotonic clock used for TTLs.
+*
+* @return The current time in milliseconds
+*/
+static unsigned long long currentTime(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000ULL + now.tv_nsec / 1000000;
 }
 
-void destroyHashTable(HashTable* hashTable) {
-    // loop through all buckets
-    for (unsigned int i = 0; i < (hashTable->num_buckets); ++i) {
-        // if bucket's head entry exist, delete all entries
-        if (hashTable->buckets[i])
-        {
-            // keep track of entries
-            // thisNode is the current entry, or the ith index in the bucket
-            HashTableEntry* thisNode = hashTable->buckets[i];
-            // nextNode is the next entry
-            HashTableEntry* nextNode = thisNode->next;
-            // while the next entry still exist, free current entry
-            while(nextNode)
-            {
-                free(thisNode->value);          // free the value in current entry
-                free(thisNode);                 // free the current entry
-                thisNode = nextNode;            // current entry become the next entry
-                nextNode = nextNode->next;      // next entry become the entry after next entry
-            }
-            // if the next entry is NULL, delete current entry
-            free(thisNode->value);
-            free(thisNode);
-        }
+/**
+* treeifyBucket
+*
+* Helper function that moves the entries of a chain that grew too long into a
+* tree bin.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+* @param bucketIndex The index of the bucket
+*/
+static void treeifyBucket(HashTable* hashTable, BucketArray* array, unsigned int bucketIndex) {
+    // the array of bins is only needed once some bucket gets crowded
+    if (!array->bins) {
+        array->bins = (TreeBin**)calloc(hashTable->num_buckets, sizeof(TreeBin*));
     }
-    // destroy hashTable
-    free(hashTable->buckets);
-    free(hashTable);
+    TreeBin* bin = createTreeBin();
+    HashTableEntry* thisNode = array->buckets[bucketIndex].head;
+    while (thisNode) {
+        HashTableEntry* nextNode = thisNode->next;
+        thisNode->next = NULL;
+        treeBinInsert(bin, thisNode->key, thisNode);
+        thisNode = nextNode;
+    }
+    array->buckets[bucketIndex].head = NULL;
+    array->buckets[bucketIndex].tags = 0;
+    array->bins[bucketIndex] = bin;
 }
 
-void* insertItem(HashTable* hashTable, unsigned int key, void* value) {
-    // retrieve key from hashTable for buckets's index
-    unsigned int bucketIndex = hashTable->hash(key);
-    // initialize currentNode from findItem function using the key
-    HashTableEntry* currentNode = findItem(hashTable, key);
-    // if current entry exist
-    if (currentNode)
-    {
-        // declare a previous value in the entry
-        // retrieve the previous value from the entry
-        void* previousValue = currentNode->value;;
-        // replace the value in current entry with value from parameter
-        currentNode->value = value;
-        // return the previous value
-        return previousValue;
+/**
+* untreeifyBucket
+*
+* Helper function that turns a tree bin that shrank back into a chain.
+*
+* @param array The bucket array
+* @param bucketIndex The index of the bucket
+*/
+static void untreeifyBucket(BucketArray* array, unsigned int bucketIndex) {
+    TreeBin* bin = array->bins[bucketIndex];
+    unsigned int i;
+    for (i = 0; i < treeBinSize(bin); ++i) {
+        HashTableEntry* thisNode = (HashTableEntry*)treeBinItem(bin, i);
+        thisNode->next = array->buckets[bucketIndex].head;
+        array->buckets[bucketIndex].head = thisNode;
+        array->buckets[bucketIndex].tags = (array->buckets[bucketIndex].tags << 8) |
+                                           keyTag(thisNode->key);
     }
-    // if the current entry does not exist, create a new entry
-    // with specified key and value from parameter
-    HashTableEntry* thisNode = createHashTableEntry(key, value);
-    // if create entry failed, return NULL
-    if (!thisNode) return NULL;
-    // the next entry points to the head to make the list loop
-    thisNode->next = hashTable->buckets[bucketIndex];
-    // head points to current entry
-    hashTable->buckets[bucketIndex] = thisNode;
-    // return NULL since we created this new entry
-    return NULL;
+    destroyTreeBin(bin);
+    array->bins[bucketIndex] = NULL;
 }
 
-void* getItem(HashTable* hashTable, unsigned int key) {
-    // initialize currentNode from findItem function using the key
-    HashTableEntry* currentNode = findItem(hashTable, key);
-    // if current entry exist
-    if (currentNode)
-    {
-        // return the value in current entry
-        return currentNode->value;
+/**
+* linkEntry
+*
+* Helper function that adds an entry for a key that is not in the table yet
+* to its bucket: at the head of the chain, or into the bucket's tree bin. A
+* chain that becomes longer than TREEIFY_THRESHOLD is treeified.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+* @param newEntry The entry to add
+* @return The length of the bucket, which is only counted up to
+*         TREEIFY_THRESHOLD + 1 for chains
+*/
+static unsigned int linkEntry(HashTable* hashTable, BucketArray* array,
+                              HashTableEntry* newEntry) {
+    unsigned int bucketIndex = bucketOf(hashTable, array, newEntry->key);
+    if (array->bins && array->bins[bucketIndex]) {
+        treeBinInsert(array->bins[bucketIndex], newEntry->key, newEntry);
+        return treeBinSize(array->bins[bucketIndex]);
     }
-    // otherwise return NULL
-    return NULL;
-}
+    newEntry->next = array->buckets[bucketIndex].head;
+    array->buckets[bucketIndex].head = newEntry;
+    // a ninth entry pushes a tag out, but the chain is then treeified
+    array->buckets[bucketIndex].tags = (array->buckets[bucketIndex].tags << 8) |
+                                       keyTag(newEntry->key);
 
-void* removeItem(HashTable* hashTable, unsigned int key) {
-    // retrieve key from hashTable for buckets's index
-    unsigned int bucketIndex = hashTable->hash(key);
-    // initialize thisNode as the head of the bucket
-    HashTableEntry* thisNode = hashTable->buckets[bucketIndex];
-    // if the head exist AND the head has the key we looking for
-    if (thisNode && thisNode->key == key)
-    {
-        // retrieve the value from the head and store it
-        void* removedEntryValue = thisNode->value;
-        // change the head points to the next entry
-        hashTable->buckets[bucketIndex] = thisNode->next;
-        // free the head
-        free(thisNode);
-        // return the value was in the head
-        return removedEntryValue;
-    }
-    // while the head AND next entry exist
-    while (thisNode && thisNode->next)
-    {
-        // if the next entry has the key
-        if (thisNode->next->key == key)
-        {
-            // store next entry pointer in tmp pointer
-            HashTableEntry* tmp = thisNode->next;
-            // retrieve the value from tmp and store it
-            void* removedEntryValue = tmp->value;
-            // the next entry points to the entry after next entry
-            thisNode->next = thisNode->next->next;
-            // free the tmp pointer
-            free(tmp);
-            // return the value was in the next entry
-            return removedEntryValue;
-        }
-        // if key is not in next entry, go to next entry
+    // only the first few entries need counting to know the chain is too long
+    unsigned int length = 0;
+    HashTableEntry* thisNode = newEntry;
+    while (thisNode && length <= TREEIFY_THRESHOLD) {
+        ++length;
         thisNode = thisNode->next;
     }
-    // return NULL if the key is not present in the table
-    return NULL;
+    if (length > TREEIFY_THRESHOLD) treeifyBucket(hashTable, array, bucketIndex);
+    return length;
 }
 
-void deleteItem(HashTable* hashTable, unsigned int key) {
+/**
+* unlinkFromArray
+*
+* Helper function that takes the entry of a key out of its bucket in one
+* bucket array, without freeing anything. A tree bin that shrinks below
+* UNTREEIFY_THRESHOLD turns back into a chain.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+* @param key The key that corresponds to the item.
+* @return The unlinked entry, or NULL if the key is not there
+*/
+static HashTableEntry* unlinkFromArray(HashTable* hashTable, BucketArray* array,
+                                       unsigned int key) {
     // retrieve key from hashTable for buckets's index
-    unsigned int bucketIndex = hashTable->hash(key);
+    unsigned int bucketIndex = bucketOf(hashTable, array, key);
+    // a crowded bucket removes from its bin
+    if (array->bins && array->bins[bucketIndex]) {
+        TreeBin* bin = array->bins[bucketIndex];
+        HashTableEntry* removed = (HashTableEntry*)treeBinRemove(bin, key);
+        if (treeBinSize(bin) < UNTREEIFY_THRESHOLD) untreeifyBucket(array, bucketIndex);
+        return removed;
+    }
+    // a key whose tag is not in the bucket is missing
+    Bucket* bucket = &array->buckets[bucketIndex];
+    unsigned char tag = keyTag(key);
+    if (!hasTag(bucket->tags, tag)) return NULL;
     // initialize thisNode as the head of the bucket
-    HashTableEntry* thisNode = hashTable->buckets[bucketIndex];
-    // if the head does not exist, return
-    if (findItem(hashTable, key) == NULL) return;
+    HashTableEntry* thisNode = bucket->head;
     // if the head exist and the key is in the head
     if (thisNode && thisNode->key == key)
     {
         // redirect the head points to the next entry
-        hashTable->buckets[bucketIndex] = thisNode->next;
-        // delete the value in the head
-         free(thisNode->value);
-        // delete the current entry
-        free(thisNode);
-        return;
+        bucket->head = thisNode->next;
+        bucket->tags = dropTag(bucket->tags, tag);
+        return thisNode;
     }
     // while the head and next entry exist
     while (thisNode && thisNode->next)
     {
         // if the next entry has the key
-        if(thisNode->next->key == key)
+        if (thisNode->next->key == key)
         {
-            // initialize a tmp pointer points to the next entry
+            // the next entry points to the entry after next entry
             HashTableEntry* tmp = thisNode->next;
-            // redirect the next entry points to the entry after next entry
-            thisNode->next = thisNode->next->next;
-            // delete the value in next entry
-             free(tmp->value);
-            // free the tmp pointer
-            free(tmp);
-            return;
+            thisNode->next = tmp->next;
+            bucket->tags = dropTag(bucket->tags, tag);
+            return tmp;
         }
         // if key is not in next entry, go to next entry
         thisNode = thisNode->next;
     }
-}
\ No newline at end of file
+    // the key is not present
+    return NULL;
+}
+
+/**
+* unlinkEntry
+*
+* Helper function that takes the entry of a key out of the table, without
+* freeing anything.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key that corresponds to the item.
+* @return The unlinked entry, or NULL if the key is not present
+*/
+static HashTableEntry* unlinkEntry(HashTable* hashTable, unsigned int key) {
+    HashTableEntry* thisNode = unlinkFromArray(hashTable, &hashTable->table, key);
+    // during a rehash, the key may not have been moved yet
+    if (!thisNode && hashTable->old_table.buckets) {
+        thisNode = unlinkFromArray(hashTable, &hashTable->old_table, key);
+    }
+    return thisNode;
+}
+
+/**
+* initBucketArray
+*
+* Helper function that allocates empty buckets. A keyed array gets a fresh
+* random seed from the kernel.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array to initialize
+* @param keyed 1 to place keys with SipHash, 0 to use the user's function
+*/
+static void initBucketArray(HashTable* hashTable, BucketArray* array, int keyed) {
+    array->buckets = (Bucket*)calloc(hashTable->num_buckets, sizeof(Bucket));
+    array->bins = NULL;
+    array->keyed = keyed;
+    array->seed[0] = array->seed[1] = 0;
+    if (keyed && getrandom(array->seed, sizeof(array->seed), 0) != sizeof(array->seed)) {
+        // no entropy source: the clock and the address space layout are
+        // still unknown to a remote attacker
+        array->seed[0] = currentTime() ^ (unsigned long long)(size_t)array;
+        array->seed[1] = (unsigned long long)(size_t)&array ^ 0x9E3779B97F4A7C15ULL;
+    }
+}
+
+/**
+* runValues
+*
+* Helper function that locates the values of a key in multimap mode.
+*
+* @param thisNode The entry of the key
+* @return The first of the key's values, which follow one another
+*/
+static void** runValues(HashTableEntry* thisNode) {
+    ValueRun* run = (ValueRun*)thisNode->value;
+    return run->values + run->first;
+}
+
+/**
+* freeEntryValue
+*
+* Helper function that frees what an entry's value field holds: the value,
+* or in multimap mode the run of values and every value in it.
+*
+* @param hashTable The pointer to the hash table.
+* @param thisNode The entry
+*/
+static void freeEntryValue(HashTable* hashTable, HashTableEntry* thisNode) {
+    if (!hashTable->multimap) {
+        free(thisNode->value);
+        return;
+    }
+    ValueRun* run = (ValueRun*)thisNode->value;
+    for (unsigned int i = 0; i < run->count; ++i) free(runValues(thisNode)[i]);
+    hashTable->run_bytes -= sizeof(ValueRun) + run->room * sizeof(void*);
+    free(run);
+}
+
+/**
+* freeEntry
+*
+* Helper function that frees an entry, unless it belongs to the arena of a
+* bulk built table, which is only freed as a whole.
+*
+* @param hashTable The pointer to the hash table.
+* @param thisNode The entry
+*/
+static void freeEntry(HashTable* hashTable, HashTableEntry* thisNode) {
+    HashTableEntry* arena = hashTable->arena;
+    if (arena && thisNode >= arena && thisNode < arena + hashTable->arena_size) {
+        hashTable->arena_live--;
+        return;
+    }
+    free(thisNode);
+}
+
+/**
+* freeArena
+*
+* Helper function that frees the arena of a bulk built table, once no entry
+* is left in it.
+*
+* @param hashTable The pointer to the hash table.
+*/
+static void freeArena(HashTable* hashTable) {
+    free(hashTable->arena);
+    hashTable->arena = NULL;
+    hashTable->arena_size = 0;
+    hashTable->arena_live = 0;
+}
+
+/**
+* freeBucketArray
+*
+* Helper function that frees the buckets of an array, along with every entry
+* and value still in them.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+*/
+static void freeBucketArray(HashTable* hashTable, BucketArray* array) {
+    // loop through all buckets
+    for (unsigned int i = 0; i < (hashTable->num_buckets); ++i) {
+        // thisNode is the current entry, starting from the head of the chain
+        HashTableEntry* thisNode = array->buckets[i].head;
+        // free every entry and its value
+        while (thisNode)
+        {
+            HashTableEntry* nextNode = thisNode->next;
+            freeEntryValue(hashTable, thisNode);  // free the value in current entry
+            freeEntry(hashTable, thisNode); // free the current entry
+            thisNode = nextNode;            // current entry become the next entry
+        }
+    }
+    // free the entries of the tree bins, if any
+    if (array->bins) {
+        for (unsigned int i = 0; i < hashTable->num_buckets; ++i) {
+            TreeBin* bin = array->bins[i];
+            if (!bin) continue;
+            for (unsigned int j = 0; j < treeBinSize(bin); ++j) {
+                HashTableEntry* thisNode = (HashTableEntry*)treeBinItem(bin, j);
+                freeEntryValue(hashTable, thisNode);
+                freeEntry(hashTable, thisNode);
+            }
+            destroyTreeBin(bin);
+        }
+        free(array->bins);
+    }
+    free(array->buckets);
+    array->buckets = NULL;
+    array->bins = NULL;
+}
+
+/**
+* bucketArrayMemoryUsage
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+* @return The bytes allocated for the buckets and bins, entries excluded
+*/
+static unsigned long long bucketArrayMemoryUsage(HashTable* hashTable, BucketArray* array) {
+    unsigned long long bytes = (unsigned long long)hashTable->num_buckets * sizeof(Bucket);
+    if (array->bins) {
+        bytes += (unsigned long long)hashTable->num_buckets * sizeof(TreeBin*);
+        unsigned int i;
+        for (i = 0; i < hashTable->num_buckets; ++i) {
+            if (array->bins[i]) bytes += treeBinMemoryUsage(array->bins[i]);
+        }
+    }
+    return bytes;
+}
+
+/**
+* rehashStep
+*
+* Helper function that moves some entries of the old buckets into the new
+* ones, bucket by bucket. Crowded buckets are moved a few entries at a time,
+* so no single operation pays for a whole flooded bucket. The old buckets
+* are freed once the last one is empty.
+*
+* @param hashTable The pointer to the hash table.
+*/
+static void rehashStep(HashTable* hashTable) {
+    BucketArray* oldArray = &hashTable->old_table;
+    unsigned int work = 0;
+    while (hashTable->rehash_index < hashTable->num_buckets && work < 10 * REHASH_WORK_PER_STEP) {
+        unsigned int index = hashTable->rehash_index;
+        TreeBin* bin = oldArray->bins ? oldArray->bins[index] : NULL;
+        if (bin) {
+            // take entries from the end of the bin, where removal is cheap
+            while (treeBinSize(bin) && work < 10 * REHASH_WORK_PER_STEP) {
+                HashTableEntry* thisNode = (HashTableEntry*)treeBinItem(bin, treeBinSize(bin) - 1);
+                treeBinRemove(bin, thisNode->key);
+                linkEntry(hashTable, &hashTable->table, thisNode);
+                work += 10;
+            }
+            if (treeBinSize(bin)) return;
+            destroyTreeBin(bin);
+            oldArray->bins[index] = NULL;
+        }
+        // move the chain
+        HashTableEntry* thisNode = oldArray->buckets[index].head;
+        while (thisNode) {
+            HashTableEntry* nextNode = thisNode->next;
+            linkEntry(hashTable, &hashTable->table, thisNode);
+            work += 10;
+            thisNode = nextNode;
+        }
+        oldArray->buckets[index].head = NULL;
+        oldArray->buckets[index].tags = 0;
+        hashTable->rehash_index++;
+        ++work;
+    }
+    if (hashTable->rehash_index == hashTable->num_buckets) {
+        // every entry has been moved
+        freeBucketArray(hashTable, oldArray);
+    }
+}
+
+/**
+* reseedHashTable
+*
+* Helper function called when an insert finds a bucket far longer than the
+* load factor explains. From now on keys are placed with SipHash and a fresh
+* secret seed, which an attacker cannot aim at. The entries are moved to the
+* new buckets gradually by the following operations.
+*
+* @param hashTable The pointer to the hash table.
+*/
+static void reseedHashTable(HashTable* hashTable) {
+    hashTable->old_table = hashTable->table;
+    initBucketArray(hashTable, &hashTable->table, 1);
+    hashTable->rehash_index = 0;
+    hashTable->num_reseeds++;
+    rehashStep(hashTable);
+}
+
+/**
+* dropTimer
+*
+* Helper function that cancels the timer of an entry that leaves the table
+* or loses its TTL, so the wheel does not keep it until its deadline.
+*
+* @param hashTable The pointer to the hash table.
+* @param thisNode The entry
+*/
+static void dropTimer(HashTable* hashTable, HashTableEntry* thisNode) {
+    if (!thisNode->timer) return;
+    cancelTimer(hashTable->wheel, thisNode->timer);
+    thisNode->timer = NULL;
+}
+
+/**
+* deleteKey
+*
+* Helper function behind deleteItem, also used to reclaim expired entries and
+* evict entries from a full cache. It frees both the entry and its value.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key that corresponds to the item.
+*/
+static void deleteKey(HashTable* hashTable, unsigned int key) {
+    HashTableEntry* thisNode = unlinkEntry(hashTable, key);
+    // if the key does not exist, return
+    if (!thisNode) return;
+    dropTimer(hashTable, thisNode);
+    // delete the value (every value of the key in multimap mode), then the entry
+    freeEntryValue(hashTable, thisNode);
+    freeEntry(hashTable, thisNode);
+    hashTable->num_entries--;
+}
+
+/**
+* findLiveItem
+*
+* Helper function like findItem, except that an entry whose TTL has passed is
+* treated as missing. Such an entry is reclaimed on the spot: its value is
+* freed and the entry is unlinked from the bucket.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key corresponds to the hash table entry
+* @return The pointer to the hash table entry, or NULL if key does not exist
+*/
+static HashTableEntry* findLiveItem(HashTable* hashTable, unsigned int key) {
+    HashTableEntry* thisNode = findItem(hashTable, key);
+    // entries without a TTL never need the clock
+    if (thisNode && thisNode->expire_at && thisNode->expire_at <= currentTime()) {
+        deleteKey(hashTable, key);
+        return NULL;
+    }
+    return thisNode;
+}
+
+/**
+* sampleArray
+*
+* Helper function that samples entries of one bucket array for sampleVictim,
+* starting from bucket start, until EVICTION_SAMPLES entries have been seen.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+* @param start The first bucket to look at
+* @param victim The best victim so far, updated in place
+* @param victimFrequency The estimated frequency of the victim
+* @param sampled The number of entries sampled so far
+*/
+static void sampleArray(HashTable* hashTable, BucketArray* array, unsigned int start,
+                        HashTableEntry** victim, unsigned int* victimFrequency,
+                        unsigned int* sampled) {
+    unsigned int i;
+    for (i = 0; i < hashTable->num_buckets && *sampled < EVICTION_SAMPLES; ++i) {
+        unsigned int bucketIndex = (start + i) % hashTable->num_buckets;
+        TreeBin* bin = array->bins ? array->bins[bucketIndex] : NULL;
+        HashTableEntry* thisNode = bin ? (treeBinSize(bin) ?
+                                          (HashTableEntry*)treeBinItem(bin, 0) : NULL)
+                                       : array->buckets[bucketIndex].head;
+        unsigned int position = 0;
+        while (thisNode && *sampled < EVICTION_SAMPLES) {
+            unsigned int frequency = hashTable->sketch ?
+                estimateFrequency(hashTable->sketch, thisNode->key) : 0;
+            if (!*victim || frequency <= *victimFrequency) {
+                *victim = thisNode;
+                *victimFrequency = frequency;
+            }
+            ++*sampled;
+            // the entries of a bin are in key order rather than chained
+            if (bin) {
+                ++position;
+                thisNode = position < treeBinSize(bin) ?
+                    (HashTableEntry*)treeBinItem(bin, position) : NULL;
+            } else {
+                thisNode = thisNode->next;
+            }
+        }
+    }
+}
+
+/**
+* sampleVictim
+*
+* Helper function that picks the entry to evict in cache mode. A few entries
+* are sampled starting from a random bucket, and the one with the lowest
+* estimated access frequency wins. Ties go to the entry furthest down its
+* chain, which is the oldest one.
+*
+* @param hashTable The pointer to the hash table.
+* @return The pointer to the victim entry, or NULL if the table is empty
+*/
+static HashTableEntry* sampleVictim(HashTable* hashTable) {
+    // xorshift32 is plenty for picking a starting bucket
+    unsigned int x = hashTable->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    hashTable->random_state = x;
+
+    HashTableEntry* victim = NULL;
+    unsigned int victimFrequency = 0;
+    unsigned int sampled = 0;
+    unsigned int start = x % hashTable->num_buckets;
+    sampleArray(hashTable, &hashTable->table, start, &victim, &victimFrequency, &sampled);
+    // entries not moved by the rehash yet are candidates too
+    if (hashTable->old_table.buckets) {
+        sampleArray(hashTable, &hashTable->old_table, start, &victim, &victimFrequency, &sampled);
+    }
+    return victim;
+}
+
+/**
+* admitItem
+*
+* Helper function that makes room for a new key in a full cache. With an
+* admission filter, the key is only let in if it has been seen more often
+* than the victim it would replace (TinyLFU); otherwise the victim is always
+* evicted.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key about to be inserted
+* @return 1 if the key may be inserted, 0 if it was rejected
+*/
+static int admitItem(HashTable* hashTable, unsigned int key) {
+    HashTableEntry* victim = sampleVictim(hashTable);
+    if (!victim) return 1;
+    if (hashTable->sketch &&
+        estimateFrequency(hashTable->sketch, key) <=
+        estimateFrequency(hashTable->sketch, victim->key)) {
+        return 0;
+    }
+    // evicting frees the victim's value, like deleteItem
+    deleteKey(hashTable, victim->key);
+    return 1;
+}
+
+/**
+* upsertItem
+*
+* Helper function behind insertItem and insertItemWithTTL. It overwrites the
+* value of a live entry, or creates a new entry at the head of the bucket.
+* Either way, the entry ends up without a TTL.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key that corresponds to the value.
+* @param value The value to be stored in the hash table.
+* @param previousValue Set to the overwritten value, or NULL
+* @return The pointer to the hash table entry holding the value
+*/
+static HashTableEntry* upsertItem(HashTable* hashTable, unsigned int key,
+                                  void* value, void** previousValue) {
+    *previousValue = NULL;
+    if (hashTable->sketch) recordFrequency(hashTable->sketch, key);
+    // if a live entry exists, replace its value
+    HashTableEntry* currentNode = findLiveItem(hashTable, key);
+    if (currentNode)
+    {
+        *previousValue = currentNode->value;
+        currentNode->value = value;
+        currentNode->expire_at = 0;
+        dropTimer(hashTable, currentNode);
+        return currentNode;
+    }
+    // a full cache has to evict something first, or turn the new key away,
+    // in which case the table still owns (and frees) the value
+    if (hashTable->capacity && hashTable->num_entries >= hashTable->capacity &&
+        !admitItem(hashTable, key)) {
+        free(value);
+        return NULL;
+    }
+    // otherwise create a new entry and add it to the bucket
+    HashTableEntry* thisNode = createHashTableEntry(key, value);
+    if (!thisNode) return NULL;
+    unsigned int length = linkEntry(hashTable, &hashTable->table, thisNode);
+    hashTable->num_entries++;
+    // a bucket far longer than the average means the hash function is
+    // being attacked (or is terrible): switch to a keyed one
+    if (length >= FLOOD_MIN_LENGTH && !hashTable->old_table.buckets &&
+        length > FLOOD_RATIO * (hashTable->num_entries / hashTable->num_buckets + 1)) {
+        reseedHashTable(hashTable);
+    }
+    return thisNode;
+}
+
+/**
+* setExpiry
+*
+* Helper function that gives an entry a TTL and schedules its timer.
+*
+* @param hashTable The pointer to the hash table.
+* @param thisNode The entry that expires
+* @param ttlMs The time to live of the entry in milliseconds.
+*/
+static void setExpiry(HashTable* hashTable, HashTableEntry* thisNode, unsigned int ttlMs) {
+    // the wheel is only created once somebody uses TTLs
+    unsigned long long now = currentTime();
+    if (!hashTable->wheel) hashTable->wheel = createTimingWheel(now);
+    // 0 is reserved for "never expires"
+    thisNode->expire_at = now + ttlMs;
+    if (thisNode->expire_at == 0) thisNode->expire_at = 1;
+    dropTimer(hashTable, thisNode);
+    thisNode->timer = addTimer(hashTable->wheel, thisNode->key, thisNode->expire_at);
+}
+
+/**
+* expireTimer
+*
+* Timing wheel callback. Timers are cancelled when their key is overwritten,
+* removed or given a new TTL, so the entry is the one the timer was created
+* for; its deadline is still checked to be safe.
+*
+* @param context The pointer to the hash table.
+* @param key The key of the timer
+* @param deadline The deadline of the timer
+* @return 1 if an entry was expired, 0 otherwise
+*/
+static int expireTimer(void* context, unsigned int key, unsigned long long deadline) {
+    HashTable* hashTable = (HashTable*)context;
+    HashTableEntry* thisNode = findItem(hashTable, key);
+    if (thisNode && thisNode->expire_at == deadline) {
+        // the timer is firing, and already out of the wheel
+        thisNode->timer = NULL;
+        deleteKey(hashTable, key);
+        return 1;
+    }
+    return 0;
+}
+
+/**
+* lookupKey
+*
+* Helper function behind getItem.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key that corresponds to the item.
+* @return the value corresponding to the key, or NULL if the key is not present
+*/
+static void* lookupKey(HashTable* hashTable, unsigned int key) {
+    // every lookup counts as an access for the admission filter
+    if (hashTable->sketch) recordFrequency(hashTable->sketch, key);
+    // initialize currentNode from findLiveItem function using the key,
+    // so that an expired entry is reclaimed and reported as missing
+    HashTableEntry* currentNode = findLiveItem(hashTable, key);
+    // if current entry exist
+    if (currentNode)
+    {
+        // return the value in current entry, or the first value of the key
+        if (hashTable->multimap) return runValues(currentNode)[0];
+        return currentNode->value;
+    }
+    // otherwise return NULL
+    return NULL;
+}
+
+/**
+* appendValue
+*
+* Helper function behind insertItem in multimap mode. It adds a value at the
+* end of the run of its key, creating the entry and the run for a new key.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key that corresponds to the value.
+* @param value The value to be stored in the hash table.
+*/
+static void appendValue(HashTable* hashTable, unsigned int key, void* value) {
+    HashTableEntry* thisNode = findItem(hashTable, key);
+    ValueRun* run = thisNode ? (ValueRun*)thisNode->value : NULL;
+    if (run && run->first + run->count == run->room && run->first >= run->count) {
+        // at least half of the room was freed by takeFirstValue: reuse it
+        memmove(run->values, run->values + run->first, run->count * sizeof(void*));
+        run->first = 0;
+    }
+    if (!run || run->first + run->count == run->room) {
+        unsigned int room = run ? 2 * run->room : RUN_INITIAL_ROOM;
+        unsigned long long oldBytes = run ? sizeof(ValueRun) + run->room * sizeof(void*) : 0;
+        run = (ValueRun*)realloc(run, sizeof(ValueRun) + room * sizeof(void*));
+        hashTable->run_bytes += sizeof(ValueRun) + room * sizeof(void*) - oldBytes;
+        run->room = room;
+        if (thisNode) {
+            thisNode->value = run;
+        } else {
+            // a new key gets its entry like any other
+            void* previousValue;
+            run->count = 0;
+            run->first = 0;
+            upsertItem(hashTable, key, run, &previousValue);
+        }
+    }
+    run->values[run->first + run->count++] = value;
+}
+
+/**
+* takeFirstValue
+*
+* Helper function behind removeItem and deleteItem in multimap mode. It takes
+* the first value out of the run of its key, and frees the entry and the run
+* along with the last value.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key that corresponds to the item.
+* @return the first value of the key, or NULL if the key is not present
+*/
+static void* takeFirstValue(HashTable* hashTable, unsigned int key) {
+    HashTableEntry* thisNode = findItem(hashTable, key);
+    if (!thisNode) return NULL;
+    ValueRun* run = (ValueRun*)thisNode->value;
+    void* value = run->values[run->first];
+    if (--run->count) {
+        run->first++;
+        return value;
+    }
+    // the last value: the key goes away
+    freeEntry(hashTable, unlinkEntry(hashTable, key));
+    hashTable->run_bytes -= sizeof(ValueRun) + run->room * sizeof(void*);
+    free(run);
+    hashTable->num_entries--;
+    return value;
+}
+
+/**
+* removeKey
+*
+* Helper function behind removeItem. It frees the entry but not its value.
+*
+* @param hashTable The pointer to the hash table.
+* @param key The key that corresponds to the item.
+* @return the value corresponding to the key, or NULL if the key is not present
+*/
+static void* removeKey(HashTable* hashTable, unsigned int key) {
+    // a key with several values only loses its first one
+    if (hashTable->multimap) return takeFirstValue(hashTable, key);
+    // an expired entry is reclaimed and reported as missing
+    if (findLiveItem(hashTable, key) == NULL) return NULL;
+    // take the entry out of its bucket
+    HashTableEntry* thisNode = unlinkEntry(hashTable, key);
+    dropTimer(hashTable, thisNode);
+    // retrieve the value from the entry and store it
+    void* removedEntryValue = thisNode->value;
+    // free the entry
+    freeEntry(hashTable, thisNode);
+    hashTable->num_entries--;
+    // return the value was in the entry
+    return removedEntryValue;
+}
+
+/**
+* appendEntry
+*
+* EntryVisitor that appends an entry to an EntryList.
+*
+* @param context The EntryList
+* @param key The key of the entry
+* @param value The value of the entry
+*/
+static void appendEntry(void* context, unsigned int key, void* value) {
+    EntryList* list = (EntryList*)context;
+    if (list->count == list->room) {
+        list->room = list->room ? 2 * list->room : 64;
+        list->keys = (unsigned int*)realloc(list->keys, list->room * sizeof(unsigned int));
+        list->values = (void**)realloc(list->values, list->room * sizeof(void*));
+    }
+    list->keys[list->count] = key;
+    list->values[list->count++] = value;
+}
+
+/**
+* takeArrayEntries
+*
+* Helper function that appends the live entries of a bucket array, chains
+* and bins, to a list, and clears their value so that freeBucketArray leaves
+* it alone. Expired entries keep theirs, to be freed with them.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+* @param list The list of entries
+*/
+static void takeArrayEntries(HashTable* hashTable, BucketArray* array, EntryList* list) {
+    unsigned long long now = currentTime();
+    for (unsigned int i = 0; i < hashTable->num_buckets; ++i) {
+        TreeBin* bin = array->bins ? array->bins[i] : NULL;
+        HashTableEntry* thisNode = array->buckets[i].head;
+        unsigned int j = 0;
+        // the entries of a bin are in the bin, those of a chain are chained
+        if (bin) thisNode = treeBinSize(bin) ? (HashTableEntry*)treeBinItem(bin, 0) : NULL;
+        while (thisNode) {
+            if (!thisNode->expire_at || thisNode->expire_at > now) {
+                appendEntry(list, thisNode->key, thisNode->value);
+                thisNode->value = NULL;
+            }
+            if (bin) thisNode = ++j < treeBinSize(bin) ? (HashTableEntry*)treeBinItem(bin, j) : NULL;
+            else thisNode = thisNode->next;
+        }
+    }
+}
+
+/**
+* requireChained
+*
+* Helper function that exits if a feature only the chained layout has is used
+* on a table with another layout.
+*
+* @param hashTable The pointer to the hash table.
+* @param feature The name of the public function that was called
+*/
+static void requireChained(HashTable* hashTable, const char* feature) {
+    if (hashTable->engine) {
+        printf("%s is only supported by the chained layout...\n", feature);
+        exit(1);
+    }
+}
+
+/**
+* enterBucket
+*
+* Helper function that points an iterator at the start of its bucket, and
+* prefetches the chain head of a bucket a few places ahead, so that its
+* first entry is in cache by the time the iterator gets there.
+*
+* @param iterator The iterator
+*/
+static void enterBucket(HashTableIterator* iterator) {
+    BucketArray* array = iterator->array;
+    unsigned int ahead = iterator->bucket + PREFETCH_BUCKETS;
+    if (ahead < iterator->table->num_buckets && array->buckets[ahead].head) {
+        __builtin_prefetch(array->buckets[ahead].head);
+    }
+    iterator->bin = array->bins ? array->bins[iterator->bucket] : NULL;
+    iterator->bin_index = 0;
+    iterator->link = &array->buckets[iterator->bucket].head;
+}
+
+/**
+* settleBin
+*
+* Helper function that turns the bin an iterator is leaving back into a
+* chain if erasing through the iterator left it small or empty, which
+* eraseCurrent cannot do while the bin is being walked.
+*
+* @param iterator The iterator
+*/
+static void settleBin(HashTableIterator* iterator) {
+    if (iterator->bin && treeBinSize(iterator->bin) < UNTREEIFY_THRESHOLD) {
+        untreeifyBucket(iterator->array, iterator->bucket);
+    }
+    iterator->bin = NULL;
+}
+
+/**
+* initIterator
+*
+* Helper function that points an iterator at the first bucket of a chained
+* table.
+*
+* @param iterator The iterator
+* @param hashTable The pointer to the hash table.
+*/
+static void initIterator(HashTableIterator* iterator, HashTable* hashTable) {
+    iterator->table = hashTable;
+    iterator->array = &hashTable->table;
+    iterator->bucket = 0;
+    iterator->current = NULL;
+    iterator->erased = 0;
+    iterator->run_next = 0;
+    enterBucket(iterator);
+}
+
+/**
+* advanceEntry
+*
+* Helper function that moves an iterator of a chained table to the entry
+* after the current one: further down the chain or bin, in the following
+* buckets, and then in the old buckets of a rehash in progress. The entry
+* after it in a chain is prefetched.
+*
+* @param iterator The iterator
+* @return The new current entry, or NULL if there is none left
+*/
+static HashTableEntry* advanceEntry(HashTableIterator* iterator) {
+    HashTable* hashTable = iterator->table;
+    if (iterator->current && !iterator->erased) {
+        if (iterator->bin) iterator->bin_index++;
+        else iterator->link = &iterator->current->next;
+    }
+    iterator->erased = 0;
+    while (iterator->array) {
+        TreeBin* bin = iterator->bin;
+        if (bin ? iterator->bin_index < treeBinSize(bin) : *iterator->link != NULL) {
+            iterator->current = bin ? (HashTableEntry*)treeBinItem(bin, iterator->bin_index)
+                                    : *iterator->link;
+            if (!bin && iterator->current->next) __builtin_prefetch(iterator->current->next);
+            return iterator->current;
+        }
+        settleBin(iterator);
+        if (++iterator->bucket == hashTable->num_buckets) {
+            // the entries not rehashed yet come last
+            iterator->bucket = 0;
+            int inNew = iterator->array == &hashTable->table;
+            iterator->array = inNew && hashTable->old_table.buckets ? &hashTable->old_table : NULL;
+        }
+        if (iterator->array) enterBucket(iterator);
+    }
+    iterator->current = NULL;
+    return NULL;
+}
+
+/**
+* nextPair
+*
+* Helper function behind htIterNext for the chained layout: the next value
+* of a multimap key, or else the first value of the next live entry.
+*
+* @param iterator The iterator
+* @param key Set to the key of the pair
+* @param value Set to the value of the pair
+* @return 1 if a pair was returned, 0 at the end
+*/
+static int nextPair(HashTableIterator* iterator, unsigned int* key, void** value) {
+    HashTable* hashTable = iterator->table;
+    HashTableEntry* thisNode = iterator->erased ? NULL : iterator->current;
+    if (thisNode && hashTable->multimap &&
+        iterator->run_next < ((ValueRun*)thisNode->value)->count) {
+        *key = thisNode->key;
+        *value = runValues(thisNode)[iterator->run_next++];
+        return 1;
+    }
+    // expired entries are skipped, and left for the wheel or a lookup
+    unsigned long long now = 0;
+    while ((thisNode = advanceEntry(iterator)) && thisNode->expire_at) {
+        if (!now) now = currentTime();
+        if (thisNode->expire_at > now) break;
+    }
+    if (!thisNode) return 0;
+    *key = thisNode->key;
+    if (hashTable->multimap) {
+        *value = runValues(thisNode)[0];
+        iterator->run_next = 1;
+    } else {
+        *value = thisNode->value;
+    }
+    return 1;
+}
+
+/**
+* eraseCurrent
+*
+* Helper function behind htIterErase for the chained layout. The entry is
+* unlinked through the iterator's link, or removed from the bin it is being
+* read from, so the key is not looked up again. A bin that becomes small is
+* left a bin while the iterator walks it, and settled when the iterator
+* leaves the bucket or ends.
+*
+* @param iterator The iterator
+*/
+static void eraseCurrent(HashTableIterator* iterator) {
+    HashTable* hashTable = iterator->table;
+    HashTableEntry* thisNode = iterator->current;
+    if (hashTable->multimap && ((ValueRun*)thisNode->value)->count > 1) {
+        // only the value last returned goes
+        ValueRun* run = (ValueRun*)thisNode->value;
+        void** values = runValues(thisNode);
+        unsigned int index = --iterator->run_next;
+        free(values[index]);
+        run->count--;
+        memmove(values + index, values + index + 1, (run->count - index) * sizeof(void*));
+        return;
+    }
+    if (iterator->bin) {
+        treeBinRemove(iterator->bin, thisNode->key);
+    } else {
+        Bucket* bucket = &iterator->array->buckets[iterator->bucket];
+        *iterator->link = thisNode->next;
+        bucket->tags = dropTag(bucket->tags, keyTag(thisNode->key));
+    }
+    dropTimer(hashTable, thisNode);
+    freeEntryValue(hashTable, thisNode);
+    freeEntry(hashTable, thisNode);
+    hashTable->num_entries--;
+    iterator->erased = 1;
+}
+
+/**
+* scanEntry
+*
+* Helper function behind scanBucket: calls a callback with each value of a
+* live entry.
+*
+* @param hashTable The pointer to the hash table.
+* @param thisNode The entry
+* @param callback The function to call with each pair
+* @param context The pointer passed to callback
+* @param now The current time, or 0 if it was not read yet
+* @return The current time if it had to be read, or now
+*/
+static unsigned long long scanEntry(HashTable* hashTable, HashTableEntry* thisNode,
+                                    ItemCallback callback, void* context, unsigned long long now) {
+    // expired entries are skipped, and left for the wheel or a lookup
+    if (thisNode->expire_at) {
+        if (!now) now = currentTime();
+        if (thisNode->expire_at <= now) return now;
+    }
+    if (!hashTable->multimap) {
+        callback(context, thisNode->key, thisNode->value);
+        return now;
+    }
+    ValueRun* run = (ValueRun*)thisNode->value;
+    unsigned int i;
+    for (i = 0; i < run->count; ++i) callback(context, thisNode->key, runValues(thisNode)[i]);
+    return now;
+}
+
+/**
+* scanBucket
+*
+* Helper function behind scanHashTable for the chained layout: calls a
+* callback with the pairs of one bucket of a bucket array.
+*
+* @param hashTable The pointer to the hash table.
+* @param array The bucket array
+* @param bucketIndex The bucket
+* @param callback The function to call with each pair
+* @param context The pointer passed to callback
+* @param now The current time, or 0 if it was not read yet
+* @return The current time if it had to be read, or now
+*/
+static unsigned long long scanBucket(HashTable* hashTable, BucketArray* array, unsigned int bucketIndex,
+                                     ItemCallback callback, void* context, unsigned long long now) {
+    TreeBin* bin = array->bins ? array->bins[bucketIndex] : NULL;
+    if (bin) {
+        unsigned int i;
+        for (i = 0; i < treeBinSize(bin); ++i) {
+            now = scanEntry(hashTable, (HashTableEntry*)treeBinItem(bin, i), callback, context, now);
+        }
+        return now;
+    }
+    HashTableEntry* thisNode;
+    for (thisNode = array->buckets[bucketIndex].head; thisNode; thisNode = thisNode->next) {
+        now = scanEntry(hashTable, thisNode, callback, context, now);
+    }
+    return now;
+}
+
+/**
+* partitionOf
+*
+* Helper function that gives the partition of a bulk build a bucket belongs
+* to: the high end of the bucket index, so each partition is a contiguous
+* range of buckets.
+*
+* @param build The bulk build
+* @param bucketIndex The bucket
+* @return The partition, below the number of threads
+*/
+static unsigned int partitionOf(BulkBuild* build, unsigned int bucketIndex) {
+    return (unsigned int)((unsigned long long)bucketIndex * build->num_threads /
+                          build->table->num_buckets);
+}
+
+/**
+* bulkLink
+*
+* Helper function that links an entry of the arena into its bucket during a
+* bulk build, where scatterKeys left the bucket index in its expire_at. A
+* later value of a key replaces the earlier one. A chain growing past
+* TREEIFY_THRESHOLD is treeified on the spot, as linkEntry does, so a
+* crowded bucket is searched by bisection rather than walked for every key.
+* Tags are kept for the first TREEIFY_THRESHOLD entries of a chain only.
+*
+* @param worker The thread linking the entry, which owns its bucket
+* @param newEntry The entry
+*/
+static void bulkLink(BulkWorker* worker, HashTableEntry* newEntry) {
+    HashTable* hashTable = worker->build->table;
+    unsigned int bucketIndex = (unsigned int)newEntry->expire_at;
+    Bucket* bucket = &hashTable->table.buckets[bucketIndex];
+    TreeBin* bin = hashTable->table.bins ? hashTable->table.bins[bucketIndex] : NULL;
+    unsigned char tag = keyTag(newEntry->key);
+    HashTableEntry* thisNode = NULL;
+    unsigned int length = 0;
+    newEntry->expire_at = 0;
+    // with every tag byte used, the tags no longer cover the chain
+    int crowded = (bucket->tags >> 56) != 0;
+    if (bin) {
+        thisNode = (HashTableEntry*)treeBinFind(bin, newEntry->key);
+    } else if (crowded || hasTag(bucket->tags, tag)) {
+        for (thisNode = bucket->head; thisNode; thisNode = thisNode->next, ++length) {
+            if (thisNode->key == newEntry->key) break;
+        }
+    }
+    if (thisNode) {
+        free(thisNode->value);
+        thisNode->value = newEntry->value;
+        worker->duplicates++;
+        return;
+    }
+    if (bin) {
+        treeBinInsert(bin, newEntry->key, newEntry);
+        return;
+    }
+    newEntry->next = bucket->head;
+    bucket->head = newEntry;
+    if (!crowded) bucket->tags = (bucket->tags << 8) | tag;
+    if (length == TREEIFY_THRESHOLD) {
+        treeifyBucket(hashTable, &hashTable->table, bucketIndex);
+        worker->bins++;
+    }
+}
+
+/**
+* bulkWorker
+*
+* Helper function run by each thread of a bulk build, in three passes
+* separated by barriers: count the keys of the thread's share of the input
+* going to each partition, copy them into the arena grouped by partition,
+* and link the entries of the thread's own partition into its buckets. Only
+* the last pass writes to the buckets, each thread to its own range.
+*
+* @param arg The BulkWorker of the thread
+* @return NULL
+*/
+static void* bulkWorker(void* arg) {
+    BulkWorker* worker = (BulkWorker*)arg;
+    BulkBuild* build = worker->build;
+    HashTable* hashTable = build->table;
+    pthread_mutex_lock(&build->start);
+    pthread_mutex_unlock(&build->start);
+    unsigned int numThreads = build->num_threads;
+    unsigned int first = (unsigned int)((unsigned long long)build->num_keys * worker->index / numThreads);
+    unsigned int last = (unsigned int)((unsigned long long)build->num_keys * (worker->index + 1) / numThreads);
+    unsigned int* positions = (unsigned int*)calloc(numThreads, sizeof(unsigned int));
+    unsigned int i, p, t;
+
+    // the keys of this share in each partition, counted apart from the other
+    // threads' counts to share no cache line while counting; the bucket is
+    // kept for the next pass
+    for (i = first; i < last; ++i) {
+        build->buckets[i] = hashTable->hash(build->keys[i]);
+        positions[partitionOf(build, build->buckets[i])]++;
+    }
+    memcpy(build->counts + worker->index * numThreads, positions, numThreads * sizeof(unsigned int));
+    pthread_barrier_wait(&build->barrier);
+
+    // after the partitions before, and the shares before in the same
+    // partition; the thread of each partition also notes where it starts
+    unsigned int start = 0;
+    for (p = 0; p < numThreads; ++p) {
+        if (p == worker->index) build->starts[p] = start;
+        positions[p] = start;
+        for (t = 0; t < numThreads; ++t) {
+            if (t < worker->index) positions[p] += build->counts[t * numThreads + p];
+            start += build->counts[t * numThreads + p];
+        }
+    }
+    for (i = first; i < last; ++i) {
+        unsigned int bucketIndex = build->buckets[i];
+        HashTableEntry* newEntry = &hashTable->arena[positions[partitionOf(build, bucketIndex)]++];
+        newEntry->key = build->keys[i];
+        newEntry->value = build->values[i];
+        // the bucket, for the next pass, until the entry is linked
+        newEntry->expire_at = bucketIndex;
+        newEntry->timer = NULL;
+        newEntry->next = NULL;
+    }
+    free(positions);
+    pthread_barrier_wait(&build->barrier);
+
+    // the entries of this partition, in input order, so a later value wins
+    unsigned int end = worker->index + 1 < numThreads ? build->starts[worker->index + 1]
+                                                      : build->num_keys;
+    for (i = build->starts[worker->index]; i < end; ++i) bulkLink(worker, &hashTable->arena[i]);
+    return NULL;
+}
+
+/**
+* rejectMultimap
+*
+* Helper function that exits if a feature that assumes one value per key is
+* used on a table in multimap mode.
+*
+* @param hashTable The pointer to the hash table.
+* @param feature The name of the public function that was called
+*/
+static void rejectMultimap(HashTable* hashTable, const char* feature) {
+    if (hashTable->multimap) {
+        printf("%s is not supported in multimap mode...\n", feature);
+        exit(1);
+    }
+}
+
+/**
+* rejectInline
+*
+* Helper function that exits if a function that passes values by pointer is
+* used on a table storing its values inline.
+*
+* @param hashTable The pointer to the hash table.
+* @param feature The name of the public function that was called
+* @param instead The function to use instead
+*/
+static void rejectInline(HashTable* hashTable, const char* feature, const char* instead) {
+    if (hashTable->value_size) {
+        printf("%s is not supported by a table of inline values, use %s...\n", feature, instead);
+        exit(1);
+    }
+}
+
+/**
+* requireCounting
+*
+* Helper function that exits if a counting function is used on a table
+* whose layout is not HT_LAYOUT_COUNTING.
+*
+* @param hashTable The pointer to the hash table.
+* @param feature The name of the public function that was called
+*/
+static void requireCounting(HashTable* hashTable, const char* feature) {
+    if (hashTable->engine != &countingEngine) {
+        printf("%s is only supported by the counting layout...\n", feature);
+        exit(1);
+    }
+}
+
+/****************************************************************************
+* Public Interface Functions
+*
+* These functions implement the public interface as specified in the header
+* file, and make use of the private functions and hidden definitions in the
+* above sections.
+****************************************************************************/
+// The createHashTable is provided for you as a starting point.
+HashTable* createHashTable(HashFunction hashFunction, unsigned int numBuckets) {
+  // The hash table has to contain at least one bucket. Exit gracefully if
+  // this condition is not met.
+  if (numBuckets==0) {
+    printf("Hash table has to contain at least 1 bucket...\n");
+    exit(1);
+  }
+
+  // Allocate memory for the new HashTable struct on heap.
+  HashTable* newTable = (HashTable*)malloc(sizeof(HashTable));
+
+  // Initialize the components of the new HashTable struct.
+  newTable->hash = hashFunction;
+  newTable->num_buckets = numBuckets;
+  newTable->wheel = NULL;
+  newTable->num_entries = 0;
+  newTable->capacity = 0;
+  newTable->sketch = NULL;
+  newTable->random_state = 2463534242u;
+  newTable->trace = NULL;
+  newTable->latency = NULL;
+  newTable->rehash_index = 0;
+  newTable->num_reseeds = 0;
+  newTable->engine = NULL;
+  newTable->engine_state = NULL;
+  newTable->multimap = 0;
+  newTable->run_bytes = 0;
+  newTable->value_size = 0;
+  newTable->arena = NULL;
+  newTable->arena_size = 0;
+  newTable->arena_live = 0;
+
+  // The buckets start empty, and keys are placed by the user's function.
+  initBucketArray(newTable, &newTable->table, 0);
+  newTable->old_table.buckets = NULL;
+  newTable->old_table.bins = NULL;
+
+  // Return the new HashTable struct.
+  return newTable;
+}
+
+HashTable* createHashTableWithLayout(HashFunction hashFunction, unsigned int numBuckets,
+                                     HashTableLayout layout) {
+    if ((unsigned int)layout >= sizeof(layoutEngines) / sizeof(layoutEngines[0])) {
+        printf("Unknown hash table layout %d...\n", (int)layout);
+        exit(1);
+    }
+    HashTable* newTable = createHashTable(hashFunction, numBuckets);
+    if (layout == HT_LAYOUT_CHAINED) return newTable;
+    // the engine keeps its own buckets
+    freeBucketArray(newTable, &newTable->table);
+    newTable->engine = layoutEngines[layout];
+    newTable->engine_state = newTable->engine->create(hashFunction, numBuckets);
+    return newTable;
+}
+
+HashTable* createHashTableWithValueSize(HashFunction hashFunction, unsigned int numBuckets,
+                                        unsigned int valueSize) {
+    if (valueSize == 0) {
+        printf("Inline values have to be at least 1 byte...\n");
+        exit(1);
+    }
+    HashTable* newTable = createHashTable(hashFunction, numBuckets);
+    // the values live in the cold array of a compact table
+    freeBucketArray(newTable, &newTable->table);
+    newTable->engine = &compactEngine;
+    newTable->engine_state = createCompactInline(hashFunction, numBuckets, valueSize);
+    newTable->value_size = valueSize;
+    return newTable;
+}
+
+HashTable* createHashTableInFile(const char* path) {
+    void* state = createExtendibleFile(path);
+    if (!state) return NULL;
+    // the keys are placed by the engine, so there is no hash function
+    HashTable* newTable = createHashTable(NULL, 1);
+    freeBucketArray(newTable, &newTable->table);
+    newTable->engine = &extendibleEngine;
+    newTable->engine_state = state;
+    return newTable;
+}
+
+void freezeHashTable(HashTable* hashTable) {
+    if (hashTable->engine == &frozenEngine) return;
+    rejectMultimap(hashTable, "freezeHashTable");
+    rejectInline(hashTable, "freezeHashTable", "a table of pointers");
+    if (hashTable->engine == &countingEngine) {
+        printf("freezeHashTable is not supported by a counting hash table...\n");
+        exit(1);
+    }
+    // take every entry out of the current representation, without its value
+    EntryList list = { NULL, NULL, 0, 0 };
+    if (hashTable->engine) {
+        hashTable->engine->visit(hashTable->engine_state, appendEntry, &list);
+        for (unsigned int i = 0; i < list.count; ++i) {
+            hashTable->engine->remove(hashTable->engine_state, list.keys[i]);
+        }
+        hashTable->engine->destroy(hashTable->engine_state);
+    } else {
+        takeArrayEntries(hashTable, &hashTable->table, &list);
+        freeBucketArray(hashTable, &hashTable->table);
+        if (hashTable->old_table.buckets) {
+            takeArrayEntries(hashTable, &hashTable->old_table, &list);
+            freeBucketArray(hashTable, &hashTable->old_table);
+        }
+        freeArena(hashTable);
+        // nothing expires or gets evicted any more
+        if (hashTable->wheel) destroyTimingWheel(hashTable->wheel);
+        if (hashTable->sketch) destroyFrequencySketch(hashTable->sketch);
+        hashTable->wheel = NULL;
+        hashTable->sketch = NULL;
+        hashTable->capacity = 0;
+        hashTable->num_entries = 0;
+    }
+    hashTable->engine = &frozenEngine;
+    hashTable->engine_state = createFrozenState(list.keys, list.values, list.count);
+    free(list.keys);
+    free(list.values);
+}
+
+void destroyHashTable(HashTable* hashTable) {
+    // finish the trace file, if any
+    if (hashTable->trace) destroyTraceRecorder(hashTable->trace);
+    // free every entry and value, including those not rehashed yet
+    if (hashTable->engine) hashTable->engine->destroy(hashTable->engine_state);
+    else freeBucketArray(hashTable, &hashTable->table);
+    if (hashTable->old_table.buckets) freeBucketArray(hashTable, &hashTable->old_table);
+    freeArena(hashTable);
+    // destroy the pending timers, if any
+    if (hashTable->wheel) destroyTimingWheel(hashTable->wheel);
+    // destroy the admission filter, if any
+    if (hashTable->sketch) destroyFrequencySketch(hashTable->sketch);
+    // destroy the latency histograms, if any
+    if (hashTable->latency) destroyLatencyRecorder(hashTable->latency);
+    // destroy hashTable
+    free(hashTable);
+}
+
+void* insertItem(HashTable* hashTable, unsigned int key, void* value) {
+    rejectInline(hashTable, "insertItem", "insertItemCopy");
+    if (hashTable->trace) recordOperation(hashTable->trace, TRACE_INSERT, key, 0);
+    unsigned long long start = hashTable->latency ? startLatency(hashTable->latency) : 0;
+    // carry on with a rehash in progress
+    if (hashTable->old_table.buckets) rehashStep(hashTable);
+    // overwrite or create the entry, and hand back the replaced value
+    void* previousValue;
+    if (hashTable->engine) {
+        previousValue = hashTable->engine->insert(hashTable->engine_state, key, value);
+    } else if (hashTable->multimap) {
+        // nothing is overwritten, the value joins those of the key
+        appendValue(hashTable, key, value);
+        previousValue = NULL;
+    } else {
+        upsertItem(hashTable, key, value, &previousValue);
+    }
+    if (start) stopLatency(hashTable->latency, LATENCY_INSERT, start);
+    return previousValue;
+}
+
+void* insertItemWithTTL(HashTable* hashTable, unsigned int key, void* value,
+                        unsigned int ttlMs) {
+    requireChained(hashTable, "insertItemWithTTL");
+    rejectMultimap(hashTable, "insertItemWithTTL");
+    if (hashTable->trace) recordOperation(hashTable->trace, TRACE_INSERT_TTL, key, ttlMs);
+    unsigned long long start = hashTable->latency ? startLatency(hashTable->latency) : 0;
+    // carry on with a rehash in progress
+    if (hashTable->old_table.buckets) rehashStep(hashTable);
+    void* previousValue;
+    HashTableEntry* thisNode = upsertItem(hashTable, key, value, &previousValue);
+    if (thisNode) setExpiry(hashTable, thisNode, ttlMs);
+    if (start) stopLatency(hashTable->latency, LATENCY_INSERT_TTL, start);
+    return previousValue;
+}
+
+unsigned int tickHashTable(HashTable* hashTable, unsigned long long now) {
+    if (!hashTable->wheel) return 0;
+    unsigned long long start = hashTable->latency ? startLatency(hashTable->latency) : 0;
+    unsigned int expired = advanceTimingWheel(hashTable->wheel, now, EXPIRE_WORK_PER_TICK,
+                                              expireTimer, hashTable);
+    if (start) stopLatency(hashTable->latency, LATENCY_TICK, start);
+    return expired;
+}
+
+unsigned long long hashTableClock(void) {
+    return currentTime();
+}
+
+void enableHashTableCache(HashTable* hashTable, unsigned int capacity,
+                          unsigned int sketchCounters, unsigned int agingPeriod) {
+    requireChained(hashTable, "enableHashTableCache");
+    rejectMultimap(hashTable, "enableHashTableCache");
+    // replace any previous admission filter
+    if (hashTable->sketch) destroyFrequencySketch(hashTable->sketch);
+    hashTable->sketch = NULL;
+    hashTable->capacity = capacity;
+    if (capacity && sketchCounters) {
+        // by default, age after ten accesses per cached entry
+        if (agingPeriod == 0) agingPeriod = 10 * capacity;
+        hashTable->sketch = createFrequencySketch(sketchCounters, agingPeriod);
+    }
+}
+
+int startHashTableTrace(HashTable* hashTable, const char* path) {
+    // a new trace replaces the current one
+    stopHashTableTrace(hashTable);
+    hashTable->trace = createTraceRecorder(path);
+    return hashTable->trace != NULL;
+}
+
+void stopHashTableTrace(HashTable* hashTable) {
+    if (hashTable->trace) destroyTraceRecorder(hashTable->trace);
+    hashTable->trace = NULL;
+}
+
+void enableHashTableLatency(HashTable* hashTable, unsigned int sampleEvery) {
+    // start over with empty histograms
+    if (hashTable->latency) destroyLatencyRecorder(hashTable->latency);
+    hashTable->latency = NULL;
+    if (sampleEvery) hashTable->latency = createLatencyRecorder(NUM_LATENCY_OPS, sampleEvery);
+}
+
+void dumpHashTableLatency(HashTable* hashTable, FILE* out) {
+    if (!hashTable->latency) {
+        fprintf(out, "Latency recording is not enabled\n");
+        return;
+    }
+    dumpLatency(hashTable->latency, out, latencyOpNames);
+}
+
+unsigned int hashTableReseedCount(HashTable* hashTable) {
+    return hashTable->num_reseeds;
+}
+
+unsigned long long hashTableMemoryUsage(HashTable* hashTable) {
+    unsigned long long bytes = sizeof(HashTable);
+    if (hashTable->engine) return bytes + hashTable->engine->memory(hashTable->engine_state);
+    bytes += bucketArrayMemoryUsage(hashTable, &hashTable->table);
+    if (hashTable->old_table.buckets) {
+        bytes += bucketArrayMemoryUsage(hashTable, &hashTable->old_table);
+    }
+    // entries of the arena are counted with it, in use or not
+    bytes += (unsigned long long)(hashTable->num_entries - hashTable->arena_live) * sizeof(HashTableEntry);
+    bytes += (unsigned long long)hashTable->arena_size * sizeof(HashTableEntry);
+    bytes += hashTable->run_bytes;
+    if (hashTable->wheel) bytes += timingWheelMemoryUsage(hashTable->wheel);
+    if (hashTable->sketch) bytes += frequencySketchMemoryUsage(hashTable->sketch);
+    return bytes;
+}
+
+void* getItem(HashTable* hashTable, unsigned int key) {
+    if (hashTable->trace) recordOperation(hashTable->trace, TRACE_GET, key, 0);
+    unsigned long long start = hashTable->latency ? startLatency(hashTable->latency) : 0;
+    // carry on with a rehash in progress
+    if (hashTable->old_table.buckets) rehashStep(hashTable);
+    void* value = hashTable->engine ? hashTable->engine->get(hashTable->engine_state, key)
+                                    : lookupKey(hashTable, key);
+    if (start) stopLatency(hashTable->latency, LATENCY_GET, start);
+    return value;
+}
+
+void* removeItem(HashTable* hashTable, unsigned int key) {
+    rejectInline(hashTable, "removeItem", "deleteItem");
+    if (hashTable->trace) recordOperation(hashTable->trace, TRACE_REMOVE, key, 0);
+    unsigned long long start = hashTable->latency ? startLatency(hashTable->latency) : 0;
+    // carry on with a rehash in progress
+    if (hashTable->old_table.buckets) rehashStep(hashTable);
+    void* value = hashTable->engine ? hashTable->engine->remove(hashTable->engine_state, key)
+                                    : removeKey(hashTable, key);
+    if (start) stopLatency(hashTable->latency, LATENCY_REMOVE, start);
+    return value;
+}
+
+void deleteItem(HashTable* hashTable, unsigned int key) {
+    if (hashTable->trace) recordOperation(hashTable->trace, TRACE_DELETE, key, 0);
+    unsigned long long start = hashTable->latency ? startLatency(hashTable->latency) : 0;
+    // carry on with a rehash in progress
+    if (hashTable->old_table.buckets) rehashStep(hashTable);
+    if (hashTable->engine) hashTable->engine->erase(hashTable->engine_state, key);
+    else if (hashTable->multimap) free(takeFirstValue(hashTable, key));
+    else deleteKey(hashTable, key);
+    if (start) stopLatency(hashTable->latency, LATENCY_DELETE, start);
+}
+
+void enableHashTableMultimap(HashTable* hashTable) {
+    requireChained(hashTable, "enableHashTableMultimap");
+    if (hashTable->num_entries || hashTable->capacity || hashTable->wheel) {
+        printf("enableHashTableMultimap needs an empty table without cache mode or TTLs...\n");
+        exit(1);
+    }
+    hashTable->multimap = 1;
+}
+
+unsigned int getAll(HashTable* hashTable, unsigned int key, ValueCallback callback,
+                    void* context) {
+    if (!hashTable->multimap) {
+        void* value = getItem(hashTable, key);
+        if (!value) return 0;
+        if (callback) callback(context, value);
+        return 1;
+    }
+    // carry on with a rehash in progress
+    if (hashTable->old_table.buckets) rehashStep(hashTable);
+    HashTableEntry* thisNode = findItem(hashTable, key);
+    if (!thisNode) return 0;
+    // the values of the key are next to each other in its run
+    ValueRun* run = (ValueRun*)thisNode->value;
+    if (callback) {
+        for (unsigned int i = 0; i < run->count; ++i) callback(context, runValues(thisNode)[i]);
+    }
+    return run->count;
+}
+
+unsigned int countKey(HashTable* hashTable, unsigned int key) {
+    return getAll(hashTable, key, NULL, NULL);
+}
+
+unsigned int removeAll(HashTable* hashTable, unsigned int key) {
+    if (!hashTable->multimap) {
+        void* value = removeItem(hashTable, key);
+        unsigned int removed = value != NULL;
+        free(value);
+        return removed;
+    }
+    // carry on with a rehash in progress
+    if (hashTable->old_table.buckets) rehashStep(hashTable);
+    HashTableEntry* thisNode = findItem(hashTable, key);
+    if (!thisNode) return 0;
+    unsigned int count = ((ValueRun*)thisNode->value)->count;
+    deleteKey(hashTable, key);
+    return count;
+}
+
+void incrementItem(HashTable* hashTable, unsigned int key, long long delta) {
+    requireCounting(hashTable, "incrementItem");
+    countingIncrement(hashTable->engine_state, key, delta);
+}
+
+void bufferHashTableCounts(HashTable* hashTable, unsigned int slots) {
+    requireCounting(hashTable, "bufferHashTableCounts");
+    countingSetBuffer(hashTable->engine_state, slots);
+}
+
+void flushHashTableCounts(HashTable* hashTable) {
+    requireCounting(hashTable, "flushHashTableCounts");
+    countingFlush(hashTable->engine_state);
+}
+
+long long getCount(HashTable* hashTable, unsigned int key) {
+    requireCounting(hashTable, "getCount");
+    return countingCount(hashTable->engine_state, key);
+}
+
+void* insertItemCopy(HashTable* hashTable, unsigned int key, const void* bytes) {
+    if (!hashTable->value_size) {
+        printf("insertItemCopy is only supported by a table of inline values...\n");
+        exit(1);
+    }
+    if (hashTable->trace) recordOperation(hashTable->trace, TRACE_INSERT, key, 0);
+    unsigned long long start = hashTable->latency ? startLatency(hashTable->latency) : 0;
+    void* stored = compactInsertCopy(hashTable->engine_state, key, bytes);
+    if (start) stopLatency(hashTable->latency, LATENCY_INSERT, start);
+    return stored;
+}
+
+void* getItemRef(HashTable* hashTable, unsigned int key) {
+    if (!hashTable->value_size) {
+        printf("getItemRef is only supported by a table of inline values...\n");
+        exit(1);
+    }
+    // getItem already hands out where an inline value is stored
+    return getItem(hashTable, key);
+}
+
+HashTableIterator* htIterBegin(HashTable* hashTable) {
+    HashTableIterator* iterator = (HashTableIterator*)malloc(sizeof(HashTableIterator));
+    if (!hashTable->engine) {
+        initIterator(iterator, hashTable);
+        return iterator;
+    }
+    // other layouts are walked in place, from before their first entry
+    EnginePosition start = { 0, NULL, 0, 0, 0 };
+    iterator->table = hashTable;
+    iterator->at = start;
+    iterator->erased = 1;
+    return iterator;
+}
+
+int htIterNext(HashTableIterator* iterator, unsigned int* key, void** value) {
+    HashTable* hashTable = iterator->table;
+    if (!hashTable->engine) return nextPair(iterator, key, value);
+    int found = hashTable->engine->next(hashTable->engine_state, &iterator->at, key, value);
+    iterator->erased = !found;
+    return found;
+}
+
+void htIterErase(HashTableIterator* iterator) {
+    HashTable* hashTable = iterator->table;
+    if (iterator->erased || (!hashTable->engine && !iterator->current)) {
+        printf("htIterErase needs a pair returned by htIterNext...\n");
+        exit(1);
+    }
+    if (!hashTable->engine) {
+        eraseCurrent(iterator);
+        return;
+    }
+    hashTable->engine->eraseAt(hashTable->engine_state, &iterator->at);
+    iterator->erased = 1;
+}
+
+void htIterEnd(HashTableIterator* iterator) {
+    if (!iterator->table->engine && iterator->array) settleBin(iterator);
+    free(iterator);
+}
+
+void forEachItem(HashTable* hashTable, ItemCallback callback, void* context) {
+    if (hashTable->engine) {
+        hashTable->engine->visit(hashTable->engine_state, callback, context);
+        return;
+    }
+    HashTableIterator iterator;
+    initIterator(&iterator, hashTable);
+    unsigned int key;
+    void* value;
+    while (nextPair(&iterator, &key, &value)) callback(context, key, value);
+}
+
+HashTable* bulkBuildHashTable(HashFunction hashFunction, unsigned int numBuckets,
+                              const unsigned int* keys, void* const* values, unsigned int n,
+                              unsigned int threads) {
+    HashTable* hashTable = createHashTable(hashFunction, numBuckets);
+    if (n == 0) return hashTable;
+    // a thread per partition, and no partition without keys to place
+    if (threads == 0) threads = 1;
+    if (threads > n) threads = n;
+    hashTable->arena = (HashTableEntry*)malloc((unsigned long long)n * sizeof(HashTableEntry));
+    hashTable->arena_size = n;
+
+    BulkBuild build;
+    build.table = hashTable;
+    build.keys = keys;
+    build.values = values;
+    build.num_keys = n;
+    build.buckets = (unsigned int*)malloc((unsigned long long)n * sizeof(unsigned int));
+    build.counts = (unsigned int*)malloc((unsigned long long)threads * threads * sizeof(unsigned int));
+    build.starts = (unsigned int*)malloc(threads * sizeof(unsigned int));
+    pthread_mutex_init(&build.start, NULL);
+    BulkWorker* workers = (BulkWorker*)calloc(threads, sizeof(BulkWorker));
+    unsigned int t, bins = 0, duplicates = 0;
+    // the threads treeify their crowded buckets themselves, so the array of
+    // bins must be there before they start
+    if (n > TREEIFY_THRESHOLD) {
+        hashTable->table.bins = (TreeBin**)calloc(hashTable->num_buckets, sizeof(TreeBin*));
+    }
+    for (t = 0; t < threads; ++t) {
+        workers[t].build = &build;
+        workers[t].index = t;
+    }
+    // this thread is the first worker; if a thread cannot be created, the
+    // ones that were split the input between them instead
+    pthread_mutex_lock(&build.start);
+    for (t = 1; t < threads; ++t) {
+        if (pthread_create(&workers[t].thread, NULL, bulkWorker, &workers[t]) != 0) break;
+    }
+    threads = t;
+    build.num_threads = threads;
+    pthread_barrier_init(&build.barrier, NULL, threads);
+    pthread_mutex_unlock(&build.start);
+    bulkWorker(&workers[0]);
+    for (t = 1; t < threads; ++t) pthread_join(workers[t].thread, NULL);
+
+    for (t = 0; t < threads; ++t) {
+        bins += workers[t].bins;
+        duplicates += workers[t].duplicates;
+    }
+    // as insertItem would have left it, no array of bins without a bin
+    if (!bins) {
+        free(hashTable->table.bins);
+        hashTable->table.bins = NULL;
+    }
+    hashTable->num_entries = n - duplicates;
+    hashTable->arena_live = n - duplicates;
+    pthread_barrier_destroy(&build.barrier);
+    pthread_mutex_destroy(&build.start);
+    free(build.buckets);
+    free(build.counts);
+    free(build.starts);
+    free(workers);
+    return hashTable;
+}
+
+unsigned long long scanHashTable(HashTable* hashTable, unsigned long long cursor, unsigned int count,
+                                 ItemCallback callback, void* context) {
+    if (count == 0) count = 1;
+    if (hashTable->engine) {
+        return hashTable->engine->scan(hashTable->engine_state, cursor, count, callback, context);
+    }
+    // the old buckets of a rehash are walked before the new ones, so an
+    // entry that rehashStep moves out of an old bucket not scanned yet is
+    // found in the new buckets later; the bucket count never changes
+    unsigned long long epoch = hashTable->num_reseeds & 0x7fffffffULL;
+    unsigned int index = (unsigned int)cursor;
+    int inOld = (cursor & SCAN_OLD_PHASE) != 0;
+    if (cursor == 0) {
+        inOld = hashTable->old_table.buckets != NULL;
+    } else if (cursor >> SCAN_EPOCH_SHIFT != epoch) {
+        // a reseed since the last call: the buckets being walked may now be
+        // the old ones, whose entries can land anywhere in the new buckets
+        int continues = !inOld && cursor >> SCAN_EPOCH_SHIFT == ((epoch - 1) & 0x7fffffffULL);
+        inOld = hashTable->old_table.buckets != NULL;
+        if (!inOld || !continues) index = 0;
+    }
+    unsigned long long now = 0;
+    while (count) {
+        if (inOld && (!hashTable->old_table.buckets || index == hashTable->num_buckets)) {
+            inOld = 0;
+            index = 0;
+        }
+        if (!inOld && index == hashTable->num_buckets) return 0;
+        now = scanBucket(hashTable, inOld ? &hashTable->old_table : &hashTable->table, index++,
+                         callback, context, now);
+        --count;
+    }
+    if (!inOld && index == hashTable->num_buckets) return 0;
+    return epoch << SCAN_EPOCH_SHIFT | (inOld ? SCAN_OLD_PHASE : 0) | index;
+}
@@ -10,6 +10,8 @@
 #ifndef HASHTABLE_H
 #define HASHTABLE_H
 
+#include <stdio.h>    // For FILE
+
 /****************************************************************************
  * Forward Declarations
  *
@@ -47,6 +49,27 @@ typedef struct _HashTable HashTable;
  */
 typedef struct _HashTableEntry HashTableEntry;
 
+/**
+ * This defines a type that is a pointer to a function which getAll calls
+ * with each value of a key, along with a pointer of the caller's choosing.
+ * The name of the type is "ValueCallback".
+ */
+typedef void (*ValueCallback)(void* context, void* value);
+
+/**
+ * This defines a type that is a pointer to a function which forEachItem
+ * calls with each key and value of a table, along with a pointer of the
+ * caller's choosing. The name of the type is "ItemCallback".
+ */
+typedef void (*ItemCallback)(void* context, unsigned int key, void* value);
+
+/**
+ * This defines a type that is a _HashTableIterator struct, the position of
+ * an iteration over a table. The definition for _HashTableIterator is
+ * implemented in hash_table.c.
+ */
+typedef struct _HashTableIterator HashTableIterator;
+
 /**
  * createHashTable
  *
@@ -61,6 +84,149 @@ typedef struct _HashTableEntry HashTableEntry;
  */
 HashTable* createHashTable(HashFunction myHashFunc, unsigned int numBuckets);
 
+/**
+ * The memory layouts a hash table can be created with. They all implement
+ * insertItem, getItem, removeItem, deleteItem, destroyHashTable, tracing,
+ * latency recording and hashTableMemoryUsage. TTLs, cache mode, tree bins
+ * and flooding protection are only available with HT_LAYOUT_CHAINED, and
+ * calling insertItemWithTTL or enableHashTableCache on another layout exits.
+ * Only HT_LAYOUT_HOPSCOTCH may be used by several threads without a lock
+ * around the table; a value it returns may still be replaced or removed by
+ * another thread, so freeing values is then up to the application.
+ * HT_LAYOUT_COUNTING is also safe for concurrent use, but holds counters
+ * rather than values.
+ */
+typedef enum {
+  /** Singly linked lists of heap allocated entries (createHashTable) */
+  HT_LAYOUT_CHAINED,
+  /** Chains linked by 32-bit indices into one contiguous array of keys,
+      with the values in a parallel array: 16 bytes per entry */
+  HT_LAYOUT_COMPACT,
+  /** Chains of nodes holding 8 entries each, whose keys are compared with
+      one vector instruction */
+  HT_LAYOUT_UNROLLED,
+  /** Buckets that embed their first entry, with an overflow chain for the
+      others, so most hits and misses take a single memory access */
+  HT_LAYOUT_INLINE,
+  /** Open addressing with hopscotch hashing: every key within 32 buckets
+      of its home. The table grows as needed, placing keys with its own mix
+      of the key rather than the hash function. It is safe for concurrent
+      use: getItem takes no lock, and writers are serialized internally */
+  HT_LAYOUT_HOPSCOTCH,
+  /** Linear hashing: chains whose bucket count grows and shrinks one bucket
+      at a time with the entries, so there is never a second bucket array.
+      Like HT_LAYOUT_HOPSCOTCH it places keys with its own mix of the key */
+  HT_LAYOUT_LINEAR,
+  /** Extendible hashing: a directory of 4 KB pages of 340 entries, where a
+      full page splits in two without touching the others. Pages are in
+      memory; createHashTableInFile keeps them in a file instead */
+  HT_LAYOUT_EXTENDIBLE,
+  /** A lock-free map from keys to 64-bit counters, updated with
+      incrementItem by any number of threads at once. Keys are never
+      removed; insertItem, removeItem and deleteItem exit, and getItem
+      returns a pointer to the key's counter (a long long) */
+  HT_LAYOUT_COUNTING
+} HashTableLayout;
+
+/**
+ * createHashTableWithLayout
+ *
+ * Creates a hash table like createHashTable, with the given memory layout.
+ *
+ * @param myHashFunc The pointer to the custom hash function.
+ * @param numBuckets The number of buckets available in the hash table.
+ * @param layout The memory layout of the table.
+ * @return a pointer to the new hash table
+ */
+HashTable* createHashTableWithLayout(HashFunction myHashFunc, unsigned int numBuckets,
+                                     HashTableLayout layout);
+
+/**
+ * createHashTableWithValueSize
+ *
+ * Creates a hash table whose values are valueSize bytes copied into the
+ * table, rather than pointers to memory the caller allocated, for values
+ * such as 8-byte integers or small structs. The values sit in a contiguous
+ * array parallel to the keys of an HT_LAYOUT_COMPACT table, aligned to 8
+ * bytes (or to valueSize rounded up to a power of 2, if smaller), so storing
+ * one needs no allocation and destroying the table frees none.
+ *
+ * Values are stored with insertItemCopy and read in place with getItemRef
+ * (or getItem, which returns the same pointer). A pointer into the table is
+ * valid until the next insertItemCopy of a new key or deleteItem, either of
+ * which may move the values. deleteItem removes a key; insertItem,
+ * removeItem, the chained-only features and freezeHashTable exit.
+ *
+ * @param myHashFunc The pointer to the custom hash function.
+ * @param numBuckets The number of buckets available in the hash table.
+ * @param valueSize The size of every value in bytes, at least 1.
+ * @return a pointer to the new hash table
+ */
+HashTable* createHashTableWithValueSize(HashFunction myHashFunc, unsigned int numBuckets,
+                                        unsigned int valueSize);
+
+/**
+ * createHashTableInFile
+ *
+ * Creates an HT_LAYOUT_EXTENDIBLE hash table whose pages are kept in a file
+ * and read and written with pread and pwrite, so only the page directory
+ * takes memory. The file is truncated first. Values are still pointers owned
+ * by the table, so the file is only meaningful to this table and is not
+ * removed by destroyHashTable.
+ *
+ * @param path The file to keep the pages in.
+ * @return a pointer to the new hash table, or NULL if the file cannot be
+ *         opened
+ */
+HashTable* createHashTableInFile(const char* path);
+
+/**
+ * bulkBuildHashTable
+ *
+ * Creates a chained hash table holding n keys and their values, built by
+ * several threads at once, for loading large data sets faster than n calls
+ * to insertItem. A radix pass partitions the keys by the high end of their
+ * bucket index, so each thread then links the entries of its own range of
+ * buckets without locking. The entries themselves come from one array
+ * allocated up front, freed with the table, so the build does no
+ * allocation per entry. The table is an ordinary chained table afterwards.
+ *
+ * The values become the table's, as with insertItem. If a key appears more
+ * than once, its last value is kept and the others are freed. The hash
+ * function is called from every thread, once per key, so it must be safe
+ * to call concurrently.
+ *
+ * @param myHashFunc The pointer to the custom hash function.
+ * @param numBuckets The number of buckets available in the hash table.
+ * @param keys The keys, n of them.
+ * @param values The value of each key, n of them.
+ * @param n The number of keys.
+ * @param threads The number of threads building the table; 0 counts as 1.
+ *        Fewer are used if no more threads can be created.
+ * @return a pointer to the new hash table
+ */
+HashTable* bulkBuildHashTable(HashFunction myHashFunc, unsigned int numBuckets,
+                              const unsigned int* keys, void* const* values, unsigned int n,
+                              unsigned int threads);
+
+/**
+ * freezeHashTable
+ *
+ * Rebuild a populated table of any layout but HT_LAYOUT_COUNTING as an immutable one for read-only
+ * use: keys and values in two dense arrays, indexed by a minimal perfect hash
+ * of the stored keys, so that getItem costs one hash and one probe of each
+ * array, and the index adds about 4 bits per key. Entries whose TTL has
+ * passed are dropped, the others no longer expire, and cache mode ends.
+ * Afterwards insertItem, insertItemWithTTL, removeItem, deleteItem and
+ * enableHashTableCache exit; getItem, destroyHashTable, tracing, latency
+ * recording and hashTableMemoryUsage work as before. Freezing takes time
+ * linear in the number of entries, and no other thread may use the table
+ * meanwhile. Freezing a frozen table does nothing.
+ *
+ * @param myHashTable The pointer to the hash table.
+ */
+void freezeHashTable(HashTable* myHashTable);
+
 /**
  * destroyHashTable
  *
@@ -80,6 +246,7 @@ void destroyHashTable(HashTable* myHashTable);
  *
  * Insert the value into the hash table based on the key.
  * In other words, create a new hash table entry and add it to a specific bucket.
+ * Overwriting an entry that had a TTL makes it permanent again.
  *
  * @param myHashTable The pointer to the hash table.
  * @param key The key that corresponds to the value.
@@ -88,6 +255,272 @@ void destroyHashTable(HashTable* myHashTable);
  */
 void* insertItem(HashTable* myHashTable, unsigned int key, void* value);
 
+/**
+ * insertItemCopy
+ *
+ * Copy valueSize bytes into the table as the value of a key, in a table
+ * created by createHashTableWithValueSize, overwriting the key's previous
+ * value if any. Exits for other tables.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param key The key that corresponds to the value.
+ * @param bytes The value to copy.
+ * @return a pointer to the copy stored in the table
+ */
+void* insertItemCopy(HashTable* myHashTable, unsigned int key, const void* bytes);
+
+/**
+ * insertItemWithTTL
+ *
+ * Insert the value like insertItem, but let the entry expire ttlMs
+ * milliseconds from now. An expired entry is treated as missing by every
+ * other function, and its value is freed by the hash table, either lazily
+ * when the key is next accessed or actively by tickHashTable.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param key The key that corresponds to the value.
+ * @param value The value to be stored in the hash table.
+ * @param ttlMs The time to live of the entry in milliseconds.
+ * @return old value if it is overwritten, or NULL if not replaced
+ */
+void* insertItemWithTTL(HashTable* myHashTable, unsigned int key, void* value,
+                        unsigned int ttlMs);
+
+/**
+ * tickHashTable
+ *
+ * Actively expire entries whose TTL has passed by now. Only a bounded amount
+ * of work is done per call, so a burst of expirations is spread over several
+ * calls; call this periodically (e.g. every few milliseconds) from the thread
+ * that owns the table.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param now The current time, as returned by hashTableClock.
+ * @return the number of entries expired by this call
+ */
+unsigned int tickHashTable(HashTable* myHashTable, unsigned long long now);
+
+/**
+ * hashTableClock
+ *
+ * Read the monotonic clock that TTLs are measured against.
+ *
+ * @return the current time in milliseconds
+ */
+unsigned long long hashTableClock(void);
+
+/**
+ * enableHashTableCache
+ *
+ * Turn the hash table into a bounded cache holding at most capacity entries.
+ * Inserting a new key into a full cache evicts one entry, chosen among a few
+ * sampled entries as the least frequently used one; its value is freed like
+ * in deleteItem.
+ *
+ * With sketchCounters > 0, a TinyLFU admission filter is enabled as well: a
+ * count-min sketch of that many 4-bit counters records every getItem and
+ * insertItem, and a new key is only admitted if it has been seen more often
+ * than the victim it would evict. A rejected insert frees the value and
+ * returns NULL, so a one-off scan cannot flush the frequently used keys.
+ * The counters are halved every agingPeriod recorded accesses (0 selects ten
+ * times the capacity), so that keys which stop being used lose their place.
+ * A sketch of a few times the capacity keeps collisions rare.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param capacity The maximum number of entries, or 0 to disable cache mode.
+ * @param sketchCounters The number of counters per sketch row, or 0 for no admission filter.
+ * @param agingPeriod The number of accesses between two agings of the sketch.
+ */
+void enableHashTableCache(HashTable* myHashTable, unsigned int capacity,
+                          unsigned int sketchCounters, unsigned int agingPeriod);
+
+/**
+ * enableHashTableMultimap
+ *
+ * Let a key hold several values, for indexing non-unique attributes without
+ * keeping a list of values per key in each value. insertItem then adds the
+ * value to those of the key instead of overwriting, and returns NULL. The
+ * key keeps a single entry, whose values sit next to each other in one array
+ * in insertion order, which getAll, countKey and removeAll read without
+ * looking at any other key. getItem returns the first value of the key,
+ * removeItem takes it out and returns it, and deleteItem frees it; the key
+ * goes away with its last value.
+ *
+ * The table must be empty and use the chained layout. Multimap mode does not
+ * combine with TTLs, cache mode or freezeHashTable, which exit.
+ *
+ * @param myHashTable The pointer to the hash table.
+ */
+void enableHashTableMultimap(HashTable* myHashTable);
+
+/**
+ * getAll
+ *
+ * Call a function with every value of a key, in insertion order. The
+ * function must not modify the table. Without multimap mode a key has at
+ * most one value, the one getItem returns.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param key The key that corresponds to the values.
+ * @param callback The function to call with each value, or NULL.
+ * @param context The pointer passed to callback along with each value.
+ * @return the number of values of the key
+ */
+unsigned int getAll(HashTable* myHashTable, unsigned int key, ValueCallback callback,
+                    void* context);
+
+/**
+ * countKey
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param key The key that corresponds to the values.
+ * @return the number of values of the key
+ */
+unsigned int countKey(HashTable* myHashTable, unsigned int key);
+
+/**
+ * removeAll
+ *
+ * Delete a key and free every value it holds, like deleteItem does with a
+ * single value.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param key The key that corresponds to the values.
+ * @return the number of values freed
+ */
+unsigned int removeAll(HashTable* myHashTable, unsigned int key);
+
+/**
+ * incrementItem
+ *
+ * Add delta to the counter of a key in an HT_LAYOUT_COUNTING table, starting
+ * the key at 0 if it is new. Any number of threads may increment at once:
+ * the key is found or inserted without a lock, and the counter is updated
+ * with one atomic add. Incrementing another layout exits.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param key The key to count.
+ * @param delta The amount to add, which may be negative.
+ */
+void incrementItem(HashTable* myHashTable, unsigned int key, long long delta);
+
+/**
+ * bufferHashTableCounts
+ *
+ * Let each thread add up its increments in a buffer of its own, holding
+ * about slots keys, before they reach an HT_LAYOUT_COUNTING table. A buffer
+ * is flushed in one batch when it is 3/4 full, so increments of a hot key
+ * contend for its counter once per batch instead of once per call. Counts
+ * still in a buffer are not seen by getCount or getItem, and are dropped by
+ * destroyHashTable. A thread has a buffer in each table it increments. Call
+ * this once, before any thread increments.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param slots The number of slots of each thread's buffer, rounded up to
+ *        a power of 2 of at least 8.
+ */
+void bufferHashTableCounts(HashTable* myHashTable, unsigned int slots);
+
+/**
+ * flushHashTableCounts
+ *
+ * Add the increments in the calling thread's buffer to the table, e.g.
+ * before the thread exits or when its counts have to be read. Does nothing
+ * without buffers.
+ *
+ * @param myHashTable The pointer to the hash table.
+ */
+void flushHashTableCounts(HashTable* myHashTable);
+
+/**
+ * getCount
+ *
+ * @param myHashTable The pointer to an HT_LAYOUT_COUNTING table.
+ * @param key The key that was counted.
+ * @return the counter of the key, or 0 if it was never incremented
+ */
+long long getCount(HashTable* myHashTable, unsigned int key);
+
+/**
+ * startHashTableTrace
+ *
+ * Start recording every call to insertItem, insertItemWithTTL, getItem,
+ * removeItem and deleteItem (operation, key and time since the previous
+ * call) into a compact binary trace file, which the trace_replay tool can run
+ * against any table configuration. Each thread records into its own buffer,
+ * and a background thread writes full buffers to the file. Any trace already
+ * being recorded is stopped first.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param path The path of the trace file, which is overwritten.
+ * @return 1 if tracing started, or 0 if the file could not be created
+ */
+int startHashTableTrace(HashTable* myHashTable, const char* path);
+
+/**
+ * stopHashTableTrace
+ *
+ * Flush and close the trace file. No other thread may be using the table.
+ * destroyHashTable does this automatically.
+ *
+ * @param myHashTable The pointer to the hash table.
+ */
+void stopHashTableTrace(HashTable* myHashTable);
+
+/**
+ * enableHashTableLatency
+ *
+ * Start recording the latency of insertItem, insertItemWithTTL, getItem,
+ * removeItem, deleteItem and tickHashTable. One call out of sampleEvery,
+ * counted per thread, reads the monotonic clock before and after the
+ * operation; the result goes into a log-linear histogram (about 3% precision)
+ * owned by the calling thread, so recording never takes a lock. Calling this
+ * again discards the histograms recorded so far.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param sampleEvery Time one call in this many, or 0 to stop recording.
+ */
+void enableHashTableLatency(HashTable* myHashTable, unsigned int sampleEvery);
+
+/**
+ * dumpHashTableLatency
+ *
+ * Merge the latency histograms of every thread and print the number of
+ * samples, p50, p90, p99, p99.9 and max latency of each operation.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param out The stream to print to, e.g. stdout.
+ */
+void dumpHashTableLatency(HashTable* myHashTable, FILE* out);
+
+/**
+ * hashTableReseedCount
+ *
+ * When an insert lands in a bucket that is far longer than the load factor
+ * explains (at least 64 entries, and 16 times the average), the table
+ * assumes somebody is feeding it keys that collide on purpose. It stops
+ * using the hash function given to createHashTable, switches to SipHash
+ * keyed with a random secret, and moves the existing entries over a little
+ * at a time during the following operations. This counts those events, so
+ * that they can be monitored and alerted on.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @return the number of times the table switched to a fresh secret hash
+ */
+unsigned int hashTableReseedCount(HashTable* myHashTable);
+
+/**
+ * hashTableMemoryUsage
+ *
+ * Report the memory the hash table allocated for itself: buckets, entries
+ * and bookkeeping such as TTL timers. The values stored by users and the
+ * overhead of the memory allocator are not included.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @return the number of bytes used by the hash table
+ */
+unsigned long long hashTableMemoryUsage(HashTable* myHashTable);
+
 /**
  * getItem
  *
@@ -99,6 +532,19 @@ void* insertItem(HashTable* myHashTable, unsigned int key, void* value);
  */
 void* getItem(HashTable* myHashTable, unsigned int key);
 
+/**
+ * getItemRef
+ *
+ * Get a pointer to the value of a key where it is stored, in a table created
+ * by createHashTableWithValueSize; the value can be read or updated through
+ * it. Exits for other tables.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param key The key that corresponds to the item.
+ * @return a pointer to the value of the key, or NULL if the key is not present
+ */
+void* getItemRef(HashTable* myHashTable, unsigned int key);
+
 /**
  * removeItem
  *
@@ -124,4 +570,102 @@ void* removeItem(HashTable* myHashTable, unsigned int key);
  */
 void deleteItem(HashTable* myHashTable, unsigned int key);
 
+/**
+ * htIterBegin
+ *
+ * Start iterating over the keys and values of a table, in no particular
+ * order. Every layout is walked in place, bucket by bucket (or page by page,
+ * or slot by slot), prefetching the buckets ahead of the iterator, which
+ * holds only its position. Entries whose TTL has passed are skipped, and in
+ * multimap mode every value of a key is returned as a pair of its own. The
+ * table must not be changed until htIterEnd, except through htIterErase.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @return a pointer to the new iterator
+ */
+HashTableIterator* htIterBegin(HashTable* myHashTable);
+
+/**
+ * htIterNext
+ *
+ * @param iterator The pointer to the iterator.
+ * @param key Set to the key of the next pair.
+ * @param value Set to the value of the next pair, as getItem would return it.
+ * @return 1 if a pair was returned, or 0 if every pair has been
+ */
+int htIterNext(HashTableIterator* iterator, unsigned int* key, void** value);
+
+/**
+ * htIterErase
+ *
+ * Delete the pair last returned by htIterNext, freeing its value like
+ * deleteItem; the iteration carries on with the pair after it. The entry is
+ * removed where the iterator stands, without looking the key up again, and
+ * the layouts that shrink as entries leave (linear and extendible) do not
+ * shrink until a later removal. Exits if no pair was returned yet, if it was
+ * already erased, or, like deleteItem, with a frozen or counting table.
+ *
+ * @param iterator The pointer to the iterator.
+ */
+void htIterErase(HashTableIterator* iterator);
+
+/**
+ * htIterEnd
+ *
+ * Free the iterator. The table may be changed again afterwards.
+ *
+ * @param iterator The pointer to the iterator.
+ */
+void htIterEnd(HashTableIterator* iterator);
+
+/**
+ * forEachItem
+ *
+ * Call a function with every key and value of a table, in no particular
+ * order, like an iteration with htIterBegin and htIterNext but without an
+ * iterator to allocate. The function must not change the table.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param callback The function to call with each key and value.
+ * @param context The pointer passed to callback along with each pair.
+ */
+void forEachItem(HashTable* myHashTable, ItemCallback callback, void* context);
+
+/**
+ * scanHashTable
+ *
+ * Scan a table a few buckets at a time, for walking a live table without
+ * holding it still: start with cursor 0 and pass each returned cursor to the
+ * next call, until one returns 0. The table may change between calls,
+ * however much it grows or shrinks: every pair present from the first call
+ * to the last is returned at least once. Pairs inserted or deleted meanwhile
+ * may or may not be, and a layout that shrank may return a pair twice.
+ *
+ * A cursor means nothing outside the table it came from. Layouts that
+ * double or halve (HT_LAYOUT_HOPSCOTCH, HT_LAYOUT_LINEAR and
+ * HT_LAYOUT_EXTENDIBLE) count buckets from their high bit down, the
+ * reverse-binary order of Redis's SCAN, so that the buckets already scanned
+ * remain so after a resize. The others never move a key and count buckets,
+ * slots or entries in order, except that HT_LAYOUT_CHAINED tables which
+ * reseed after a hash flooding attack (see hashTableReseedCount) walk the
+ * old buckets of the rehash before the new ones. A pair moved meanwhile
+ * may be returned twice, and a reseed between two calls starts the walk of
+ * the new buckets over.
+ *
+ * Each call examines count buckets, so its work is bounded by count and
+ * the length of their chains. Expired entries are skipped, and in multimap
+ * mode every value of a key is returned as a pair of its own. The callback
+ * must not change the table; HT_LAYOUT_HOPSCOTCH and HT_LAYOUT_COUNTING
+ * tables may be changed by other threads during a call.
+ *
+ * @param myHashTable The pointer to the hash table.
+ * @param cursor 0 to start a scan, or the cursor returned by the last call.
+ * @param count The number of buckets to examine; 0 counts as 1.
+ * @param callback The function to call with each key and value.
+ * @param context The pointer passed to callback along with each pair.
+ * @return the cursor to continue from, or 0 when the scan is complete
+ */
+unsigned long long scanHashTable(HashTable* myHashTable, unsigned long long cursor,
+                                 unsigned int count, ItemCallback callback, void* context);
+
 #endif
@@ -0,0 +1,421 @@
+/*
+ HT_LAYOUT_COMPACT: chains linked by 32-bit indices instead of pointers.
+
+ Every entry lives in one contiguous pool. The hot array holds what a chain
+ walk reads, the key and the index of the next entry, in 8 bytes; the values
+ live in a parallel cold array that is only touched once the key matched.
+ That is 16 bytes per entry with no allocator overhead, against 24 bytes
+ plus a malloc header for a HashTableEntry, and a walk reads 8 entries per
+ cache line. Because entries are named by index, the pool can grow with
+ realloc without fixing up any link.
+
+ A table created by createCompactInline stores fixed-size values in the
+ cold array itself instead of pointers to them (createHashTableWithValueSize),
+ so small values need no allocation of their own. The cold array is then a
+ byte array with one value_stride-byte slot per entry.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, realloc and free
+#include <string.h>   // For memcpy
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The index that ends a chain or the free list */
+#define NIL             0xFFFFFFFFu
+
+/** The number of entries the pool starts with */
+#define INITIAL_ENTRIES 16
+
+/**
+ * The part of an entry that chain walks read.
+ */
+typedef struct {
+  /** The key of the entry */
+  unsigned int key;
+
+  /** The index of the next entry of the chain (or of the free list), or NIL */
+  unsigned int next;
+} HotEntry;
+
+/**
+ * This structure represents a compact table.
+ */
+typedef struct {
+  /** The hash function pointer */
+  HashFunction hash;
+
+  /** The number of buckets */
+  unsigned int num_buckets;
+
+  /** The index of the first entry of each bucket, or NIL */
+  unsigned int* heads;
+
+  /** The keys and links of the entries */
+  HotEntry* hot;
+
+  /** The value of each entry, at the same index as in hot: value_stride
+      bytes holding a pointer, or the value itself in an inline table */
+  unsigned char* values;
+
+  /** The size of the values stored inline, or 0 if values are pointers */
+  unsigned int value_size;
+
+  /** The bytes between two values in the cold array */
+  unsigned int value_stride;
+
+  /** The number of entries the pool has room for */
+  unsigned int capacity;
+
+  /** The number of entries of the pool handed out so far, free or not */
+  unsigned int used;
+
+  /** The first entry of the list of removed entries, or NIL */
+  unsigned int free_list;
+} CompactTable;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* valueAt
+*
+* @return The cold slot of an entry
+*/
+static unsigned char* valueAt(CompactTable* table, unsigned int index) {
+    return table->values + (size_t)index * table->value_stride;
+}
+
+/**
+* pointerAt
+*
+* @return The value of an entry of a table whose values are pointers
+*/
+static void* pointerAt(CompactTable* table, unsigned int index) {
+    return *(void**)valueAt(table, index);
+}
+
+/**
+* valueOf
+*
+* @return The value of an entry as getItem returns it: the pointer stored,
+*         or in an inline table where the value is stored
+*/
+static void* valueOf(CompactTable* table, unsigned int index) {
+    return table->value_size ? valueAt(table, index) : pointerAt(table, index);
+}
+
+/**
+* allocateEntry
+*
+* Helper function that takes an entry from the free list, or from the end of
+* the pool, growing the pool when it is full.
+*
+* @return The index of the entry
+*/
+static unsigned int allocateEntry(CompactTable* table) {
+    unsigned int index = table->free_list;
+    if (index != NIL) {
+        table->free_list = table->hot[index].next;
+        return index;
+    }
+    if (table->used == table->capacity) {
+        // indices stay valid when the pool moves
+        table->capacity *= 2;
+        table->hot = (HotEntry*)realloc(table->hot, table->capacity * sizeof(HotEntry));
+        table->values = (unsigned char*)realloc(table->values,
+                                                (size_t)table->capacity * table->value_stride);
+    }
+    return table->used++;
+}
+
+/**
+* findEntry
+*
+* @return The index of the entry of the key, or NIL
+*/
+static unsigned int findEntry(CompactTable* table, unsigned int key) {
+    unsigned int index = table->heads[table->hash(key)];
+    while (index != NIL && table->hot[index].key != key) index = table->hot[index].next;
+    return index;
+}
+
+/**
+* unlinkAt
+*
+* Helper function that takes the entry a link points at out of its chain and
+* puts it on the free list.
+*
+* @return The value of the entry
+*/
+static void* unlinkAt(CompactTable* table, unsigned int* link) {
+    unsigned int index = *link;
+    *link = table->hot[index].next;
+    table->hot[index].next = table->free_list;
+    table->free_list = index;
+    return valueOf(table, index);
+}
+
+/**
+* unlinkKey
+*
+* Helper function that takes the entry of a key out of its chain and puts it
+* on the free list.
+*
+* @return The value of the entry, or NULL if the key is not present
+*/
+static void* unlinkKey(CompactTable* table, unsigned int key) {
+    unsigned int* link = &table->heads[table->hash(key)];
+    while (*link != NIL && table->hot[*link].key != key) link = &table->hot[*link].next;
+    if (*link == NIL) return NULL;
+    return unlinkAt(table, link);
+}
+
+/**
+* createTable
+*
+* Helper function that creates an empty table whose cold slots are stride
+* bytes.
+*/
+static CompactTable* createTable(HashFunction hash, unsigned int numBuckets,
+                                 unsigned int valueSize, unsigned int stride) {
+    CompactTable* table = (CompactTable*)malloc(sizeof(CompactTable));
+    table->hash = hash;
+    table->num_buckets = numBuckets;
+    table->heads = (unsigned int*)malloc(numBuckets * sizeof(unsigned int));
+    unsigned int i;
+    for (i = 0; i < numBuckets; ++i) table->heads[i] = NIL;
+    table->capacity = INITIAL_ENTRIES;
+    table->hot = (HotEntry*)malloc(table->capacity * sizeof(HotEntry));
+    table->value_size = valueSize;
+    table->value_stride = stride;
+    table->values = (unsigned char*)malloc((size_t)table->capacity * stride);
+    table->used = 0;
+    table->free_list = NIL;
+    return table;
+}
+
+/**
+* compactCreate
+*/
+static void* compactCreate(HashFunction hash, unsigned int numBuckets) {
+    return createTable(hash, numBuckets, 0, sizeof(void*));
+}
+
+/**
+* compactDestroy
+*/
+static void compactDestroy(void* state) {
+    CompactTable* table = (CompactTable*)state;
+    // free the values of the entries still linked from a bucket, unless
+    // they are stored inline
+    unsigned int i;
+    for (i = 0; i < table->num_buckets && !table->value_size; ++i) {
+        unsigned int index;
+        for (index = table->heads[i]; index != NIL; index = table->hot[index].next) {
+            free(pointerAt(table, index));
+        }
+    }
+    free(table->heads);
+    free(table->hot);
+    free(table->values);
+    free(table);
+}
+
+/**
+* pushEntry
+*
+* Helper function that links a new entry for a key that is not present at
+* the head of its bucket.
+*
+* @return The index of the entry, whose value is left to the caller
+*/
+static unsigned int pushEntry(CompactTable* table, unsigned int key) {
+    unsigned int bucketIndex = table->hash(key);
+    unsigned int index = allocateEntry(table);
+    table->hot[index].key = key;
+    table->hot[index].next = table->heads[bucketIndex];
+    table->heads[bucketIndex] = index;
+    return index;
+}
+
+/**
+* compactInsert
+*/
+static void* compactInsert(void* state, unsigned int key, void* value) {
+    CompactTable* table = (CompactTable*)state;
+    // overwrite a present key
+    unsigned int index = findEntry(table, key);
+    if (index != NIL) {
+        void* previousValue = pointerAt(table, index);
+        *(void**)valueAt(table, index) = value;
+        return previousValue;
+    }
+    // or push a new entry on the head of the bucket
+    index = pushEntry(table, key);
+    *(void**)valueAt(table, index) = value;
+    return NULL;
+}
+
+/**
+* compactGet
+*/
+static void* compactGet(void* state, unsigned int key) {
+    CompactTable* table = (CompactTable*)state;
+    unsigned int index = findEntry(table, key);
+    return index == NIL ? NULL : valueOf(table, index);
+}
+
+/**
+* compactRemove
+*/
+static void* compactRemove(void* state, unsigned int key) {
+    return unlinkKey((CompactTable*)state, key);
+}
+
+/**
+* compactErase
+*/
+static void compactErase(void* state, unsigned int key) {
+    CompactTable* table = (CompactTable*)state;
+    void* value = unlinkKey(table, key);
+    if (!table->value_size) free(value);
+}
+
+/**
+* compactMemory
+*/
+static unsigned long long compactMemory(void* state) {
+    CompactTable* table = (CompactTable*)state;
+    return sizeof(CompactTable) +
+           (unsigned long long)table->num_buckets * sizeof(unsigned int) +
+           (unsigned long long)table->capacity * (sizeof(HotEntry) + table->value_stride);
+}
+
+
+/**
+* compactVisit
+*/
+static void compactVisit(void* state, EntryVisitor visitor, void* context) {
+    CompactTable* table = (CompactTable*)state;
+    unsigned int i;
+    for (i = 0; i < table->num_buckets; ++i) {
+        unsigned int index;
+        for (index = table->heads[i]; index != NIL; index = table->hot[index].next) {
+            visitor(context, table->hot[index].key, valueOf(table, index));
+        }
+    }
+}
+
+/**
+* compactScan
+*
+* The bucket count never changes, so the cursor is a bucket index.
+*/
+static unsigned long long compactScan(void* state, unsigned long long cursor, unsigned int count,
+                                      EntryVisitor visitor, void* context) {
+    CompactTable* table = (CompactTable*)state;
+    for (; count && cursor < table->num_buckets; --count, ++cursor) {
+        unsigned int index;
+        for (index = table->heads[cursor]; index != NIL; index = table->hot[index].next) {
+            visitor(context, table->hot[index].key, valueOf(table, index));
+        }
+    }
+    return cursor < table->num_buckets ? cursor : 0;
+}
+
+/**
+* compactNext
+*
+* The position holds the link to the current entry: a bucket head or the
+* next index of the entry before it. The pool does not move while the table
+* is iterated, since nothing is inserted.
+*/
+static int compactNext(void* state, EnginePosition* position, unsigned int* key, void** value) {
+    CompactTable* table = (CompactTable*)state;
+    unsigned int* link = (unsigned int*)position->node;
+    if (!position->started) {
+        position->started = 1;
+        link = &table->heads[0];
+    } else if (!position->erased) {
+        link = &table->hot[*link].next;
+    }
+    position->erased = 0;
+    while (*link == NIL) {
+        if (position->bucket + 1 >= table->num_buckets) {
+            // stay at the end
+            position->node = link;
+            position->erased = 1;
+            return 0;
+        }
+        unsigned long long ahead = ++position->bucket + PREFETCH_BUCKETS;
+        if (ahead < table->num_buckets && table->heads[ahead] != NIL) {
+            __builtin_prefetch(&table->hot[table->heads[ahead]]);
+        }
+        link = &table->heads[position->bucket];
+    }
+    position->node = link;
+    HotEntry* entry = &table->hot[*link];
+    if (entry->next != NIL) __builtin_prefetch(&table->hot[entry->next]);
+    *key = entry->key;
+    *value = valueOf(table, *link);
+    return 1;
+}
+
+/**
+* compactEraseAt
+*/
+static void compactEraseAt(void* state, EnginePosition* position) {
+    CompactTable* table = (CompactTable*)state;
+    void* value = unlinkAt(table, (unsigned int*)position->node);
+    if (!table->value_size) free(value);
+    position->erased = 1;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+const HashTableEngine compactEngine = {
+  compactCreate,
+  compactDestroy,
+  compactInsert,
+  compactGet,
+  compactRemove,
+  compactErase,
+  compactMemory,
+  compactVisit,
+  compactScan,
+  compactNext,
+  compactEraseAt
+};
+
+void* createCompactInline(HashFunction hash, unsigned int numBuckets, unsigned int valueSize) {
+    // keep values aligned: to 8 bytes, or to their size rounded up to a
+    // power of 2 if they are smaller
+    unsigned int stride = (valueSize + 7) & ~7u;
+    if (valueSize < 8) {
+        stride = 1;
+        while (stride < valueSize) stride *= 2;
+    }
+    return createTable(hash, numBuckets, valueSize, stride);
+}
+
+void* compactInsertCopy(void* state, unsigned int key, const void* bytes) {
+    CompactTable* table = (CompactTable*)state;
+    unsigned int index = findEntry(table, key);
+    if (index == NIL) index = pushEntry(table, key);
+    memcpy(valueAt(table, index), bytes, table->value_size);
+    return valueAt(table, index);
+}
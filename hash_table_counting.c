@@ -0,0 +1,496 @@
+/*
+ HT_LAYOUT_COUNTING: a lock-free map from keys to 64-bit counters, for
+ counting events per key from many threads.
+
+ The counters live in the slots, next to their keys, and incrementItem is a
+ find-or-insert followed by an atomic add, neither of which takes a lock.
+ Keys are never moved or removed, which is what makes that simple: a slot
+ goes from empty to holding a key once, with a compare-and-swap, and then
+ only its counter changes.
+
+ The table is a list of submaps, each an open addressing array twice the
+ size of the previous one (as in folly's AtomicHashMap). A key is looked up
+ by linear probing over at most MAX_PROBES slots of each submap in turn, and
+ inserted into the first empty slot it meets. When every probed slot of the
+ last submap is taken, the next submap is allocated and published with a
+ compare-and-swap; the existing keys stay where they are. Since slots are
+ never emptied, all threads agree on the first empty slot of a probe
+ sequence, so a key can never end up in two slots.
+
+ Each thread may also add up its increments in a small buffer of its own
+ (bufferHashTableCounts), which is flushed into the table in one batch when
+ it fills up, so a hot key costs one atomic add per batch rather than one
+ per increment.
+
+ The submaps outgrow the bucket count the user asked for, which the user's
+ HashFunction (returning indices below that count) cannot address, so the
+ slots come from mixKey instead.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, calloc and free
+#include <stdio.h>    // For printf
+#include <string.h>   // For memset
+#include <pthread.h>  // For the mutex of the thread buffers
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The number of slots of a submap searched before moving to the next */
+#define MAX_PROBES        32
+
+/** The most submaps a table can have; the last one has 2^(MAX_SUBMAPS - 1)
+    times as many slots as the first */
+#define MAX_SUBMAPS       24
+
+/** The fewest slots of the first submap */
+#define MIN_SLOTS         64
+
+/** The fewest slots of a thread buffer */
+#define MIN_BUFFER_SLOTS  8
+
+/** The tag of a slot holding key: the key with bit 32 set, so that the tag
+    of an empty slot, 0, is never a key's */
+#define TAG(key)          ((1ULL << 32) | (key))
+
+/**
+ * A key and its counter, 16 bytes. Also the slot of a thread buffer, where
+ * count is the increment not flushed yet.
+ */
+typedef struct {
+  /** TAG(key), or 0 for an empty slot */
+  unsigned long long tag;
+
+  /** The counter */
+  long long count;
+} CounterSlot;
+
+/**
+ * The buffer of one thread.
+ */
+typedef struct _ThreadCounts {
+  /** The thread that owns this buffer */
+  pthread_t thread;
+
+  /** The slots, buffer_slots of them */
+  CounterSlot* slots;
+
+  /** The number of keys in the slots */
+  unsigned int used;
+
+  /** The next thread of the same table */
+  struct _ThreadCounts* next;
+} ThreadCounts;
+
+/**
+ * This structure represents a counting table.
+ */
+typedef struct {
+  /** The submaps allocated so far, in order; NULL after the last one */
+  CounterSlot* submaps[MAX_SUBMAPS];
+
+  /** The number of slots of the first submap, a power of 2 */
+  unsigned int first_slots;
+
+  /** A number that is never reused, identifying this table to threads */
+  unsigned long long id;
+
+  /** The number of slots of each thread buffer, a power of 2, or 0 if
+      increments go straight to the table */
+  unsigned int buffer_slots;
+
+  /** Protects the list of thread buffers */
+  pthread_mutex_t lock;
+
+  /** The buffer of every thread that incremented a key while buffering */
+  ThreadCounts* threads;
+} CountingTable;
+
+/** The source of table ids */
+static unsigned long long nextTableId = 1;
+
+/** The buffer the calling thread last used, and the table it belongs to.
+    It is only valid while threadTableId matches a live table. */
+static _Thread_local unsigned long long threadTableId;
+static _Thread_local ThreadCounts* threadCounts;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* submapSlots
+*
+* @return The number of slots of submap i
+*/
+static unsigned long long submapSlots(CountingTable* table, unsigned int i) {
+    return (unsigned long long)table->first_slots << i;
+}
+
+/**
+* addSubmap
+*
+* Helper function that allocates submap i, unless another thread did first.
+*
+* @return The submap
+*/
+static CounterSlot* addSubmap(CountingTable* table, unsigned int i) {
+    if (i == MAX_SUBMAPS) {
+        printf("Counting hash table is full...\n");
+        exit(1);
+    }
+    CounterSlot* fresh = (CounterSlot*)calloc(submapSlots(table, i), sizeof(CounterSlot));
+    CounterSlot* expected = NULL;
+    // the zeroed slots are visible to whoever sees the pointer
+    if (__atomic_compare_exchange_n(&table->submaps[i], &expected, fresh, 0,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        return fresh;
+    }
+    free(fresh);
+    return expected;
+}
+
+/**
+* findSlot
+*
+* Helper function that finds the slot of a key, claiming one if it has none
+* and insert is set.
+*
+* @return The slot of the key, or NULL if it has none and insert is not set
+*/
+static CounterSlot* findSlot(CountingTable* table, unsigned int key, int insert) {
+    unsigned long long tag = TAG(key);
+    unsigned int home = mixKey(key);
+    unsigned int i, probe;
+    for (i = 0; i <= MAX_SUBMAPS; ++i) {
+        CounterSlot* slots = i < MAX_SUBMAPS ? __atomic_load_n(&table->submaps[i], __ATOMIC_ACQUIRE)
+                                             : NULL;
+        if (!slots) {
+            if (!insert) return NULL;
+            slots = addSubmap(table, i);
+        }
+        unsigned long long mask = submapSlots(table, i) - 1;
+        for (probe = 0; probe < MAX_PROBES; ++probe) {
+            CounterSlot* slot = &slots[(home + probe) & mask];
+            unsigned long long current = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+            if (current == tag) return slot;
+            if (current != 0) continue;
+            // slots are never emptied, so the key cannot be further along
+            if (!insert) return NULL;
+            if (__atomic_compare_exchange_n(&slot->tag, &current, tag, 0,
+                                            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                return slot;
+            }
+            // another thread took the slot, maybe for the same key
+            if (current == tag) return slot;
+        }
+    }
+    return NULL;
+}
+
+/**
+* addCount
+*
+* Helper function that adds delta to the counter of a key in the table.
+*/
+static void addCount(CountingTable* table, unsigned int key, long long delta) {
+    CounterSlot* slot = findSlot(table, key, 1);
+    __atomic_fetch_add(&slot->count, delta, __ATOMIC_RELAXED);
+}
+
+/**
+* flushBuffer
+*
+* Helper function that adds the increments of a thread buffer to the table
+* and empties the buffer.
+*/
+static void flushBuffer(CountingTable* table, ThreadCounts* buffer) {
+    unsigned int i;
+    for (i = 0; i < table->buffer_slots; ++i) {
+        CounterSlot* slot = &buffer->slots[i];
+        if (slot->tag && slot->count) addCount(table, (unsigned int)slot->tag, slot->count);
+    }
+    memset(buffer->slots, 0, table->buffer_slots * sizeof(CounterSlot));
+    buffer->used = 0;
+}
+
+/**
+* attachThread
+*
+* Helper function that finds the calling thread's buffer for this table,
+* creating it on first use, and caches it in thread-local storage. A thread
+* switching between tables finds its buffer again, with its counts.
+*/
+static ThreadCounts* attachThread(CountingTable* table) {
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&table->lock);
+    ThreadCounts* buffer = table->threads;
+    while (buffer && !pthread_equal(buffer->thread, self)) buffer = buffer->next;
+    if (!buffer) {
+        buffer = (ThreadCounts*)malloc(sizeof(ThreadCounts));
+        buffer->thread = self;
+        buffer->slots = (CounterSlot*)calloc(table->buffer_slots, sizeof(CounterSlot));
+        buffer->used = 0;
+        buffer->next = table->threads;
+        table->threads = buffer;
+    }
+    pthread_mutex_unlock(&table->lock);
+
+    threadTableId = table->id;
+    threadCounts = buffer;
+    return buffer;
+}
+
+/**
+* bufferCount
+*
+* Helper function that adds delta to the calling thread's buffer, flushing
+* the buffer first if the key does not fit.
+*/
+static void bufferCount(CountingTable* table, unsigned int key, long long delta) {
+    ThreadCounts* buffer = threadTableId == table->id ? threadCounts : attachThread(table);
+    unsigned long long tag = TAG(key);
+    unsigned int mask = table->buffer_slots - 1;
+    unsigned int home = mixKey(key);
+    unsigned int probe;
+    // past 3/4 full, probes get long: flush and start over
+    if (buffer->used >= table->buffer_slots / 4 * 3) flushBuffer(table, buffer);
+    for (probe = 0; ; ++probe) {
+        CounterSlot* slot = &buffer->slots[(home + probe) & mask];
+        if (slot->tag == tag) {
+            slot->count += delta;
+            return;
+        }
+        if (slot->tag == 0) {
+            slot->tag = tag;
+            slot->count = delta;
+            buffer->used++;
+            return;
+        }
+    }
+}
+
+/**
+* countingCreate
+*/
+static void* countingCreate(HashFunction hash, unsigned int numBuckets) {
+    (void)hash;
+    CountingTable* table = (CountingTable*)calloc(1, sizeof(CountingTable));
+    table->first_slots = MIN_SLOTS;
+    while (table->first_slots < numBuckets && table->first_slots < (1u << 30)) table->first_slots *= 2;
+    table->submaps[0] = (CounterSlot*)calloc(table->first_slots, sizeof(CounterSlot));
+    table->id = __atomic_fetch_add(&nextTableId, 1, __ATOMIC_RELAXED);
+    pthread_mutex_init(&table->lock, NULL);
+    return table;
+}
+
+/**
+* countingDestroy
+*
+* Counts still in thread buffers go away with the table, unflushed.
+*/
+static void countingDestroy(void* state) {
+    CountingTable* table = (CountingTable*)state;
+    unsigned int i;
+    for (i = 0; i < MAX_SUBMAPS; ++i) free(table->submaps[i]);
+    while (table->threads) {
+        ThreadCounts* buffer = table->threads;
+        table->threads = buffer->next;
+        free(buffer->slots);
+        free(buffer);
+    }
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
+
+/**
+* countingInsert
+*/
+static void* countingInsert(void* state, unsigned int key, void* value) {
+    (void)state; (void)key; (void)value;
+    printf("insertItem is not supported by a counting hash table, use incrementItem...\n");
+    exit(1);
+}
+
+/**
+* countingGet
+*
+* The "value" of a key is its counter.
+*/
+static void* countingGet(void* state, unsigned int key) {
+    CounterSlot* slot = findSlot((CountingTable*)state, key, 0);
+    return slot ? &slot->count : NULL;
+}
+
+/**
+* countingRemove
+*/
+static void* countingRemove(void* state, unsigned int key) {
+    (void)state; (void)key;
+    printf("removeItem is not supported by a counting hash table...\n");
+    exit(1);
+}
+
+/**
+* countingErase
+*/
+static void countingErase(void* state, unsigned int key) {
+    (void)state; (void)key;
+    printf("deleteItem is not supported by a counting hash table...\n");
+    exit(1);
+}
+
+/**
+* countingMemory
+*/
+static unsigned long long countingMemory(void* state) {
+    CountingTable* table = (CountingTable*)state;
+    unsigned long long bytes = sizeof(CountingTable);
+    unsigned int i;
+    for (i = 0; i < MAX_SUBMAPS && __atomic_load_n(&table->submaps[i], __ATOMIC_ACQUIRE); ++i) {
+        bytes += submapSlots(table, i) * sizeof(CounterSlot);
+    }
+    pthread_mutex_lock(&table->lock);
+    ThreadCounts* buffer;
+    for (buffer = table->threads; buffer; buffer = buffer->next) {
+        bytes += sizeof(ThreadCounts) + table->buffer_slots * sizeof(CounterSlot);
+    }
+    pthread_mutex_unlock(&table->lock);
+    return bytes;
+}
+
+/**
+* countingVisit
+*
+* The "value" of each key is a pointer to its counter.
+*/
+static void countingVisit(void* state, EntryVisitor visitor, void* context) {
+    CountingTable* table = (CountingTable*)state;
+    unsigned int i;
+    unsigned long long j;
+    for (i = 0; i < MAX_SUBMAPS && table->submaps[i]; ++i) {
+        for (j = 0; j < submapSlots(table, i); ++j) {
+            CounterSlot* slot = &table->submaps[i][j];
+            if (slot->tag) visitor(context, (unsigned int)slot->tag, &slot->count);
+        }
+    }
+}
+
+/**
+* countingScan
+*
+* Keys never move, so the cursor is a slot position across the submaps, one
+* after another. Safe to call while other threads increment.
+*/
+static unsigned long long countingScan(void* state, unsigned long long cursor, unsigned int count,
+                                       EntryVisitor visitor, void* context) {
+    CountingTable* table = (CountingTable*)state;
+    unsigned long long start = 0;
+    unsigned int i = 0;
+    // the submap the cursor is in
+    while (i < MAX_SUBMAPS && cursor >= start + submapSlots(table, i)) start += submapSlots(table, i++);
+    for (; count; --count, ++cursor) {
+        if (cursor == start + submapSlots(table, i)) start += submapSlots(table, i++);
+        CounterSlot* slots = i < MAX_SUBMAPS ? __atomic_load_n(&table->submaps[i], __ATOMIC_ACQUIRE)
+                                             : NULL;
+        if (!slots) return 0;
+        CounterSlot* slot = &slots[cursor - start];
+        unsigned long long tag = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+        if (tag) visitor(context, (unsigned int)tag, &slot->count);
+    }
+    return cursor;
+}
+
+/**
+* countingNext
+*
+* The position is a submap and a slot in it, read in order like the cursor
+* of countingScan. The "value" of each key is a pointer to its counter.
+*/
+static int countingNext(void* state, EnginePosition* position, unsigned int* key, void** value) {
+    CountingTable* table = (CountingTable*)state;
+    if (!position->started) {
+        position->started = 1;
+    } else {
+        position->bucket++;
+    }
+    for (; position->index < MAX_SUBMAPS; position->index++, position->bucket = 0) {
+        CounterSlot* slots = __atomic_load_n(&table->submaps[position->index], __ATOMIC_ACQUIRE);
+        if (!slots) break;
+        for (; position->bucket < submapSlots(table, position->index); position->bucket++) {
+            CounterSlot* slot = &slots[position->bucket];
+            unsigned long long tag = __atomic_load_n(&slot->tag, __ATOMIC_ACQUIRE);
+            if (!tag) continue;
+            *key = (unsigned int)tag;
+            *value = &slot->count;
+            return 1;
+        }
+    }
+    // the next call starts here again, in case another thread added a submap
+    position->bucket--;
+    return 0;
+}
+
+/**
+* countingEraseAt
+*/
+static void countingEraseAt(void* state, EnginePosition* position) {
+    (void)state; (void)position;
+    printf("htIterErase is not supported by a counting hash table...\n");
+    exit(1);
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+const HashTableEngine countingEngine = {
+  countingCreate,
+  countingDestroy,
+  countingInsert,
+  countingGet,
+  countingRemove,
+  countingErase,
+  countingMemory,
+  countingVisit,
+  countingScan,
+  countingNext,
+  countingEraseAt
+};
+
+void countingIncrement(void* state, unsigned int key, long long delta) {
+    CountingTable* table = (CountingTable*)state;
+    if (table->buffer_slots) bufferCount(table, key, delta);
+    else addCount(table, key, delta);
+}
+
+void countingSetBuffer(void* state, unsigned int slots) {
+    CountingTable* table = (CountingTable*)state;
+    if (table->buffer_slots || table->threads) {
+        printf("Counting buffers can only be enabled once...\n");
+        exit(1);
+    }
+    unsigned int size = MIN_BUFFER_SLOTS;
+    while (size < slots && size < (1u << 20)) size *= 2;
+    table->buffer_slots = slots ? size : 0;
+}
+
+void countingFlush(void* state) {
+    CountingTable* table = (CountingTable*)state;
+    if (!table->buffer_slots) return;
+    flushBuffer(table, threadTableId == table->id ? threadCounts : attachThread(table));
+}
+
+long long countingCount(void* state, unsigned int key) {
+    CounterSlot* slot = findSlot((CountingTable*)state, key, 0);
+    return slot ? __atomic_load_n(&slot->count, __ATOMIC_RELAXED) : 0;
+}
@@ -0,0 +1,185 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef HASHTABLEENGINE_H
+#define HASHTABLEENGINE_H
+
+#include "hash_table.h"
+
+/****************************************************************************
+ * Hash Table Engines
+ *
+ * This interface is private to the hash table implementation. Every layout
+ * other than HT_LAYOUT_CHAINED is an engine: a table of function pointers
+ * that hash_table.c calls from the public functions, after tracing and
+ * latency recording, which therefore work the same for every layout.
+ *
+ * Each engine lives in its own hash_table_<layout>.c file. Engines own the
+ * values stored in them exactly like the chained layout does: destroy and
+ * erase free them, remove hands them back.
+ ***************************************************************************/
+
+/**
+ * A function called with each entry of a table by an engine's visit.
+ */
+typedef void (*EntryVisitor)(void* context, unsigned int key, void* value);
+
+/** How many buckets ahead of an iterator the chains are prefetched */
+#define PREFETCH_BUCKETS      4
+
+/**
+ * Where an iteration over an engine table stands (htIterBegin). What the
+ * fields hold is up to each engine; a zeroed position is before the first
+ * entry.
+ */
+typedef struct {
+  /** The bucket, slot or directory slot of the current entry */
+  unsigned long long bucket;
+
+  /** The node, page or link the current entry is reached through */
+  void* node;
+
+  /** The place of the current entry in the node or page, or its submap */
+  unsigned int index;
+
+  /** 1 once the first entry was looked for */
+  int started;
+
+  /** 1 if the entry last returned was erased, and the position already
+      designates the one to return next */
+  int erased;
+} EnginePosition;
+
+/**
+ * The operations of one layout. state is whatever create returned.
+ */
+typedef struct _HashTableEngine {
+  /** Creates an empty table */
+  void* (*create)(HashFunction hash, unsigned int numBuckets);
+
+  /** Frees the table and every value in it */
+  void (*destroy)(void* state);
+
+  /** Stores a value, returning the value it replaced or NULL (insertItem) */
+  void* (*insert)(void* state, unsigned int key, void* value);
+
+  /** Returns the value of a key or NULL (getItem) */
+  void* (*get)(void* state, unsigned int key);
+
+  /** Takes a key out and returns its value, or NULL (removeItem) */
+  void* (*remove)(void* state, unsigned int key);
+
+  /** Takes a key out and frees its value (deleteItem) */
+  void (*erase)(void* state, unsigned int key);
+
+  /** The bytes allocated by the table, values excluded */
+  unsigned long long (*memory)(void* state);
+
+  /** Calls visitor with every entry, in no particular order. The table
+      must not change meanwhile. */
+  void (*visit)(void* state, EntryVisitor visitor, void* context);
+
+  /** Calls visitor with the entries of the next count (at least 1) buckets
+      from cursor on, and returns the cursor to continue from, or 0 once
+      every bucket was scanned (scanHashTable). Cursor 0 starts a scan. */
+  unsigned long long (*scan)(void* state, unsigned long long cursor, unsigned int count,
+                             EntryVisitor visitor, void* context);
+
+  /** Moves a position to the next entry, bucket by bucket with the buckets
+      ahead prefetched, and returns 1 with its key and value, or 0 once
+      every entry was returned (htIterNext). The table must not change
+      meanwhile, except through eraseAt. */
+  int (*next)(void* state, EnginePosition* position, unsigned int* key, void** value);
+
+  /** Takes out the entry next last returned and frees its value, where the
+      position stands rather than by key, and leaves the position so that
+      next carries on with the entries not returned yet (htIterErase).
+      Tables that shrink as entries leave do not while iterated. */
+  void (*eraseAt)(void* state, EnginePosition* position);
+} HashTableEngine;
+
+/**
+ * mixKey
+ *
+ * The murmur3 finalizer: a full 32-bit hash of a key. Engines that grow past
+ * the bucket count given to create place keys with it, since the user's
+ * HashFunction only returns indices below that count.
+ */
+static inline unsigned int mixKey(unsigned int key) {
+    key ^= key >> 16;
+    key *= 0x85ebca6bu;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35u;
+    key ^= key >> 16;
+    return key;
+}
+
+/**
+ * reverseBits
+ *
+ * @return The bits of a 64-bit word in reverse order
+ */
+static inline unsigned long long reverseBits(unsigned long long v) {
+    v = ((v >> 1) & 0x5555555555555555ULL) | ((v & 0x5555555555555555ULL) << 1);
+    v = ((v >> 2) & 0x3333333333333333ULL) | ((v & 0x3333333333333333ULL) << 2);
+    v = ((v >> 4) & 0x0F0F0F0F0F0F0F0FULL) | ((v & 0x0F0F0F0F0F0F0F0FULL) << 4);
+    return __builtin_bswap64(v);
+}
+
+/**
+ * nextCursor
+ *
+ * The scan cursor after bucket cursor & mask, for engines whose bucket count
+ * is mask + 1, a power of two that can change between calls. The cursor is
+ * incremented from its high bit down, so the buckets scanned so far are those
+ * whose index ends in one of the bit patterns already counted. Doubling the
+ * table splits each bucket in two that end in the same pattern, and halving
+ * it merges two such buckets: either way the buckets scanned stay scanned
+ * and the others stay ahead of the cursor, so a key present throughout the
+ * scan is returned at least once, and only a shrink can return it again.
+ * Wraps to 0 after the last bucket.
+ */
+static inline unsigned long long nextCursor(unsigned long long cursor, unsigned long long mask) {
+    cursor |= ~mask;
+    cursor = reverseBits(cursor);
+    cursor++;
+    return reverseBits(cursor);
+}
+
+/** The engine of each layout, defined in hash_table_<layout>.c */
+extern const HashTableEngine compactEngine;
+extern const HashTableEngine unrolledEngine;
+extern const HashTableEngine inlineEngine;
+extern const HashTableEngine hopscotchEngine;
+extern const HashTableEngine linearEngine;
+extern const HashTableEngine extendibleEngine;
+extern const HashTableEngine countingEngine;
+
+/** The engine of tables frozen by freezeHashTable, which has no create */
+extern const HashTableEngine frozenEngine;
+
+/** The state of a frozenEngine table holding count entries, built from
+    parallel arrays of distinct keys and their values (hash_table_frozen.c).
+    The arrays stay the caller's; the values become the table's. */
+void* createFrozenState(const unsigned int* keys, void* const* values, unsigned int count);
+
+/** The state of an extendibleEngine table whose pages are in a file, or NULL
+    if the file cannot be opened (hash_table_extendible.c) */
+void* createExtendibleFile(const char* path);
+
+/** The state of a compactEngine table storing values of valueSize bytes
+    inline, and the insert that copies a value into it, returning where the
+    copy is (hash_table_compact.c). get hands out that address, and destroy
+    and erase have no value to free */
+void* createCompactInline(HashFunction hash, unsigned int numBuckets, unsigned int valueSize);
+void* compactInsertCopy(void* state, unsigned int key, const void* bytes);
+
+/** The operations of countingEngine tables behind incrementItem,
+    bufferHashTableCounts, flushHashTableCounts and getCount
+    (hash_table_counting.c) */
+void countingIncrement(void* state, unsigned int key, long long delta);
+void countingSetBuffer(void* state, unsigned int slots);
+void countingFlush(void* state);
+long long countingCount(void* state, unsigned int key);
+
+#endif
@@ -0,0 +1,578 @@
+/*
+ HT_LAYOUT_EXTENDIBLE: extendible hashing over 4 KB pages, in memory or in a
+ file (createHashTableInFile).
+
+ Entries live in fixed-size pages of PAGE_ENTRIES keys and values. A
+ directory of 2^global_depth page numbers maps the low global_depth bits of a
+ key's hash to its page; a page with local depth d is shared by the
+ 2^(global_depth - d) directory slots that agree on the low d bits. When a
+ page is full, only that page is split: its entries are divided between it
+ and one new page by bit d, both get local depth d + 1, and the directory is
+ doubled first if d was already the global depth, which copies page numbers
+ but moves no entry. A removal that leaves a page and its buddy (the page
+ differing in bit d - 1) at most half full merges them back, and the
+ directory halves once no page needs its full depth.
+
+ Pages are only ever read and written whole, through loadPage and storePage,
+ so the same code runs over an array of pages in memory or over a file with
+ pread and pwrite. In a file only the directory stays in memory. The values
+ are still pointers owned by the table, so the file is scratch space for
+ this process: it is truncated on creation and means nothing afterwards.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, calloc, realloc and free
+#include <stdio.h>    // For printf
+#include <string.h>   // For memcmp and memset
+#include <fcntl.h>    // For open
+#include <unistd.h>   // For pread, pwrite and close
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The size of a page, in memory and on file */
+#define PAGE_SIZE       4096
+
+/** The number of entries in a page: a header and 12 bytes per entry */
+#define PAGE_ENTRIES    340
+
+/** The deepest directory, 2^MAX_DEPTH slots */
+#define MAX_DEPTH       30
+
+/**
+ * A page. Keys and values are kept apart so a search reads only the keys.
+ */
+typedef struct {
+  /** The number of low hash bits all the keys of this page share */
+  unsigned int local_depth;
+
+  /** The number of entries */
+  unsigned int count;
+
+  /** The keys of the entries; only the first count are valid */
+  unsigned int keys[PAGE_ENTRIES];
+
+  /** The values, at the same position as their key */
+  void* values[PAGE_ENTRIES];
+} Page;
+
+/** A page buffer of exactly PAGE_SIZE bytes */
+typedef union {
+  Page page;
+  char bytes[PAGE_SIZE];
+} PageBuffer;
+
+/** Fails to compile if a page does not fit in PAGE_SIZE */
+typedef char pageFitsCheck[sizeof(Page) <= PAGE_SIZE ? 1 : -1];
+
+/**
+ * This structure represents an extendible hashing table.
+ */
+typedef struct {
+  /** The page number of each directory slot */
+  unsigned int* directory;
+
+  /** log2 of the number of directory slots */
+  unsigned int global_depth;
+
+  /** The pages by number when in memory, or NULL when in a file */
+  PageBuffer** pages;
+
+  /** The file descriptor of the page file, or -1 when in memory */
+  int fd;
+
+  /** The number of page numbers handed out, in use or free */
+  unsigned int num_pages;
+
+  /** The page numbers freed by merges, reused before new ones */
+  unsigned int* free_pages;
+  unsigned int num_free;
+
+  /** Two scratch buffers for file pages: a page and its split or buddy, or
+      the page an iteration is at */
+  PageBuffer* buffers;
+
+  /** The number of entries */
+  unsigned int num_entries;
+} ExtendibleTable;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* loadPage
+*
+* Helper function that gives access to a page: the page itself in memory, or
+* a copy read into one of the scratch buffers from the file.
+*
+* @param buffer Which scratch buffer to use, 0 or 1
+*/
+static Page* loadPage(ExtendibleTable* table, unsigned int number, int buffer) {
+    if (table->fd < 0) return &table->pages[number]->page;
+    PageBuffer* copy = &table->buffers[buffer];
+    if (pread(table->fd, copy->bytes, PAGE_SIZE, (off_t)number * PAGE_SIZE) != PAGE_SIZE) {
+        printf("Cannot read page %u of the hash table file...\n", number);
+        exit(1);
+    }
+    return &copy->page;
+}
+
+/**
+* storePage
+*
+* Helper function that writes a page loaded with loadPage back to the file.
+* Pages in memory were changed in place already.
+*/
+static void storePage(ExtendibleTable* table, unsigned int number, Page* page) {
+    if (table->fd < 0) return;
+    if (pwrite(table->fd, page, PAGE_SIZE, (off_t)number * PAGE_SIZE) != PAGE_SIZE) {
+        printf("Cannot write page %u of the hash table file...\n", number);
+        exit(1);
+    }
+}
+
+/**
+* allocatePage
+*
+* Helper function that takes a free page number and gives access to an empty
+* page for it, in the given scratch buffer when in a file.
+*/
+static Page* allocatePage(ExtendibleTable* table, unsigned int* number, int buffer) {
+    if (table->num_free) {
+        *number = table->free_pages[--table->num_free];
+    } else {
+        *number = table->num_pages++;
+        if (table->fd < 0) {
+            table->pages = (PageBuffer**)realloc(table->pages, table->num_pages * sizeof(PageBuffer*));
+            table->pages[*number] = NULL;
+        }
+    }
+    if (table->fd >= 0) {
+        memset(&table->buffers[buffer], 0, PAGE_SIZE);
+        return &table->buffers[buffer].page;
+    }
+    table->pages[*number] = (PageBuffer*)calloc(1, PAGE_SIZE);
+    return &table->pages[*number]->page;
+}
+
+/**
+* releasePage
+*/
+static void releasePage(ExtendibleTable* table, unsigned int number) {
+    if (table->fd < 0) {
+        free(table->pages[number]);
+        table->pages[number] = NULL;
+    }
+    table->free_pages = (unsigned int*)realloc(table->free_pages,
+                                               (table->num_free + 1) * sizeof(unsigned int));
+    table->free_pages[table->num_free++] = number;
+}
+
+/**
+* slotOf
+*
+* @return The directory slot of a key
+*/
+static unsigned int slotOf(ExtendibleTable* table, unsigned int key) {
+    return mixKey(key) & ((1u << table->global_depth) - 1);
+}
+
+/**
+* findKey
+*
+* @return The position of a key in a page, or -1
+*/
+static int findKey(Page* page, unsigned int key) {
+    unsigned int i;
+    for (i = 0; i < page->count; ++i) {
+        if (page->keys[i] == key) return (int)i;
+    }
+    return -1;
+}
+
+/**
+* pointSlots
+*
+* Helper function that points every directory slot agreeing with slot on the
+* low depth bits at a page.
+*/
+static void pointSlots(ExtendibleTable* table, unsigned int slot, unsigned int depth,
+                       unsigned int number) {
+    unsigned int step = 1u << depth;
+    unsigned int i;
+    for (i = slot & (step - 1); i < (1u << table->global_depth); i += step) {
+        table->directory[i] = number;
+    }
+}
+
+/**
+* splitPage
+*
+* Helper function that splits the full page of a directory slot in two,
+* doubling the directory first if the page already uses every bit of it.
+*/
+static void splitPage(ExtendibleTable* table, unsigned int slot, unsigned int number, Page* page) {
+    unsigned int depth = page->local_depth;
+    if (depth == table->global_depth) {
+        if (depth == MAX_DEPTH) {
+            printf("Hash table directory cannot grow beyond 2^%d pages...\n", MAX_DEPTH);
+            exit(1);
+        }
+        unsigned int size = 1u << depth;
+        table->directory = (unsigned int*)realloc(table->directory, 2 * size * sizeof(unsigned int));
+        memcpy(table->directory + size, table->directory, size * sizeof(unsigned int));
+        table->global_depth++;
+    }
+
+    // keys with bit depth set move to the new page
+    unsigned int newNumber;
+    Page* newPage = allocatePage(table, &newNumber, 1);
+    unsigned int kept = 0, i;
+    for (i = 0; i < page->count; ++i) {
+        if (mixKey(page->keys[i]) & (1u << depth)) {
+            newPage->keys[newPage->count] = page->keys[i];
+            newPage->values[newPage->count++] = page->values[i];
+        } else {
+            page->keys[kept] = page->keys[i];
+            page->values[kept++] = page->values[i];
+        }
+    }
+    page->count = kept;
+    page->local_depth = newPage->local_depth = depth + 1;
+    storePage(table, number, page);
+    storePage(table, newNumber, newPage);
+    pointSlots(table, slot | (1u << depth), depth + 1, newNumber);
+}
+
+/**
+* mergePage
+*
+* Helper function that merges a page with its buddy when both together fill
+* at most half a page, then halves the directory while every pair of halves
+* agrees.
+*/
+static void mergePage(ExtendibleTable* table, unsigned int slot, unsigned int number, Page* page) {
+    unsigned int depth = page->local_depth;
+    if (depth == 0) return;
+    unsigned int buddySlot = slot ^ (1u << (depth - 1));
+    unsigned int buddyNumber = table->directory[buddySlot];
+    Page* buddy = loadPage(table, buddyNumber, 1);
+    if (buddy->local_depth != depth || page->count + buddy->count > PAGE_ENTRIES / 2) return;
+
+    // keep the page whose bit depth - 1 is clear
+    if (slot & (1u << (depth - 1))) {
+        unsigned int swapNumber = number;
+        Page* swapPage = page;
+        number = buddyNumber;
+        page = buddy;
+        buddyNumber = swapNumber;
+        buddy = swapPage;
+    }
+    unsigned int i;
+    for (i = 0; i < buddy->count; ++i) {
+        page->keys[page->count] = buddy->keys[i];
+        page->values[page->count++] = buddy->values[i];
+    }
+    page->local_depth = depth - 1;
+    storePage(table, number, page);
+    releasePage(table, buddyNumber);
+    pointSlots(table, slot, depth - 1, number);
+
+    while (table->global_depth > 0) {
+        unsigned int half = 1u << (table->global_depth - 1);
+        if (memcmp(table->directory, table->directory + half, half * sizeof(unsigned int)) != 0) break;
+        table->global_depth--;
+        table->directory = (unsigned int*)realloc(table->directory, half * sizeof(unsigned int));
+    }
+}
+
+/**
+* takeKey
+*
+* Helper function that removes the entry of a key, filling its position with
+* the last entry of the page, and merges the page with its buddy if they
+* have become sparse.
+*
+* @return The value of the entry, or NULL if the key is not present
+*/
+static void* takeKey(ExtendibleTable* table, unsigned int key) {
+    unsigned int slot = slotOf(table, key);
+    unsigned int number = table->directory[slot];
+    Page* page = loadPage(table, number, 0);
+    int position = findKey(page, key);
+    if (position < 0) return NULL;
+    void* value = page->values[position];
+    page->count--;
+    page->keys[position] = page->keys[page->count];
+    page->values[position] = page->values[page->count];
+    storePage(table, number, page);
+    table->num_entries--;
+    mergePage(table, slot, number, page);
+    return value;
+}
+
+/**
+* createTable
+*
+* Helper function that creates a table of one empty page, in memory if fd is
+* negative.
+*/
+static ExtendibleTable* createTable(int fd) {
+    ExtendibleTable* table = (ExtendibleTable*)malloc(sizeof(ExtendibleTable));
+    table->global_depth = 0;
+    table->directory = (unsigned int*)malloc(sizeof(unsigned int));
+    table->pages = NULL;
+    table->fd = fd;
+    table->num_pages = 0;
+    table->free_pages = NULL;
+    table->num_free = 0;
+    table->buffers = fd < 0 ? NULL : (PageBuffer*)malloc(2 * sizeof(PageBuffer));
+    table->num_entries = 0;
+    Page* page = allocatePage(table, &table->directory[0], 0);
+    storePage(table, table->directory[0], page);
+    return table;
+}
+
+/**
+* extendibleCreate
+*/
+static void* extendibleCreate(HashFunction hash, unsigned int numBuckets) {
+    (void)hash;
+    (void)numBuckets;
+    return createTable(-1);
+}
+
+/**
+* extendibleDestroy
+*/
+static void extendibleDestroy(void* state) {
+    ExtendibleTable* table = (ExtendibleTable*)state;
+    unsigned int slot;
+    for (slot = 0; slot < (1u << table->global_depth); ++slot) {
+        unsigned int number = table->directory[slot];
+        Page* page = loadPage(table, number, 0);
+        // each page once: from the first slot pointing at it
+        if (slot >= (1u << page->local_depth)) continue;
+        unsigned int i;
+        for (i = 0; i < page->count; ++i) free(page->values[i]);
+    }
+    // pages released by merges are NULL already
+    unsigned int number;
+    for (number = 0; table->fd < 0 && number < table->num_pages; ++number) free(table->pages[number]);
+    if (table->fd >= 0) close(table->fd);
+    free(table->pages);
+    free(table->free_pages);
+    free(table->buffers);
+    free(table->directory);
+    free(table);
+}
+
+/**
+* extendibleInsert
+*/
+static void* extendibleInsert(void* state, unsigned int key, void* value) {
+    ExtendibleTable* table = (ExtendibleTable*)state;
+    for (;;) {
+        unsigned int slot = slotOf(table, key);
+        unsigned int number = table->directory[slot];
+        Page* page = loadPage(table, number, 0);
+        // overwrite a present key
+        int position = findKey(page, key);
+        if (position >= 0) {
+            void* previousValue = page->values[position];
+            page->values[position] = value;
+            storePage(table, number, page);
+            return previousValue;
+        }
+        // or add it if the page has room, else split the page and try again
+        if (page->count < PAGE_ENTRIES) {
+            page->keys[page->count] = key;
+            page->values[page->count++] = value;
+            storePage(table, number, page);
+            table->num_entries++;
+            return NULL;
+        }
+        splitPage(table, slot, number, page);
+    }
+}
+
+/**
+* extendibleGet
+*/
+static void* extendibleGet(void* state, unsigned int key) {
+    ExtendibleTable* table = (ExtendibleTable*)state;
+    Page* page = loadPage(table, table->directory[slotOf(table, key)], 0);
+    int position = findKey(page, key);
+    return position < 0 ? NULL : page->values[position];
+}
+
+/**
+* extendibleRemove
+*/
+static void* extendibleRemove(void* state, unsigned int key) {
+    return takeKey((ExtendibleTable*)state, key);
+}
+
+/**
+* extendibleErase
+*/
+static void extendibleErase(void* state, unsigned int key) {
+    free(takeKey((ExtendibleTable*)state, key));
+}
+
+/**
+* extendibleMemory
+*
+* Pages in a file do not count, only their two buffers.
+*/
+static unsigned long long extendibleMemory(void* state) {
+    ExtendibleTable* table = (ExtendibleTable*)state;
+    unsigned long long bytes = sizeof(ExtendibleTable) +
+                               ((unsigned long long)sizeof(unsigned int) << table->global_depth) +
+                               (unsigned long long)table->num_free * sizeof(unsigned int);
+    if (table->fd >= 0) return bytes + 2 * sizeof(PageBuffer);
+    return bytes + (unsigned long long)table->num_pages * sizeof(PageBuffer*) +
+           (unsigned long long)(table->num_pages - table->num_free) * PAGE_SIZE;
+}
+
+
+/**
+* extendibleVisit
+*/
+static void extendibleVisit(void* state, EntryVisitor visitor, void* context) {
+    ExtendibleTable* table = (ExtendibleTable*)state;
+    unsigned int slot, i;
+    for (slot = 0; slot < (1u << table->global_depth); ++slot) {
+        Page* page = loadPage(table, table->directory[slot], 0);
+        // each page once: from the first slot pointing at it
+        if (slot >= (1u << page->local_depth)) continue;
+        for (i = 0; i < page->count; ++i) visitor(context, page->keys[i], page->values[i]);
+    }
+}
+
+/**
+* extendibleScan
+*
+* Scans directory slots in nextCursor order. A page of local depth d holds
+* the keys of 2^(global_depth - d) slots, which nextCursor visits one after
+* another; the cursor reaches the first of them with the bits above d clear,
+* and then returns the whole page and skips the rest. Reached anywhere else,
+* because the depths changed between calls, it returns only the page's keys
+* that belong to the slot.
+*/
+static unsigned long long extendibleScan(void* state, unsigned long long cursor, unsigned int count,
+                                         EntryVisitor visitor, void* context) {
+    ExtendibleTable* table = (ExtendibleTable*)state;
+    unsigned int mask = (1u << table->global_depth) - 1;
+    unsigned int i;
+    do {
+        unsigned int slot = (unsigned int)cursor & mask;
+        Page* page = loadPage(table, table->directory[slot], 0);
+        unsigned int pageMask = (1u << page->local_depth) - 1;
+        if ((slot & ~pageMask) == 0) {
+            for (i = 0; i < page->count; ++i) visitor(context, page->keys[i], page->values[i]);
+            // the last slot of the page
+            cursor |= mask & ~pageMask;
+        } else {
+            for (i = 0; i < page->count; ++i) {
+                if ((mixKey(page->keys[i]) & mask) == slot) visitor(context, page->keys[i], page->values[i]);
+            }
+        }
+        cursor = nextCursor(cursor, mask);
+    } while (cursor && --count);
+    return cursor;
+}
+
+/**
+* extendibleNext
+*
+* The position holds the directory slot, the page and the number of its
+* entries not returned yet; a page is walked from its last entry down, so
+* the entry that fills an erased one has been returned already. In a file
+* the page is read once into the second buffer, which only splits and
+* merges use otherwise, and neither happens while the table is iterated.
+*/
+static int extendibleNext(void* state, EnginePosition* position, unsigned int* key, void** value) {
+    ExtendibleTable* table = (ExtendibleTable*)state;
+    Page* page = (Page*)position->node;
+    if (!position->started) {
+        position->started = 1;
+        page = loadPage(table, table->directory[0], 1);
+        position->index = page->count;
+    }
+    while (!position->index) {
+        unsigned long long slot = position->bucket + 1;
+        // each page once: from the first slot pointing at it
+        for (; slot < (1ull << table->global_depth); ++slot) {
+            if (table->fd < 0 && slot + PREFETCH_BUCKETS < (1ull << table->global_depth)) {
+                __builtin_prefetch(table->pages[table->directory[slot + PREFETCH_BUCKETS]]);
+            }
+            page = loadPage(table, table->directory[slot], 1);
+            if (slot < (1ull << page->local_depth)) break;
+        }
+        if (slot >= (1ull << table->global_depth)) {
+            // stay at the end
+            position->node = page;
+            return 0;
+        }
+        position->bucket = slot;
+        position->index = page->count;
+    }
+    position->node = page;
+    position->index--;
+    *key = page->keys[position->index];
+    *value = page->values[position->index];
+    return 1;
+}
+
+/**
+* extendibleEraseAt
+*
+* Merging would move the entries of a buddy page, maybe walked already, so
+* an erasure during an iteration leaves the pages as they are; the removals
+* after it merge them again.
+*/
+static void extendibleEraseAt(void* state, EnginePosition* position) {
+    ExtendibleTable* table = (ExtendibleTable*)state;
+    Page* page = (Page*)position->node;
+    free(page->values[position->index]);
+    page->count--;
+    page->keys[position->index] = page->keys[page->count];
+    page->values[position->index] = page->values[page->count];
+    storePage(table, table->directory[position->bucket], page);
+    table->num_entries--;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+const HashTableEngine extendibleEngine = {
+  extendibleCreate,
+  extendibleDestroy,
+  extendibleInsert,
+  extendibleGet,
+  extendibleRemove,
+  extendibleErase,
+  extendibleMemory,
+  extendibleVisit,
+  extendibleScan,
+  extendibleNext,
+  extendibleEraseAt
+};
+
+void* createExtendibleFile(const char* path) {
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return NULL;
+    return createTable(fd);
+}
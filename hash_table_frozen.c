@@ -0,0 +1,382 @@
+/*
+ The representation of a table after freezeHashTable: immutable, with a
+ minimal perfect hash over its keys.
+
+ The keys and values sit in two dense arrays of exactly one slot per entry,
+ and a minimal perfect hash maps every stored key to its own slot, so a
+ getItem is one hash of the key, one pilot lookup and one probe of each
+ array, with no collision to resolve. An absent key maps to some slot too,
+ which is why the stored key is compared.
+
+ The hash is built like PTHash (Pibiri and Trani). Keys are hashed with a
+ seed and spread over buckets of about BUCKET_LOAD keys. Buckets are placed
+ largest first: each gets the first 16-bit pilot p for which
+ (hash ^ mix(p)) maps all of its keys to free, distinct slots among
+ num_slots, a little more than the number of keys so that the last buckets
+ still find room quickly. The few keys that land past the number of entries
+ are sent back to the free slots below it through a small remap array. On
+ top of the 12 bytes of key and value, that costs about 16 / BUCKET_LOAD +
+ 32 * 2% = 3.8 bits per key. If some bucket finds no pilot, the build
+ starts over with another seed.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, calloc and free
+#include <stdio.h>    // For printf
+#include <string.h>   // For memset
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The average number of keys per bucket */
+#define BUCKET_LOAD       5
+
+/** The keys per 100 slots searched by the pilots */
+#define SLOT_LOAD_PERCENT 98
+
+/** The largest pilot, so that pilots fit in 16 bits */
+#define MAX_PILOT         65535
+
+/** The number of seeds tried before giving up */
+#define MAX_SEEDS         64
+
+/**
+ * This structure represents a frozen table.
+ */
+typedef struct {
+  /** The seed of the key hash */
+  unsigned long long seed;
+
+  /** The number of entries, and of slots in keys and values */
+  unsigned int num_entries;
+
+  /** The number of buckets, each with a pilot */
+  unsigned int num_buckets;
+
+  /** The number of slots the pilots place keys in, at least num_entries */
+  unsigned int num_slots;
+
+  /** The pilot of each bucket */
+  unsigned short* pilots;
+
+  /** For each slot from num_entries up, the free slot below num_entries its
+      key actually lives in */
+  unsigned int* remap;
+
+  /** The key of each slot */
+  unsigned int* keys;
+
+  /** The value of each slot */
+  void** values;
+} FrozenTable;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* mix64
+*
+* The splitmix64 finalizer.
+*/
+static unsigned long long mix64(unsigned long long x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+}
+
+/**
+* keyHash
+*/
+static unsigned long long keyHash(const FrozenTable* table, unsigned int key) {
+    return mix64(key + table->seed);
+}
+
+/**
+* bucketOf
+*
+* @return The bucket of a key hash, from its high 32 bits
+*/
+static unsigned int bucketOf(const FrozenTable* table, unsigned long long hash) {
+    return (unsigned int)(((hash >> 32) * table->num_buckets) >> 32);
+}
+
+/**
+* slotOf
+*
+* @return The slot a pilot sends a key hash to, below num_slots
+*/
+static unsigned int slotOf(const FrozenTable* table, unsigned long long hash, unsigned int pilot) {
+    unsigned int mixed = (unsigned int)(hash ^ mix64(pilot));
+    return (unsigned int)(((unsigned long long)mixed * table->num_slots) >> 32);
+}
+
+/**
+* placeBuckets
+*
+* Helper function that searches a pilot for every bucket with the table's
+* current seed.
+*
+* @param hashes The hash of each key
+* @param order The keys, grouped by bucket
+* @param starts Where the keys of each bucket start in order, with one more
+*               entry for the end
+* @param byLength The buckets, longest first
+* @param taken One byte per slot, set when a key was placed there
+* @param slots Room for the slots of the longest bucket
+* @return 1 on success, 0 if some bucket has no pilot
+*/
+static int placeBuckets(FrozenTable* table, const unsigned long long* hashes,
+                        const unsigned int* order, const unsigned int* starts,
+                        const unsigned int* byLength, unsigned char* taken,
+                        unsigned int* slots) {
+    unsigned int b;
+    for (b = 0; b < table->num_buckets; ++b) {
+        unsigned int bucket = byLength[b];
+        unsigned int length = starts[bucket + 1] - starts[bucket];
+        if (length == 0) break;
+        unsigned int pilot;
+        for (pilot = 0; pilot <= MAX_PILOT; ++pilot) {
+            unsigned int i, j;
+            for (i = 0; i < length; ++i) {
+                slots[i] = slotOf(table, hashes[order[starts[bucket] + i]], pilot);
+                if (taken[slots[i]]) break;
+                for (j = 0; j < i && slots[j] != slots[i]; ++j) {}
+                if (j < i) break;
+            }
+            if (i == length) break;
+        }
+        if (pilot > MAX_PILOT) return 0;
+        table->pilots[bucket] = (unsigned short)pilot;
+        unsigned int i;
+        for (i = 0; i < length; ++i) taken[slots[i]] = 1;
+    }
+    return 1;
+}
+
+/**
+* frozenInsert
+*/
+static void* frozenInsert(void* state, unsigned int key, void* value) {
+    (void)state; (void)key; (void)value;
+    printf("insertItem is not supported by a frozen hash table...\n");
+    exit(1);
+}
+
+/**
+* frozenDestroy
+*/
+static void frozenDestroy(void* state) {
+    FrozenTable* table = (FrozenTable*)state;
+    unsigned int i;
+    for (i = 0; i < table->num_entries; ++i) free(table->values[i]);
+    free(table->pilots);
+    free(table->remap);
+    free(table->keys);
+    free(table->values);
+    free(table);
+}
+
+/**
+* frozenGet
+*
+* One hash, one pilot, one slot.
+*/
+static void* frozenGet(void* state, unsigned int key) {
+    FrozenTable* table = (FrozenTable*)state;
+    if (table->num_entries == 0) return NULL;
+    unsigned long long hash = keyHash(table, key);
+    unsigned int slot = slotOf(table, hash, table->pilots[bucketOf(table, hash)]);
+    if (slot >= table->num_entries) slot = table->remap[slot - table->num_entries];
+    return table->keys[slot] == key ? table->values[slot] : NULL;
+}
+
+/**
+* frozenRemove
+*/
+static void* frozenRemove(void* state, unsigned int key) {
+    (void)state; (void)key;
+    printf("removeItem is not supported by a frozen hash table...\n");
+    exit(1);
+}
+
+/**
+* frozenErase
+*/
+static void frozenErase(void* state, unsigned int key) {
+    (void)state; (void)key;
+    printf("deleteItem is not supported by a frozen hash table...\n");
+    exit(1);
+}
+
+/**
+* frozenMemory
+*/
+static unsigned long long frozenMemory(void* state) {
+    FrozenTable* table = (FrozenTable*)state;
+    return sizeof(FrozenTable) +
+           (unsigned long long)table->num_buckets * sizeof(unsigned short) +
+           (unsigned long long)(table->num_slots - table->num_entries) * sizeof(unsigned int) +
+           (unsigned long long)table->num_entries * (sizeof(unsigned int) + sizeof(void*));
+}
+
+/**
+* frozenVisit
+*/
+static void frozenVisit(void* state, EntryVisitor visitor, void* context) {
+    FrozenTable* table = (FrozenTable*)state;
+    unsigned int i;
+    for (i = 0; i < table->num_entries; ++i) visitor(context, table->keys[i], table->values[i]);
+}
+
+/**
+* frozenScan
+*
+* The table never changes, so the cursor is a position in the dense arrays,
+* and each entry counts as a bucket.
+*/
+static unsigned long long frozenScan(void* state, unsigned long long cursor, unsigned int count,
+                                     EntryVisitor visitor, void* context) {
+    FrozenTable* table = (FrozenTable*)state;
+    for (; count && cursor < table->num_entries; --count, ++cursor) {
+        visitor(context, table->keys[cursor], table->values[cursor]);
+    }
+    return cursor < table->num_entries ? cursor : 0;
+}
+
+/**
+* frozenNext
+*
+* The position is an index in the dense arrays, which are read in order.
+*/
+static int frozenNext(void* state, EnginePosition* position, unsigned int* key, void** value) {
+    FrozenTable* table = (FrozenTable*)state;
+    if (!position->started) {
+        position->started = 1;
+    } else if (position->bucket < table->num_entries) {
+        position->bucket++;
+    }
+    if (position->bucket >= table->num_entries) return 0;
+    *key = table->keys[position->bucket];
+    *value = table->values[position->bucket];
+    return 1;
+}
+
+/**
+* frozenEraseAt
+*/
+static void frozenEraseAt(void* state, EnginePosition* position) {
+    (void)state; (void)position;
+    printf("htIterErase is not supported by a frozen hash table...\n");
+    exit(1);
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+const HashTableEngine frozenEngine = {
+  NULL,
+  frozenDestroy,
+  frozenInsert,
+  frozenGet,
+  frozenRemove,
+  frozenErase,
+  frozenMemory,
+  frozenVisit,
+  frozenScan,
+  frozenNext,
+  frozenEraseAt
+};
+
+void* createFrozenState(const unsigned int* keys, void* const* values, unsigned int count) {
+    FrozenTable* table = (FrozenTable*)malloc(sizeof(FrozenTable));
+    table->num_entries = count;
+    table->num_buckets = count / BUCKET_LOAD + 1;
+    table->num_slots = (unsigned int)((unsigned long long)count * 100 / SLOT_LOAD_PERCENT) + 1;
+    table->pilots = (unsigned short*)calloc(table->num_buckets, sizeof(unsigned short));
+    table->remap = (unsigned int*)calloc(table->num_slots - count, sizeof(unsigned int));
+    table->keys = (unsigned int*)malloc((count ? count : 1) * sizeof(unsigned int));
+    table->values = (void**)malloc((count ? count : 1) * sizeof(void*));
+
+    unsigned long long* hashes = (unsigned long long*)malloc((count ? count : 1) * sizeof(unsigned long long));
+    unsigned int* order = (unsigned int*)malloc((count ? count : 1) * sizeof(unsigned int));
+    unsigned int* starts = (unsigned int*)malloc((table->num_buckets + 1) * sizeof(unsigned int));
+    unsigned int* byLength = (unsigned int*)malloc(table->num_buckets * sizeof(unsigned int));
+    unsigned char* taken = (unsigned char*)malloc(table->num_slots);
+    unsigned int* slots = NULL;
+
+    unsigned int attempt, i;
+    for (attempt = 0; attempt < MAX_SEEDS; ++attempt) {
+        table->seed = mix64(0x9E3779B97F4A7C15ULL * (attempt + 1));
+
+        // group the keys by bucket (a counting sort)
+        memset(starts, 0, (table->num_buckets + 1) * sizeof(unsigned int));
+        for (i = 0; i < count; ++i) {
+            hashes[i] = keyHash(table, keys[i]);
+            starts[bucketOf(table, hashes[i]) + 1]++;
+        }
+        unsigned int longest = 0, b;
+        for (b = 0; b < table->num_buckets; ++b) {
+            if (starts[b + 1] > longest) longest = starts[b + 1];
+            starts[b + 1] += starts[b];
+        }
+        unsigned int* fill = (unsigned int*)malloc(table->num_buckets * sizeof(unsigned int));
+        memcpy(fill, starts, table->num_buckets * sizeof(unsigned int));
+        for (i = 0; i < count; ++i) order[fill[bucketOf(table, hashes[i])]++] = i;
+
+        // order the buckets longest first (a counting sort on the length)
+        unsigned int* lengthStarts = (unsigned int*)calloc(longest + 2, sizeof(unsigned int));
+        for (b = 0; b < table->num_buckets; ++b) {
+            lengthStarts[longest - (starts[b + 1] - starts[b]) + 1]++;
+        }
+        for (i = 0; i <= longest; ++i) lengthStarts[i + 1] += lengthStarts[i];
+        for (b = 0; b < table->num_buckets; ++b) {
+            byLength[lengthStarts[longest - (starts[b + 1] - starts[b])]++] = b;
+        }
+        free(lengthStarts);
+        free(fill);
+
+        slots = (unsigned int*)realloc(slots, (longest ? longest : 1) * sizeof(unsigned int));
+        memset(taken, 0, table->num_slots);
+        if (placeBuckets(table, hashes, order, starts, byLength, taken, slots)) break;
+    }
+    if (attempt == MAX_SEEDS) {
+        printf("Cannot build a perfect hash over %u keys; are they distinct?...\n", count);
+        exit(1);
+    }
+
+    // the keys placed past the entries go to the free slots below them
+    unsigned int nextFree = 0;
+    for (i = count; i < table->num_slots; ++i) {
+        if (!taken[i]) continue;
+        while (taken[nextFree]) ++nextFree;
+        table->remap[i - count] = nextFree++;
+    }
+    for (i = 0; i < count; ++i) {
+        unsigned int slot = slotOf(table, hashes[i], table->pilots[bucketOf(table, hashes[i])]);
+        if (slot >= count) slot = table->remap[slot - count];
+        table->keys[slot] = keys[i];
+        table->values[slot] = values[i];
+    }
+
+    free(hashes);
+    free(order);
+    free(starts);
+    free(byLength);
+    free(taken);
+    free(slots);
+    return table;
+}
@@ -0,0 +1,557 @@
+/*
+ HT_LAYOUT_HOPSCOTCH: open addressing with hopscotch hashing, safe for
+ concurrent use.
+
+ Every key lives within HOP_RANGE = 32 buckets of its home bucket, and the
+ home bucket keeps a 32-bit hop map with bit i set when bucket home + i
+ holds one of its keys. A lookup reads the hop map and compares only the
+ keys it points at, all of them usually in one or two cache lines, so the
+ table behaves well up to load factors of 0.9.
+
+ Insert probes linearly for a free bucket. If it is too far from home,
+ entries between home and the free bucket are moved ("hopped") forward into
+ it, each within its own neighborhood, until the free bucket is close
+ enough. If no entry can move, or the table is too full, it doubles.
+
+ Concurrency (Herlihy, Shavit and Tzafrir): writers take a mutex; readers
+ take no lock at all. Each segment of SEGMENT_BUCKETS home buckets has a
+ timestamp that a writer makes odd before moving or removing a key homed in
+ that segment and even again afterwards. A reader notes the timestamp of
+ its key's segment, searches, and retries if the timestamp changed, so it
+ never reports a key missing just because the key was being hopped. When
+ the table doubles, the new arrays are published with one atomic store and
+ the old ones are kept until destroyHashTable, since readers may still be
+ searching them.
+
+ The buckets outgrow the bucket count the user asked for, which the user's
+ HashFunction (returning indices below that count) cannot address, so the
+ home bucket comes from mixKey instead.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, calloc and free
+#include <pthread.h>  // For the writer mutex
+#include <sched.h>    // For sched_yield
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The size of a neighborhood: a key is at most HOP_RANGE - 1 buckets after
+    its home */
+#define HOP_RANGE         32
+
+/** How far insert looks for a free bucket before giving up and doubling */
+#define ADD_RANGE         512
+
+/** The number of home buckets sharing a timestamp */
+#define SEGMENT_BUCKETS   64
+
+/** The smallest number of buckets */
+#define MIN_BUCKETS       64
+
+/** Relaxed atomic accesses to fields that readers read without the lock */
+#define LOAD(field)         __atomic_load_n(&(field), __ATOMIC_RELAXED)
+#define STORE(field, v)     __atomic_store_n(&(field), (v), __ATOMIC_RELAXED)
+
+/**
+ * A bucket, 16 bytes.
+ */
+typedef struct {
+  /** The value of the entry in this bucket */
+  void* value;
+
+  /** The key of the entry in this bucket */
+  unsigned int key;
+
+  /** Bit i is set if bucket (this + i) holds a key whose home is this bucket */
+  unsigned int hop_map;
+} HopBucket;
+
+/**
+ * One generation of the table. A generation is never freed before the table,
+ * because readers may still be searching it after it has been replaced.
+ */
+typedef struct _HopArray {
+  /** The buckets, a power of two of them */
+  HopBucket* buckets;
+
+  /** The number of buckets minus one */
+  unsigned int mask;
+
+  /** One bit per bucket, set if the bucket holds an entry. Only writers
+      use it. */
+  unsigned long long* occupied;
+
+  /** The timestamp of each segment of home buckets */
+  unsigned int* timestamps;
+
+  /** The previous generation, or NULL */
+  struct _HopArray* retired;
+} HopArray;
+
+/**
+ * This structure represents a hopscotch table.
+ */
+typedef struct {
+  /** The current generation */
+  HopArray* array;
+
+  /** Serializes insert, remove and erase */
+  pthread_mutex_t write_lock;
+
+  /** The number of entries */
+  unsigned int num_entries;
+
+  /** The bytes allocated for every generation, current and retired */
+  unsigned long long bytes;
+} HopscotchTable;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* homeOf
+*
+* @return The home bucket of a key in an array
+*/
+static unsigned int homeOf(HopArray* array, unsigned int key) {
+    return mixKey(key) & array->mask;
+}
+
+/**
+* arrayBytes
+*
+* @return The bytes allocated for a generation of numBuckets buckets
+*/
+static unsigned long long arrayBytes(unsigned int numBuckets) {
+    return sizeof(HopArray) + (unsigned long long)numBuckets * sizeof(HopBucket) +
+           (numBuckets + 63) / 64 * sizeof(unsigned long long) +
+           (numBuckets + SEGMENT_BUCKETS - 1) / SEGMENT_BUCKETS * sizeof(unsigned int);
+}
+
+/**
+* createArray
+*
+* Helper function that allocates an empty generation of numBuckets buckets.
+*/
+static HopArray* createArray(HopscotchTable* table, unsigned int numBuckets) {
+    HopArray* array = (HopArray*)malloc(sizeof(HopArray));
+    unsigned int numSegments = (numBuckets + SEGMENT_BUCKETS - 1) / SEGMENT_BUCKETS;
+    array->buckets = (HopBucket*)calloc(numBuckets, sizeof(HopBucket));
+    array->mask = numBuckets - 1;
+    array->occupied = (unsigned long long*)calloc((numBuckets + 63) / 64, sizeof(unsigned long long));
+    array->timestamps = (unsigned int*)calloc(numSegments, sizeof(unsigned int));
+    array->retired = NULL;
+    table->bytes += arrayBytes(numBuckets);
+    return array;
+}
+
+/**
+* destroyArray
+*
+* Helper function that frees a generation, but not the values in it.
+*/
+static void destroyArray(HopscotchTable* table, HopArray* array) {
+    table->bytes -= arrayBytes(array->mask + 1);
+    free(array->buckets);
+    free(array->occupied);
+    free(array->timestamps);
+    free(array);
+}
+
+/**
+* isOccupied
+*/
+static int isOccupied(HopArray* array, unsigned int index) {
+    return (array->occupied[index / 64] >> (index % 64)) & 1;
+}
+
+/**
+* setOccupied
+*/
+static void setOccupied(HopArray* array, unsigned int index, int occupied) {
+    if (occupied) array->occupied[index / 64] |= 1ULL << (index % 64);
+    else array->occupied[index / 64] &= ~(1ULL << (index % 64));
+}
+
+/**
+* beginWrite
+*
+* Helper function that makes the timestamp of a home bucket's segment odd, so
+* that readers searching that segment retry.
+*/
+static void beginWrite(HopArray* array, unsigned int home) {
+    __atomic_fetch_add(&array->timestamps[home / SEGMENT_BUCKETS], 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+/**
+* endWrite
+*/
+static void endWrite(HopArray* array, unsigned int home) {
+    __atomic_fetch_add(&array->timestamps[home / SEGMENT_BUCKETS], 1, __ATOMIC_RELEASE);
+}
+
+/**
+* findBucket
+*
+* Helper function for writers, which hold the lock, that finds the bucket
+* holding a key.
+*
+* @return The index of the bucket, or -1 if the key is not present
+*/
+static long findBucket(HopArray* array, unsigned int key) {
+    unsigned int home = homeOf(array, key);
+    unsigned int hopMap = array->buckets[home].hop_map;
+    while (hopMap) {
+        unsigned int index = (home + __builtin_ctz(hopMap)) & array->mask;
+        if (array->buckets[index].key == key) return index;
+        hopMap &= hopMap - 1;
+    }
+    return -1;
+}
+
+/**
+* placeEntry
+*
+* Helper function that adds a key that is not present, hopping entries to
+* bring a free bucket into the key's neighborhood.
+*
+* @return 1 on success, 0 if the array has to grow first
+*/
+static int placeEntry(HopArray* array, unsigned int key, void* value) {
+    unsigned int home = homeOf(array, key);
+    unsigned int size = array->mask + 1;
+
+    // look for a free bucket
+    unsigned int distance = 0;
+    unsigned int limit = size < ADD_RANGE ? size : ADD_RANGE;
+    while (distance < limit && isOccupied(array, (home + distance) & array->mask)) ++distance;
+    if (distance == limit) return 0;
+
+    // hop it closer until it is in the neighborhood
+    while (distance >= HOP_RANGE) {
+        unsigned int freeIndex = (home + distance) & array->mask;
+        int moved = 0;
+        unsigned int back;
+        // the candidates are the home buckets HOP_RANGE - 1 .. 1 before
+        // the free one, furthest first so that the hop is as long as possible
+        for (back = HOP_RANGE - 1; back > 0 && !moved; --back) {
+            unsigned int candidate = (freeIndex - back) & array->mask;
+            unsigned int hopMap = array->buckets[candidate].hop_map;
+            // only entries before the free bucket can move into it
+            hopMap &= (1u << back) - 1;
+            if (!hopMap) continue;
+            unsigned int offset = __builtin_ctz(hopMap);
+            unsigned int from = (candidate + offset) & array->mask;
+
+            // copy the entry forward, then switch the hop map over to it
+            beginWrite(array, candidate);
+            STORE(array->buckets[freeIndex].key, array->buckets[from].key);
+            STORE(array->buckets[freeIndex].value, array->buckets[from].value);
+            STORE(array->buckets[candidate].hop_map,
+                  (array->buckets[candidate].hop_map | (1u << back)) & ~(1u << offset));
+            endWrite(array, candidate);
+            setOccupied(array, freeIndex, 1);
+            setOccupied(array, from, 0);
+
+            distance -= back - offset;
+            moved = 1;
+        }
+        if (!moved) return 0;
+    }
+
+    // fill the free bucket, then make it visible in the hop map
+    unsigned int index = (home + distance) & array->mask;
+    STORE(array->buckets[index].key, key);
+    STORE(array->buckets[index].value, value);
+    __atomic_store_n(&array->buckets[home].hop_map,
+                     array->buckets[home].hop_map | (1u << distance), __ATOMIC_RELEASE);
+    setOccupied(array, index, 1);
+    return 1;
+}
+
+/**
+* growTable
+*
+* Helper function that moves every entry into a generation twice as large
+* and publishes it. The old generation is retired, not freed.
+*/
+static void growTable(HopscotchTable* table) {
+    HopArray* old = table->array;
+    unsigned int size = (old->mask + 1) * 2;
+    for (;;) {
+        HopArray* array = createArray(table, size);
+        unsigned int i;
+        for (i = 0; i <= old->mask; ++i) {
+            if (isOccupied(old, i) && !placeEntry(array, old->buckets[i].key, old->buckets[i].value)) break;
+        }
+        if (i > old->mask) {
+            array->retired = old;
+            __atomic_store_n(&table->array, array, __ATOMIC_RELEASE);
+            return;
+        }
+        // nobody has seen the new array yet, so if it is still too crowded
+        // somewhere, throw it away and try a larger one
+        destroyArray(table, array);
+        size *= 2;
+    }
+}
+
+/**
+* takeAt
+*
+* Helper function that removes the entry of an occupied bucket. Must hold
+* the lock.
+*
+* @return The value of the entry
+*/
+static void* takeAt(HopscotchTable* table, unsigned int index) {
+    HopArray* array = table->array;
+    unsigned int home = homeOf(array, array->buckets[index].key);
+    void* value = array->buckets[index].value;
+    beginWrite(array, home);
+    STORE(array->buckets[home].hop_map,
+          array->buckets[home].hop_map & ~(1u << ((index - home) & array->mask)));
+    endWrite(array, home);
+    setOccupied(array, index, 0);
+    table->num_entries--;
+    return value;
+}
+
+/**
+* takeKey
+*
+* Helper function that removes the entry of a key. Must hold the lock.
+*
+* @return The value of the entry, or NULL if the key is not present
+*/
+static void* takeKey(HopscotchTable* table, unsigned int key) {
+    long index = findBucket(table->array, key);
+    return index < 0 ? NULL : takeAt(table, (unsigned int)index);
+}
+
+/**
+* hopscotchCreate
+*/
+static void* hopscotchCreate(HashFunction hash, unsigned int numBuckets) {
+    (void)hash;
+    HopscotchTable* table = (HopscotchTable*)malloc(sizeof(HopscotchTable));
+    unsigned int size = MIN_BUCKETS;
+    while (size < numBuckets && size < 0x80000000u) size *= 2;
+    table->bytes = sizeof(HopscotchTable);
+    table->array = createArray(table, size);
+    pthread_mutex_init(&table->write_lock, NULL);
+    table->num_entries = 0;
+    return table;
+}
+
+/**
+* hopscotchDestroy
+*/
+static void hopscotchDestroy(void* state) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    HopArray* array = table->array;
+    // only the current generation owns the values
+    unsigned int i;
+    for (i = 0; i <= array->mask; ++i) {
+        if (isOccupied(array, i)) free(array->buckets[i].value);
+    }
+    while (array) {
+        HopArray* retired = array->retired;
+        destroyArray(table, array);
+        array = retired;
+    }
+    pthread_mutex_destroy(&table->write_lock);
+    free(table);
+}
+
+/**
+* hopscotchInsert
+*/
+static void* hopscotchInsert(void* state, unsigned int key, void* value) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    pthread_mutex_lock(&table->write_lock);
+    void* previousValue = NULL;
+    long index = findBucket(table->array, key);
+    if (index >= 0) {
+        // overwrite a present key
+        previousValue = table->array->buckets[index].value;
+        __atomic_store_n(&table->array->buckets[index].value, value, __ATOMIC_RELEASE);
+    } else {
+        // keep the load factor below 7/8, and grow when hopping fails
+        if ((table->num_entries + 1) * 8ULL > (table->array->mask + 1) * 7ULL) growTable(table);
+        while (!placeEntry(table->array, key, value)) growTable(table);
+        table->num_entries++;
+    }
+    pthread_mutex_unlock(&table->write_lock);
+    return previousValue;
+}
+
+/**
+* hopscotchGet
+*
+* Lock-free: search, and retry if a writer touched the key's segment.
+*/
+static void* hopscotchGet(void* state, unsigned int key) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    for (;;) {
+        HopArray* array = __atomic_load_n(&table->array, __ATOMIC_ACQUIRE);
+        unsigned int home = homeOf(array, key);
+        unsigned int* timestamp = &array->timestamps[home / SEGMENT_BUCKETS];
+        unsigned int before = __atomic_load_n(timestamp, __ATOMIC_ACQUIRE);
+        if (before & 1) {
+            // a writer is moving something here right now
+            sched_yield();
+            continue;
+        }
+
+        void* value = NULL;
+        unsigned int hopMap = __atomic_load_n(&array->buckets[home].hop_map, __ATOMIC_ACQUIRE);
+        while (hopMap) {
+            unsigned int index = (home + __builtin_ctz(hopMap)) & array->mask;
+            if (LOAD(array->buckets[index].key) == key) {
+                value = __atomic_load_n(&array->buckets[index].value, __ATOMIC_ACQUIRE);
+                break;
+            }
+            hopMap &= hopMap - 1;
+        }
+
+        // the result only counts if no writer moved a key of this segment
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(timestamp, __ATOMIC_RELAXED) == before) return value;
+    }
+}
+
+/**
+* hopscotchRemove
+*/
+static void* hopscotchRemove(void* state, unsigned int key) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    pthread_mutex_lock(&table->write_lock);
+    void* value = takeKey(table, key);
+    pthread_mutex_unlock(&table->write_lock);
+    return value;
+}
+
+/**
+* hopscotchErase
+*/
+static void hopscotchErase(void* state, unsigned int key) {
+    free(hopscotchRemove(state, key));
+}
+
+/**
+* hopscotchMemory
+*/
+static unsigned long long hopscotchMemory(void* state) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    pthread_mutex_lock(&table->write_lock);
+    unsigned long long bytes = table->bytes;
+    pthread_mutex_unlock(&table->write_lock);
+    return bytes;
+}
+
+
+/**
+* hopscotchVisit
+*
+* Like the other writers, holds the lock.
+*/
+static void hopscotchVisit(void* state, EntryVisitor visitor, void* context) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    pthread_mutex_lock(&table->write_lock);
+    HopArray* array = table->array;
+    unsigned int i;
+    for (i = 0; i <= array->mask; ++i) {
+        if (isOccupied(array, i)) visitor(context, array->buckets[i].key, array->buckets[i].value);
+    }
+    pthread_mutex_unlock(&table->write_lock);
+}
+
+/**
+* hopscotchScan
+*
+* Scans home buckets in nextCursor order, returning the keys whose home is
+* the bucket through its neighborhood bitmap, so doublings between calls
+* neither skip nor repeat keys. Holds the lock like hopscotchVisit.
+*/
+static unsigned long long hopscotchScan(void* state, unsigned long long cursor, unsigned int count,
+                                        EntryVisitor visitor, void* context) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    pthread_mutex_lock(&table->write_lock);
+    HopArray* array = table->array;
+    do {
+        unsigned int home = (unsigned int)cursor & array->mask;
+        unsigned int hopMap = array->buckets[home].hop_map;
+        while (hopMap) {
+            HopBucket* bucket = &array->buckets[(home + __builtin_ctz(hopMap)) & array->mask];
+            visitor(context, bucket->key, bucket->value);
+            hopMap &= hopMap - 1;
+        }
+        cursor = nextCursor(cursor, array->mask);
+    } while (cursor && --count);
+    pthread_mutex_unlock(&table->write_lock);
+    return cursor;
+}
+
+/**
+* hopscotchNext
+*
+* Walks the buckets in order, skipping the free ones by their occupied bits.
+* Removing an entry moves no other, so the position is the bucket alone.
+*/
+static int hopscotchNext(void* state, EnginePosition* position, unsigned int* key, void** value) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    HopArray* array = table->array;
+    unsigned long long index = position->started ? position->bucket + 1 : 0;
+    position->started = 1;
+    while (index <= array->mask && !isOccupied(array, (unsigned int)index)) ++index;
+    position->bucket = index;
+    if (index > array->mask) return 0;
+    if (index + PREFETCH_BUCKETS <= array->mask) __builtin_prefetch(&array->buckets[index + PREFETCH_BUCKETS]);
+    *key = array->buckets[index].key;
+    *value = array->buckets[index].value;
+    return 1;
+}
+
+/**
+* hopscotchEraseAt
+*
+* A writer like hopscotchErase, so it takes the lock.
+*/
+static void hopscotchEraseAt(void* state, EnginePosition* position) {
+    HopscotchTable* table = (HopscotchTable*)state;
+    pthread_mutex_lock(&table->write_lock);
+    void* value = takeAt(table, (unsigned int)position->bucket);
+    pthread_mutex_unlock(&table->write_lock);
+    free(value);
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+const HashTableEngine hopscotchEngine = {
+  hopscotchCreate,
+  hopscotchDestroy,
+  hopscotchInsert,
+  hopscotchGet,
+  hopscotchRemove,
+  hopscotchErase,
+  hopscotchMemory,
+  hopscotchVisit,
+  hopscotchScan,
+  hopscotchNext,
+  hopscotchEraseAt
+};
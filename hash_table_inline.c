@@ -0,0 +1,344 @@
+/*
+ HT_LAYOUT_INLINE: the first entry of each bucket lives in the bucket array.
+
+ At a sane load factor most buckets hold zero or one entry. With a bucket
+ array of pointers, even a hit on a one-entry bucket costs two cache misses:
+ the bucket, then the entry. Here each bucket slot embeds the key and value
+ of its first entry, so that case, and a miss on an empty bucket, take a
+ single memory access. Further entries go to a classic overflow chain.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, calloc and free
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/**
+ * An entry that did not fit in its bucket slot.
+ */
+typedef struct _OverflowEntry {
+  unsigned int key;
+  void* value;
+  struct _OverflowEntry* next;
+} OverflowEntry;
+
+/**
+ * A bucket slot, 24 bytes.
+ */
+typedef struct {
+  /** The key of the first entry, valid if occupied */
+  unsigned int key;
+
+  /** 1 if the slot holds an entry. An empty slot has no overflow either. */
+  unsigned int occupied;
+
+  /** The value of the first entry */
+  void* value;
+
+  /** The other entries of the bucket, or NULL */
+  OverflowEntry* overflow;
+} InlineSlot;
+
+/**
+ * This structure represents an inline table.
+ */
+typedef struct {
+  /** The hash function pointer */
+  HashFunction hash;
+
+  /** The number of buckets */
+  unsigned int num_buckets;
+
+  /** The bucket slots */
+  InlineSlot* slots;
+
+  /** The number of overflow entries allocated */
+  unsigned long long num_overflow;
+} InlineTable;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* findValue
+*
+* Helper function that finds where the value of a key is stored.
+*
+* @return A pointer to the value field of the key's entry, or NULL
+*/
+static void** findValue(InlineTable* table, unsigned int key) {
+    InlineSlot* slot = &table->slots[table->hash(key)];
+    if (!slot->occupied) return NULL;
+    if (slot->key == key) return &slot->value;
+    OverflowEntry* entry;
+    for (entry = slot->overflow; entry; entry = entry->next) {
+        if (entry->key == key) return &entry->value;
+    }
+    return NULL;
+}
+
+/**
+* takeAt
+*
+* Helper function that removes the inline entry of a slot if link is NULL,
+* or else the overflow entry link points at. When the inline entry is
+* removed, the first overflow entry moves into the slot.
+*
+* @return The value of the entry
+*/
+static void* takeAt(InlineTable* table, InlineSlot* slot, OverflowEntry** link) {
+    void* value;
+    if (!link) {
+        value = slot->value;
+        OverflowEntry* first = slot->overflow;
+        if (first) {
+            slot->key = first->key;
+            slot->value = first->value;
+            slot->overflow = first->next;
+            free(first);
+            table->num_overflow--;
+        } else {
+            slot->occupied = 0;
+        }
+        return value;
+    }
+    OverflowEntry* entry = *link;
+    *link = entry->next;
+    value = entry->value;
+    free(entry);
+    table->num_overflow--;
+    return value;
+}
+
+/**
+* takeKey
+*
+* Helper function that removes the entry of a key.
+*
+* @return The value of the entry, or NULL if the key is not present
+*/
+static void* takeKey(InlineTable* table, unsigned int key) {
+    InlineSlot* slot = &table->slots[table->hash(key)];
+    if (!slot->occupied) return NULL;
+    if (slot->key == key) return takeAt(table, slot, NULL);
+    OverflowEntry** link = &slot->overflow;
+    while (*link && (*link)->key != key) link = &(*link)->next;
+    if (!*link) return NULL;
+    return takeAt(table, slot, link);
+}
+
+/**
+* inlineCreate
+*/
+static void* inlineCreate(HashFunction hash, unsigned int numBuckets) {
+    InlineTable* table = (InlineTable*)malloc(sizeof(InlineTable));
+    table->hash = hash;
+    table->num_buckets = numBuckets;
+    table->slots = (InlineSlot*)calloc(numBuckets, sizeof(InlineSlot));
+    table->num_overflow = 0;
+    return table;
+}
+
+/**
+* inlineDestroy
+*/
+static void inlineDestroy(void* state) {
+    InlineTable* table = (InlineTable*)state;
+    unsigned int i;
+    for (i = 0; i < table->num_buckets; ++i) {
+        InlineSlot* slot = &table->slots[i];
+        if (!slot->occupied) continue;
+        free(slot->value);
+        OverflowEntry* entry = slot->overflow;
+        while (entry) {
+            OverflowEntry* next = entry->next;
+            free(entry->value);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(table->slots);
+    free(table);
+}
+
+/**
+* inlineInsert
+*/
+static void* inlineInsert(void* state, unsigned int key, void* value) {
+    InlineTable* table = (InlineTable*)state;
+    InlineSlot* slot = &table->slots[table->hash(key)];
+    // fill an empty slot
+    if (!slot->occupied) {
+        slot->key = key;
+        slot->value = value;
+        slot->occupied = 1;
+        return NULL;
+    }
+    // overwrite a present key
+    void** present = findValue(table, key);
+    if (present) {
+        void* previousValue = *present;
+        *present = value;
+        return previousValue;
+    }
+    // or push a new overflow entry
+    OverflowEntry* entry = (OverflowEntry*)malloc(sizeof(OverflowEntry));
+    entry->key = key;
+    entry->value = value;
+    entry->next = slot->overflow;
+    slot->overflow = entry;
+    table->num_overflow++;
+    return NULL;
+}
+
+/**
+* inlineGet
+*/
+static void* inlineGet(void* state, unsigned int key) {
+    void** present = findValue((InlineTable*)state, key);
+    return present ? *present : NULL;
+}
+
+/**
+* inlineRemove
+*/
+static void* inlineRemove(void* state, unsigned int key) {
+    return takeKey((InlineTable*)state, key);
+}
+
+/**
+* inlineErase
+*/
+static void inlineErase(void* state, unsigned int key) {
+    free(takeKey((InlineTable*)state, key));
+}
+
+/**
+* inlineMemory
+*/
+static unsigned long long inlineMemory(void* state) {
+    InlineTable* table = (InlineTable*)state;
+    return sizeof(InlineTable) +
+           (unsigned long long)table->num_buckets * sizeof(InlineSlot) +
+           table->num_overflow * sizeof(OverflowEntry);
+}
+
+
+/**
+* inlineVisit
+*/
+static void inlineVisit(void* state, EntryVisitor visitor, void* context) {
+    InlineTable* table = (InlineTable*)state;
+    unsigned int i;
+    for (i = 0; i < table->num_buckets; ++i) {
+        InlineSlot* slot = &table->slots[i];
+        if (!slot->occupied) continue;
+        visitor(context, slot->key, slot->value);
+        OverflowEntry* entry;
+        for (entry = slot->overflow; entry; entry = entry->next) {
+            visitor(context, entry->key, entry->value);
+        }
+    }
+}
+
+/**
+* inlineScan
+*
+* The bucket count never changes, so the cursor is a bucket index.
+*/
+static unsigned long long inlineScan(void* state, unsigned long long cursor, unsigned int count,
+                                     EntryVisitor visitor, void* context) {
+    InlineTable* table = (InlineTable*)state;
+    for (; count && cursor < table->num_buckets; --count, ++cursor) {
+        InlineSlot* slot = &table->slots[cursor];
+        if (!slot->occupied) continue;
+        visitor(context, slot->key, slot->value);
+        OverflowEntry* entry;
+        for (entry = slot->overflow; entry; entry = entry->next) {
+            visitor(context, entry->key, entry->value);
+        }
+    }
+    return cursor < table->num_buckets ? cursor : 0;
+}
+
+/**
+* inlineNext
+*
+* The position holds NULL for the inline entry of its slot, or the link to
+* the current overflow entry. Erasing the inline entry moves the first
+* overflow entry into the slot, so the slot is looked at again.
+*/
+static int inlineNext(void* state, EnginePosition* position, unsigned int* key, void** value) {
+    InlineTable* table = (InlineTable*)state;
+    OverflowEntry** link = (OverflowEntry**)position->node;
+    InlineSlot* slot = &table->slots[position->bucket];
+    if (!position->started) {
+        position->started = 1;
+    } else if (!position->erased) {
+        link = link ? &(*link)->next : &slot->overflow;
+    }
+    position->erased = 0;
+    while (!slot->occupied || (link && !*link)) {
+        if (position->bucket + 1 >= table->num_buckets) {
+            // stay at the end
+            position->node = link;
+            position->erased = 1;
+            return 0;
+        }
+        unsigned long long ahead = ++position->bucket + PREFETCH_BUCKETS;
+        if (ahead < table->num_buckets && table->slots[ahead].overflow) {
+            __builtin_prefetch(table->slots[ahead].overflow);
+        }
+        slot = &table->slots[position->bucket];
+        link = NULL;
+    }
+    position->node = link;
+    if (!link) {
+        *key = slot->key;
+        *value = slot->value;
+    } else {
+        if ((*link)->next) __builtin_prefetch((*link)->next);
+        *key = (*link)->key;
+        *value = (*link)->value;
+    }
+    return 1;
+}
+
+/**
+* inlineEraseAt
+*/
+static void inlineEraseAt(void* state, EnginePosition* position) {
+    InlineTable* table = (InlineTable*)state;
+    InlineSlot* slot = &table->slots[position->bucket];
+    free(takeAt(table, slot, (OverflowEntry**)position->node));
+    position->erased = 1;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+const HashTableEngine inlineEngine = {
+  inlineCreate,
+  inlineDestroy,
+  inlineInsert,
+  inlineGet,
+  inlineRemove,
+  inlineErase,
+  inlineMemory,
+  inlineVisit,
+  inlineScan,
+  inlineNext,
+  inlineEraseAt
+};
@@ -0,0 +1,438 @@
+/*
+ HT_LAYOUT_LINEAR: Litwin's linear hashing, growing one bucket at a time.
+
+ The table starts with the bucket count given to create, N. Once the load
+ passes MAX_LOAD entries per bucket, each insert splits one bucket, the one
+ at the split pointer, into itself and a new bucket at the end of the table:
+ while the table has N * 2^level buckets and the split pointer is at s, a
+ key whose hash h falls below s mod N * 2^level goes by h mod N * 2^(level+1)
+ instead, which is where splitting moved it. After the last bucket of a
+ round is split the level goes up and the pointer restarts at 0. Deleting
+ below MIN_LOAD merges the last bucket back into its buddy, the same way in
+ reverse.
+
+ So memory follows the number of entries, there is never a second bucket
+ array, and no operation moves more than the entries of one bucket. Bucket
+ heads live in fixed segments of SEGMENT_BUCKETS listed in a small
+ directory, so adding a bucket never copies the others either.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, calloc, realloc and free
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The number of bucket heads in a segment (4 KB of pointers) */
+#define SEGMENT_BUCKETS   512
+
+/** Split a bucket when an insert leaves more entries per bucket than this */
+#define MAX_LOAD          2
+
+/** Merge two buckets when a removal leaves fewer entries per bucket than this
+    (as a fraction, MIN_LOAD_NUM / MIN_LOAD_DEN) */
+#define MIN_LOAD_NUM      1
+#define MIN_LOAD_DEN      2
+
+/**
+ * An entry of a bucket chain.
+ */
+typedef struct _LinearEntry {
+  unsigned int key;
+  void* value;
+  struct _LinearEntry* next;
+} LinearEntry;
+
+/**
+ * This structure represents a linear hashing table.
+ */
+typedef struct {
+  /** The segments of bucket heads; segment i holds buckets
+      i * SEGMENT_BUCKETS .. (i + 1) * SEGMENT_BUCKETS - 1 */
+  LinearEntry*** segments;
+
+  /** The number of segments allocated, and the room in segments */
+  unsigned int num_segments;
+  unsigned int segment_capacity;
+
+  /** The number of buckets at level 0, N */
+  unsigned int initial_buckets;
+
+  /** The number of completed rounds of splits */
+  unsigned int level;
+
+  /** The next bucket to split */
+  unsigned int split;
+
+  /** The number of buckets, N * 2^level + split */
+  unsigned int num_buckets;
+
+  /** The number of entries */
+  unsigned int num_entries;
+} LinearTable;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* bucketAt
+*
+* @return The head of bucket index
+*/
+static LinearEntry** bucketAt(LinearTable* table, unsigned int index) {
+    return &table->segments[index / SEGMENT_BUCKETS][index % SEGMENT_BUCKETS];
+}
+
+/**
+* addressOf
+*
+* @return The bucket of a key with the current level and split pointer
+*/
+static unsigned int addressOf(LinearTable* table, unsigned int key) {
+    unsigned long long roundBuckets = (unsigned long long)table->initial_buckets << table->level;
+    unsigned int hash = mixKey(key);
+    unsigned int index = (unsigned int)(hash % roundBuckets);
+    // buckets before the split pointer were already split this round
+    if (index < table->split) index = (unsigned int)(hash % (roundBuckets * 2));
+    return index;
+}
+
+/**
+* findEntry
+*
+* @return The link pointing at the entry of a key, or at the NULL ending its
+*         bucket if the key is not present
+*/
+static LinearEntry** findEntry(LinearTable* table, unsigned int key) {
+    LinearEntry** link = bucketAt(table, addressOf(table, key));
+    while (*link && (*link)->key != key) link = &(*link)->next;
+    return link;
+}
+
+/**
+* splitBucket
+*
+* Helper function that adds one bucket at the end of the table and moves
+* into it the entries of the bucket at the split pointer that now belong
+* there.
+*/
+static void splitBucket(LinearTable* table) {
+    unsigned long long roundBuckets = (unsigned long long)table->initial_buckets << table->level;
+    if (roundBuckets * 2 > 0xFFFFFFFFu) return;
+
+    // room for the new bucket
+    unsigned int newIndex = table->num_buckets;
+    if (newIndex % SEGMENT_BUCKETS == 0 && newIndex / SEGMENT_BUCKETS == table->num_segments) {
+        if (table->num_segments == table->segment_capacity) {
+            table->segment_capacity *= 2;
+            table->segments = (LinearEntry***)realloc(table->segments,
+                                                      table->segment_capacity * sizeof(LinearEntry**));
+        }
+        table->segments[table->num_segments++] =
+            (LinearEntry**)calloc(SEGMENT_BUCKETS, sizeof(LinearEntry*));
+    }
+
+    // redistribute the split bucket between itself and the new one
+    LinearEntry** source = bucketAt(table, table->split);
+    LinearEntry** target = bucketAt(table, newIndex);
+    LinearEntry* entry = *source;
+    *source = NULL;
+    while (entry) {
+        LinearEntry* next = entry->next;
+        LinearEntry** bucket = mixKey(entry->key) % (roundBuckets * 2) == newIndex ? target : source;
+        entry->next = *bucket;
+        *bucket = entry;
+        entry = next;
+    }
+
+    table->num_buckets++;
+    if (++table->split == roundBuckets) {
+        table->level++;
+        table->split = 0;
+    }
+}
+
+/**
+* mergeBucket
+*
+* Helper function that undoes the last split: the last bucket goes back into
+* its buddy, and its segment is freed once empty.
+*/
+static void mergeBucket(LinearTable* table) {
+    if (table->num_buckets <= table->initial_buckets) return;
+    if (table->split == 0) {
+        table->level--;
+        table->split = table->initial_buckets << table->level;
+    }
+    table->split--;
+    table->num_buckets--;
+
+    // append the last bucket to its buddy at the split pointer
+    unsigned int lastIndex = table->num_buckets;
+    LinearEntry** link = bucketAt(table, table->split);
+    while (*link) link = &(*link)->next;
+    *link = *bucketAt(table, lastIndex);
+    *bucketAt(table, lastIndex) = NULL;
+
+    if (lastIndex % SEGMENT_BUCKETS == 0 && lastIndex / SEGMENT_BUCKETS > 0) {
+        free(table->segments[--table->num_segments]);
+    }
+}
+
+/**
+* unlinkAt
+*
+* Helper function that removes the entry a link points at, without merging.
+*
+* @return The value of the entry
+*/
+static void* unlinkAt(LinearTable* table, LinearEntry** link) {
+    LinearEntry* entry = *link;
+    *link = entry->next;
+    void* value = entry->value;
+    free(entry);
+    table->num_entries--;
+    return value;
+}
+
+/**
+* takeKey
+*
+* Helper function that removes the entry of a key, merging buckets when the
+* table has become sparse.
+*
+* @return The value of the entry, or NULL if the key is not present
+*/
+static void* takeKey(LinearTable* table, unsigned int key) {
+    LinearEntry** link = findEntry(table, key);
+    if (!*link) return NULL;
+    void* value = unlinkAt(table, link);
+    if ((unsigned long long)table->num_entries * MIN_LOAD_DEN <
+        (unsigned long long)table->num_buckets * MIN_LOAD_NUM) {
+        mergeBucket(table);
+    }
+    return value;
+}
+
+/**
+* linearCreate
+*/
+static void* linearCreate(HashFunction hash, unsigned int numBuckets) {
+    (void)hash;
+    LinearTable* table = (LinearTable*)malloc(sizeof(LinearTable));
+    table->initial_buckets = numBuckets ? numBuckets : 1;
+    table->num_segments = (table->initial_buckets + SEGMENT_BUCKETS - 1) / SEGMENT_BUCKETS;
+    table->segment_capacity = table->num_segments;
+    table->segments = (LinearEntry***)malloc(table->segment_capacity * sizeof(LinearEntry**));
+    unsigned int i;
+    for (i = 0; i < table->num_segments; ++i) {
+        table->segments[i] = (LinearEntry**)calloc(SEGMENT_BUCKETS, sizeof(LinearEntry*));
+    }
+    table->level = 0;
+    table->split = 0;
+    table->num_buckets = table->initial_buckets;
+    table->num_entries = 0;
+    return table;
+}
+
+/**
+* linearDestroy
+*/
+static void linearDestroy(void* state) {
+    LinearTable* table = (LinearTable*)state;
+    unsigned int i;
+    for (i = 0; i < table->num_buckets; ++i) {
+        LinearEntry* entry = *bucketAt(table, i);
+        while (entry) {
+            LinearEntry* next = entry->next;
+            free(entry->value);
+            free(entry);
+            entry = next;
+        }
+    }
+    for (i = 0; i < table->num_segments; ++i) free(table->segments[i]);
+    free(table->segments);
+    free(table);
+}
+
+/**
+* linearInsert
+*/
+static void* linearInsert(void* state, unsigned int key, void* value) {
+    LinearTable* table = (LinearTable*)state;
+    // overwrite a present key
+    LinearEntry** link = findEntry(table, key);
+    if (*link) {
+        void* previousValue = (*link)->value;
+        (*link)->value = value;
+        return previousValue;
+    }
+    // or append a new entry, then split one bucket if the table is too full
+    LinearEntry* entry = (LinearEntry*)malloc(sizeof(LinearEntry));
+    entry->key = key;
+    entry->value = value;
+    entry->next = NULL;
+    *link = entry;
+    table->num_entries++;
+    if (table->num_entries > (unsigned long long)table->num_buckets * MAX_LOAD) splitBucket(table);
+    return NULL;
+}
+
+/**
+* linearGet
+*/
+static void* linearGet(void* state, unsigned int key) {
+    LinearEntry* entry = *findEntry((LinearTable*)state, key);
+    return entry ? entry->value : NULL;
+}
+
+/**
+* linearRemove
+*/
+static void* linearRemove(void* state, unsigned int key) {
+    return takeKey((LinearTable*)state, key);
+}
+
+/**
+* linearErase
+*/
+static void linearErase(void* state, unsigned int key) {
+    free(takeKey((LinearTable*)state, key));
+}
+
+/**
+* linearMemory
+*/
+static unsigned long long linearMemory(void* state) {
+    LinearTable* table = (LinearTable*)state;
+    return sizeof(LinearTable) +
+           (unsigned long long)table->segment_capacity * sizeof(LinearEntry**) +
+           (unsigned long long)table->num_segments * SEGMENT_BUCKETS * sizeof(LinearEntry*) +
+           (unsigned long long)table->num_entries * sizeof(LinearEntry);
+}
+
+
+/**
+* linearVisit
+*/
+static void linearVisit(void* state, EntryVisitor visitor, void* context) {
+    LinearTable* table = (LinearTable*)state;
+    unsigned int i;
+    for (i = 0; i < table->num_buckets; ++i) {
+        LinearEntry* entry;
+        for (entry = *bucketAt(table, i); entry; entry = entry->next) {
+            visitor(context, entry->key, entry->value);
+        }
+    }
+}
+
+/**
+* linearScan
+*
+* Bucket r + N * q of a round of N * 2^level buckets holds the keys whose
+* hash h has h mod N = r and (h / N) mod 2^level = q, and each round adds a
+* higher bit of h / N. So the cursor keeps r in its high 32 bits, and counts
+* q in its low 32 bits in nextCursor order, which the splits and merges
+* between calls then cannot fool. A bucket already split this round is
+* scanned along with the bucket it split into, as one bucket of the round.
+*/
+static unsigned long long linearScan(void* state, unsigned long long cursor, unsigned int count,
+                                     EntryVisitor visitor, void* context) {
+    LinearTable* table = (LinearTable*)state;
+    unsigned long long roundBuckets = (unsigned long long)table->initial_buckets << table->level;
+    unsigned int mask = (1u << table->level) - 1;
+    unsigned int r = (unsigned int)(cursor >> 32);
+    unsigned int q = (unsigned int)cursor;
+    do {
+        unsigned int index = r + table->initial_buckets * (q & mask);
+        LinearEntry* entry;
+        for (entry = *bucketAt(table, index); entry; entry = entry->next) {
+            visitor(context, entry->key, entry->value);
+        }
+        if (index < table->split) {
+            for (entry = *bucketAt(table, (unsigned int)(index + roundBuckets)); entry; entry = entry->next) {
+                visitor(context, entry->key, entry->value);
+            }
+        }
+        q = (unsigned int)nextCursor(q, mask);
+        // the next residue once every q was scanned
+        if (q == 0 && ++r == table->initial_buckets) return 0;
+    } while (--count);
+    return (unsigned long long)r << 32 | q;
+}
+
+/**
+* linearNext
+*
+* The position holds the link to the current entry: a bucket head or the
+* next field of the entry before it.
+*/
+static int linearNext(void* state, EnginePosition* position, unsigned int* key, void** value) {
+    LinearTable* table = (LinearTable*)state;
+    LinearEntry** link = (LinearEntry**)position->node;
+    if (!position->started) {
+        position->started = 1;
+        link = bucketAt(table, 0);
+    } else if (!position->erased) {
+        link = &(*link)->next;
+    }
+    position->erased = 0;
+    while (!*link) {
+        if (position->bucket + 1 >= table->num_buckets) {
+            // stay at the end
+            position->node = link;
+            position->erased = 1;
+            return 0;
+        }
+        unsigned long long ahead = ++position->bucket + PREFETCH_BUCKETS;
+        if (ahead < table->num_buckets && *bucketAt(table, (unsigned int)ahead)) {
+            __builtin_prefetch(*bucketAt(table, (unsigned int)ahead));
+        }
+        link = bucketAt(table, (unsigned int)position->bucket);
+    }
+    position->node = link;
+    if ((*link)->next) __builtin_prefetch((*link)->next);
+    *key = (*link)->key;
+    *value = (*link)->value;
+    return 1;
+}
+
+/**
+* linearEraseAt
+*
+* Merging would move the last bucket, maybe not walked yet, into one that
+* was, so an erasure during an iteration leaves the buckets as they are;
+* the removals after it merge them again.
+*/
+static void linearEraseAt(void* state, EnginePosition* position) {
+    free(unlinkAt((LinearTable*)state, (LinearEntry**)position->node));
+    position->erased = 1;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+const HashTableEngine linearEngine = {
+  linearCreate,
+  linearDestroy,
+  linearInsert,
+  linearGet,
+  linearRemove,
+  linearErase,
+  linearMemory,
+  linearVisit,
+  linearScan,
+  linearNext,
+  linearEraseAt
+};
@@ -0,0 +1,357 @@
+/*
+ HT_LAYOUT_UNROLLED: chains of nodes holding up to 8 entries each.
+
+ A node keeps its 8 keys together in 32 bytes, so looking for a key in it is
+ one vector comparison (two with SSE2, one with AVX2) instead of 8 dependent
+ pointer loads, and a 16-entry chain is 2 nodes instead of 16. The values
+ follow the keys in the node and are only read once a key matched.
+
+ Only the head node of a chain may be partly filled: new entries go into it,
+ and a removed entry is replaced by the last entry of the head node. So a
+ chain of n entries always has ceil(n / 8) nodes.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "hash_table_engine.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, calloc and free
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>  // For the vector comparisons
+#endif
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The number of entries in a node */
+#define NODE_ENTRIES  8
+
+/**
+ * A node of a chain.
+ */
+typedef struct _UnrolledNode {
+  /** The keys of the entries; only the first count are valid */
+  unsigned int keys[NODE_ENTRIES];
+
+  /** The number of entries in the node */
+  unsigned int count;
+
+  /** The next node of the chain, or NULL */
+  struct _UnrolledNode* next;
+
+  /** The values of the entries, at the same position as their key */
+  void* values[NODE_ENTRIES];
+} UnrolledNode;
+
+/**
+ * This structure represents an unrolled table.
+ */
+typedef struct {
+  /** The hash function pointer */
+  HashFunction hash;
+
+  /** The number of buckets */
+  unsigned int num_buckets;
+
+  /** The first node of each chain, or NULL */
+  UnrolledNode** buckets;
+
+  /** The number of nodes allocated */
+  unsigned long long num_nodes;
+} UnrolledTable;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* matchKeys
+*
+* Helper function that compares key with all the keys of a node at once.
+*
+* @return A bit mask with bit i set if the i-th entry of the node holds key
+*/
+static unsigned int matchKeys(const UnrolledNode* node, unsigned int key) {
+    unsigned int mask;
+#if defined(__AVX2__)
+    __m256i keys = _mm256_loadu_si256((const __m256i*)node->keys);
+    __m256i equal = _mm256_cmpeq_epi32(keys, _mm256_set1_epi32((int)key));
+    mask = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(equal));
+#elif defined(__SSE2__)
+    __m128i wanted = _mm_set1_epi32((int)key);
+    __m128i low = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)node->keys), wanted);
+    __m128i high = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*)(node->keys + 4)), wanted);
+    mask = (unsigned int)_mm_movemask_ps(_mm_castsi128_ps(low)) |
+           ((unsigned int)_mm_movemask_ps(_mm_castsi128_ps(high)) << 4);
+#else
+    int i;
+    mask = 0;
+    for (i = 0; i < NODE_ENTRIES; ++i) mask |= (unsigned int)(node->keys[i] == key) << i;
+#endif
+    // ignore the stale keys of unused positions
+    return mask & ((1u << node->count) - 1);
+}
+
+/**
+* findSlot
+*
+* Helper function that finds the node and the position holding key.
+*
+* @return The node, or NULL if the key is not present
+*/
+static UnrolledNode* findSlot(UnrolledTable* table, unsigned int key, int* position) {
+    UnrolledNode* node = table->buckets[table->hash(key)];
+    while (node) {
+        unsigned int mask = matchKeys(node, key);
+        if (mask) {
+            *position = __builtin_ctz(mask);
+            return node;
+        }
+        node = node->next;
+    }
+    return NULL;
+}
+
+/**
+* takeAt
+*
+* Helper function that removes the entry at a position of a node of a
+* bucket, filling the position with the last entry of the head node, and
+* frees the head node once it is empty.
+*
+* @return The value of the entry
+*/
+static void* takeAt(UnrolledTable* table, unsigned int bucketIndex, UnrolledNode* node,
+                    unsigned int position) {
+    void* value = node->values[position];
+    UnrolledNode* head = table->buckets[bucketIndex];
+    head->count--;
+    node->keys[position] = head->keys[head->count];
+    node->values[position] = head->values[head->count];
+    if (head->count == 0) {
+        table->buckets[bucketIndex] = head->next;
+        free(head);
+        table->num_nodes--;
+    }
+    return value;
+}
+
+/**
+* takeKey
+*
+* Helper function that removes the entry of a key.
+*
+* @return The value of the entry, or NULL if the key is not present
+*/
+static void* takeKey(UnrolledTable* table, unsigned int key) {
+    int position;
+    UnrolledNode* node = findSlot(table, key, &position);
+    if (!node) return NULL;
+    return takeAt(table, table->hash(key), node, (unsigned int)position);
+}
+
+/**
+* unrolledCreate
+*/
+static void* unrolledCreate(HashFunction hash, unsigned int numBuckets) {
+    UnrolledTable* table = (UnrolledTable*)malloc(sizeof(UnrolledTable));
+    table->hash = hash;
+    table->num_buckets = numBuckets;
+    table->buckets = (UnrolledNode**)calloc(numBuckets, sizeof(UnrolledNode*));
+    table->num_nodes = 0;
+    return table;
+}
+
+/**
+* unrolledDestroy
+*/
+static void unrolledDestroy(void* state) {
+    UnrolledTable* table = (UnrolledTable*)state;
+    unsigned int i;
+    for (i = 0; i < table->num_buckets; ++i) {
+        UnrolledNode* node = table->buckets[i];
+        while (node) {
+            UnrolledNode* next = node->next;
+            unsigned int j;
+            for (j = 0; j < node->count; ++j) free(node->values[j]);
+            free(node);
+            node = next;
+        }
+    }
+    free(table->buckets);
+    free(table);
+}
+
+/**
+* unrolledInsert
+*/
+static void* unrolledInsert(void* state, unsigned int key, void* value) {
+    UnrolledTable* table = (UnrolledTable*)state;
+    // overwrite a present key
+    int position;
+    UnrolledNode* node = findSlot(table, key, &position);
+    if (node) {
+        void* previousValue = node->values[position];
+        node->values[position] = value;
+        return previousValue;
+    }
+    // or append to the head node, starting a new one when it is full
+    unsigned int bucketIndex = table->hash(key);
+    node = table->buckets[bucketIndex];
+    if (!node || node->count == NODE_ENTRIES) {
+        UnrolledNode* head = (UnrolledNode*)calloc(1, sizeof(UnrolledNode));
+        head->count = 0;
+        head->next = node;
+        table->buckets[bucketIndex] = head;
+        table->num_nodes++;
+        node = head;
+    }
+    node->keys[node->count] = key;
+    node->values[node->count] = value;
+    node->count++;
+    return NULL;
+}
+
+/**
+* unrolledGet
+*/
+static void* unrolledGet(void* state, unsigned int key) {
+    int position;
+    UnrolledNode* node = findSlot((UnrolledTable*)state, key, &position);
+    return node ? node->values[position] : NULL;
+}
+
+/**
+* unrolledRemove
+*/
+static void* unrolledRemove(void* state, unsigned int key) {
+    return takeKey((UnrolledTable*)state, key);
+}
+
+/**
+* unrolledErase
+*/
+static void unrolledErase(void* state, unsigned int key) {
+    free(takeKey((UnrolledTable*)state, key));
+}
+
+/**
+* unrolledMemory
+*/
+static unsigned long long unrolledMemory(void* state) {
+    UnrolledTable* table = (UnrolledTable*)state;
+    return sizeof(UnrolledTable) +
+           (unsigned long long)table->num_buckets * sizeof(UnrolledNode*) +
+           table->num_nodes * sizeof(UnrolledNode);
+}
+
+
+/**
+* unrolledVisit
+*/
+static void unrolledVisit(void* state, EntryVisitor visitor, void* context) {
+    UnrolledTable* table = (UnrolledTable*)state;
+    unsigned int i, j;
+    for (i = 0; i < table->num_buckets; ++i) {
+        UnrolledNode* node;
+        for (node = table->buckets[i]; node; node = node->next) {
+            for (j = 0; j < node->count; ++j) visitor(context, node->keys[j], node->values[j]);
+        }
+    }
+}
+
+/**
+* unrolledScan
+*
+* The bucket count never changes, so the cursor is a bucket index.
+*/
+static unsigned long long unrolledScan(void* state, unsigned long long cursor, unsigned int count,
+                                       EntryVisitor visitor, void* context) {
+    UnrolledTable* table = (UnrolledTable*)state;
+    unsigned int j;
+    for (; count && cursor < table->num_buckets; --count, ++cursor) {
+        UnrolledNode* node;
+        for (node = table->buckets[cursor]; node; node = node->next) {
+            for (j = 0; j < node->count; ++j) visitor(context, node->keys[j], node->values[j]);
+        }
+    }
+    return cursor < table->num_buckets ? cursor : 0;
+}
+
+/**
+* unrolledNext
+*
+* Each node is walked from its last entry down, so the entries below the
+* current one are those not returned yet. An erasure fills the position
+* with the last entry of the head node, which was returned already, or
+* frees the head node, so it leaves them where they are.
+*/
+static int unrolledNext(void* state, EnginePosition* position, unsigned int* key, void** value) {
+    UnrolledTable* table = (UnrolledTable*)state;
+    UnrolledNode* node = (UnrolledNode*)position->node;
+    if (!position->started) {
+        position->started = 1;
+        node = table->buckets[0];
+        position->index = node ? node->count : 0;
+    }
+    while (!node || position->index == 0) {
+        if (node) {
+            node = node->next;
+        } else {
+            if (position->bucket + 1 >= table->num_buckets) {
+                position->node = NULL;
+                return 0;
+            }
+            unsigned long long ahead = ++position->bucket + PREFETCH_BUCKETS;
+            if (ahead < table->num_buckets && table->buckets[ahead]) __builtin_prefetch(table->buckets[ahead]);
+            node = table->buckets[position->bucket];
+        }
+        if (node && node->next) __builtin_prefetch(node->next);
+        position->index = node ? node->count : 0;
+    }
+    position->node = node;
+    position->index--;
+    *key = node->keys[position->index];
+    *value = node->values[position->index];
+    return 1;
+}
+
+/**
+* unrolledEraseAt
+*/
+static void unrolledEraseAt(void* state, EnginePosition* position) {
+    UnrolledTable* table = (UnrolledTable*)state;
+    UnrolledNode* node = (UnrolledNode*)position->node;
+    unsigned int bucketIndex = (unsigned int)position->bucket;
+    unsigned int index = position->index;
+    // a head node about to be freed hands over to the node after it
+    if (node == table->buckets[bucketIndex] && node->count == 1) {
+        position->node = node->next;
+        position->index = node->next ? node->next->count : 0;
+    }
+    free(takeAt(table, bucketIndex, node, index));
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+const HashTableEngine unrolledEngine = {
+  unrolledCreate,
+  unrolledDestroy,
+  unrolledInsert,
+  unrolledGet,
+  unrolledRemove,
+  unrolledErase,
+  unrolledMemory,
+  unrolledVisit,
+  unrolledScan,
+  unrolledNext,
+  unrolledEraseAt
+};
@@ -4,8 +4,15 @@
 // Inform the compiler that this included module is written in C instead of C++.
 extern "C" {
 	#include "hash_table.h"
+	#include "hash_set.h"
 }
 #include "gtest/gtest.h"
+#include "static_hash_table.hpp"
+#include <unistd.h>   // For usleep, close and unlink
+#include <string.h>   // For memcmp
+#include <string>     // For latency reports
+#include <vector>     // For the values of a multimap key
+#include <pthread.h>  // For the concurrent hopscotch readers
 
 
 // Use the TEST macro to define your tests.
@@ -809,4 +816,1935 @@ TEST(CombTest, Test2)
     free(m[0]);
     // Since num_items = 3, and we deleted m[2] and destroyed m[1],
     // we need to free m[0].
-}
\ No newline at end of file
+}
+//////////////
+// TTL Tests
+//////////////
+TEST(TTLTest, GetBeforeExpiry)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+
+    size_t num_items = 1;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    // A long TTL should not affect lookups.
+    EXPECT_EQ(NULL, insertItemWithTTL(ht, 3, m[0], 60000));
+    EXPECT_EQ(m[0], getItem(ht, 3));
+
+    destroyHashTable(ht);
+}
+
+TEST(TTLTest, LazyExpiry)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+
+    size_t num_items = 2;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    insertItemWithTTL(ht, 3, m[0], 1);
+    insertItem(ht, 7, m[1]);
+    usleep(5000);
+
+    // The expired entry is missing (and its value freed by the table),
+    // while the entry without a TTL is untouched.
+    EXPECT_EQ(NULL, getItem(ht, 3));
+    EXPECT_EQ(NULL, removeItem(ht, 3));
+    EXPECT_EQ(m[1], getItem(ht, 7));
+
+    destroyHashTable(ht);
+}
+
+TEST(TTLTest, TickExpires)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+
+    size_t num_items = 100;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    for (unsigned int i = 0; i < num_items; ++i) {
+        insertItemWithTTL(ht, i, m[i], 10 + i);
+    }
+    unsigned long long now = hashTableClock();
+
+    // Nothing has expired yet.
+    EXPECT_EQ(0u, tickHashTable(ht, now));
+    EXPECT_EQ(m[0], getItem(ht, 0));
+
+    // Far in the future, every entry has expired.
+    EXPECT_EQ(num_items, tickHashTable(ht, now + 100000));
+    EXPECT_EQ(NULL, getItem(ht, 0));
+    EXPECT_EQ(NULL, getItem(ht, 99));
+
+    destroyHashTable(ht);
+}
+
+TEST(TTLTest, TickAcrossLevels)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+
+    size_t num_items = 3;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    // TTLs that land in different levels of the timing wheel.
+    insertItemWithTTL(ht, 3, m[0], 50);
+    insertItemWithTTL(ht, 7, m[1], 5000);
+    insertItemWithTTL(ht, 19, m[2], 300000);
+    unsigned long long now = hashTableClock();
+
+    // Ticks stop short of each deadline, then pass it.
+    EXPECT_EQ(0u, tickHashTable(ht, now + 40));
+    EXPECT_EQ(1u, tickHashTable(ht, now + 60));
+    unsigned int expired = 0;
+    unsigned long long t;
+    for (t = now + 60; t < now + 4990; t += 100) expired += tickHashTable(ht, t);
+    EXPECT_EQ(0u, expired);
+    for (; t < now + 5100; t += 100) expired += tickHashTable(ht, t);
+    EXPECT_EQ(1u, expired);
+    EXPECT_EQ(m[2], getItem(ht, 19));
+    for (; t < now + 301000; t += 500) expired += tickHashTable(ht, t);
+    EXPECT_EQ(2u, expired);
+    EXPECT_EQ(NULL, getItem(ht, 19));
+
+    destroyHashTable(ht);
+}
+
+TEST(TTLTest, OverwriteClearsTTL)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+
+    size_t num_items = 2;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    insertItemWithTTL(ht, 3, m[0], 1);
+    // A plain insert replaces the value and makes the entry permanent.
+    EXPECT_EQ(m[0], insertItem(ht, 3, m[1]));
+    usleep(5000);
+    EXPECT_EQ(m[1], getItem(ht, 3));
+    // The timer of the first insert is stale and must not expire anything.
+    EXPECT_EQ(0u, tickHashTable(ht, hashTableClock() + 1000));
+    EXPECT_EQ(m[1], getItem(ht, 3));
+
+    destroyHashTable(ht);
+    free(m[0]);
+}
+
+TEST(TTLTest, TickIsBounded)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+
+    size_t num_items = 3000;
+    HTItem** m = (HTItem**)malloc(num_items * sizeof(HTItem*));
+    make_items(m, num_items);
+
+    for (unsigned int i = 0; i < num_items; ++i) {
+        insertItemWithTTL(ht, i, m[i], 5);
+    }
+    unsigned long long later = hashTableClock() + 1000;
+
+    // A single tick does not expire everything at once...
+    unsigned int expired = tickHashTable(ht, later);
+    EXPECT_LT(expired, num_items);
+    EXPECT_GT(expired, 0u);
+    // ...but repeated ticks do.
+    while (expired < num_items) {
+        unsigned int more = tickHashTable(ht, later);
+        ASSERT_GT(more, 0u);
+        expired += more;
+    }
+    EXPECT_EQ(num_items, expired);
+    EXPECT_EQ(NULL, getItem(ht, 0));
+
+    destroyHashTable(ht);
+    free(m);
+}
+
+TEST(TTLTest, RefreshesCancelTimers)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+
+    HTItem* m[2];
+    make_items(m, 2);
+    insertItemWithTTL(ht, 1, m[0], 60000);
+    insertItemWithTTL(ht, 2, m[1], 60000);
+    unsigned long long bytes = hashTableMemoryUsage(ht);
+    // Refreshing a TTL replaces the key's timer rather than adding one.
+    for (int i = 0; i < 10000; ++i) {
+        insertItemWithTTL(ht, 1, removeItem(ht, 1), 60000);
+        EXPECT_EQ(m[1], insertItemWithTTL(ht, 2, m[1], 60000));
+    }
+    EXPECT_EQ(bytes, hashTableMemoryUsage(ht));
+    // Removed and overwritten keys leave no timer to fire.
+    deleteItem(ht, 1);
+    insertItem(ht, 2, m[1]);
+    EXPECT_EQ(0u, tickHashTable(ht, hashTableClock() + 120000));
+    EXPECT_EQ(m[1], getItem(ht, 2));
+
+    destroyHashTable(ht);
+}
+
+////////////////
+// Cache Tests
+////////////////
+// Count how many of the keys in [first, last) are present in the table.
+static unsigned int count_present(HashTable* ht, unsigned int first, unsigned int last)
+{
+    unsigned int present = 0;
+    for (unsigned int key = first; key < last; ++key) {
+        if (getItem(ht, key)) ++present;
+    }
+    return present;
+}
+
+TEST(CacheTest, CapacityBound)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableCache(ht, 10, 0, 0);
+
+    size_t num_items = 100;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    // Without an admission filter every insert gets in, evicting older
+    // entries (whose values the table frees).
+    for (unsigned int i = 0; i < num_items; ++i) {
+        EXPECT_EQ(NULL, insertItem(ht, i, m[i]));
+    }
+    EXPECT_EQ(10u, count_present(ht, 0, num_items));
+    EXPECT_EQ(m[99], getItem(ht, 99));
+
+    destroyHashTable(ht);
+}
+
+TEST(CacheTest, AdmissionResistsScan)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableCache(ht, 10, 64, 0);
+
+    // Build a hot set that is accessed over and over.
+    size_t num_hot = 10;
+    HTItem* hot[num_hot];
+    make_items(hot, num_hot);
+    for (unsigned int i = 0; i < num_hot; ++i) insertItem(ht, i, hot[i]);
+    for (int round = 0; round < 5; ++round) {
+        EXPECT_EQ(num_hot, count_present(ht, 0, num_hot));
+    }
+
+    // A scan touches each key once while the hot set keeps being used;
+    // rejected values are freed by the table.
+    for (unsigned int key = 1000; key < 2000; ++key) {
+        insertItem(ht, key, malloc(sizeof(HTItem)));
+        if (key % 10 == 0) count_present(ht, 0, num_hot);
+    }
+
+    // The hot set survives the scan.
+    EXPECT_EQ(num_hot, count_present(ht, 0, num_hot));
+    EXPECT_EQ(0u, count_present(ht, 1000, 2000));
+
+    destroyHashTable(ht);
+}
+
+TEST(CacheTest, FrequentKeyAdmitted)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableCache(ht, 10, 64, 0);
+
+    size_t num_items = 11;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+    for (unsigned int i = 0; i < 10; ++i) insertItem(ht, i, m[i]);
+
+    // A key that keeps being looked up eventually beats the coldest entry.
+    for (int round = 0; round < 5; ++round) EXPECT_EQ(NULL, getItem(ht, 500));
+    EXPECT_EQ(NULL, insertItem(ht, 500, m[10]));
+    EXPECT_EQ(m[10], getItem(ht, 500));
+    EXPECT_EQ(9u, count_present(ht, 0, 10));
+
+    destroyHashTable(ht);
+}
+
+////////////////
+// Trace Tests
+////////////////
+TEST(TraceTest, RecordsEveryOperation)
+{
+    char path[] = "/tmp/ht_trace_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_NE(-1, fd);
+    close(fd);
+
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    ASSERT_EQ(1, startHashTableTrace(ht, path));
+
+    size_t num_items = 2;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+    insertItem(ht, 3, m[0]);
+    insertItemWithTTL(ht, 7, m[1], 1000);
+    getItem(ht, 3);
+    free(removeItem(ht, 3));
+    deleteItem(ht, 7);
+    stopHashTableTrace(ht);
+
+    // Untraced operations after stopping.
+    getItem(ht, 3);
+    destroyHashTable(ht);
+
+    // Read back the file: magic, one chunk header, then the records.
+    FILE* file = fopen(path, "rb");
+    ASSERT_TRUE(file != NULL);
+    unsigned char data[256];
+    size_t size = fread(data, 1, sizeof(data), file);
+    fclose(file);
+    unlink(path);
+
+    ASSERT_GT(size, 24u);
+    EXPECT_EQ(0, memcmp(data, "HTTRACE1", 8));
+    unsigned int length = data[12] | (data[13] << 8) | (data[14] << 16) | (data[15] << 24);
+    EXPECT_EQ(size, 24u + length);
+
+    // Each record is an op byte, a 4-byte key and varints.
+    int ops[8];
+    unsigned int keys[8];
+    int count = 0;
+    size_t pos = 24;
+    while (pos < size && count < 8) {
+        ops[count] = data[pos];
+        keys[count] = data[pos + 1] | (data[pos + 2] << 8);
+        pos += 5;
+        while (data[pos] & 0x80) ++pos;                 // time delta
+        ++pos;
+        if (ops[count] == 2) {                          // insert with TTL
+            while (data[pos] & 0x80) ++pos;
+            ++pos;
+        }
+        ++count;
+    }
+    ASSERT_EQ(5, count);
+    EXPECT_EQ(1, ops[0]); EXPECT_EQ(3u, keys[0]);
+    EXPECT_EQ(2, ops[1]); EXPECT_EQ(7u, keys[1]);
+    EXPECT_EQ(3, ops[2]); EXPECT_EQ(3u, keys[2]);
+    EXPECT_EQ(4, ops[3]); EXPECT_EQ(3u, keys[3]);
+    EXPECT_EQ(5, ops[4]); EXPECT_EQ(7u, keys[4]);
+}
+
+TEST(TraceTest, BadPath)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    EXPECT_EQ(0, startHashTableTrace(ht, "/nonexistent/dir/trace"));
+    // The table keeps working without a trace.
+    EXPECT_EQ(NULL, getItem(ht, 3));
+    destroyHashTable(ht);
+}
+
+//////////////////
+// Latency Tests
+//////////////////
+// Dump the latency report of the table into a string.
+static std::string latency_report(HashTable* ht)
+{
+    char buffer[4096];
+    FILE* out = fmemopen(buffer, sizeof(buffer), "w");
+    dumpHashTableLatency(ht, out);
+    fclose(out);
+    return std::string(buffer);
+}
+
+TEST(LatencyTest, RecordsEachOperation)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableLatency(ht, 1);
+
+    size_t num_items = 3;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+    insertItem(ht, 3, m[0]);
+    insertItem(ht, 7, m[1]);
+    insertItemWithTTL(ht, 19, m[2], 1000);
+    for (int i = 0; i < 10; ++i) getItem(ht, 3);
+    free(removeItem(ht, 3));
+
+    std::string report = latency_report(ht);
+    EXPECT_NE(std::string::npos, report.find("p99.9"));
+    EXPECT_NE(std::string::npos, report.find("insertItem "));
+    EXPECT_NE(std::string::npos, report.find("insertItemTTL"));
+    EXPECT_NE(std::string::npos, report.find("removeItem"));
+    // No deleteItem was made, so it has no line.
+    EXPECT_EQ(std::string::npos, report.find("deleteItem"));
+    // Every getItem was sampled.
+    size_t line = report.find("getItem");
+    ASSERT_NE(std::string::npos, line);
+    EXPECT_EQ(10, atoi(report.c_str() + line + strlen("getItem")));
+
+    destroyHashTable(ht);
+}
+
+TEST(LatencyTest, Sampling)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableLatency(ht, 4);
+
+    for (int i = 0; i < 100; ++i) getItem(ht, i);
+
+    std::string report = latency_report(ht);
+    size_t line = report.find("getItem");
+    ASSERT_NE(std::string::npos, line);
+    EXPECT_EQ(25, atoi(report.c_str() + line + strlen("getItem")));
+
+    // Disabling drops the histograms.
+    enableHashTableLatency(ht, 0);
+    EXPECT_EQ(std::string::npos, latency_report(ht).find("getItem"));
+
+    destroyHashTable(ht);
+}
+
+////////////////
+// Tree Bin Tests
+////////////////
+// A hash function that sends every key to the same bucket.
+unsigned int one_bucket(unsigned int key)
+{
+    (void)key;
+    return 0;
+}
+
+TEST(TreeBinTest, CrowdedBucket)
+{
+    HashTable* ht = createHashTable(one_bucket, 1);
+
+    size_t num_items = 1000;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    // Insert in a shuffled order, so the bin has to sort.
+    for (unsigned int i = 0; i < num_items; ++i) {
+        unsigned int key = (i * 7919) % num_items;
+        EXPECT_EQ(NULL, insertItem(ht, key, m[key]));
+    }
+    for (unsigned int key = 0; key < num_items; ++key) {
+        EXPECT_EQ(m[key], getItem(ht, key));
+    }
+    EXPECT_EQ(NULL, getItem(ht, num_items));
+
+    // Overwriting inside the bin hands back the old value.
+    HTItem* replacement = (HTItem*) malloc(sizeof(HTItem));
+    EXPECT_EQ(m[500], insertItem(ht, 500, replacement));
+    free(m[500]);
+    EXPECT_EQ(replacement, getItem(ht, 500));
+
+    // Remove the odd keys, delete the multiples of four.
+    for (unsigned int key = 1; key < num_items; key += 2) {
+        EXPECT_EQ(m[key], removeItem(ht, key));
+        free(m[key]);
+    }
+    for (unsigned int key = 0; key < num_items; key += 4) deleteItem(ht, key);
+    for (unsigned int key = 0; key < num_items; ++key) {
+        if (key % 4 == 2) EXPECT_NE((void*)NULL, getItem(ht, key));
+        else EXPECT_EQ(NULL, getItem(ht, key));
+    }
+
+    destroyHashTable(ht);
+}
+
+TEST(TreeBinTest, ShrinksBackToChain)
+{
+    HashTable* ht = createHashTable(one_bucket, 1);
+
+    size_t num_items = 20;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    // Grow past the treeify threshold, shrink to a few entries, grow again.
+    for (unsigned int key = 0; key < num_items; ++key) insertItem(ht, key, m[key]);
+    for (unsigned int key = 3; key < num_items; ++key) {
+        EXPECT_EQ(m[key], removeItem(ht, key));
+    }
+    for (unsigned int key = 0; key < 3; ++key) EXPECT_EQ(m[key], getItem(ht, key));
+    for (unsigned int key = 3; key < num_items; ++key) {
+        EXPECT_EQ(NULL, getItem(ht, key));
+        EXPECT_EQ(NULL, insertItem(ht, key, m[key]));
+    }
+    for (unsigned int key = 0; key < num_items; ++key) EXPECT_EQ(m[key], getItem(ht, key));
+
+    destroyHashTable(ht);
+}
+
+TEST(TreeBinTest, ExpiryAndEvictionInBin)
+{
+    HashTable* ht = createHashTable(one_bucket, 1);
+
+    // Entries with a TTL expire out of the bin.
+    for (unsigned int key = 0; key < 50; ++key) {
+        insertItemWithTTL(ht, key, malloc(sizeof(HTItem)), key % 2 ? 1 : 1000000);
+    }
+    usleep(5000);
+    EXPECT_EQ(25u, tickHashTable(ht, hashTableClock()));
+    for (unsigned int key = 0; key < 50; ++key) {
+        if (key % 2) EXPECT_EQ(NULL, getItem(ht, key));
+        else EXPECT_NE((void*)NULL, getItem(ht, key));
+    }
+
+    // A full cache evicts from the bin to make room.
+    enableHashTableCache(ht, 25, 0, 0);
+    for (unsigned int key = 100; key < 200; ++key) insertItem(ht, key, malloc(sizeof(HTItem)));
+    EXPECT_EQ(25u, count_present(ht, 0, 200));
+
+    destroyHashTable(ht);
+}
+
+////////////////
+// Flooding Tests
+////////////////
+// A table of 1024 buckets indexed by the low bits of the key, which an
+// attacker defeats by sending multiples of 1024.
+#define FLOOD_BUCKETS 1024
+unsigned int low_bits(unsigned int key)
+{
+    return key % FLOOD_BUCKETS;
+}
+
+TEST(FloodTest, CollidingKeysReseed)
+{
+    HashTable* ht = createHashTable(low_bits, FLOOD_BUCKETS);
+
+    // Some honest traffic first, so the rehash has entries to move.
+    size_t num_items = 3000;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+    for (unsigned int i = 0; i < 2000; ++i) insertItem(ht, i, m[i]);
+    EXPECT_EQ(0u, hashTableReseedCount(ht));
+
+    // Then keys that all land in bucket 0.
+    for (unsigned int i = 2000; i < num_items; ++i) {
+        insertItem(ht, (i - 2000) * FLOOD_BUCKETS + FLOOD_BUCKETS * 4, m[i]);
+        // every key stays reachable while the entries are being moved
+        if (i % 97 == 0) {
+            EXPECT_EQ(m[i % 2000], getItem(ht, i % 2000));
+        }
+    }
+    EXPECT_EQ(1u, hashTableReseedCount(ht));
+
+    for (unsigned int i = 0; i < 2000; ++i) EXPECT_EQ(m[i], getItem(ht, i));
+    for (unsigned int i = 2000; i < num_items; ++i) {
+        unsigned int key = (i - 2000) * FLOOD_BUCKETS + FLOOD_BUCKETS * 4;
+        EXPECT_EQ(m[i], removeItem(ht, key));
+        free(m[i]);
+    }
+    for (unsigned int i = 0; i < 2000; ++i) deleteItem(ht, i);
+    EXPECT_EQ(NULL, getItem(ht, 5));
+
+    destroyHashTable(ht);
+}
+
+TEST(FloodTest, HonestLoadDoesNotReseed)
+{
+    // Long chains that match the load factor are not an attack.
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    for (unsigned int key = 0; key < 3000; ++key) insertItem(ht, key, malloc(sizeof(HTItem)));
+    EXPECT_EQ(0u, hashTableReseedCount(ht));
+    destroyHashTable(ht);
+
+    ht = createHashTable(one_bucket, 1);
+    for (unsigned int key = 0; key < 1000; ++key) insertItem(ht, key, malloc(sizeof(HTItem)));
+    EXPECT_EQ(0u, hashTableReseedCount(ht));
+    destroyHashTable(ht);
+}
+
+TEST(FloodTest, DestroyDuringRehash)
+{
+    HashTable* ht = createHashTable(low_bits, FLOOD_BUCKETS);
+    for (unsigned int i = 0; i < 5000; ++i) insertItem(ht, i, malloc(sizeof(HTItem)));
+    for (unsigned int i = 0; i < 100; ++i) {
+        insertItemWithTTL(ht, (i + 10) * FLOOD_BUCKETS, malloc(sizeof(HTItem)), 1000000);
+    }
+    EXPECT_EQ(1u, hashTableReseedCount(ht));
+    // Both bucket arrays are freed, along with every value.
+    destroyHashTable(ht);
+}
+
+////////////////
+// Layout Tests
+////////////////
+// Run the same sequence of operations against a table of any layout, with
+// chains long enough to exercise unlinking from the middle.
+static void exercise_layout(HashTableLayout layout)
+{
+    HashTable* ht = createHashTableWithLayout(hash, BUCKET_NUM, layout);
+
+    size_t num_items = 300;
+    HTItem* m[num_items];
+    make_items(m, num_items);
+
+    for (unsigned int key = 0; key < num_items; ++key) {
+        EXPECT_EQ(NULL, getItem(ht, key));
+        EXPECT_EQ(NULL, insertItem(ht, key, m[key]));
+    }
+    for (unsigned int key = 0; key < num_items; ++key) EXPECT_EQ(m[key], getItem(ht, key));
+
+    // Overwrite hands back the old value.
+    HTItem* replacement = (HTItem*) malloc(sizeof(HTItem));
+    EXPECT_EQ(m[7], insertItem(ht, 7, replacement));
+    free(m[7]);
+    m[7] = replacement;
+    EXPECT_EQ(replacement, getItem(ht, 7));
+
+    // Remove every third key, delete the next one, and reinsert some.
+    for (unsigned int key = 0; key < num_items; key += 3) {
+        EXPECT_EQ(m[key], removeItem(ht, key));
+        EXPECT_EQ(NULL, removeItem(ht, key));
+        deleteItem(ht, key + 1);
+    }
+    for (unsigned int key = 0; key < num_items; key += 6) {
+        EXPECT_EQ(NULL, insertItem(ht, key, m[key]));
+    }
+    for (unsigned int key = 0; key < num_items; ++key) {
+        if (key % 3 == 0 && key % 6 != 0) {
+            EXPECT_EQ(NULL, getItem(ht, key));
+            free(m[key]);
+        }
+        else if (key % 3 == 1) EXPECT_EQ(NULL, getItem(ht, key));
+        else EXPECT_EQ(m[key], getItem(ht, key));
+    }
+    EXPECT_GT(hashTableMemoryUsage(ht), 0u);
+
+    destroyHashTable(ht);
+}
+
+// The memory a table of the layout uses for n entries in FLOOD_BUCKETS buckets.
+static unsigned long long layout_memory(HashTableLayout layout, unsigned int n)
+{
+    HashTable* ht = createHashTableWithLayout(low_bits, FLOOD_BUCKETS, layout);
+    for (unsigned int key = 0; key < n; ++key) insertItem(ht, key, NULL);
+    unsigned long long bytes = hashTableMemoryUsage(ht);
+    destroyHashTable(ht);
+    return bytes;
+}
+
+TEST(LayoutTest, Chained)
+{
+    exercise_layout(HT_LAYOUT_CHAINED);
+}
+
+TEST(LayoutTest, Compact)
+{
+    exercise_layout(HT_LAYOUT_COMPACT);
+    // Two thirds of the chained entry size or less, even with a pool that
+    // is not full.
+    EXPECT_LT(layout_memory(HT_LAYOUT_COMPACT, 1000) * 3,
+              layout_memory(HT_LAYOUT_CHAINED, 1000) * 2);
+}
+
+TEST(LayoutTest, Unrolled)
+{
+    exercise_layout(HT_LAYOUT_UNROLLED);
+
+    // Removing from a full node refills it from the head node.
+    HashTable* ht = createHashTableWithLayout(one_bucket, 1, HT_LAYOUT_UNROLLED);
+    for (unsigned int key = 0; key < 20; ++key) insertItem(ht, key, malloc(sizeof(HTItem)));
+    for (unsigned int key = 0; key < 20; key += 2) deleteItem(ht, key);
+    for (unsigned int key = 0; key < 20; ++key) {
+        if (key % 2) EXPECT_NE((void*)NULL, getItem(ht, key));
+        else EXPECT_EQ(NULL, getItem(ht, key));
+    }
+    destroyHashTable(ht);
+}
+
+TEST(LayoutTest, Inline)
+{
+    exercise_layout(HT_LAYOUT_INLINE);
+
+    // Removing the inline entry promotes an overflow entry into the slot.
+    HashTable* ht = createHashTableWithLayout(one_bucket, 1, HT_LAYOUT_INLINE);
+    HTItem* m[3];
+    make_items(m, 3);
+    for (unsigned int key = 0; key < 3; ++key) insertItem(ht, key, m[key]);
+    EXPECT_EQ(m[0], removeItem(ht, 0));
+    free(m[0]);
+    EXPECT_EQ(m[1], getItem(ht, 1));
+    EXPECT_EQ(m[2], getItem(ht, 2));
+    deleteItem(ht, 2);
+    deleteItem(ht, 1);
+    EXPECT_EQ(NULL, getItem(ht, 1));
+    EXPECT_EQ(NULL, insertItem(ht, 1, malloc(sizeof(HTItem))));
+    destroyHashTable(ht);
+}
+
+struct HopscotchReaders {
+    HashTable* ht;
+    HTItem** items;
+    unsigned int num_stable;
+    int done;
+    unsigned long long misses;
+};
+
+static void* read_stable_keys(void* arg)
+{
+    HopscotchReaders* readers = (HopscotchReaders*) arg;
+    unsigned long long misses = 0;
+    while (!__atomic_load_n(&readers->done, __ATOMIC_RELAXED)) {
+        for (unsigned int key = 0; key < readers->num_stable; ++key) {
+            if (getItem(readers->ht, key) != readers->items[key]) ++misses;
+        }
+    }
+    __atomic_fetch_add(&readers->misses, misses, __ATOMIC_RELAXED);
+    return NULL;
+}
+
+TEST(LayoutTest, Hopscotch)
+{
+    exercise_layout(HT_LAYOUT_HOPSCOTCH);
+
+    // Lock-free readers never miss a present key while a writer inserts,
+    // hops and removes entries around it and the table doubles many times.
+    HopscotchReaders readers;
+    readers.ht = createHashTableWithLayout(hash, 1, HT_LAYOUT_HOPSCOTCH);
+    readers.num_stable = 500;
+    readers.done = 0;
+    readers.misses = 0;
+    HTItem* m[500];
+    make_items(m, 500);
+    readers.items = m;
+    for (unsigned int key = 0; key < readers.num_stable; ++key) insertItem(readers.ht, key, m[key]);
+
+    pthread_t threads[3];
+    for (int i = 0; i < 3; ++i) pthread_create(&threads[i], NULL, read_stable_keys, &readers);
+    for (unsigned int key = 1000; key < 60000; ++key) {
+        insertItem(readers.ht, key, malloc(sizeof(HTItem)));
+        if (key % 2) deleteItem(readers.ht, key - 1);
+    }
+    __atomic_store_n(&readers.done, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < 3; ++i) pthread_join(threads[i], NULL);
+    EXPECT_EQ(0u, readers.misses);
+    for (unsigned int key = 0; key < readers.num_stable; ++key) {
+        EXPECT_EQ(m[key], getItem(readers.ht, key));
+    }
+    destroyHashTable(readers.ht);
+}
+
+TEST(LayoutTest, Linear)
+{
+    exercise_layout(HT_LAYOUT_LINEAR);
+
+    // Memory follows the entries: no insert allocates more than one entry,
+    // one segment of buckets and a bigger segment directory, and removals
+    // merge buckets back, one per removal.
+    HashTable* ht = createHashTableWithLayout(hash, 1, HT_LAYOUT_LINEAR);
+    unsigned long long previous = hashTableMemoryUsage(ht), largest_step = 0;
+    for (unsigned int key = 0; key < 20000; ++key) {
+        insertItem(ht, key, malloc(sizeof(HTItem)));
+        unsigned long long now = hashTableMemoryUsage(ht);
+        if (now - previous > largest_step) largest_step = now - previous;
+        previous = now;
+    }
+    EXPECT_LT(largest_step, 5000u);
+    for (unsigned int key = 0; key < 20000; ++key) EXPECT_NE((void*)NULL, getItem(ht, key));
+    for (unsigned int key = 0; key < 20000; ++key) deleteItem(ht, key);
+    EXPECT_LT(hashTableMemoryUsage(ht) * 8, previous);
+    EXPECT_EQ(NULL, getItem(ht, 5));
+    EXPECT_EQ(NULL, insertItem(ht, 5, malloc(sizeof(HTItem))));
+    EXPECT_NE((void*)NULL, getItem(ht, 5));
+    destroyHashTable(ht);
+}
+
+// Fill a paged table far past one page, check every key, then empty it
+// again so the pages merge back.
+static void exercise_pages(HashTable* ht)
+{
+    unsigned int num_keys = 20000;
+    for (unsigned int key = 0; key < num_keys; ++key) {
+        EXPECT_EQ(NULL, insertItem(ht, key, malloc(sizeof(HTItem))));
+    }
+    unsigned long long full = hashTableMemoryUsage(ht);
+    for (unsigned int key = 0; key < num_keys; ++key) EXPECT_NE((void*)NULL, getItem(ht, key));
+    EXPECT_EQ(NULL, getItem(ht, num_keys));
+    for (unsigned int key = 0; key < num_keys; key += 2) deleteItem(ht, key);
+    for (unsigned int key = 0; key < num_keys; ++key) {
+        if (key % 2) {
+            EXPECT_NE((void*)NULL, getItem(ht, key));
+        } else {
+            EXPECT_EQ(NULL, getItem(ht, key));
+        }
+    }
+    for (unsigned int key = 1; key < num_keys; key += 2) deleteItem(ht, key);
+    EXPECT_LT(hashTableMemoryUsage(ht), full);
+    EXPECT_EQ(NULL, insertItem(ht, 3, malloc(sizeof(HTItem))));
+    EXPECT_NE((void*)NULL, getItem(ht, 3));
+}
+
+TEST(LayoutTest, Extendible)
+{
+    exercise_layout(HT_LAYOUT_EXTENDIBLE);
+
+    HashTable* ht = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_EXTENDIBLE);
+    exercise_pages(ht);
+    destroyHashTable(ht);
+
+    // Destroy frees each page once, however many directory slots share it.
+    ht = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_EXTENDIBLE);
+    for (unsigned int key = 0; key < 5000; ++key) insertItem(ht, key, malloc(sizeof(HTItem)));
+    destroyHashTable(ht);
+}
+
+TEST(LayoutTest, ExtendibleInFile)
+{
+    char path[] = "/tmp/ht_pages_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+
+    HashTable* ht = createHashTableInFile(path);
+    ASSERT_TRUE(ht != NULL);
+    exercise_pages(ht);
+    // Only the directory and two page buffers are in memory.
+    EXPECT_LT(hashTableMemoryUsage(ht), 3 * 4096u);
+    destroyHashTable(ht);
+    unlink(path);
+
+    EXPECT_EQ(NULL, createHashTableInFile("/nonexistent/dir/pages"));
+}
+
+TEST(LayoutTest, ChainedOnlyFeatures)
+{
+    HashTable* ht = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COMPACT);
+    EXPECT_EXIT(insertItemWithTTL(ht, 1, NULL, 10), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(enableHashTableCache(ht, 10, 0, 0), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(ht);
+}
+
+////////////////
+// Tag Tests
+////////////////
+TEST(TagTest, ShortChains)
+{
+    // About 6 entries per bucket: chains stay short, so lookups go through
+    // the bucket tags rather than tree bins.
+    HashTable* ht = createHashTable(low_bits, FLOOD_BUCKETS);
+    unsigned int num_keys = 6 * FLOOD_BUCKETS;
+    for (unsigned int key = 0; key < num_keys; ++key) {
+        insertItem(ht, key * 7, malloc(sizeof(HTItem)));
+    }
+    // Misses, some of which share a bucket and a tag with present keys.
+    for (unsigned int key = 0; key < 7 * num_keys; ++key) {
+        if (key % 7) {
+            EXPECT_EQ(NULL, getItem(ht, key));
+        }
+    }
+    // Remove entries from the middle of chains, and check nobody else's tag
+    // went with them.
+    for (unsigned int key = 0; key < num_keys; key += 2) deleteItem(ht, key * 7);
+    for (unsigned int key = 0; key < num_keys; ++key) {
+        if (key % 2) EXPECT_NE((void*)NULL, getItem(ht, key * 7));
+        else EXPECT_EQ(NULL, getItem(ht, key * 7));
+    }
+    for (unsigned int key = 0; key < num_keys; key += 2) {
+        EXPECT_EQ(NULL, insertItem(ht, key * 7, malloc(sizeof(HTItem))));
+    }
+    for (unsigned int key = 0; key < num_keys; ++key) EXPECT_NE((void*)NULL, getItem(ht, key * 7));
+    EXPECT_EQ(0u, hashTableReseedCount(ht));
+
+    destroyHashTable(ht);
+}
+
+////////////////
+// Freeze Tests
+////////////////
+// Check a frozen table holds exactly the values in m for the keys where m is
+// not NULL, and nothing for keys up to twice as far.
+static void expect_frozen(HashTable* ht, HTItem* m[], unsigned int num_keys)
+{
+    for (unsigned int key = 0; key < num_keys; ++key) EXPECT_EQ(m[key], getItem(ht, key));
+    for (unsigned int key = num_keys; key < 2 * num_keys; ++key) EXPECT_EQ(NULL, getItem(ht, key));
+}
+
+TEST(FreezeTest, EveryLayout)
+{
+    HashTableLayout layouts[] = { HT_LAYOUT_CHAINED, HT_LAYOUT_COMPACT, HT_LAYOUT_UNROLLED,
+                                  HT_LAYOUT_INLINE, HT_LAYOUT_HOPSCOTCH, HT_LAYOUT_LINEAR,
+                                  HT_LAYOUT_EXTENDIBLE };
+    for (size_t l = 0; l < sizeof(layouts) / sizeof(layouts[0]); ++l) {
+        HashTable* ht = createHashTableWithLayout(hash, BUCKET_NUM, layouts[l]);
+        unsigned int num_keys = 2000;
+        HTItem* m[num_keys];
+        make_items(m, num_keys);
+        for (unsigned int key = 0; key < num_keys; ++key) insertItem(ht, key, m[key]);
+        for (unsigned int key = 0; key < num_keys; key += 3) {
+            deleteItem(ht, key);
+            m[key] = NULL;
+        }
+        freezeHashTable(ht);
+        expect_frozen(ht, m, num_keys);
+        // Freezing again changes nothing.
+        freezeHashTable(ht);
+        expect_frozen(ht, m, num_keys);
+        destroyHashTable(ht);
+    }
+}
+
+TEST(FreezeTest, ChainedExtras)
+{
+    // Tree bins, an unfinished rehash after a flood, and TTLs.
+    HashTable* ht = createHashTable(low_bits, FLOOD_BUCKETS);
+    unsigned int num_keys = 3000;
+    HTItem* m[num_keys];
+    make_items(m, num_keys);
+    for (unsigned int i = 0; i < 2000; ++i) insertItem(ht, i, m[i]);
+    for (unsigned int i = 2000; i < num_keys; ++i) {
+        insertItem(ht, (i - 2000) * FLOOD_BUCKETS + FLOOD_BUCKETS * 4, m[i]);
+    }
+    EXPECT_EQ(1u, hashTableReseedCount(ht));
+    HTItem* expired = (HTItem*) malloc(sizeof(HTItem));
+    insertItemWithTTL(ht, 5000000, expired, 1);
+    HTItem* alive = (HTItem*) malloc(sizeof(HTItem));
+    insertItemWithTTL(ht, 5000001, alive, 100000);
+    usleep(5000);
+
+    freezeHashTable(ht);
+    for (unsigned int i = 0; i < 2000; ++i) EXPECT_EQ(m[i], getItem(ht, i));
+    for (unsigned int i = 2000; i < num_keys; ++i) {
+        EXPECT_EQ(m[i], getItem(ht, (i - 2000) * FLOOD_BUCKETS + FLOOD_BUCKETS * 4));
+    }
+    EXPECT_EQ(NULL, getItem(ht, 5000000));
+    EXPECT_EQ(alive, getItem(ht, 5000001));
+    EXPECT_EQ(0u, tickHashTable(ht, hashTableClock() + 1000000));
+    EXPECT_EQ(alive, getItem(ht, 5000001));
+    destroyHashTable(ht);
+}
+
+TEST(FreezeTest, FewBitsPerKey)
+{
+    HashTable* ht = createHashTable(low_bits, FLOOD_BUCKETS);
+    unsigned int num_keys = 100000;
+    for (unsigned int key = 0; key < num_keys; ++key) {
+        insertItem(ht, key * 2654435761u, malloc(sizeof(HTItem)));
+    }
+    freezeHashTable(ht);
+    // 12 bytes of key and value per entry, and less than one byte of index.
+    EXPECT_LT(hashTableMemoryUsage(ht), num_keys * 13ull);
+    for (unsigned int key = 0; key < num_keys; ++key) {
+        EXPECT_NE((void*)NULL, getItem(ht, key * 2654435761u));
+    }
+    destroyHashTable(ht);
+}
+
+TEST(FreezeTest, EmptyAndImmutable)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    freezeHashTable(ht);
+    EXPECT_EQ(NULL, getItem(ht, 1));
+    EXPECT_EXIT(insertItem(ht, 1, NULL), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(removeItem(ht, 1), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(deleteItem(ht, 1), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(insertItemWithTTL(ht, 1, NULL, 10), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(enableHashTableCache(ht, 10, 0, 0), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(ht);
+}
+
+////////////////
+// Static Hash Table Tests
+////////////////
+// Built entirely by the compiler.
+constexpr auto static_opcodes = makeStaticHashTable<int>({
+    {0x00, 1}, {0x01, 2}, {0x3c, 3}, {0x90, 4}, {0xc3, 5}, {0xe8, 6}, {0xe9, 7}, {0xff, 8}});
+static_assert(static_opcodes.size() == 8, "");
+static_assert(*static_opcodes.find(0x90) == 4, "");
+static_assert(static_opcodes.find(0x02) == nullptr, "");
+static_assert(!static_opcodes.contains(0x100), "");
+
+TEST(StaticHashTest, SmallSet)
+{
+    const unsigned int keys[] = {0x00, 0x01, 0x3c, 0x90, 0xc3, 0xe8, 0xe9, 0xff};
+    for (unsigned int i = 0; i < 8; ++i) {
+        ASSERT_TRUE(static_opcodes.find(keys[i]) != nullptr);
+        EXPECT_EQ((int)i + 1, *static_opcodes.find(keys[i]));
+    }
+    // Every other key misses, including those sharing a slot with a key and
+    // the key copied into the empty slots.
+    unsigned int found = 0;
+    for (unsigned int key = 0; key < 100000; ++key) found += static_opcodes.contains(key);
+    EXPECT_EQ(8u, found);
+}
+
+TEST(StaticHashTest, SequentialIdsAndExplicitBits)
+{
+    // 64 enum-like IDs in the default 512 slots, and in 128 slots.
+    static constexpr StaticHashEntry<unsigned int> ids[] = {
+        {100, 0}, {101, 1}, {102, 2}, {103, 3}, {104, 4}, {105, 5}, {106, 6}, {107, 7},
+        {108, 8}, {109, 9}, {110, 10}, {111, 11}, {112, 12}, {113, 13}, {114, 14}, {115, 15},
+        {116, 16}, {117, 17}, {118, 18}, {119, 19}, {120, 20}, {121, 21}, {122, 22}, {123, 23},
+        {124, 24}, {125, 25}, {126, 26}, {127, 27}, {128, 28}, {129, 29}, {130, 30}, {131, 31},
+        {132, 32}, {133, 33}, {134, 34}, {135, 35}, {136, 36}, {137, 37}, {138, 38}, {139, 39},
+        {140, 40}, {141, 41}, {142, 42}, {143, 43}, {144, 44}, {145, 45}, {146, 46}, {147, 47},
+        {148, 48}, {149, 49}, {150, 50}, {151, 51}, {152, 52}, {153, 53}, {154, 54}, {155, 55},
+        {156, 56}, {157, 57}, {158, 58}, {159, 59}, {160, 60}, {161, 61}, {162, 62}, {163, 63}};
+    constexpr auto wide = makeStaticHashTable(ids);
+    constexpr auto tight = StaticHashTable<unsigned int, 64, 7>::build(ids);
+    static_assert(sizeof(tight) < sizeof(wide), "");
+    for (unsigned int key = 0; key < 1000; ++key) {
+        bool present = key >= 100 && key < 164;
+        EXPECT_EQ(present, wide.contains(key));
+        EXPECT_EQ(present, tight.contains(key));
+        if (present) {
+            EXPECT_EQ(key - 100, *wide.find(key));
+            EXPECT_EQ(key - 100, *tight.find(key));
+        }
+    }
+}
+
+////////////////
+// Multimap Tests
+////////////////
+
+// Appends the value, an int, to a std::vector<int>.
+static void collect_value(void* context, void* value)
+{
+    ((std::vector<int>*)context)->push_back(*(int*)value);
+}
+
+static int* make_int(int n)
+{
+    int* value = (int*)malloc(sizeof(int));
+    *value = n;
+    return value;
+}
+
+TEST(MultimapTest, DuplicateKeys)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableMultimap(ht);
+    unsigned long long empty = hashTableMemoryUsage(ht);
+    for (int i = 0; i < 5; ++i) EXPECT_EQ(NULL, insertItem(ht, 7, make_int(i)));
+    EXPECT_EQ(NULL, insertItem(ht, 10, make_int(100)));
+    EXPECT_EQ(5u, countKey(ht, 7));
+    EXPECT_EQ(1u, countKey(ht, 10));
+    EXPECT_EQ(0u, countKey(ht, 4));
+    EXPECT_GT(hashTableMemoryUsage(ht), empty);
+
+    // getAll sees the values in insertion order, and only those of the key.
+    std::vector<int> values;
+    EXPECT_EQ(5u, getAll(ht, 7, collect_value, &values));
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3, 4}), values);
+    EXPECT_EQ(0u, getAll(ht, 4, collect_value, &values));
+
+    // getItem, removeItem and deleteItem act on the first value.
+    EXPECT_EQ(0, *(int*)getItem(ht, 7));
+    int* first = (int*)removeItem(ht, 7);
+    EXPECT_EQ(0, *first);
+    free(first);
+    deleteItem(ht, 7);
+    EXPECT_EQ(2, *(int*)getItem(ht, 7));
+    EXPECT_EQ(3u, countKey(ht, 7));
+
+    EXPECT_EQ(3u, removeAll(ht, 7));
+    EXPECT_EQ(0u, removeAll(ht, 7));
+    EXPECT_EQ(NULL, getItem(ht, 7));
+    free(removeItem(ht, 10));
+    EXPECT_EQ(0u, countKey(ht, 10));
+    EXPECT_EQ(empty, hashTableMemoryUsage(ht));
+    // destroying frees the values left behind
+    insertItem(ht, 1, make_int(1));
+    insertItem(ht, 1, make_int(2));
+    destroyHashTable(ht);
+}
+
+TEST(MultimapTest, ManyKeysInOneBucket)
+{
+    // The keys of a crowded bucket move into a tree bin, values and all.
+    HashTable* ht = createHashTable(one_bucket, 1);
+    enableHashTableMultimap(ht);
+    for (int round = 0; round < 3; ++round) {
+        for (int key = 0; key < 100; ++key) insertItem(ht, key, make_int(key * 10 + round));
+    }
+    for (unsigned int key = 0; key < 100; ++key) {
+        std::vector<int> values;
+        EXPECT_EQ(3u, getAll(ht, key, collect_value, &values));
+        EXPECT_EQ(std::vector<int>({(int)key * 10, (int)key * 10 + 1, (int)key * 10 + 2}), values);
+    }
+    for (unsigned int key = 0; key < 100; key += 2) EXPECT_EQ(3u, removeAll(ht, key));
+    for (unsigned int key = 0; key < 100; ++key) EXPECT_EQ(key % 2 ? 3u : 0u, countKey(ht, key));
+    destroyHashTable(ht);
+}
+
+TEST(MultimapTest, SingleValuedTables)
+{
+    // Without multimap mode every key has at most one value, on any layout.
+    HashTable* chained = createHashTable(hash, BUCKET_NUM);
+    HashTable* compact = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COMPACT);
+    HashTable* tables[] = {chained, compact};
+    for (HashTable* ht : tables) {
+        free(insertItem(ht, 7, make_int(1)));
+        free(insertItem(ht, 7, make_int(2)));
+        std::vector<int> values;
+        EXPECT_EQ(1u, getAll(ht, 7, collect_value, &values));
+        EXPECT_EQ(std::vector<int>({2}), values);
+        EXPECT_EQ(1u, countKey(ht, 7));
+        EXPECT_EQ(0u, countKey(ht, 8));
+        EXPECT_EQ(1u, removeAll(ht, 7));
+        EXPECT_EQ(0u, removeAll(ht, 7));
+        destroyHashTable(ht);
+    }
+}
+
+TEST(MultimapTest, TakesValuesInOrder)
+{
+    // Values leave in insertion order, while more keep coming, and taking
+    // the first one does not move the others.
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableMultimap(ht);
+    int next_in = 0, next_out = 0;
+    for (int round = 0; round < 4; ++round) {
+        for (int i = 0; i < 50000; ++i) insertItem(ht, 7, make_int(next_in++));
+        for (int i = 0; i < 30000; ++i) {
+            int* value = (int*)removeItem(ht, 7);
+            ASSERT_EQ(next_out++, *value);
+            free(value);
+        }
+        EXPECT_EQ((unsigned int)(next_in - next_out), countKey(ht, 7));
+        EXPECT_EQ(next_out, *(int*)getItem(ht, 7));
+    }
+    while (countKey(ht, 7)) deleteItem(ht, 7);
+    EXPECT_EQ(NULL, getItem(ht, 7));
+    destroyHashTable(ht);
+}
+
+TEST(MultimapTest, Restrictions)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    insertItem(ht, 1, make_int(1));
+    EXPECT_EXIT(enableHashTableMultimap(ht), ::testing::ExitedWithCode(1), "");
+    deleteItem(ht, 1);
+    enableHashTableMultimap(ht);
+    EXPECT_EXIT(insertItemWithTTL(ht, 1, NULL, 10), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(enableHashTableCache(ht, 10, 0, 0), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(freezeHashTable(ht), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(ht);
+    HashTable* compact = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COMPACT);
+    EXPECT_EXIT(enableHashTableMultimap(compact), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(compact);
+}
+
+////////////////
+// Inline Value Tests
+////////////////
+
+TEST(InlineValueTest, Integers)
+{
+    HashTable* ht = createHashTableWithValueSize(hash, BUCKET_NUM, sizeof(long long));
+    EXPECT_EQ(NULL, getItemRef(ht, 1));
+    for (long long key = 0; key < 1000; ++key) {
+        long long value = key * 3;
+        long long* stored = (long long*)insertItemCopy(ht, (unsigned int)key, &value);
+        EXPECT_EQ(value, *stored);
+    }
+    for (unsigned int key = 0; key < 1000; ++key) {
+        long long* value = (long long*)getItemRef(ht, key);
+        ASSERT_TRUE(value != NULL);
+        EXPECT_EQ(3LL * key, *value);
+        // updated in place
+        *value += 1;
+    }
+    EXPECT_EQ(7, *(long long*)getItem(ht, 2));
+
+    // Overwriting copies the new bytes over the old ones.
+    long long value = -5;
+    insertItemCopy(ht, 10, &value);
+    EXPECT_EQ(-5, *(long long*)getItemRef(ht, 10));
+    deleteItem(ht, 10);
+    EXPECT_EQ(NULL, getItemRef(ht, 10));
+    EXPECT_EQ(4, *(long long*)getItemRef(ht, 1));
+
+    // 16 bytes per entry for the key, link and value, and no allocation per value.
+    EXPECT_LT(hashTableMemoryUsage(ht), 2048 * 16 + 1024);
+    destroyHashTable(ht);
+}
+
+struct SmallStruct {
+    unsigned int id;
+    unsigned short flags;
+    unsigned char level;
+};
+
+TEST(InlineValueTest, SmallStructsAndOddSizes)
+{
+    HashTable* ht = createHashTableWithValueSize(hash, BUCKET_NUM, sizeof(SmallStruct));
+    for (unsigned int key = 0; key < 100; ++key) {
+        SmallStruct value = {key, (unsigned short)(key * 2), (unsigned char)key};
+        insertItemCopy(ht, key, &value);
+    }
+    for (unsigned int key = 0; key < 100; ++key) {
+        SmallStruct* value = (SmallStruct*)getItemRef(ht, key);
+        EXPECT_EQ(0u, (size_t)value % alignof(SmallStruct));
+        EXPECT_EQ(key, value->id);
+        EXPECT_EQ(key * 2, value->flags);
+        EXPECT_EQ(key, value->level);
+    }
+    destroyHashTable(ht);
+
+    // A 3-byte value takes 4 bytes and neighbors are left alone.
+    ht = createHashTableWithValueSize(hash, BUCKET_NUM, 3);
+    for (unsigned int key = 0; key < 50; ++key) {
+        unsigned char bytes[3] = {(unsigned char)key, (unsigned char)(key + 1), (unsigned char)(key + 2)};
+        insertItemCopy(ht, key, bytes);
+    }
+    for (unsigned int key = 0; key < 50; ++key) {
+        unsigned char* bytes = (unsigned char*)getItemRef(ht, key);
+        EXPECT_EQ(key, bytes[0]);
+        EXPECT_EQ(key + 2, bytes[2]);
+    }
+    destroyHashTable(ht);
+}
+
+TEST(InlineValueTest, PointerFunctionsExit)
+{
+    HashTable* ht = createHashTableWithValueSize(hash, BUCKET_NUM, 8);
+    long long value = 1;
+    insertItemCopy(ht, 1, &value);
+    EXPECT_EXIT(insertItem(ht, 1, NULL), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(removeItem(ht, 1), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(freezeHashTable(ht), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(insertItemWithTTL(ht, 1, NULL, 10), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(createHashTableWithValueSize(hash, BUCKET_NUM, 0), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(ht);
+
+    HashTable* chained = createHashTable(hash, BUCKET_NUM);
+    EXPECT_EXIT(insertItemCopy(chained, 1, &value), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(getItemRef(chained, 1), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(chained);
+}
+
+////////////////
+// Counting Tests
+////////////////
+
+TEST(CountingTest, IncrementAndGrow)
+{
+    HashTable* ht = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COUNTING);
+    EXPECT_EQ(0, getCount(ht, 5));
+    EXPECT_EQ(NULL, getItem(ht, 5));
+    incrementItem(ht, 5, 3);
+    incrementItem(ht, 5, -1);
+    EXPECT_EQ(2, getCount(ht, 5));
+    EXPECT_EQ(2, *(long long*)getItem(ht, 5));
+
+    // Far more keys than the first submap holds: the keys counted early
+    // stay where they are while later ones go to new submaps.
+    unsigned long long before = hashTableMemoryUsage(ht);
+    for (unsigned int round = 0; round < 3; ++round) {
+        for (unsigned int key = 100; key < 100100; ++key) incrementItem(ht, key, key % 7);
+    }
+    EXPECT_GT(hashTableMemoryUsage(ht), before);
+    for (unsigned int key = 100; key < 100100; ++key) EXPECT_EQ(3 * (key % 7), getCount(ht, key));
+    EXPECT_EQ(0, getCount(ht, 100100));
+    EXPECT_EQ(2, getCount(ht, 5));
+
+    EXPECT_EXIT(insertItem(ht, 1, NULL), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(removeItem(ht, 5), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(deleteItem(ht, 5), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(freezeHashTable(ht), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(ht);
+
+    HashTable* chained = createHashTable(hash, BUCKET_NUM);
+    EXPECT_EXIT(incrementItem(chained, 1, 1), ::testing::ExitedWithCode(1), "");
+    EXPECT_EXIT(getCount(chained, 1), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(chained);
+}
+
+TEST(CountingTest, Buffered)
+{
+    HashTable* ht = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COUNTING);
+    bufferHashTableCounts(ht, 16);
+    // A few keys stay in the buffer until it is flushed.
+    incrementItem(ht, 1, 10);
+    incrementItem(ht, 1, 5);
+    incrementItem(ht, 2, 1);
+    EXPECT_EQ(0, getCount(ht, 1));
+    flushHashTableCounts(ht);
+    EXPECT_EQ(15, getCount(ht, 1));
+    EXPECT_EQ(1, getCount(ht, 2));
+    // Many keys flush it in batches along the way.
+    for (unsigned int key = 0; key < 1000; ++key) incrementItem(ht, key, 1);
+    EXPECT_GT(getCount(ht, 0) + getCount(ht, 500), 0);
+    flushHashTableCounts(ht);
+    for (unsigned int key = 0; key < 1000; ++key) {
+        EXPECT_EQ(1 + (key == 1) * 15 + (key == 2), getCount(ht, key));
+    }
+    EXPECT_EXIT(bufferHashTableCounts(ht, 16), ::testing::ExitedWithCode(1), "");
+    destroyHashTable(ht);
+}
+
+struct CountingThread {
+    HashTable* ht;
+    unsigned int seed;
+};
+
+// Counts 20000 events, half on 4 hot keys and half on keys below 5000, and
+// flushes its buffer, if any, before returning.
+TEST(CountingTest, BufferedTablesSideBySide)
+{
+    // A thread alternating between two buffered tables keeps one buffer in
+    // each, and loses none of its counts.
+    HashTable* a = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COUNTING);
+    HashTable* b = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COUNTING);
+    bufferHashTableCounts(a, 64);
+    bufferHashTableCounts(b, 64);
+    incrementItem(a, 1, 1);
+    incrementItem(b, 1, 1);
+    unsigned long long bytes = hashTableMemoryUsage(a);
+    for (int i = 1; i < 1000; ++i) {
+        incrementItem(a, 1, 1);
+        incrementItem(b, 1, 1);
+    }
+    EXPECT_EQ(bytes, hashTableMemoryUsage(a));
+    flushHashTableCounts(a);
+    flushHashTableCounts(b);
+    EXPECT_EQ(1000, getCount(a, 1));
+    EXPECT_EQ(1000, getCount(b, 1));
+    destroyHashTable(a);
+    destroyHashTable(b);
+}
+
+static void* count_events(void* arg)
+{
+    CountingThread* thread = (CountingThread*) arg;
+    unsigned int state = thread->seed;
+    for (unsigned int i = 0; i < 20000; ++i) {
+        state = state * 1664525u + 1013904223u;
+        unsigned int key = i % 2 ? (state >> 8) % 4 : 10 + (state >> 8) % 5000;
+        incrementItem(thread->ht, key, 1);
+    }
+    flushHashTableCounts(thread->ht);
+    return NULL;
+}
+
+// Runs 4 counting threads and checks that no increment was lost.
+static void expect_concurrent_counts(HashTable* ht)
+{
+    CountingThread threads[4];
+    pthread_t ids[4];
+    for (int i = 0; i < 4; ++i) {
+        threads[i].ht = ht;
+        threads[i].seed = 12345 + i;
+        pthread_create(&ids[i], NULL, count_events, &threads[i]);
+    }
+    for (int i = 0; i < 4; ++i) pthread_join(ids[i], NULL);
+    long long total = 0, hot = 0;
+    for (unsigned int key = 0; key < 5010; ++key) total += getCount(ht, key);
+    for (unsigned int key = 0; key < 4; ++key) hot += getCount(ht, key);
+    EXPECT_EQ(4 * 20000, total);
+    EXPECT_EQ(4 * 10000, hot);
+}
+
+TEST(CountingTest, ConcurrentIncrements)
+{
+    HashTable* direct = createHashTableWithLayout(hash, 1, HT_LAYOUT_COUNTING);
+    expect_concurrent_counts(direct);
+    destroyHashTable(direct);
+
+    HashTable* buffered = createHashTableWithLayout(hash, 1, HT_LAYOUT_COUNTING);
+    bufferHashTableCounts(buffered, 64);
+    expect_concurrent_counts(buffered);
+    destroyHashTable(buffered);
+}
+
+////////////////
+// Iterator Tests
+////////////////
+
+// Iterates over a table and checks that it holds exactly keys [0, n) with
+// values m, skipping the keys erase_every divides, which are erased.
+static void expect_iteration(HashTable* ht, HTItem** m, unsigned int n, unsigned int erase_every)
+{
+    std::vector<int> seen(n, 0);
+    HashTableIterator* it = htIterBegin(ht);
+    unsigned int key;
+    void* value;
+    while (htIterNext(it, &key, &value)) {
+        ASSERT_LT(key, n);
+        EXPECT_EQ(m[key], value);
+        seen[key]++;
+        if (erase_every && key % erase_every == 0) htIterErase(it);
+    }
+    htIterEnd(it);
+    for (unsigned int i = 0; i < n; ++i) EXPECT_EQ(1, seen[i]) << i;
+    if (erase_every) {
+        for (unsigned int i = 0; i < n; ++i) {
+            EXPECT_EQ(i % erase_every ? m[i] : NULL, getItem(ht, i)) << i;
+        }
+    }
+}
+
+// Adds the key to the sum pointed to by context.
+static void sum_keys(void* context, unsigned int key, void* value)
+{
+    (void)value;
+    *(unsigned long long*)context += key;
+}
+
+TEST(IteratorTest, EveryLayout)
+{
+    const HashTableLayout layouts[] = { HT_LAYOUT_CHAINED, HT_LAYOUT_COMPACT, HT_LAYOUT_UNROLLED,
+                                        HT_LAYOUT_INLINE, HT_LAYOUT_HOPSCOTCH, HT_LAYOUT_LINEAR,
+                                        HT_LAYOUT_EXTENDIBLE };
+    for (HashTableLayout layout : layouts) {
+        HashTable* ht = createHashTableWithLayout(hash, BUCKET_NUM, layout);
+        HTItem* m[1000];
+        make_items(m, 1000);
+        for (unsigned int key = 0; key < 1000; ++key) insertItem(ht, key, m[key]);
+        unsigned long long sum = 0;
+        forEachItem(ht, sum_keys, &sum);
+        EXPECT_EQ(999ull * 1000 / 2, sum) << layout;
+        expect_iteration(ht, m, 1000, 2);
+        // and again after the erasures
+        HashTableIterator* it = htIterBegin(ht);
+        unsigned int key, count = 0;
+        void* value;
+        while (htIterNext(it, &key, &value)) count++;
+        EXPECT_EQ(0, htIterNext(it, &key, &value));
+        htIterEnd(it);
+        EXPECT_EQ(500u, count) << layout;
+        destroyHashTable(ht);
+    }
+
+    // An empty table, and a frozen one.
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    HashTableIterator* it = htIterBegin(ht);
+    unsigned int key;
+    void* value;
+    EXPECT_EQ(0, htIterNext(it, &key, &value));
+    htIterEnd(it);
+    HTItem* m[100];
+    make_items(m, 100);
+    for (unsigned int i = 0; i < 100; ++i) insertItem(ht, i, m[i]);
+    freezeHashTable(ht);
+    expect_iteration(ht, m, 100, 0);
+    destroyHashTable(ht);
+}
+
+TEST(IteratorTest, InPlace)
+{
+    // Every key in one bucket of the user's hash: crowded chains, nodes and
+    // overflow lists are walked and erased from where the iterator stands.
+    const HashTableLayout layouts[] = { HT_LAYOUT_COMPACT, HT_LAYOUT_UNROLLED, HT_LAYOUT_INLINE,
+                                        HT_LAYOUT_HOPSCOTCH, HT_LAYOUT_LINEAR,
+                                        HT_LAYOUT_EXTENDIBLE };
+    unsigned int key, count;
+    void* value;
+    HTItem* m[1000];
+    for (HashTableLayout layout : layouts) {
+        HashTable* ht = createHashTableWithLayout(one_bucket, 1, layout);
+        make_items(m, 1000);
+        for (key = 0; key < 1000; ++key) insertItem(ht, key, m[key]);
+        expect_iteration(ht, m, 1000, 3);
+        HashTableIterator* it = htIterBegin(ht);
+        for (count = 0; htIterNext(it, &key, &value); ++count) htIterErase(it);
+        EXPECT_EQ(0, htIterNext(it, &key, &value));
+        htIterEnd(it);
+        EXPECT_EQ(666u, count) << layout;
+        EXPECT_EQ(0u, count_present(ht, 0, 1000)) << layout;
+        // the table still grows and shrinks afterwards
+        make_items(m, 1000);
+        for (key = 0; key < 1000; ++key) insertItem(ht, key, m[key]);
+        for (key = 0; key < 1000; key += 2) deleteItem(ht, key);
+        EXPECT_EQ(500u, count_present(ht, 0, 1000)) << layout;
+        destroyHashTable(ht);
+    }
+
+    // Pages in a file are read one at a time.
+    char path[] = "/tmp/ht_pages_XXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    close(fd);
+    HashTable* ht = createHashTableInFile(path);
+    make_items(m, 1000);
+    for (key = 0; key < 1000; ++key) insertItem(ht, key, m[key]);
+    expect_iteration(ht, m, 1000, 3);
+    EXPECT_EQ(666u, count_present(ht, 0, 1000));
+    destroyHashTable(ht);
+    unlink(path);
+
+    // Counters are returned in place, but cannot be erased, nor can the
+    // entries of a frozen table.
+    ht = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COUNTING);
+    for (key = 0; key < 1000; ++key) incrementItem(ht, key, key + 1);
+    HashTableIterator* it = htIterBegin(ht);
+    for (count = 0; htIterNext(it, &key, &value); ++count) EXPECT_EQ(key + 1, *(long long*)value);
+    EXPECT_EQ(1000u, count);
+    EXPECT_EXIT(htIterErase(it), ::testing::ExitedWithCode(1), "");
+    htIterEnd(it);
+    it = htIterBegin(ht);
+    ASSERT_EQ(1, htIterNext(it, &key, &value));
+    EXPECT_EXIT(htIterErase(it), ::testing::ExitedWithCode(1), "");
+    htIterEnd(it);
+    destroyHashTable(ht);
+    ht = createHashTable(hash, BUCKET_NUM);
+    insertItem(ht, 1, malloc(sizeof(HTItem)));
+    freezeHashTable(ht);
+    it = htIterBegin(ht);
+    ASSERT_EQ(1, htIterNext(it, &key, &value));
+    EXPECT_EXIT(htIterErase(it), ::testing::ExitedWithCode(1), "");
+    htIterEnd(it);
+    destroyHashTable(ht);
+}
+
+// A hash function that splits the keys into even and odd ones.
+unsigned int two_buckets(unsigned int key)
+{
+    return key % 2;
+}
+
+TEST(IteratorTest, BinsRehashAndTTL)
+{
+    // A crowded bucket is a tree bin, erased from as it is walked.
+    HashTable* ht = createHashTable(one_bucket, 1);
+    HTItem* m[2000];
+    make_items(m, 100);
+    for (unsigned int key = 0; key < 100; ++key) insertItem(ht, key, m[key]);
+    expect_iteration(ht, m, 100, 3);
+    HashTableIterator* it = htIterBegin(ht);
+    unsigned int key, count = 0;
+    void* value;
+    while (htIterNext(it, &key, &value)) {
+        count++;
+        htIterErase(it);
+    }
+    htIterEnd(it);
+    EXPECT_EQ(66u, count);
+    EXPECT_EQ(NULL, getItem(ht, 50));
+    destroyHashTable(ht);
+
+    // A bin emptied through the iterator, or left small by an iteration
+    // that stops inside it, is settled, so an eviction that samples its
+    // bucket afterwards does not read from an empty bin.
+    for (unsigned int stop = 7; stop <= 10; stop += 3) {
+        ht = createHashTable(two_buckets, 2);
+        enableHashTableCache(ht, 20, 64, 0);
+        for (unsigned int key = 0; key < 20; ++key) insertItem(ht, key, malloc(sizeof(HTItem)));
+        it = htIterBegin(ht);
+        for (count = 0; count < stop && htIterNext(it, &key, &value); ++count) {
+            EXPECT_EQ(0u, key % 2);
+            htIterErase(it);
+        }
+        htIterEnd(it);
+        EXPECT_EQ(10 - stop, count_present(ht, 0, 20) - 10);
+        for (unsigned int key = 21; key < 61; key += 2) insertItem(ht, key, malloc(sizeof(HTItem)));
+        EXPECT_EQ(20u, count_present(ht, 0, 61));
+        destroyHashTable(ht);
+    }
+
+    // Entries still in the old buckets of a rehash are returned too.
+    ht = createHashTable(low_bits, FLOOD_BUCKETS);
+    make_items(m, 2000);
+    for (unsigned int key = 0; key < 2000; ++key) insertItem(ht, key, m[key]);
+    for (unsigned int i = 0; hashTableReseedCount(ht) == 0; ++i) {
+        insertItem(ht, (i + 10) * FLOOD_BUCKETS, malloc(sizeof(HTItem)));
+    }
+    std::vector<int> seen(2000, 0);
+    it = htIterBegin(ht);
+    while (htIterNext(it, &key, &value)) {
+        if (key < 2000) {
+            seen[key]++;
+            EXPECT_EQ(m[key], value);
+            if (key % 2) htIterErase(it);
+        }
+    }
+    htIterEnd(it);
+    for (unsigned int i = 0; i < 2000; ++i) {
+        EXPECT_EQ(1, seen[i]);
+        EXPECT_EQ(i % 2 ? NULL : m[i], getItem(ht, i));
+    }
+    destroyHashTable(ht);
+
+    // Expired entries are skipped.
+    ht = createHashTable(hash, BUCKET_NUM);
+    insertItemWithTTL(ht, 1, malloc(sizeof(HTItem)), 1);
+    insertItem(ht, 2, malloc(sizeof(HTItem)));
+    usleep(5000);
+    it = htIterBegin(ht);
+    ASSERT_EQ(1, htIterNext(it, &key, &value));
+    EXPECT_EQ(2u, key);
+    EXPECT_EQ(0, htIterNext(it, &key, &value));
+    htIterEnd(it);
+    destroyHashTable(ht);
+}
+
+TEST(IteratorTest, MultimapAndMisuse)
+{
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableMultimap(ht);
+    for (int i = 0; i < 4; ++i) insertItem(ht, 7, make_int(i));
+    insertItem(ht, 8, make_int(10));
+    // every value is a pair; erase the odd values of key 7
+    HashTableIterator* it = htIterBegin(ht);
+    EXPECT_EXIT(htIterErase(it), ::testing::ExitedWithCode(1), "");
+    unsigned int key;
+    void* value;
+    int pairs = 0;
+    while (htIterNext(it, &key, &value)) {
+        pairs++;
+        if (key == 7 && *(int*)value % 2) htIterErase(it);
+    }
+    htIterEnd(it);
+    EXPECT_EQ(5, pairs);
+    std::vector<int> values;
+    getAll(ht, 7, collect_value, &values);
+    EXPECT_EQ(std::vector<int>({0, 2}), values);
+
+    // Erasing every value of a key erases the key.
+    it = htIterBegin(ht);
+    while (htIterNext(it, &key, &value)) {
+        if (key == 7) htIterErase(it);
+    }
+    htIterEnd(it);
+    EXPECT_EQ(0u, countKey(ht, 7));
+    EXPECT_EQ(1u, countKey(ht, 8));
+
+    it = htIterBegin(ht);
+    ASSERT_EQ(1, htIterNext(it, &key, &value));
+    htIterErase(it);
+    EXPECT_EXIT(htIterErase(it), ::testing::ExitedWithCode(1), "");
+    htIterEnd(it);
+    EXPECT_EQ(0u, countKey(ht, 8));
+    destroyHashTable(ht);
+}
+
+////////////////
+// Scan Tests
+////////////////
+
+// Counts how often scanHashTable returned each key below the size of the
+// vector pointed to by context.
+static void count_scanned(void* context, unsigned int key, void* value)
+{
+    (void)value;
+    std::vector<int>* seen = (std::vector<int>*)context;
+    if (key < seen->size()) (*seen)[key]++;
+}
+
+TEST(ScanTest, WhileGrowingAndShrinking)
+{
+    const HashTableLayout layouts[] = { HT_LAYOUT_CHAINED, HT_LAYOUT_COMPACT, HT_LAYOUT_UNROLLED,
+                                        HT_LAYOUT_INLINE, HT_LAYOUT_HOPSCOTCH, HT_LAYOUT_LINEAR,
+                                        HT_LAYOUT_EXTENDIBLE };
+    for (HashTableLayout layout : layouts) {
+        HashTable* ht = createHashTableWithLayout(hash, BUCKET_NUM, layout);
+        HTItem* m[1000];
+        make_items(m, 1000);
+        for (unsigned int key = 0; key < 1000; ++key) insertItem(ht, key, m[key]);
+        // between calls, 20000 more keys come and go, resizing the table
+        std::vector<int> seen(1000, 0);
+        unsigned long long cursor = 0;
+        unsigned int calls = 0, churn = 0;
+        do {
+            cursor = scanHashTable(ht, cursor, 1, count_scanned, &seen);
+            calls++;
+            for (unsigned int i = 0; i < 2500; ++i, ++churn) {
+                unsigned int key = 1000 + churn % 20000;
+                if (churn < 20000) insertItem(ht, key, malloc(sizeof(HTItem)));
+                else if (churn < 40000) deleteItem(ht, key);
+            }
+        } while (cursor);
+        for (unsigned int i = 0; i < 1000; ++i) {
+            EXPECT_LE(1, seen[i]) << layout << " " << i;
+            // only shrinking tables may return a key twice
+            if (layout != HT_LAYOUT_LINEAR && layout != HT_LAYOUT_EXTENDIBLE) {
+                EXPECT_EQ(1, seen[i]) << layout << " " << i;
+            }
+        }
+        // the resizing layouts were still scanning while the churn went on
+        if (layout >= HT_LAYOUT_HOPSCOTCH) {
+            EXPECT_LT(16u, calls) << layout;
+        }
+        destroyHashTable(ht);
+    }
+}
+
+TEST(ScanTest, ChainedExtras)
+{
+    // An empty table takes one call; a count of 0 still makes progress.
+    HashTable* ht = createHashTable(hash, BUCKET_NUM);
+    std::vector<int> seen(2000, 0);
+    EXPECT_EQ(1ull, scanHashTable(ht, 0, 0, count_scanned, &seen));
+    EXPECT_EQ(0ull, scanHashTable(ht, 0, BUCKET_NUM, count_scanned, &seen));
+
+    // Expired entries are skipped.
+    insertItemWithTTL(ht, 8, malloc(sizeof(HTItem)), 1);
+    insertItem(ht, 9, malloc(sizeof(HTItem)));
+    usleep(5000);
+    unsigned long long cursor = 0;
+    do cursor = scanHashTable(ht, cursor, 1, count_scanned, &seen); while (cursor);
+    EXPECT_EQ(0, seen[8]);
+    EXPECT_EQ(1, seen[9]);
+    destroyHashTable(ht);
+
+    // Multimap values are pairs of their own.
+    ht = createHashTable(hash, BUCKET_NUM);
+    enableHashTableMultimap(ht);
+    for (int i = 0; i < 3; ++i) insertItem(ht, 7, make_int(i));
+    do cursor = scanHashTable(ht, cursor, 1, count_scanned, &seen); while (cursor);
+    EXPECT_EQ(3, seen[7]);
+    destroyHashTable(ht);
+
+    // Entries still in the old buckets of a rehash are returned, even if
+    // lookups between the calls move them, whether the reseed came before
+    // the scan or between two of its calls.
+    HTItem* m[2000];
+    for (unsigned int step = 1; step <= 100; step *= 10) {
+        for (int midScan = 0; midScan < 2; ++midScan) {
+            ht = createHashTable(low_bits, FLOOD_BUCKETS);
+            make_items(m, 2000);
+            for (unsigned int key = 0; key < 2000; ++key) insertItem(ht, key, m[key]);
+            unsigned int flood = 0;
+            if (!midScan) {
+                while (hashTableReseedCount(ht) == 0) {
+                    insertItem(ht, (flood++ + 10) * FLOOD_BUCKETS, malloc(sizeof(HTItem)));
+                }
+            }
+            std::fill(seen.begin(), seen.end(), 0);
+            unsigned int calls = 0;
+            do {
+                cursor = scanHashTable(ht, cursor, step, count_scanned, &seen);
+                // halfway through the buckets, the table is flooded
+                if (midScan && ++calls * step >= FLOOD_BUCKETS / 2) {
+                    while (hashTableReseedCount(ht) == 0) {
+                        insertItem(ht, (flood++ + 10) * FLOOD_BUCKETS, malloc(sizeof(HTItem)));
+                    }
+                }
+                for (unsigned int key = 0; key < 10; ++key) getItem(ht, key);
+            } while (cursor);
+            EXPECT_EQ(1u, hashTableReseedCount(ht));
+            for (unsigned int i = 0; i < 2000; ++i) EXPECT_LE(1, seen[i]) << i;
+            destroyHashTable(ht);
+        }
+    }
+
+    // Frozen and counting tables.
+    ht = createHashTable(hash, BUCKET_NUM);
+    make_items(m, 100);
+    for (unsigned int key = 0; key < 100; ++key) insertItem(ht, key, m[key]);
+    freezeHashTable(ht);
+    std::fill(seen.begin(), seen.end(), 0);
+    do cursor = scanHashTable(ht, cursor, 7, count_scanned, &seen); while (cursor);
+    for (unsigned int i = 0; i < 100; ++i) EXPECT_EQ(1, seen[i]) << i;
+    destroyHashTable(ht);
+
+    ht = createHashTableWithLayout(hash, BUCKET_NUM, HT_LAYOUT_COUNTING);
+    std::fill(seen.begin(), seen.end(), 0);
+    for (unsigned int key = 0; key < 1000; ++key) incrementItem(ht, key, 1);
+    unsigned int calls = 0;
+    do {
+        cursor = scanHashTable(ht, cursor, 16, count_scanned, &seen);
+        // keys never move, so a growing counting table loses none
+        if (++calls <= 8) {
+            for (unsigned int key = 0; key < 2000; ++key) incrementItem(ht, calls * 10000 + key, 1);
+        }
+    } while (cursor);
+    for (unsigned int i = 0; i < 1000; ++i) EXPECT_EQ(1, seen[i]) << i;
+    destroyHashTable(ht);
+}
+
+////////////////
+// Bulk Build Tests
+////////////////
+
+TEST(BulkBuildTest, ManyThreads)
+{
+    const unsigned int n = 20000;
+    std::vector<unsigned int> keys(n);
+    std::vector<void*> values(n);
+    for (unsigned int i = 0; i < n; ++i) keys[i] = i * 7919;
+    for (unsigned int threads : { 1u, 3u, 8u }) {
+        HTItem** m = (HTItem**)values.data();
+        make_items(m, n);
+        HashTable* ht = bulkBuildHashTable(low_bits, FLOOD_BUCKETS, keys.data(), values.data(), n, threads);
+        for (unsigned int i = 0; i < n; ++i) ASSERT_EQ(m[i], getItem(ht, keys[i])) << threads << " " << i;
+        EXPECT_EQ(NULL, getItem(ht, 1));
+        unsigned long long sum = 0, expected = 0;
+        forEachItem(ht, sum_keys, &sum);
+        for (unsigned int i = 0; i < n; ++i) expected += keys[i];
+        EXPECT_EQ(expected, sum);
+
+        // an ordinary table afterwards, whose entries leave one by one
+        for (unsigned int i = 0; i < n; i += 2) deleteItem(ht, keys[i]);
+        EXPECT_EQ(m[1], removeItem(ht, keys[1]));
+        free(m[1]);
+        insertItem(ht, 1, malloc(sizeof(HTItem)));
+        EXPECT_EQ(NULL, getItem(ht, keys[0]));
+        EXPECT_EQ(m[3], getItem(ht, keys[3]));
+        EXPECT_TRUE(getItem(ht, 1) != NULL);
+        EXPECT_LT((unsigned long long)n * 24, hashTableMemoryUsage(ht));
+        destroyHashTable(ht);
+    }
+}
+
+TEST(BulkBuildTest, DuplicatesAndCrowdedBuckets)
+{
+    // The last value of a key wins; the earlier ones are freed.
+    unsigned int keys[] = { 5, 6, 5, 5, 7 };
+    void* values[5];
+    for (int i = 0; i < 5; ++i) values[i] = make_int(i);
+    HashTable* ht = bulkBuildHashTable(hash, BUCKET_NUM, keys, values, 5, 16);
+    EXPECT_EQ(3, *(int*)getItem(ht, 5));
+    EXPECT_EQ(1, *(int*)getItem(ht, 6));
+    unsigned int pairs = 0;
+    HashTableIterator* it = htIterBegin(ht);
+    unsigned int key;
+    void* value;
+    while (htIterNext(it, &key, &value)) pairs++;
+    htIterEnd(it);
+    EXPECT_EQ(3u, pairs);
+    destroyHashTable(ht);
+
+    // Nothing to build, and 0 threads.
+    ht = bulkBuildHashTable(hash, BUCKET_NUM, keys, values, 0, 0);
+    EXPECT_EQ(NULL, getItem(ht, 5));
+    destroyHashTable(ht);
+
+    // A bucket with more keys than a chain holds becomes a tree bin, which
+    // shrinks back into a chain as usual.
+    HTItem* m[100];
+    make_items(m, 100);
+    unsigned int many[100];
+    for (unsigned int i = 0; i < 100; ++i) many[i] = i;
+    ht = bulkBuildHashTable(one_bucket, 1, many, (void**)m, 100, 0);
+    for (unsigned int i = 0; i < 100; ++i) EXPECT_EQ(m[i], getItem(ht, i));
+    for (unsigned int i = 0; i < 95; ++i) deleteItem(ht, i);
+    for (unsigned int i = 95; i < 100; ++i) EXPECT_EQ(m[i], getItem(ht, i));
+    freezeHashTable(ht);
+    EXPECT_EQ(m[99], getItem(ht, 99));
+    destroyHashTable(ht);
+
+    // Many keys, each given twice, in one crowded bucket or in crowded
+    // buckets spread over every thread's partition.
+    const unsigned int distinct = 50000;
+    std::vector<unsigned int> crowd(2 * distinct);
+    std::vector<void*> crowdValues(2 * distinct);
+    for (unsigned int threads = 1; threads <= 4; threads *= 4) {
+        for (unsigned int i = 0; i < 2 * distinct; ++i) {
+            crowd[i] = i % distinct;
+            crowdValues[i] = make_int(i);
+        }
+        ht = bulkBuildHashTable(threads == 1 ? one_bucket : low_bits, threads == 1 ? 1 : FLOOD_BUCKETS,
+                                crowd.data(), crowdValues.data(), 2 * distinct, threads);
+        for (unsigned int i = 0; i < distinct; ++i) {
+            ASSERT_EQ((int)(i + distinct), *(int*)getItem(ht, i)) << i;
+        }
+        pairs = 0;
+        it = htIterBegin(ht);
+        while (htIterNext(it, &key, &value)) pairs++;
+        htIterEnd(it);
+        EXPECT_EQ(distinct, pairs);
+        for (unsigned int i = 0; i < distinct; i += 2) deleteItem(ht, i);
+        for (unsigned int i = 0; i < distinct; ++i) EXPECT_EQ(i % 2 != 0, getItem(ht, i) != NULL);
+        destroyHashTable(ht);
+    }
+}
+
+////////////////
+// Hash Set Tests
+////////////////
+
+TEST(SetTest, InsertContainsRemove)
+{
+    HashSet* set = createHashSet(hash, BUCKET_NUM);
+    EXPECT_EQ(0u, setSize(set));
+    EXPECT_EQ(0, setContains(set, 1));
+    EXPECT_EQ(0, setRemove(set, 1));
+    for (unsigned int key = 0; key < 100; ++key) EXPECT_EQ(1, setInsert(set, key));
+    EXPECT_EQ(0, setInsert(set, 42));
+    EXPECT_EQ(100u, setSize(set));
+    for (unsigned int key = 0; key < 100; key += 2) EXPECT_EQ(1, setRemove(set, key));
+    EXPECT_EQ(0, setRemove(set, 42));
+    EXPECT_EQ(50u, setSize(set));
+    for (unsigned int key = 0; key < 120; ++key) EXPECT_EQ(key < 100 && key % 2, setContains(set, key));
+
+    // Removed keys are reused before the pool grows.
+    unsigned long long before = hashSetMemoryUsage(set);
+    for (unsigned int key = 200; key < 250; ++key) EXPECT_EQ(1, setInsert(set, key));
+    EXPECT_EQ(before, hashSetMemoryUsage(set));
+    EXPECT_EQ(1, setContains(set, 249));
+    destroyHashSet(set);
+}
+
+TEST(SetTest, SmallerThanATable)
+{
+    HashSet* set = createHashSet(low_bits, FLOOD_BUCKETS);
+    for (unsigned int key = 0; key < 10000; ++key) setInsert(set, key * 7);
+    // 8 bytes per key against 16 for the compact layout, and no values.
+    EXPECT_LT(hashSetMemoryUsage(set), layout_memory(HT_LAYOUT_COMPACT, 10000) / 3 * 2);
+    destroyHashSet(set);
+}
+
+// Checks that a set holds exactly the keys below limit that satisfy member.
+static void expect_set(HashSet* set, unsigned int limit, bool (*member)(unsigned int))
+{
+    unsigned int count = 0;
+    for (unsigned int key = 0; key < limit; ++key) {
+        EXPECT_EQ(member(key), setContains(set, key) == 1) << key;
+        count += member(key);
+    }
+    EXPECT_EQ(count, setSize(set));
+}
+
+// Membership in the sets of exercise_algebra.
+static bool in_range(unsigned int key) { return key > 0 && key < 3000; }
+static bool in_union(unsigned int key) { return in_range(key) && (key % 2 == 0 || key % 3 == 0); }
+static bool in_both(unsigned int key) { return in_range(key) && key % 6 == 0; }
+static bool in_first_only(unsigned int key) { return in_range(key) && key % 2 == 0 && key % 3 != 0; }
+
+// Runs the three operations on the even keys and the multiples of 3 in
+// (0, 3000).
+static void exercise_algebra(HashSet* evens, HashSet* threes)
+{
+    for (unsigned int key = 0; key < 3000; key += 2) setInsert(evens, key);
+    for (unsigned int key = 0; key < 3000; key += 3) setInsert(threes, key);
+    setRemove(evens, 0);
+    setRemove(threes, 0);
+    HashSet* all = setUnion(evens, threes);
+    HashSet* both = setIntersection(evens, threes);
+    HashSet* evenOnly = setDifference(evens, threes);
+    expect_set(all, 3100, in_union);
+    expect_set(both, 3100, in_both);
+    expect_set(evenOnly, 3100, in_first_only);
+
+    // The results are sets of their own.
+    EXPECT_EQ(1, setInsert(all, 1));
+    EXPECT_EQ(1, setRemove(both, 6));
+    EXPECT_EQ(1, setContains(evens, 6));
+    EXPECT_EQ(0, setContains(threes, 1));
+    destroyHashSet(all);
+    destroyHashSet(both);
+    destroyHashSet(evenOnly);
+}
+
+TEST(SetTest, AlgebraBucketByBucket)
+{
+    HashSet* evens = createHashSet(low_bits, FLOOD_BUCKETS);
+    HashSet* threes = createHashSet(low_bits, FLOOD_BUCKETS);
+    exercise_algebra(evens, threes);
+    // Against an empty set, and against itself.
+    HashSet* empty = createHashSet(low_bits, FLOOD_BUCKETS);
+    HashSet* same = setUnion(evens, empty);
+    EXPECT_EQ(setSize(evens), setSize(same));
+    HashSet* none = setIntersection(empty, evens);
+    EXPECT_EQ(0u, setSize(none));
+    HashSet* nothing = setDifference(evens, evens);
+    EXPECT_EQ(0u, setSize(nothing));
+    destroyHashSet(same);
+    destroyHashSet(none);
+    destroyHashSet(nothing);
+    destroyHashSet(empty);
+    destroyHashSet(evens);
+    destroyHashSet(threes);
+}
+
+TEST(SetTest, AlgebraAcrossHashFunctions)
+{
+    HashSet* evens = createHashSet(hash, BUCKET_NUM);
+    HashSet* threes = createHashSet(low_bits, FLOOD_BUCKETS);
+    exercise_algebra(evens, threes);
+    destroyHashSet(evens);
+    destroyHashSet(threes);
+}
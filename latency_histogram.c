@@ -0,0 +1,141 @@
+/*
+ Log-linear latency histogram. See latency_histogram.h.
+
+ A value v whose highest set bit is b >= SUB_BITS is stored in range
+ b - SUB_BITS + 1, at the sub-bucket given by the SUB_BITS bits just below
+ its highest bit. Values below 2^SUB_BITS are stored exactly in range 0.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "latency_histogram.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For calloc and free
+#include <string.h>   // For memset
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The number of bits selecting the sub-bucket within a range */
+#define SUB_BITS      5
+#define SUB_BUCKETS   (1 << SUB_BITS)
+/** Range 0 plus one range per possible highest bit above SUB_BITS */
+#define NUM_RANGES    (64 - SUB_BITS + 1)
+#define NUM_BUCKETS   (NUM_RANGES * SUB_BUCKETS)
+
+/**
+ * This structure represents a latency histogram.
+ */
+struct _LatencyHistogram {
+  /** The number of values recorded in each bucket */
+  unsigned long long counts[NUM_BUCKETS];
+
+  /** The number of recorded values */
+  unsigned long long total;
+
+  /** The sum of the recorded values, for the mean */
+  unsigned long long sum;
+
+  /** The largest recorded value */
+  unsigned long long max;
+};
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* bucketOf
+*
+* @param value The value to record
+* @return The index of the bucket holding the value
+*/
+static unsigned int bucketOf(unsigned long long value) {
+    if (value < SUB_BUCKETS) return (unsigned int)value;
+    unsigned int highBit = 63 - __builtin_clzll(value);
+    unsigned int shift = highBit - SUB_BITS;
+    return ((shift + 1) << SUB_BITS) | ((value >> shift) & (SUB_BUCKETS - 1));
+}
+
+/**
+* bucketHighest
+*
+* @param bucket The index of a bucket
+* @return The largest value that falls into the bucket
+*/
+static unsigned long long bucketHighest(unsigned int bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+    unsigned int shift = (bucket >> SUB_BITS) - 1;
+    unsigned long long lowest = (unsigned long long)((bucket & (SUB_BUCKETS - 1)) | SUB_BUCKETS) << shift;
+    return lowest + ((1ULL << shift) - 1);
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+LatencyHistogram* createLatencyHistogram(void) {
+    return (LatencyHistogram*)calloc(1, sizeof(LatencyHistogram));
+}
+
+void destroyLatencyHistogram(LatencyHistogram* histogram) {
+    free(histogram);
+}
+
+void recordLatency(LatencyHistogram* histogram, unsigned long long nanoseconds) {
+    histogram->counts[bucketOf(nanoseconds)]++;
+    histogram->total++;
+    histogram->sum += nanoseconds;
+    if (nanoseconds > histogram->max) histogram->max = nanoseconds;
+}
+
+void mergeLatencyHistogram(LatencyHistogram* destination, const LatencyHistogram* source) {
+    unsigned int i;
+    for (i = 0; i < NUM_BUCKETS; ++i) destination->counts[i] += source->counts[i];
+    destination->total += source->total;
+    destination->sum += source->sum;
+    if (source->max > destination->max) destination->max = source->max;
+}
+
+void resetLatencyHistogram(LatencyHistogram* histogram) {
+    memset(histogram, 0, sizeof(LatencyHistogram));
+}
+
+unsigned long long latencyCount(const LatencyHistogram* histogram) {
+    return histogram->total;
+}
+
+unsigned long long latencyPercentile(const LatencyHistogram* histogram, double percentile) {
+    if (histogram->total == 0) return 0;
+    // the rank of the value we are looking for, counting from 1
+    unsigned long long rank = (unsigned long long)(percentile / 100.0 * histogram->total + 0.5);
+    if (rank < 1) rank = 1;
+    if (rank > histogram->total) rank = histogram->total;
+
+    unsigned long long seen = 0;
+    unsigned int i;
+    for (i = 0; i < NUM_BUCKETS; ++i) {
+        seen += histogram->counts[i];
+        if (seen >= rank) {
+            // never report more than what was actually recorded
+            unsigned long long highest = bucketHighest(i);
+            return highest < histogram->max ? highest : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+unsigned long long latencyMax(const LatencyHistogram* histogram) {
+    return histogram->max;
+}
+
+double latencyMean(const LatencyHistogram* histogram) {
+    if (histogram->total == 0) return 0;
+    return (double)histogram->sum / histogram->total;
+}
@@ -0,0 +1,99 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+/****************************************************************************
+ * Latency Histogram
+ *
+ * A fixed-size histogram of latencies in nanoseconds, in the style of
+ * HdrHistogram: values are grouped into power-of-two ranges, each split into
+ * 32 linear sub-buckets, so any recorded value is reported within about 3%
+ * over the full 64-bit range, while recording is a couple of shifts and an
+ * increment.
+ *
+ * A histogram is not thread-safe. Give each thread its own histogram and
+ * merge them when a report is needed.
+ ***************************************************************************/
+
+/**
+ * This defines a type that is a _LatencyHistogram struct. The definition for
+ * _LatencyHistogram is implemented in latency_histogram.c.
+ */
+typedef struct _LatencyHistogram LatencyHistogram;
+
+/**
+ * createLatencyHistogram
+ *
+ * @return a pointer to a new, empty histogram
+ */
+LatencyHistogram* createLatencyHistogram(void);
+
+/**
+ * destroyLatencyHistogram
+ *
+ * @param histogram The pointer to the histogram.
+ */
+void destroyLatencyHistogram(LatencyHistogram* histogram);
+
+/**
+ * recordLatency
+ *
+ * @param histogram The pointer to the histogram.
+ * @param nanoseconds The latency to record.
+ */
+void recordLatency(LatencyHistogram* histogram, unsigned long long nanoseconds);
+
+/**
+ * mergeLatencyHistogram
+ *
+ * Add every value recorded in source to destination.
+ *
+ * @param destination The pointer to the histogram that receives the values.
+ * @param source The pointer to the histogram to add.
+ */
+void mergeLatencyHistogram(LatencyHistogram* destination, const LatencyHistogram* source);
+
+/**
+ * resetLatencyHistogram
+ *
+ * @param histogram The pointer to the histogram to empty.
+ */
+void resetLatencyHistogram(LatencyHistogram* histogram);
+
+/**
+ * latencyCount
+ *
+ * @param histogram The pointer to the histogram.
+ * @return the number of recorded values
+ */
+unsigned long long latencyCount(const LatencyHistogram* histogram);
+
+/**
+ * latencyPercentile
+ *
+ * @param histogram The pointer to the histogram.
+ * @param percentile The percentile to compute, between 0 and 100.
+ * @return the value below which that percentage of the recorded values fall,
+ *         or 0 if the histogram is empty
+ */
+unsigned long long latencyPercentile(const LatencyHistogram* histogram, double percentile);
+
+/**
+ * latencyMax
+ *
+ * @param histogram The pointer to the histogram.
+ * @return the exact largest recorded value, or 0 if the histogram is empty
+ */
+unsigned long long latencyMax(const LatencyHistogram* histogram);
+
+/**
+ * latencyMean
+ *
+ * @param histogram The pointer to the histogram.
+ * @return the exact mean of the recorded values, or 0 if the histogram is empty
+ */
+double latencyMean(const LatencyHistogram* histogram);
+
+#endif
@@ -0,0 +1,179 @@
+/*
+ Sampled per-thread latency recording. See latency_recorder.h.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "latency_recorder.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc and free
+#include <pthread.h>  // For the registration lock
+#include <time.h>     // For clock_gettime
+#include "latency_histogram.h"
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/**
+ * The histograms of one thread.
+ */
+typedef struct _ThreadLatency {
+  /** The thread that owns these histograms */
+  pthread_t thread;
+
+  /** Counts calls down to the next sampled one */
+  unsigned int countdown;
+
+  /** One histogram per operation */
+  LatencyHistogram** histograms;
+
+  /** The next thread of the same recorder */
+  struct _ThreadLatency* next;
+} ThreadLatency;
+
+/**
+ * This structure represents a latency recorder.
+ */
+struct _LatencyRecorder {
+  /** A number that is never reused, identifying this recorder to threads */
+  unsigned long long id;
+
+  /** The number of operations */
+  int num_ops;
+
+  /** Time one call out of sample_every */
+  unsigned int sample_every;
+
+  /** Protects the list of threads */
+  pthread_mutex_t lock;
+
+  /** The histograms of every thread that recorded something */
+  ThreadLatency* threads;
+};
+
+/** The source of recorder ids */
+static unsigned long long nextRecorderId = 1;
+
+/** The histograms the calling thread last used, and the recorder they belong
+    to. They are only valid while threadRecorderId matches a live recorder. */
+static _Thread_local unsigned long long threadRecorderId;
+static _Thread_local ThreadLatency* threadLatency;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* nowNs
+*
+* @return The monotonic clock in nanoseconds
+*/
+static unsigned long long nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+* attachThread
+*
+* Helper function that finds the calling thread's histograms for this
+* recorder, creating them on first use, and caches them in thread-local
+* storage.
+*/
+static ThreadLatency* attachThread(LatencyRecorder* recorder) {
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&recorder->lock);
+    ThreadLatency* thread = recorder->threads;
+    while (thread && !pthread_equal(thread->thread, self)) thread = thread->next;
+    if (!thread) {
+        thread = (ThreadLatency*)malloc(sizeof(ThreadLatency));
+        thread->thread = self;
+        thread->countdown = 0;
+        thread->histograms = (LatencyHistogram**)malloc(recorder->num_ops * sizeof(LatencyHistogram*));
+        int op;
+        for (op = 0; op < recorder->num_ops; ++op) thread->histograms[op] = createLatencyHistogram();
+        thread->next = recorder->threads;
+        recorder->threads = thread;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+
+    threadRecorderId = recorder->id;
+    threadLatency = thread;
+    return thread;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+LatencyRecorder* createLatencyRecorder(int numOps, unsigned int sampleEvery) {
+    LatencyRecorder* recorder = (LatencyRecorder*)malloc(sizeof(LatencyRecorder));
+    recorder->id = __atomic_fetch_add(&nextRecorderId, 1, __ATOMIC_RELAXED);
+    recorder->num_ops = numOps;
+    recorder->sample_every = sampleEvery ? sampleEvery : 1;
+    pthread_mutex_init(&recorder->lock, NULL);
+    recorder->threads = NULL;
+    return recorder;
+}
+
+void destroyLatencyRecorder(LatencyRecorder* recorder) {
+    while (recorder->threads) {
+        ThreadLatency* thread = recorder->threads;
+        recorder->threads = thread->next;
+        int op;
+        for (op = 0; op < recorder->num_ops; ++op) destroyLatencyHistogram(thread->histograms[op]);
+        free(thread->histograms);
+        free(thread);
+    }
+    pthread_mutex_destroy(&recorder->lock);
+    free(recorder);
+}
+
+unsigned long long startLatency(LatencyRecorder* recorder) {
+    ThreadLatency* thread = threadRecorderId == recorder->id ? threadLatency
+                                                             : attachThread(recorder);
+    if (thread->countdown) {
+        thread->countdown--;
+        return 0;
+    }
+    thread->countdown = recorder->sample_every - 1;
+    return nowNs();
+}
+
+void stopLatency(LatencyRecorder* recorder, int op, unsigned long long start) {
+    unsigned long long elapsed = nowNs() - start;
+    // startLatency normally attached the thread already
+    ThreadLatency* thread = threadRecorderId == recorder->id ? threadLatency
+                                                             : attachThread(recorder);
+    recordLatency(thread->histograms[op], elapsed);
+}
+
+void dumpLatency(LatencyRecorder* recorder, FILE* out, const char* const* opNames) {
+    LatencyHistogram* merged = createLatencyHistogram();
+    fprintf(out, "%-12s %10s %8s %8s %8s %8s %10s   (ns, 1 in %u calls sampled)\n",
+            "operation", "samples", "p50", "p90", "p99", "p99.9", "max",
+            recorder->sample_every);
+    int op;
+    for (op = 0; op < recorder->num_ops; ++op) {
+        resetLatencyHistogram(merged);
+        pthread_mutex_lock(&recorder->lock);
+        ThreadLatency* thread;
+        for (thread = recorder->threads; thread; thread = thread->next) {
+            mergeLatencyHistogram(merged, thread->histograms[op]);
+        }
+        pthread_mutex_unlock(&recorder->lock);
+        if (latencyCount(merged) == 0) continue;
+        fprintf(out, "%-12s %10llu %8llu %8llu %8llu %8llu %10llu\n", opNames[op],
+                latencyCount(merged), latencyPercentile(merged, 50),
+                latencyPercentile(merged, 90), latencyPercentile(merged, 99),
+                latencyPercentile(merged, 99.9), latencyMax(merged));
+    }
+    destroyLatencyHistogram(merged);
+}
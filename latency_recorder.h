@@ -0,0 +1,79 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef LATENCYRECORDER_H
+#define LATENCYRECORDER_H
+
+#include <stdio.h>    // For FILE
+
+/****************************************************************************
+ * Latency Recorder
+ *
+ * This module is private to the hash table implementation. It samples the
+ * latency of operations into latency histograms, one set per thread so that
+ * recording never takes a lock, and merges them when a report is requested.
+ *
+ * Operations are identified by small integers in [0, numOps).
+ ***************************************************************************/
+
+/**
+ * This defines a type that is a _LatencyRecorder struct. The definition for
+ * _LatencyRecorder is implemented in latency_recorder.c.
+ */
+typedef struct _LatencyRecorder LatencyRecorder;
+
+/**
+ * createLatencyRecorder
+ *
+ * @param numOps The number of distinct operations.
+ * @param sampleEvery Time one call out of this many, per thread (at least 1).
+ * @return a pointer to the new recorder
+ */
+LatencyRecorder* createLatencyRecorder(int numOps, unsigned int sampleEvery);
+
+/**
+ * destroyLatencyRecorder
+ *
+ * Frees the recorder and the histograms of every thread. No other thread may
+ * be recording at this point.
+ *
+ * @param recorder The pointer to the recorder.
+ */
+void destroyLatencyRecorder(LatencyRecorder* recorder);
+
+/**
+ * startLatency
+ *
+ * Decide whether the calling thread's next operation is sampled, and if so
+ * read the clock.
+ *
+ * @param recorder The pointer to the recorder.
+ * @return the start time in nanoseconds, or 0 if the call is not sampled
+ */
+unsigned long long startLatency(LatencyRecorder* recorder);
+
+/**
+ * stopLatency
+ *
+ * Record the time elapsed since start for the operation.
+ *
+ * @param recorder The pointer to the recorder.
+ * @param op The operation that was timed.
+ * @param start The value returned by startLatency, which must not be 0.
+ */
+void stopLatency(LatencyRecorder* recorder, int op, unsigned long long start);
+
+/**
+ * dumpLatency
+ *
+ * Merge the histograms of every thread and print one line per operation
+ * that has samples. Histograms of threads that are still recording are read
+ * without synchronisation, so their most recent samples may be missed.
+ *
+ * @param recorder The pointer to the recorder.
+ * @param out The stream to print to.
+ * @param opNames The name of each operation.
+ */
+void dumpLatency(LatencyRecorder* recorder, FILE* out, const char* const* opNames);
+
+#endif
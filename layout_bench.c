@@ -0,0 +1,145 @@
+/*
+=======================
+Layout Benchmark
+=======================
+Compares the memory layouts of createHashTableWithLayout, and a chained table
+after freezeHashTable, on the two things a lookup-heavy application cares
+about: how long a getItem takes when the key
+is present (hit) and when it is not (miss), and how many bytes each entry
+costs. Tables are filled with random keys, then looked up in random order,
+so most accesses miss the CPU caches once the table outgrows them.
+
+Usage:
+    ./layout_bench [-n KEYS] [-l LOAD_FACTORS] [-q LOOKUPS]
+
+    -n  keys inserted in each table (default 1000000)
+    -l  comma separated load factors, keys per bucket (default 0.5,1,2,4)
+    -q  lookups timed per measurement (default 4000000)
+*/
+
+#include "hash_table.h"
+#include "workload.h"
+
+#include <stdlib.h>   // For malloc, free and strtod
+#include <stdio.h>    // For printf
+#include <string.h>   // For strchr
+#include <time.h>     // For clock_gettime
+#include <unistd.h>   // For getopt
+
+
+/** The layouts compared, and their names */
+static const HashTableLayout layouts[] = {
+  HT_LAYOUT_CHAINED, HT_LAYOUT_COMPACT, HT_LAYOUT_UNROLLED, HT_LAYOUT_INLINE,
+  HT_LAYOUT_HOPSCOTCH, HT_LAYOUT_LINEAR, HT_LAYOUT_EXTENDIBLE
+};
+static const char* layoutNames[] = { "chained", "compact", "unrolled", "inline", "hopscotch",
+                                     "linear", "extendible" };
+#define NUM_LAYOUTS  (sizeof(layouts) / sizeof(layouts[0]))
+
+/** The number of buckets of the table under test, read by bucketHash */
+static unsigned int numBuckets;
+
+/**
+ * bucketHash
+ *
+ * Keys are already scrambled ranks, so reducing them is enough.
+ */
+static unsigned int bucketHash(unsigned int key) {
+    return key % numBuckets;
+}
+
+/**
+ * nowNs
+ *
+ * @return the monotonic clock in nanoseconds
+ */
+static unsigned long long nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * timeLookups
+ *
+ * @return the mean time of a getItem over the keys, in nanoseconds
+ */
+static double timeLookups(HashTable* ht, const unsigned int* keys, unsigned long long count,
+                          unsigned long long* found) {
+    unsigned long long start = nowNs();
+    unsigned long long i, hits = 0;
+    for (i = 0; i < count; ++i) hits += getItem(ht, keys[i]) != NULL;
+    *found = hits;
+    return (double)(nowNs() - start) / count;
+}
+
+int main(int argc, char** argv) {
+    unsigned long long keys = 1000000;
+    const char* loadList = "0.5,1,2,4";
+    unsigned long long lookups = 4000000;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:l:q:")) != -1) {
+        switch (option) {
+        case 'n': keys = strtoull(optarg, NULL, 10); break;
+        case 'l': loadList = optarg; break;
+        case 'q': lookups = strtoull(optarg, NULL, 10); break;
+        default:
+            printf("Usage: %s [-n KEYS] [-l LOAD_FACTORS] [-q LOOKUPS]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (keys == 0 || lookups == 0) {
+        printf("Need at least one key and one lookup\n");
+        return 1;
+    }
+
+    // the lookup streams: present keys and absent keys, in random order
+    unsigned int* hitKeys = (unsigned int*)malloc(lookups * sizeof(unsigned int));
+    unsigned int* missKeys = (unsigned int*)malloc(lookups * sizeof(unsigned int));
+    unsigned long long seed = 0x9E3779B97F4A7C15ULL;
+    unsigned long long i;
+    for (i = 0; i < lookups; ++i) {
+        hitKeys[i] = scrambleKey(nextRandom(&seed) % keys);
+        missKeys[i] = scrambleKey(keys + nextRandom(&seed) % keys);
+    }
+
+    printf("%llu keys, %llu lookups per measurement, times in ns per getItem\n\n",
+           keys, lookups);
+    printf("%6s  %-10s %8s %8s %12s\n", "load", "layout", "hit", "miss", "bytes/entry");
+    const char* list = loadList;
+    while (*list) {
+        double load = strtod(list, NULL);
+        if (load > 0) {
+            numBuckets = (unsigned int)(keys / load) ? (unsigned int)(keys / load) : 1;
+            size_t l;
+            // one more round for the frozen table
+            for (l = 0; l <= NUM_LAYOUTS; ++l) {
+                HashTableLayout layout = l < NUM_LAYOUTS ? layouts[l] : HT_LAYOUT_CHAINED;
+                const char* name = l < NUM_LAYOUTS ? layoutNames[l] : "frozen";
+                HashTable* ht = createHashTableWithLayout(bucketHash, numBuckets, layout);
+                unsigned long long rank;
+                for (rank = 0; rank < keys; ++rank) {
+                    insertItem(ht, scrambleKey(rank), malloc(sizeof(unsigned long long)));
+                }
+                if (l == NUM_LAYOUTS) freezeHashTable(ht);
+                unsigned long long hits, misses;
+                double hitNs = timeLookups(ht, hitKeys, lookups, &hits);
+                double missNs = timeLookups(ht, missKeys, lookups, &misses);
+                if (hits != lookups || misses != 0) {
+                    printf("%s returned wrong results\n", name);
+                }
+                printf("%6.2f  %-10s %8.1f %8.1f %12.1f\n", load, name, hitNs, missNs,
+                       (double)hashTableMemoryUsage(ht) / keys);
+                destroyHashTable(ht);
+            }
+        }
+        const char* comma = strchr(list, ',');
+        if (!comma) break;
+        list = comma + 1;
+    }
+
+    free(hitKeys);
+    free(missKeys);
+    return 0;
+}
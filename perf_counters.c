@@ -0,0 +1,172 @@
+/*
+ Hardware performance counters through perf_event_open. See perf_counters.h.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "perf_counters.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc and free
+#include <string.h>   // For memset
+#include <time.h>     // For clock_gettime
+#ifdef __linux__
+#include <unistd.h>               // For read, close and syscall
+#include <sys/ioctl.h>            // For ioctl
+#include <sys/syscall.h>          // For SYS_perf_event_open
+#include <linux/perf_event.h>     // For the perf_event_attr definitions
+#endif
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/**
+ * This structure represents a set of counters.
+ */
+struct _PerfCounters {
+  /** The file descriptor of each event, or -1 if it could not be opened */
+  int fds[PERF_NUM_EVENTS];
+
+  /** The wall clock at the start of the phase, in nanoseconds */
+  unsigned long long start_ns;
+};
+
+/** The column titles, indexed by event */
+static const char* eventNames[PERF_NUM_EVENTS] = {
+  "cycles", "instr", "LLC-miss", "dTLB-miss", "br-miss"
+};
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* nowNs
+*
+* @return The monotonic clock in nanoseconds
+*/
+static unsigned long long nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+#ifdef __linux__
+/**
+* openEvent
+*
+* Helper function that opens one disabled counter for the calling thread
+* and its future children, counting user space only so that it works with
+* the default perf_event_paranoid setting.
+*
+* @return The file descriptor, or -1 if the kernel refused
+*/
+static int openEvent(unsigned int type, unsigned long long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    long fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+    return fd < 0 ? -1 : (int)fd;
+}
+#endif
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+PerfCounters* createPerfCounters(void) {
+    PerfCounters* counters = (PerfCounters*)malloc(sizeof(PerfCounters));
+    int event;
+    for (event = 0; event < PERF_NUM_EVENTS; ++event) counters->fds[event] = -1;
+#ifdef __linux__
+    counters->fds[PERF_CYCLES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+    counters->fds[PERF_INSTRUCTIONS] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+    counters->fds[PERF_LLC_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    counters->fds[PERF_DTLB_MISSES] = openEvent(PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+        (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    counters->fds[PERF_BRANCH_MISSES] = openEvent(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+#endif
+    counters->start_ns = nowNs();
+    return counters;
+}
+
+void destroyPerfCounters(PerfCounters* counters) {
+#ifdef __linux__
+    int event;
+    for (event = 0; event < PERF_NUM_EVENTS; ++event) {
+        if (counters->fds[event] >= 0) close(counters->fds[event]);
+    }
+#endif
+    free(counters);
+}
+
+int perfCountersAvailable(PerfCounters* counters) {
+    int event, available = 0;
+    for (event = 0; event < PERF_NUM_EVENTS; ++event) available += counters->fds[event] >= 0;
+    return available;
+}
+
+void startPerfCounters(PerfCounters* counters) {
+#ifdef __linux__
+    int event;
+    for (event = 0; event < PERF_NUM_EVENTS; ++event) {
+        if (counters->fds[event] < 0) continue;
+        ioctl(counters->fds[event], PERF_EVENT_IOC_RESET, 0);
+        ioctl(counters->fds[event], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#endif
+    counters->start_ns = nowNs();
+}
+
+void stopPerfCounters(PerfCounters* counters, PerfSample* sample) {
+    sample->wall_ns = nowNs() - counters->start_ns;
+    int event;
+    for (event = 0; event < PERF_NUM_EVENTS; ++event) {
+        sample->counts[event] = 0;
+        sample->available[event] = 0;
+#ifdef __linux__
+        if (counters->fds[event] < 0) continue;
+        ioctl(counters->fds[event], PERF_EVENT_IOC_DISABLE, 0);
+        unsigned long long count;
+        if (read(counters->fds[event], &count, sizeof(count)) == sizeof(count)) {
+            sample->counts[event] = count;
+            sample->available[event] = 1;
+        }
+#endif
+    }
+}
+
+void printPerfHeader(FILE* out) {
+    int event;
+    fprintf(out, "%10s", "ns/op");
+    for (event = 0; event < PERF_NUM_EVENTS; ++event) fprintf(out, " %10s", eventNames[event]);
+    fprintf(out, " %6s\n", "IPC");
+}
+
+void printPerfSample(FILE* out, const PerfSample* sample, unsigned long long operations) {
+    double ops = operations ? (double)operations : 1.0;
+    fprintf(out, "%10.1f", sample->wall_ns / ops);
+    int event;
+    for (event = 0; event < PERF_NUM_EVENTS; ++event) {
+        if (sample->available[event]) fprintf(out, " %10.2f", sample->counts[event] / ops);
+        else fprintf(out, " %10s", "-");
+    }
+    if (sample->available[PERF_CYCLES] && sample->available[PERF_INSTRUCTIONS] &&
+        sample->counts[PERF_CYCLES]) {
+        fprintf(out, " %6.2f\n", (double)sample->counts[PERF_INSTRUCTIONS] / sample->counts[PERF_CYCLES]);
+    } else {
+        fprintf(out, " %6s\n", "-");
+    }
+}
@@ -0,0 +1,121 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <stdio.h>    // For FILE
+
+/****************************************************************************
+ * Hardware Performance Counters
+ *
+ * Benchmark support module that counts hardware events around a phase of a
+ * benchmark with the Linux perf_event_open system call: cycles,
+ * instructions, last level cache misses, data TLB misses and branch misses.
+ * Dividing by the number of operations of the phase tells whether a slowdown
+ * comes from cache misses, TLB misses or mispredicted branches.
+ *
+ * Counters are opened for the calling thread and inherited by threads it
+ * creates afterwards; the counts of those threads are included once they
+ * have been joined. Each counter is opened on its own, so when the kernel
+ * refuses some or all of them (no PMU in a VM, perf_event_paranoid, seccomp,
+ * or not Linux at all) the others still work and the report falls back to
+ * wall-clock time only.
+ ***************************************************************************/
+
+/** The events that are counted */
+enum {
+  PERF_CYCLES,
+  PERF_INSTRUCTIONS,
+  PERF_LLC_MISSES,
+  PERF_DTLB_MISSES,
+  PERF_BRANCH_MISSES,
+  PERF_NUM_EVENTS
+};
+
+/**
+ * The counts of one phase.
+ */
+typedef struct {
+  /** The count of each event, valid only where available is set */
+  unsigned long long counts[PERF_NUM_EVENTS];
+
+  /** Whether each event could be counted */
+  int available[PERF_NUM_EVENTS];
+
+  /** The wall-clock time of the phase in nanoseconds */
+  unsigned long long wall_ns;
+} PerfSample;
+
+/**
+ * This defines a type that is a _PerfCounters struct. The definition for
+ * _PerfCounters is implemented in perf_counters.c.
+ */
+typedef struct _PerfCounters PerfCounters;
+
+/**
+ * createPerfCounters
+ *
+ * Open every counter the kernel allows. This never fails: counters that
+ * cannot be opened are simply reported as unavailable.
+ *
+ * @return a pointer to the new set of counters
+ */
+PerfCounters* createPerfCounters(void);
+
+/**
+ * destroyPerfCounters
+ *
+ * @param counters The pointer to the counters.
+ */
+void destroyPerfCounters(PerfCounters* counters);
+
+/**
+ * perfCountersAvailable
+ *
+ * @param counters The pointer to the counters.
+ * @return the number of events that could be opened
+ */
+int perfCountersAvailable(PerfCounters* counters);
+
+/**
+ * startPerfCounters
+ *
+ * Reset the counters and the wall clock, and start counting.
+ *
+ * @param counters The pointer to the counters.
+ */
+void startPerfCounters(PerfCounters* counters);
+
+/**
+ * stopPerfCounters
+ *
+ * Stop counting and read the counts of the phase.
+ *
+ * @param counters The pointer to the counters.
+ * @param sample Receives the counts.
+ */
+void stopPerfCounters(PerfCounters* counters, PerfSample* sample);
+
+/**
+ * printPerfSample
+ *
+ * Print the counts of a phase divided by its number of operations, plus
+ * instructions per cycle, on one line. Unavailable events print as "-".
+ *
+ * @param out The stream to print to.
+ * @param sample The counts of the phase.
+ * @param operations The number of operations done in the phase.
+ */
+void printPerfSample(FILE* out, const PerfSample* sample, unsigned long long operations);
+
+/**
+ * printPerfHeader
+ *
+ * Print the column titles matching printPerfSample.
+ *
+ * @param out The stream to print to.
+ */
+void printPerfHeader(FILE* out);
+
+#endif
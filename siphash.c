@@ -0,0 +1,75 @@
+/*
+ SipHash-1-3, following the reference implementation by Aumasson and
+ Bernstein. See siphash.h.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "siphash.h"
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+#define ROTATE(x, b)  (((x) << (b)) | ((x) >> (64 - (b))))
+
+/** One SipRound over the four state words */
+#define SIPROUND(v0, v1, v2, v3)                                        \
+    do {                                                                \
+        v0 += v1; v1 = ROTATE(v1, 13); v1 ^= v0; v0 = ROTATE(v0, 32);   \
+        v2 += v3; v3 = ROTATE(v3, 16); v3 ^= v2;                        \
+        v0 += v3; v3 = ROTATE(v3, 21); v3 ^= v0;                        \
+        v2 += v1; v1 = ROTATE(v1, 17); v1 ^= v2; v2 = ROTATE(v2, 32);   \
+    } while (0)
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* readWord
+*
+* Helper function that reads 8 bytes, least significant first.
+*/
+static unsigned long long readWord(const unsigned char* in, size_t bytes) {
+    unsigned long long word = 0;
+    size_t i;
+    for (i = 0; i < bytes; ++i) word |= (unsigned long long)in[i] << (8 * i);
+    return word;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+unsigned long long sipHash13(const void* data, size_t length,
+                             const unsigned long long seed[2]) {
+    const unsigned char* in = (const unsigned char*)data;
+    unsigned long long v0 = seed[0] ^ 0x736f6d6570736575ULL;
+    unsigned long long v1 = seed[1] ^ 0x646f72616e646f6dULL;
+    unsigned long long v2 = seed[0] ^ 0x6c7967656e657261ULL;
+    unsigned long long v3 = seed[1] ^ 0x7465646279746573ULL;
+
+    // compress every full 8-byte word
+    size_t i;
+    for (i = 0; i + 8 <= length; i += 8) {
+        unsigned long long word = readWord(in + i, 8);
+        v3 ^= word;
+        SIPROUND(v0, v1, v2, v3);
+        v0 ^= word;
+    }
+
+    // the last word holds the remaining bytes and the length
+    unsigned long long last = ((unsigned long long)length << 56) | readWord(in + i, length - i);
+    v3 ^= last;
+    SIPROUND(v0, v1, v2, v3);
+    v0 ^= last;
+
+    // finalize
+    v2 ^= 0xFF;
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    SIPROUND(v0, v1, v2, v3);
+    return v0 ^ v1 ^ v2 ^ v3;
+}
@@ -0,0 +1,33 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef SIPHASH_H
+#define SIPHASH_H
+
+#include <stddef.h>   // For size_t
+
+/****************************************************************************
+ * SipHash
+ *
+ * This module is private to the hash table implementation. SipHash-1-3 is a
+ * keyed hash function: without the 128-bit seed, nobody can predict which
+ * keys collide, so an attacker cannot pile keys into a single bucket. The
+ * table switches to it when it detects such an attack against the user's
+ * hash function.
+ *
+ * This is the reduced-round variant (one compression round, three
+ * finalization rounds) that Rust and Python use for their hash tables.
+ ***************************************************************************/
+
+/**
+ * sipHash13
+ *
+ * @param data The bytes to hash.
+ * @param length The number of bytes.
+ * @param seed The secret 128-bit seed.
+ * @return the 64-bit hash of the bytes
+ */
+unsigned long long sipHash13(const void* data, size_t length,
+                             const unsigned long long seed[2]);
+
+#endif
@@ -0,0 +1,179 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef STATICHASHTABLE_HPP
+#define STATICHASHTABLE_HPP
+
+/****************************************************************************
+ * Static Hash Tables (C++17)
+ *
+ * For small lookup tables whose keys are known when the program is compiled
+ * (opcodes, enum-like IDs), which would otherwise be built with
+ * createHashTable at startup. makeStaticHashTable builds a perfect hash
+ * table from a list of key/value pairs in a constant expression:
+ *
+ *     constexpr auto opcodes = makeStaticHashTable<int>({
+ *         {0x01, 10}, {0x3c, 20}, {0x90, 30}});
+ *     static_assert(*opcodes.find(0x3c) == 20, "");
+ *
+ * The table has 2^Bits slots and a multiplier chosen so that
+ * (key * multiplier) >> (32 - Bits) sends every key to its own slot
+ * (multiplicative hashing, searched over a fixed sequence of odd
+ * multipliers). A lookup is that multiply and shift and one key compare:
+ * a slot without a key holds the key of another slot, which no key hashing
+ * there can equal. Nothing is built at run time; the table is plain data.
+ *
+ * A perfect multiplier is only likely to exist if there are many more slots
+ * than keys, so the default Bits gives at least N^2 / 8 slots (and 2N): 32
+ * for 16 keys, 512 for 64 keys. Pass Bits to StaticHashTable::build to
+ * trade search time for space. Duplicate keys, or a Bits for which no
+ * multiplier is found, fail to compile.
+ ***************************************************************************/
+#include <cstddef>    // For std::size_t
+#include <cstdint>    // For std::uint32_t and std::uint64_t
+#include <stdexcept>  // For std::invalid_argument
+
+/**
+ * A key and its value, as given to makeStaticHashTable.
+ */
+template <typename Value>
+struct StaticHashEntry {
+  std::uint32_t key;
+  Value value;
+};
+
+/**
+ * staticHashBits
+ *
+ * @return The default log2 of the number of slots for n keys
+ */
+constexpr std::size_t staticHashBits(std::size_t n) {
+    std::size_t bits = 1;
+    while ((std::size_t{1} << bits) < 2 * n || (std::size_t{1} << bits) < n * n / 8) ++bits;
+    return bits;
+}
+
+template <typename Value, std::size_t N, std::size_t Bits = staticHashBits(N)>
+class StaticHashTable {
+  static_assert(N > 0, "a static hash table needs at least one key");
+  static_assert(Bits > 0 && Bits < 32, "Bits must be between 1 and 31");
+
+ public:
+  /** The number of slots */
+  static constexpr std::size_t kSlots = std::size_t{1} << Bits;
+
+  /** The number of multipliers tried before giving up */
+  static constexpr std::uint64_t kMaxAttempts = 1 << 16;
+
+  /**
+   * build
+   *
+   * Finds a perfect multiplier for the keys and fills the slots. Meant to be
+   * evaluated at compile time; it throws, which makes the constant
+   * expression fail, on duplicate keys or if no multiplier works.
+   *
+   * @param entries The keys and their values.
+   * @return the table
+   */
+  static constexpr StaticHashTable build(const StaticHashEntry<Value> (&entries)[N]) {
+    for (std::size_t i = 0; i < N; ++i) {
+      for (std::size_t j = 0; j < i; ++j) {
+        if (entries[i].key == entries[j].key) throw std::invalid_argument("duplicate key");
+      }
+    }
+
+    StaticHashTable table;
+    // which attempt last took each slot, so slots need no clearing
+    std::uint64_t takenBy[kSlots] = {};
+    for (std::uint64_t attempt = 1; attempt <= kMaxAttempts; ++attempt) {
+      table.multiplier_ = candidate(attempt);
+      std::size_t i = 0;
+      while (i < N && takenBy[table.slotOf(entries[i].key)] != attempt) {
+        takenBy[table.slotOf(entries[i].key)] = attempt;
+        ++i;
+      }
+      if (i < N) continue;
+
+      // a perfect multiplier: empty slots get the key of the first entry,
+      // which hashes elsewhere, so they never match
+      for (std::size_t slot = 0; slot < kSlots; ++slot) {
+        table.keys_[slot] = entries[0].key;
+        table.values_[slot] = Value();
+      }
+      for (std::size_t k = 0; k < N; ++k) {
+        table.keys_[table.slotOf(entries[k].key)] = entries[k].key;
+        table.values_[table.slotOf(entries[k].key)] = entries[k].value;
+      }
+      return table;
+    }
+    throw std::invalid_argument("no perfect multiplier; use more Bits");
+  }
+
+  /**
+   * find
+   *
+   * @param key The key to look up.
+   * @return a pointer to the value of the key, or nullptr if it is absent
+   */
+  constexpr const Value* find(std::uint32_t key) const {
+    std::size_t slot = slotOf(key);
+    return keys_[slot] == key ? &values_[slot] : nullptr;
+  }
+
+  /**
+   * contains
+   *
+   * @param key The key to look up.
+   * @return true if the key is in the table
+   */
+  constexpr bool contains(std::uint32_t key) const {
+    return keys_[slotOf(key)] == key;
+  }
+
+  /** The number of keys */
+  static constexpr std::size_t size() { return N; }
+
+  /** The multiplier found by build */
+  constexpr std::uint32_t multiplier() const { return multiplier_; }
+
+ private:
+  constexpr StaticHashTable() : multiplier_(0), keys_(), values_() {}
+
+  /** The slot of a key */
+  constexpr std::size_t slotOf(std::uint32_t key) const {
+    return static_cast<std::uint32_t>(key * multiplier_) >> (32 - Bits);
+  }
+
+  /** The odd multiplier tried by an attempt (splitmix64 of its number) */
+  static constexpr std::uint32_t candidate(std::uint64_t attempt) {
+    std::uint64_t x = attempt * 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return static_cast<std::uint32_t>(x >> 32) | 1u;
+  }
+
+  /** The perfect multiplier */
+  std::uint32_t multiplier_;
+
+  /** The key of each slot */
+  std::uint32_t keys_[kSlots];
+
+  /** The value of each slot */
+  Value values_[kSlots];
+};
+
+/**
+ * makeStaticHashTable
+ *
+ * Builds a static hash table with the default number of slots.
+ *
+ * @param entries The keys and their values, e.g. {{1, a}, {7, b}}.
+ * @return the table, a constant expression when entries are
+ */
+template <typename Value, std::size_t N>
+constexpr StaticHashTable<Value, N> makeStaticHashTable(const StaticHashEntry<Value> (&entries)[N]) {
+    return StaticHashTable<Value, N>::build(entries);
+}
+
+#endif
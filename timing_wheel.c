@@ -0,0 +1,274 @@
+/*
+ Hierarchical timing wheel used by the hash table for active TTL expiry.
+ See timing_wheel.h for an overview.
+
+ The placement rule follows the classic Varghese & Lauck scheme used by the
+ Linux kernel: a timer goes to the lowest level whose span covers the
+ distance to its deadline, in the slot selected by the deadline bits of that
+ level. Every time the level 0 index wraps to zero, the current slot of level
+ 1 is cascaded down, and so on for the upper levels.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "timing_wheel.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc and free
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** Number of bits of the deadline consumed by each level */
+#define WHEEL_BITS    6
+/** Number of slots in each level */
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)
+/** Number of levels. 64^5 ms is a little more than 12 days. */
+#define WHEEL_LEVELS  5
+
+/**
+ * A single pending timer. Timers in the same slot form a linked list, in
+ * which each node also points at the link pointing to it, so that it can be
+ * unlinked without walking the slot.
+ */
+typedef struct _TimerNode {
+  /** The key this timer belongs to */
+  unsigned int key;
+
+  /** The absolute deadline of the timer in milliseconds */
+  unsigned long long deadline;
+
+  /** The next timer in the same slot, or NULL */
+  struct _TimerNode* next;
+
+  /** The slot head or the next field of the timer before this one */
+  struct _TimerNode** link;
+} TimerNode;
+
+/**
+ * This structure represents a timing wheel.
+ */
+struct _TimingWheel {
+  /** The slots of every level, each one the head of a list of timers */
+  TimerNode* slots[WHEEL_LEVELS][WHEEL_SLOTS];
+
+  /** The last millisecond whose level 0 slot has been fully processed */
+  unsigned long long current;
+
+  /** The millisecond for which the upper levels have last been cascaded.
+      It is either current, or current + 1 while that slot is half done. */
+  unsigned long long base;
+
+  /** The number of timers in the wheel */
+  unsigned long long num_timers;
+
+  /** Timer nodes that have fired, kept for reuse to avoid malloc churn */
+  TimerNode* free_nodes;
+
+  /** The number of timer nodes allocated, pending or free */
+  unsigned long long num_nodes;
+};
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* pushTimer
+*
+* Helper function that links a timer node at the head of a slot.
+*
+* @param slot The head of the slot
+* @param node The timer node
+*/
+static void pushTimer(TimerNode** slot, TimerNode* node) {
+    node->next = *slot;
+    node->link = slot;
+    if (node->next) node->next->link = &node->next;
+    *slot = node;
+}
+
+/**
+* unlinkTimer
+*
+* Helper function that takes a timer node out of its slot.
+*
+* @param node The timer node
+*/
+static void unlinkTimer(TimerNode* node) {
+    *node->link = node->next;
+    if (node->next) node->next->link = node->link;
+}
+
+/**
+* placeTimer
+*
+* Helper function that links a timer node into the slot matching its deadline,
+* relative to the time the wheel was last cascaded for.
+*
+* @param wheel The pointer to the timing wheel
+* @param node The timer node to place
+*/
+static void placeTimer(TimingWheel* wheel, TimerNode* node) {
+    // Deadlines already in the past fire at the next millisecond to process
+    unsigned long long effective = node->deadline;
+    if (effective <= wheel->current) effective = wheel->current + 1;
+
+    // Find the lowest level that spans the distance to the deadline
+    unsigned long long delta = effective - wheel->base;
+    int level = 0;
+    while (level < WHEEL_LEVELS - 1 &&
+           delta >= (1ULL << (WHEEL_BITS * (level + 1)))) {
+        ++level;
+    }
+    // Timers beyond the top level wait in its furthest slot and get
+    // re-placed when that slot cascades
+    if (delta >= (1ULL << (WHEEL_BITS * WHEEL_LEVELS))) {
+        effective = wheel->base + (1ULL << (WHEEL_BITS * WHEEL_LEVELS)) - 1;
+    }
+
+    // Push the node on the head of the slot
+    unsigned int slot = (effective >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+    pushTimer(&wheel->slots[level][slot], node);
+}
+
+/**
+* cascade
+*
+* Helper function that moves every timer from the slot of the upper levels
+* that starts at time down to the finer levels. Timers are placed relative to
+* time, so wheel->base must already be set.
+*
+* @param wheel The pointer to the timing wheel
+* @param time The millisecond being entered
+*/
+static void cascade(TimingWheel* wheel, unsigned long long time) {
+    int level;
+    for (level = 1; level < WHEEL_LEVELS; ++level) {
+        // Only cascade a level when all the bits below it are zero
+        if (time & ((1ULL << (WHEEL_BITS * level)) - 1)) break;
+        unsigned int slot = (time >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+        TimerNode* node = wheel->slots[level][slot];
+        wheel->slots[level][slot] = NULL;
+        while (node) {
+            TimerNode* next = node->next;
+            placeTimer(wheel, node);
+            node = next;
+        }
+    }
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+TimingWheel* createTimingWheel(unsigned long long now) {
+    // calloc leaves every slot empty
+    TimingWheel* wheel = (TimingWheel*)calloc(1, sizeof(TimingWheel));
+    wheel->current = now;
+    wheel->base = now;
+    return wheel;
+}
+
+void destroyTimingWheel(TimingWheel* wheel) {
+    int level, slot;
+    // free the pending timers of every slot
+    for (level = 0; level < WHEEL_LEVELS; ++level) {
+        for (slot = 0; slot < WHEEL_SLOTS; ++slot) {
+            TimerNode* node = wheel->slots[level][slot];
+            while (node) {
+                TimerNode* next = node->next;
+                free(node);
+                node = next;
+            }
+        }
+    }
+    // free the recycled nodes
+    while (wheel->free_nodes) {
+        TimerNode* next = wheel->free_nodes->next;
+        free(wheel->free_nodes);
+        wheel->free_nodes = next;
+    }
+    free(wheel);
+}
+
+Timer* addTimer(TimingWheel* wheel, unsigned int key, unsigned long long deadline) {
+    // reuse a fired node if there is one
+    TimerNode* node = wheel->free_nodes;
+    if (node) {
+        wheel->free_nodes = node->next;
+    } else {
+        node = (TimerNode*)malloc(sizeof(TimerNode));
+        wheel->num_nodes++;
+    }
+    node->key = key;
+    node->deadline = deadline;
+    placeTimer(wheel, node);
+    wheel->num_timers++;
+    return node;
+}
+
+void cancelTimer(TimingWheel* wheel, Timer* timer) {
+    unlinkTimer(timer);
+    wheel->num_timers--;
+    // recycle the node
+    timer->next = wheel->free_nodes;
+    wheel->free_nodes = timer;
+}
+
+unsigned long long timingWheelMemoryUsage(TimingWheel* wheel) {
+    return sizeof(TimingWheel) + wheel->num_nodes * sizeof(TimerNode);
+}
+
+unsigned int advanceTimingWheel(TimingWheel* wheel, unsigned long long now,
+                                unsigned int budget, TimerCallback callback,
+                                void* context) {
+    unsigned int work = 0;
+    unsigned int fired = 0;
+
+    // An empty wheel can jump straight to now
+    if (wheel->num_timers == 0 && wheel->current < now) {
+        wheel->current = now;
+        wheel->base = now;
+        return 0;
+    }
+
+    while (wheel->current < now && work < budget) {
+        unsigned long long time = wheel->current + 1;
+
+        // Cascade the upper levels once per millisecond entered
+        if (wheel->base != time) {
+            wheel->base = time;
+            cascade(wheel, time);
+        }
+
+        // Fire the timers of this millisecond, one by one so that the
+        // budget can stop us in the middle of a crowded slot
+        TimerNode** slot = &wheel->slots[0][time & (WHEEL_SLOTS - 1)];
+        while (*slot && work < budget) {
+            TimerNode* node = *slot;
+            unlinkTimer(node);
+            ++work;
+            wheel->num_timers--;
+            fired += callback(context, node->key, node->deadline);
+            // recycle the node
+            node->next = wheel->free_nodes;
+            wheel->free_nodes = node;
+        }
+        if (*slot) break;           // out of budget, resume here next time
+
+        // The slot is done, move on
+        wheel->current = time;
+        ++work;
+        if (wheel->num_timers == 0) {
+            wheel->current = now;
+            wheel->base = now;
+        }
+    }
+    return fired;
+}
@@ -0,0 +1,113 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef TIMINGWHEEL_H
+#define TIMINGWHEEL_H
+
+/****************************************************************************
+ * Hierarchical Timing Wheel
+ *
+ * This module is private to the hash table implementation. It keeps track of
+ * (key, deadline) pairs so that expiring keys costs time proportional to the
+ * number of keys that actually expire, instead of scanning every bucket.
+ *
+ * Deadlines are absolute times in milliseconds. The wheel has several levels
+ * of 64 slots each: level 0 covers the next 64 ms with 1 ms resolution, level
+ * 1 the next 4096 ms with 64 ms resolution, and so on. When time reaches the
+ * start of a coarse slot, its timers are "cascaded" down to finer levels.
+ *
+ * addTimer returns a handle to the timer, which cancelTimer takes out of the
+ * wheel in constant time when its key is overwritten, given a new TTL or
+ * removed, so the wheel only holds timers of live keys.
+ ***************************************************************************/
+
+/**
+ * This defines a type that is a _TimingWheel struct. The definition for
+ * _TimingWheel is implemented in timing_wheel.c.
+ */
+typedef struct _TimingWheel TimingWheel;
+
+/**
+ * This defines a type that is a _TimerNode struct, a pending timer. The
+ * definition for _TimerNode is implemented in timing_wheel.c.
+ */
+typedef struct _TimerNode Timer;
+
+/**
+ * This defines a type that is a pointer to a function which is called for
+ * every timer that fires. It should return 1 if the timer expired something
+ * and 0 if the timer was stale.
+ */
+typedef int (*TimerCallback)(void* context, unsigned int key, unsigned long long deadline);
+
+/**
+ * createTimingWheel
+ *
+ * Creates an empty timing wheel whose current time is now.
+ *
+ * @param now The current time in milliseconds.
+ * @return a pointer to the new timing wheel
+ */
+TimingWheel* createTimingWheel(unsigned long long now);
+
+/**
+ * destroyTimingWheel
+ *
+ * Frees the timing wheel and every timer still pending in it.
+ *
+ * @param wheel The pointer to the timing wheel.
+ */
+void destroyTimingWheel(TimingWheel* wheel);
+
+/**
+ * addTimer
+ *
+ * Schedule a timer for the key. A deadline that is already in the past fires
+ * on the next millisecond processed by advanceTimingWheel.
+ *
+ * @param wheel The pointer to the timing wheel.
+ * @param key The key the timer belongs to.
+ * @param deadline The absolute time in milliseconds when the timer fires.
+ * @return the timer, valid until it fires or is cancelled
+ */
+Timer* addTimer(TimingWheel* wheel, unsigned int key, unsigned long long deadline);
+
+/**
+ * cancelTimer
+ *
+ * Take a pending timer out of the wheel, so that it never fires. A timer
+ * that fired already, or is firing, must not be cancelled.
+ *
+ * @param wheel The pointer to the timing wheel.
+ * @param timer The timer returned by addTimer.
+ */
+void cancelTimer(TimingWheel* wheel, Timer* timer);
+
+/**
+ * advanceTimingWheel
+ *
+ * Move the wheel forward towards now, calling the callback for every timer
+ * whose deadline has passed. At most budget units of work (one per timer
+ * handled and one per millisecond stepped) are done per call; whatever is
+ * left over is picked up by the next call.
+ *
+ * @param wheel The pointer to the timing wheel.
+ * @param now The current time in milliseconds.
+ * @param budget The maximum amount of work to do in this call.
+ * @param callback The function called for each fired timer.
+ * @param context An opaque pointer passed to the callback.
+ * @return the number of fired timers for which the callback returned 1
+ */
+unsigned int advanceTimingWheel(TimingWheel* wheel, unsigned long long now,
+                                unsigned int budget, TimerCallback callback,
+                                void* context);
+
+/**
+ * timingWheelMemoryUsage
+ *
+ * @param wheel The pointer to the timing wheel.
+ * @return the number of bytes allocated for the wheel and its timers
+ */
+unsigned long long timingWheelMemoryUsage(TimingWheel* wheel);
+
+#endif
@@ -0,0 +1,289 @@
+/*
+ Operation trace recorder with per-thread buffers and a background writer.
+ See trace_recorder.h for the file format.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "trace_recorder.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc and free
+#include <stdio.h>    // For FILE
+#include <pthread.h>  // For the writer thread
+#include <time.h>     // For clock_gettime
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The size of the data of one chunk, header included */
+#define CHUNK_SIZE    (64 * 1024)
+/** The largest encoded record: op, key, and two 10-byte varints */
+#define MAX_RECORD    25
+
+/**
+ * A chunk of records, either being filled by a thread or queued for writing.
+ */
+typedef struct _Chunk {
+  /** The next chunk in the write queue */
+  struct _Chunk* next;
+
+  /** The number of bytes used in data, header included */
+  size_t length;
+
+  /** The encoded chunk header and records */
+  unsigned char data[CHUNK_SIZE];
+} Chunk;
+
+/**
+ * The recording state of one thread.
+ */
+typedef struct _ThreadBuffer {
+  /** The thread that owns this buffer */
+  pthread_t thread;
+
+  /** The number written in the header of this thread's chunks */
+  unsigned int thread_number;
+
+  /** The chunk being filled */
+  Chunk* chunk;
+
+  /** The time of the last record in the chunk, in nanoseconds */
+  unsigned long long last_time;
+
+  /** The next buffer of the same recorder */
+  struct _ThreadBuffer* next;
+} ThreadBuffer;
+
+/**
+ * This structure represents a trace recorder.
+ */
+struct _TraceRecorder {
+  /** A number that is never reused, identifying this recorder to threads */
+  unsigned long long id;
+
+  /** The trace file */
+  FILE* file;
+
+  /** Protects the write queue and the list of thread buffers */
+  pthread_mutex_t lock;
+
+  /** Signalled when a chunk is queued or the recorder is stopping */
+  pthread_cond_t wake;
+
+  /** The chunks waiting to be written, oldest first */
+  Chunk* queue_head;
+  Chunk* queue_tail;
+
+  /** Set when the writer should exit once the queue is empty */
+  int stopping;
+
+  /** The background writer thread */
+  pthread_t writer;
+
+  /** The buffers of every thread that recorded something */
+  ThreadBuffer* buffers;
+  unsigned int num_threads;
+};
+
+/** The source of recorder ids */
+static unsigned long long nextRecorderId = 1;
+
+/** The buffer the calling thread last used, and the recorder it belongs to.
+    The buffer is only valid while threadRecorderId matches a live recorder. */
+static _Thread_local unsigned long long threadRecorderId;
+static _Thread_local ThreadBuffer* threadBuffer;
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* nowNs
+*
+* @return The monotonic clock in nanoseconds
+*/
+static unsigned long long nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+* putLittleEndian
+*
+* Helper function that stores the low bytes of value, least significant first.
+*/
+static void putLittleEndian(unsigned char* out, unsigned long long value, int bytes) {
+    int i;
+    for (i = 0; i < bytes; ++i) out[i] = (unsigned char)(value >> (8 * i));
+}
+
+/**
+* putVarint
+*
+* @return The number of bytes written
+*/
+static size_t putVarint(unsigned char* out, unsigned long long value) {
+    size_t length = 0;
+    while (value >= 0x80) {
+        out[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+/**
+* submitChunk
+*
+* Helper function that finishes the header of a thread's chunk and queues it
+* for the writer. The thread gets a fresh chunk. Must be called with the
+* lock held.
+*/
+static void submitChunk(TraceRecorder* recorder, ThreadBuffer* buffer) {
+    Chunk* chunk = buffer->chunk;
+    putLittleEndian(chunk->data + 4, chunk->length - TRACE_CHUNK_HEADER, 4);
+    chunk->next = NULL;
+    if (recorder->queue_tail) recorder->queue_tail->next = chunk;
+    else recorder->queue_head = chunk;
+    recorder->queue_tail = chunk;
+    pthread_cond_signal(&recorder->wake);
+
+    buffer->chunk = (Chunk*)malloc(sizeof(Chunk));
+    buffer->chunk->length = 0;
+}
+
+/**
+* attachThread
+*
+* Helper function that finds the calling thread's buffer for this recorder,
+* creating it on first use, and caches it in thread-local storage.
+*/
+static ThreadBuffer* attachThread(TraceRecorder* recorder) {
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&recorder->lock);
+    ThreadBuffer* buffer = recorder->buffers;
+    while (buffer && !pthread_equal(buffer->thread, self)) buffer = buffer->next;
+    if (!buffer) {
+        buffer = (ThreadBuffer*)malloc(sizeof(ThreadBuffer));
+        buffer->thread = self;
+        buffer->thread_number = recorder->num_threads++;
+        buffer->chunk = (Chunk*)malloc(sizeof(Chunk));
+        buffer->chunk->length = 0;
+        buffer->next = recorder->buffers;
+        recorder->buffers = buffer;
+    }
+    pthread_mutex_unlock(&recorder->lock);
+
+    threadRecorderId = recorder->id;
+    threadBuffer = buffer;
+    return buffer;
+}
+
+/**
+* writerMain
+*
+* Body of the background thread: write queued chunks until stopped.
+*/
+static void* writerMain(void* argument) {
+    TraceRecorder* recorder = (TraceRecorder*)argument;
+    pthread_mutex_lock(&recorder->lock);
+    for (;;) {
+        while (!recorder->queue_head && !recorder->stopping) {
+            pthread_cond_wait(&recorder->wake, &recorder->lock);
+        }
+        if (!recorder->queue_head) break;
+
+        // take the whole queue and write it without holding the lock
+        Chunk* chunk = recorder->queue_head;
+        recorder->queue_head = recorder->queue_tail = NULL;
+        pthread_mutex_unlock(&recorder->lock);
+        while (chunk) {
+            Chunk* next = chunk->next;
+            fwrite(chunk->data, 1, chunk->length, recorder->file);
+            free(chunk);
+            chunk = next;
+        }
+        pthread_mutex_lock(&recorder->lock);
+    }
+    pthread_mutex_unlock(&recorder->lock);
+    return NULL;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+TraceRecorder* createTraceRecorder(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) return NULL;
+    fwrite(TRACE_MAGIC, 1, TRACE_MAGIC_LENGTH, file);
+
+    TraceRecorder* recorder = (TraceRecorder*)calloc(1, sizeof(TraceRecorder));
+    recorder->id = __atomic_fetch_add(&nextRecorderId, 1, __ATOMIC_RELAXED);
+    recorder->file = file;
+    pthread_mutex_init(&recorder->lock, NULL);
+    pthread_cond_init(&recorder->wake, NULL);
+    pthread_create(&recorder->writer, NULL, writerMain, recorder);
+    return recorder;
+}
+
+void destroyTraceRecorder(TraceRecorder* recorder) {
+    // queue what every thread has buffered, then let the writer drain
+    pthread_mutex_lock(&recorder->lock);
+    ThreadBuffer* buffer;
+    for (buffer = recorder->buffers; buffer; buffer = buffer->next) {
+        if (buffer->chunk->length) submitChunk(recorder, buffer);
+    }
+    recorder->stopping = 1;
+    pthread_cond_signal(&recorder->wake);
+    pthread_mutex_unlock(&recorder->lock);
+    pthread_join(recorder->writer, NULL);
+
+    fclose(recorder->file);
+    while (recorder->buffers) {
+        buffer = recorder->buffers;
+        recorder->buffers = buffer->next;
+        free(buffer->chunk);
+        free(buffer);
+    }
+    pthread_mutex_destroy(&recorder->lock);
+    pthread_cond_destroy(&recorder->wake);
+    free(recorder);
+}
+
+void recordOperation(TraceRecorder* recorder, int op, unsigned int key, unsigned int ttl) {
+    ThreadBuffer* buffer = threadRecorderId == recorder->id ? threadBuffer
+                                                            : attachThread(recorder);
+    if (buffer->chunk->length + MAX_RECORD > CHUNK_SIZE) {
+        pthread_mutex_lock(&recorder->lock);
+        submitChunk(recorder, buffer);
+        pthread_mutex_unlock(&recorder->lock);
+    }
+
+    Chunk* chunk = buffer->chunk;
+    unsigned long long now = nowNs();
+    if (chunk->length == 0) {
+        // start a new chunk; its length is filled in when it is submitted
+        putLittleEndian(chunk->data, buffer->thread_number, 4);
+        putLittleEndian(chunk->data + 8, now, 8);
+        chunk->length = TRACE_CHUNK_HEADER;
+        buffer->last_time = now;
+    }
+
+    unsigned char* out = chunk->data + chunk->length;
+    size_t length = 0;
+    out[length++] = (unsigned char)op;
+    putLittleEndian(out + length, key, 4);
+    length += 4;
+    length += putVarint(out + length, now - buffer->last_time);
+    if (op == TRACE_INSERT_TTL) length += putVarint(out + length, ttl);
+    chunk->length += length;
+    buffer->last_time = now;
+}
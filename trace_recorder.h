@@ -0,0 +1,84 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef TRACERECORDER_H
+#define TRACERECORDER_H
+
+/****************************************************************************
+ * Operation Trace Recorder
+ *
+ * This module is private to the hash table implementation, except for the
+ * file format definitions below, which the trace_replay tool also uses.
+ *
+ * Every traced operation is appended to a buffer owned by the calling thread,
+ * so recording takes no lock. Full buffers are handed to a background writer
+ * thread, which appends them to the trace file.
+ *
+ * File format (all integers little-endian):
+ *
+ *   file   := "HTTRACE1" chunk*
+ *   chunk  := thread:u32 length:u32 start:u64 record*   (length bytes of records)
+ *   record := op:u8 key:u32 delta:varint [ttl:varint if op is TRACE_INSERT_TTL]
+ *
+ * thread numbers the recording threads from 0, start is the monotonic clock in
+ * nanoseconds when the chunk was started, and delta is the time in
+ * nanoseconds since the previous record of the chunk (or since start).
+ * Varints use 7 bits per byte, least significant first, with the high bit
+ * set on every byte but the last.
+ ***************************************************************************/
+
+/** The magic bytes at the start of every trace file */
+#define TRACE_MAGIC         "HTTRACE1"
+#define TRACE_MAGIC_LENGTH  8
+
+/** The size of a chunk header in bytes */
+#define TRACE_CHUNK_HEADER  16
+
+/** The operation codes stored in records */
+enum {
+  TRACE_INSERT = 1,
+  TRACE_INSERT_TTL,
+  TRACE_GET,
+  TRACE_REMOVE,
+  TRACE_DELETE
+};
+
+/**
+ * This defines a type that is a _TraceRecorder struct. The definition for
+ * _TraceRecorder is implemented in trace_recorder.c.
+ */
+typedef struct _TraceRecorder TraceRecorder;
+
+/**
+ * createTraceRecorder
+ *
+ * Creates the trace file and starts the background writer thread.
+ *
+ * @param path The path of the trace file, which is truncated.
+ * @return a pointer to the new recorder, or NULL if the file cannot be created
+ */
+TraceRecorder* createTraceRecorder(const char* path);
+
+/**
+ * destroyTraceRecorder
+ *
+ * Flushes the buffers of every thread, waits for the writer thread to finish
+ * and closes the file. No other thread may be recording at this point.
+ *
+ * @param recorder The pointer to the recorder.
+ */
+void destroyTraceRecorder(TraceRecorder* recorder);
+
+/**
+ * recordOperation
+ *
+ * Append one record to the calling thread's buffer.
+ *
+ * @param recorder The pointer to the recorder.
+ * @param op One of the TRACE_ operation codes.
+ * @param key The key of the operation.
+ * @param ttl The TTL in milliseconds for TRACE_INSERT_TTL, ignored otherwise.
+ */
+void recordOperation(TraceRecorder* recorder, int op, unsigned int key, unsigned int ttl);
+
+#endif
@@ -0,0 +1,237 @@
+/*
+=======================
+Trace Replay Tool
+=======================
+Replays an operation trace recorded with startHashTableTrace against a table
+configured from the command line, as fast as possible, and reports the
+throughput, the latency distribution of each operation and the memory the
+table uses at the end.
+
+Chunks are replayed in the order they were written, so operations recorded
+by different threads are interleaved chunk by chunk, on a single thread.
+Inserted values are fresh 8-byte heap blocks. With -p, hardware events are
+counted over the whole replay and printed per operation.
+
+Usage:
+    ./trace_replay [-b BUCKETS] [-c CAPACITY] [-s SKETCH_COUNTERS] [-p] TRACE_FILE
+*/
+
+#include "hash_table.h"
+#include "trace_recorder.h"
+#include "latency_histogram.h"
+#include "workload.h"
+#include "perf_counters.h"
+
+#include <stdlib.h>   // For malloc and free
+#include <stdio.h>    // For printf and file reading
+#include <string.h>   // For memcmp
+#include <time.h>     // For clock_gettime
+#include <unistd.h>   // For getopt
+
+
+/** The names of the TRACE_ operation codes, indexed by code */
+static const char* opNames[] = { "?", "insert", "insert-ttl", "get", "remove", "delete" };
+#define NUM_OP_CODES  6
+
+/** The number of buckets of the table under test, read by bucketHash */
+static unsigned int numBuckets;
+
+/**
+ * bucketHash
+ *
+ * Mix the key, then reduce it to a bucket.
+ */
+static unsigned int bucketHash(unsigned int key) {
+    return scrambleKey(key) % numBuckets;
+}
+
+/**
+ * nowNs
+ *
+ * @return the monotonic clock in nanoseconds
+ */
+static unsigned long long nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * getLittleEndian
+ */
+static unsigned long long getLittleEndian(const unsigned char* in, int bytes) {
+    unsigned long long value = 0;
+    int i;
+    for (i = bytes - 1; i >= 0; --i) value = (value << 8) | in[i];
+    return value;
+}
+
+/**
+ * getVarint
+ *
+ * Decode a varint, without reading past end.
+ *
+ * @return the number of bytes consumed, or 0 if the varint is truncated
+ */
+static size_t getVarint(const unsigned char* in, const unsigned char* end,
+                        unsigned long long* value) {
+    size_t length = 0;
+    int shift = 0;
+    *value = 0;
+    while (in + length < end && shift < 64) {
+        unsigned char byte = in[length++];
+        *value |= (unsigned long long)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return length;
+        shift += 7;
+    }
+    return 0;
+}
+
+/**
+ * readFile
+ *
+ * Read a whole file into memory.
+ */
+static unsigned char* readFile(const char* path, size_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return NULL;
+    fseek(file, 0, SEEK_END);
+    *size = (size_t)ftell(file);
+    fseek(file, 0, SEEK_SET);
+    unsigned char* data = (unsigned char*)malloc(*size ? *size : 1);
+    if (fread(data, 1, *size, file) != *size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    return data;
+}
+
+int main(int argc, char** argv) {
+    unsigned int buckets = 1 << 20;
+    unsigned int capacity = 0;
+    unsigned int sketchCounters = 0;
+    int countEvents = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "b:c:s:p")) != -1) {
+        switch (option) {
+        case 'b': buckets = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'c': capacity = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 's': sketchCounters = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'p': countEvents = 1; break;
+        default: optind = argc + 1; break;
+        }
+    }
+    if (optind != argc - 1 || buckets == 0) {
+        printf("Usage: %s [-b BUCKETS] [-c CAPACITY] [-s SKETCH_COUNTERS] [-p] TRACE_FILE\n",
+               argv[0]);
+        return 1;
+    }
+
+    size_t size;
+    unsigned char* data = readFile(argv[optind], &size);
+    if (!data || size < TRACE_MAGIC_LENGTH ||
+        memcmp(data, TRACE_MAGIC, TRACE_MAGIC_LENGTH) != 0) {
+        printf("%s is not a hash table trace\n", argv[optind]);
+        free(data);
+        return 1;
+    }
+
+    numBuckets = buckets;
+    HashTable* ht = createHashTable(bucketHash, numBuckets);
+    if (capacity) enableHashTableCache(ht, capacity, sketchCounters, 0);
+
+    LatencyHistogram* latency[NUM_OP_CODES];
+    int op;
+    for (op = 0; op < NUM_OP_CODES; ++op) latency[op] = createLatencyHistogram();
+    unsigned long long hits = 0;
+    unsigned long long recordedNs = 0;
+
+    PerfCounters* counters = countEvents ? createPerfCounters() : NULL;
+    PerfSample sample;
+    if (counters) startPerfCounters(counters);
+    unsigned long long start = nowNs();
+    const unsigned char* chunk = data + TRACE_MAGIC_LENGTH;
+    const unsigned char* end = data + size;
+    while (chunk + TRACE_CHUNK_HEADER <= end) {
+        const unsigned char* in = chunk + TRACE_CHUNK_HEADER;
+        const unsigned char* chunkEnd = in + getLittleEndian(chunk + 4, 4);
+        if (chunkEnd > end) {
+            printf("warning: the last chunk is truncated\n");
+            chunkEnd = end;
+        }
+        while (in + 5 < chunkEnd) {
+            // decode one record
+            op = in[0];
+            unsigned int key = (unsigned int)getLittleEndian(in + 1, 4);
+            unsigned long long delta, ttl = 0;
+            size_t used = getVarint(in + 5, chunkEnd, &delta);
+            if (!used || op <= 0 || op >= NUM_OP_CODES) break;
+            in += 5 + used;
+            if (op == TRACE_INSERT_TTL) {
+                used = getVarint(in, chunkEnd, &ttl);
+                if (!used) break;
+                in += used;
+            }
+            recordedNs += delta;
+
+            // run it
+            unsigned long long before = nowNs();
+            switch (op) {
+            case TRACE_INSERT:
+                free(insertItem(ht, key, malloc(sizeof(unsigned long long))));
+                break;
+            case TRACE_INSERT_TTL:
+                free(insertItemWithTTL(ht, key, malloc(sizeof(unsigned long long)),
+                                       (unsigned int)ttl));
+                break;
+            case TRACE_GET:
+                if (getItem(ht, key)) ++hits;
+                break;
+            case TRACE_REMOVE:
+                free(removeItem(ht, key));
+                break;
+            case TRACE_DELETE:
+                deleteItem(ht, key);
+                break;
+            }
+            recordLatency(latency[op], nowNs() - before);
+        }
+        chunk = chunkEnd;
+    }
+    double seconds = (nowNs() - start) / 1e9;
+    if (counters) stopPerfCounters(counters, &sample);
+
+    // report
+    unsigned long long total = 0, gets = 0;
+    for (op = 1; op < NUM_OP_CODES; ++op) total += latencyCount(latency[op]);
+    gets = latencyCount(latency[TRACE_GET]);
+    printf("replayed %llu operations in %.3f s: %.3f Mops/s\n",
+           total, seconds, seconds > 0 ? total / seconds / 1e6 : 0.0);
+    printf("recorded time between operations: %.3f s in total\n", recordedNs / 1e9);
+    if (gets) printf("get hit ratio: %.2f%%\n", 100.0 * hits / gets);
+    printf("\n%-10s %10s %8s %8s %8s %8s %8s %10s   (ns)\n",
+           "op", "count", "mean", "p50", "p90", "p99", "p99.9", "max");
+    for (op = 1; op < NUM_OP_CODES; ++op) {
+        if (!latencyCount(latency[op])) continue;
+        printf("%-10s %10llu %8.0f %8llu %8llu %8llu %8llu %10llu\n", opNames[op],
+               latencyCount(latency[op]), latencyMean(latency[op]),
+               latencyPercentile(latency[op], 50), latencyPercentile(latency[op], 90),
+               latencyPercentile(latency[op], 99), latencyPercentile(latency[op], 99.9),
+               latencyMax(latency[op]));
+    }
+    if (counters) {
+        // the per-operation timing is included in these counts
+        printf("\nhardware events per operation:\n");
+        printPerfHeader(stdout);
+        printPerfSample(stdout, &sample, total);
+        destroyPerfCounters(counters);
+    }
+    printf("\nfinal table memory: %llu bytes (values excluded)\n", hashTableMemoryUsage(ht));
+
+    for (op = 0; op < NUM_OP_CODES; ++op) destroyLatencyHistogram(latency[op]);
+    destroyHashTable(ht);
+    free(data);
+    return 0;
+}
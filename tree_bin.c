@@ -0,0 +1,123 @@
+/*
+ Sorted array bins for crowded hash table buckets. See tree_bin.h.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "tree_bin.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc, realloc and free
+#include <string.h>   // For memmove
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/** The room a new bin starts with, in items */
+#define INITIAL_CAPACITY  16
+
+/**
+ * This structure represents a tree bin.
+ */
+struct _TreeBin {
+  /** The keys, in increasing order */
+  unsigned int* keys;
+
+  /** The item stored with each key */
+  void** items;
+
+  /** The number of items in the bin */
+  unsigned int count;
+
+  /** The number of items the arrays have room for */
+  unsigned int capacity;
+};
+
+
+/****************************************************************************
+* Private Functions
+***************************************************************************/
+/**
+* lowerBound
+*
+* Helper function that finds where key is, or where it would be inserted.
+*
+* @return The position of the first key that is not smaller than key
+*/
+static unsigned int lowerBound(TreeBin* bin, unsigned int key) {
+    unsigned int low = 0, high = bin->count;
+    while (low < high) {
+        unsigned int middle = low + (high - low) / 2;
+        if (bin->keys[middle] < key) low = middle + 1;
+        else high = middle;
+    }
+    return low;
+}
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+TreeBin* createTreeBin(void) {
+    TreeBin* bin = (TreeBin*)malloc(sizeof(TreeBin));
+    bin->keys = (unsigned int*)malloc(INITIAL_CAPACITY * sizeof(unsigned int));
+    bin->items = (void**)malloc(INITIAL_CAPACITY * sizeof(void*));
+    bin->count = 0;
+    bin->capacity = INITIAL_CAPACITY;
+    return bin;
+}
+
+void destroyTreeBin(TreeBin* bin) {
+    free(bin->keys);
+    free(bin->items);
+    free(bin);
+}
+
+void* treeBinFind(TreeBin* bin, unsigned int key) {
+    unsigned int i = lowerBound(bin, key);
+    return i < bin->count && bin->keys[i] == key ? bin->items[i] : NULL;
+}
+
+void treeBinInsert(TreeBin* bin, unsigned int key, void* item) {
+    if (bin->count == bin->capacity) {
+        bin->capacity *= 2;
+        bin->keys = (unsigned int*)realloc(bin->keys, bin->capacity * sizeof(unsigned int));
+        bin->items = (void**)realloc(bin->items, bin->capacity * sizeof(void*));
+    }
+    // shift the larger keys up by one
+    unsigned int i = lowerBound(bin, key);
+    memmove(bin->keys + i + 1, bin->keys + i, (bin->count - i) * sizeof(unsigned int));
+    memmove(bin->items + i + 1, bin->items + i, (bin->count - i) * sizeof(void*));
+    bin->keys[i] = key;
+    bin->items[i] = item;
+    bin->count++;
+}
+
+void* treeBinRemove(TreeBin* bin, unsigned int key) {
+    unsigned int i = lowerBound(bin, key);
+    if (i == bin->count || bin->keys[i] != key) return NULL;
+    void* item = bin->items[i];
+    // shift the larger keys down by one
+    bin->count--;
+    memmove(bin->keys + i, bin->keys + i + 1, (bin->count - i) * sizeof(unsigned int));
+    memmove(bin->items + i, bin->items + i + 1, (bin->count - i) * sizeof(void*));
+    return item;
+}
+
+unsigned int treeBinSize(TreeBin* bin) {
+    return bin->count;
+}
+
+void* treeBinItem(TreeBin* bin, unsigned int i) {
+    return bin->items[i];
+}
+
+unsigned long long treeBinMemoryUsage(TreeBin* bin) {
+    return sizeof(TreeBin) +
+           (unsigned long long)bin->capacity * (sizeof(unsigned int) + sizeof(void*));
+}
@@ -0,0 +1,100 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef TREEBIN_H
+#define TREEBIN_H
+
+/****************************************************************************
+ * Tree Bin
+ *
+ * This module is private to the hash table implementation. When too many keys
+ * land in one bucket, the bucket's entries are moved out of their linked list
+ * into a tree bin, so that finding a key takes O(log n) comparisons instead of
+ * a walk down a chain that a weak hash function or an attacker could make
+ * thousands of entries long.
+ *
+ * A bin is a pair of arrays sorted by key: the keys, which binary search
+ * scans without touching the entries, and the items stored with them.
+ * Inserting and removing shift the tail of the arrays, which is a single
+ * memmove of a few kilobytes even for very crowded buckets.
+ ***************************************************************************/
+
+/**
+ * This defines a type that is a _TreeBin struct. The definition for
+ * _TreeBin is implemented in tree_bin.c.
+ */
+typedef struct _TreeBin TreeBin;
+
+/**
+ * createTreeBin
+ *
+ * @return a pointer to a new, empty bin
+ */
+TreeBin* createTreeBin(void);
+
+/**
+ * destroyTreeBin
+ *
+ * Frees the bin, but not the items it holds.
+ *
+ * @param bin The pointer to the bin.
+ */
+void destroyTreeBin(TreeBin* bin);
+
+/**
+ * treeBinFind
+ *
+ * @param bin The pointer to the bin.
+ * @param key The key to look for.
+ * @return the item stored with the key, or NULL if the key is not in the bin
+ */
+void* treeBinFind(TreeBin* bin, unsigned int key);
+
+/**
+ * treeBinInsert
+ *
+ * Add a key that is not in the bin yet.
+ *
+ * @param bin The pointer to the bin.
+ * @param key The key of the item.
+ * @param item The item to store, which must not be NULL.
+ */
+void treeBinInsert(TreeBin* bin, unsigned int key, void* item);
+
+/**
+ * treeBinRemove
+ *
+ * @param bin The pointer to the bin.
+ * @param key The key to remove.
+ * @return the item that was stored with the key, or NULL if it was not there
+ */
+void* treeBinRemove(TreeBin* bin, unsigned int key);
+
+/**
+ * treeBinSize
+ *
+ * @param bin The pointer to the bin.
+ * @return the number of items in the bin
+ */
+unsigned int treeBinSize(TreeBin* bin);
+
+/**
+ * treeBinItem
+ *
+ * Items are numbered from 0 in key order.
+ *
+ * @param bin The pointer to the bin.
+ * @param i The position of the item, below treeBinSize.
+ * @return the item at that position
+ */
+void* treeBinItem(TreeBin* bin, unsigned int i);
+
+/**
+ * treeBinMemoryUsage
+ *
+ * @param bin The pointer to the bin.
+ * @return the number of bytes allocated for the bin, items excluded
+ */
+unsigned long long treeBinMemoryUsage(TreeBin* bin);
+
+#endif
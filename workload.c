@@ -0,0 +1,107 @@
+/*
+ Workload generators for the benchmark programs. See workload.h.
+*/
+
+/****************************************************************************
+* Include the Public Interface
+***************************************************************************/
+#include "workload.h"
+
+
+/****************************************************************************
+* Include other private dependencies
+***************************************************************************/
+#include <stdlib.h>   // For malloc and free
+#include <math.h>     // For pow
+
+
+/****************************************************************************
+* Hidden Definitions
+***************************************************************************/
+/**
+ * This structure holds the constants of a Zipfian distribution.
+ */
+struct _ZipfianGenerator {
+  /** The number of distinct ranks */
+  unsigned long long num_items;
+
+  /** The skew of the distribution */
+  double theta;
+
+  /** Derived constants, named after the paper */
+  double alpha;
+  double zetan;
+  double eta;
+  double half_pow_theta;
+};
+
+
+/****************************************************************************
+* Public Interface Functions
+****************************************************************************/
+unsigned long long nextRandom(unsigned long long* state) {
+    unsigned long long x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+double nextUniform(unsigned long long* state) {
+    // the top 53 bits fill a double's mantissa
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+ZipfianGenerator* createZipfian(unsigned long long numItems, double theta) {
+    ZipfianGenerator* generator = (ZipfianGenerator*)malloc(sizeof(ZipfianGenerator));
+    generator->num_items = numItems;
+    generator->theta = theta;
+
+    // zeta(n, theta) = sum of 1 / i^theta
+    double zetan = 0;
+    unsigned long long i;
+    for (i = 1; i <= numItems; ++i) zetan += 1.0 / pow((double)i, theta);
+    double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+
+    generator->zetan = zetan;
+    generator->alpha = 1.0 / (1.0 - theta);
+    generator->eta = (1.0 - pow(2.0 / numItems, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+    generator->half_pow_theta = 1.0 + pow(0.5, theta);
+    return generator;
+}
+
+void destroyZipfian(ZipfianGenerator* generator) {
+    free(generator);
+}
+
+unsigned long long nextZipfian(ZipfianGenerator* generator, unsigned long long* state) {
+    double u = nextUniform(state);
+    double uz = u * generator->zetan;
+    if (uz < 1.0) return 0;
+    if (uz < generator->half_pow_theta) return 1;
+    unsigned long long rank = (unsigned long long)(generator->num_items *
+        pow(generator->eta * u - generator->eta + 1.0, generator->alpha));
+    return rank < generator->num_items ? rank : generator->num_items - 1;
+}
+
+unsigned long long nextHotspot(unsigned long long numItems, double hotFraction,
+                               double hotOpFraction, unsigned long long* state) {
+    unsigned long long hotItems = (unsigned long long)(numItems * hotFraction);
+    if (hotItems == 0) hotItems = 1;
+    if (hotItems >= numItems || nextUniform(state) < hotOpFraction) {
+        return nextRandom(state) % hotItems;
+    }
+    return hotItems + nextRandom(state) % (numItems - hotItems);
+}
+
+unsigned int scrambleKey(unsigned long long rank) {
+    // murmur3 finalizer, a bijection on 32 bits
+    unsigned int h = (unsigned int)rank;
+    h ^= h >> 16;
+    h *= 0x85EBCA6Bu;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35u;
+    h ^= h >> 16;
+    return h;
+}
@@ -0,0 +1,98 @@
+/****************************************************************************
+ * Include guards
+ ***************************************************************************/
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+/****************************************************************************
+ * Workload Generators
+ *
+ * Random number and key distribution generators shared by the benchmark
+ * programs. They are not part of the hash table library.
+ *
+ * Every generator draws from a caller-owned random state, so that each
+ * benchmark thread can have its own stream without any locking.
+ ***************************************************************************/
+
+/**
+ * This defines a type that is a _ZipfianGenerator struct. The definition for
+ * _ZipfianGenerator is implemented in workload.c.
+ */
+typedef struct _ZipfianGenerator ZipfianGenerator;
+
+/**
+ * nextRandom
+ *
+ * Advance the random state and return 64 random bits (xorshift64*).
+ *
+ * @param state The random state, which must not be 0.
+ * @return the next random number
+ */
+unsigned long long nextRandom(unsigned long long* state);
+
+/**
+ * nextUniform
+ *
+ * @param state The random state.
+ * @return a random number uniformly distributed in [0, 1)
+ */
+double nextUniform(unsigned long long* state);
+
+/**
+ * createZipfian
+ *
+ * Creates a generator of ranks in [0, numItems) following a Zipfian
+ * distribution, where rank 0 is the most popular. This is the algorithm from
+ * "Quickly Generating Billion-Record Synthetic Databases" (Gray et al.), as
+ * used by YCSB. Construction is O(numItems); drawing is O(1).
+ *
+ * @param numItems The number of distinct ranks.
+ * @param theta The skew, between 0 (uniform) and just under 1 (very skewed).
+ * @return a pointer to the new generator
+ */
+ZipfianGenerator* createZipfian(unsigned long long numItems, double theta);
+
+/**
+ * destroyZipfian
+ *
+ * @param generator The pointer to the generator.
+ */
+void destroyZipfian(ZipfianGenerator* generator);
+
+/**
+ * nextZipfian
+ *
+ * @param generator The pointer to the generator.
+ * @param state The random state.
+ * @return the next rank
+ */
+unsigned long long nextZipfian(ZipfianGenerator* generator, unsigned long long* state);
+
+/**
+ * nextHotspot
+ *
+ * Draw a rank from a hotspot distribution: a fraction hotOpFraction of the
+ * draws fall uniformly in the first hotFraction of the ranks, and the rest
+ * fall uniformly in the remaining ranks.
+ *
+ * @param numItems The number of distinct ranks.
+ * @param hotFraction The fraction of ranks that are hot, in (0, 1).
+ * @param hotOpFraction The fraction of draws that hit the hot ranks, in [0, 1].
+ * @param state The random state.
+ * @return the next rank
+ */
+unsigned long long nextHotspot(unsigned long long numItems, double hotFraction,
+                               double hotOpFraction, unsigned long long* state);
+
+/**
+ * scrambleKey
+ *
+ * Spread ranks over the key space with a bijective mix, so that popular keys
+ * are not neighbours (and do not all land in neighbouring buckets).
+ *
+ * @param rank The rank to scramble.
+ * @return the key for the rank
+ */
+unsigned int scrambleKey(unsigned long long rank);
+
+#endif
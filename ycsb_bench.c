@@ -0,0 +1,419 @@
+/*
+=======================
+YCSB-Style Macro-Benchmark
+=======================
+Runs mixes of operations modelled on the Yahoo! Cloud Serving Benchmark core
+workloads against the hash table API, and reports throughput and latency
+percentiles per operation type.
+
+    A  50% read, 50% update                 (session store)
+    B  95% read,  5% update                 (photo tagging)
+    C 100% read                             (user profile cache)
+    D  95% read,  5% insert, reads skewed to the latest inserts (status updates)
+    E  20% read, 80% insert                 (insert-heavy ingestion; YCSB's E
+                                             is scan-based, which the API lacks)
+    F  50% read, 50% read-modify-write      (user database)
+
+Every run loads a fresh table with the record count, then each thread issues
+its share of operations. Most layouts are not thread-safe, so the driver
+serialises access with a readers-writer lock, like an application sharing one
+table would: reads take it shared, updates and inserts take it exclusive.
+The hopscotch layout is used without that lock, since it synchronises itself
+with lock-free reads, so read-mostly workloads (B, C, D) compare the two
+approaches; its read-modify-write then writes a fresh value instead of
+reading the current one, which another thread may be freeing.
+
+Usage:
+    ./ycsb_bench [-w WORKLOADS] [-d uniform|zipfian|hotspot] [-z THETA]
+                 [-t THREADS,...] [-r RECORDS] [-o OPERATIONS] [-b BUCKETS]
+                 [-l LAYOUT] [-p]
+
+    -w  workloads to run, e.g. ACF (default ABCDEF)
+    -d  key distribution (default zipfian)
+    -z  Zipfian skew (default 0.99)
+    -t  comma separated thread counts (default 1,2,4)
+    -r  records loaded before each run (default 1000000)
+    -o  operations per run, split between threads (default 2000000)
+    -b  number of buckets (default: the record count)
+    -l  table layout: chained, compact, unrolled, inline, hopscotch,
+        linear or extendible
+        (default chained)
+    -p  also count hardware events (perf_event_open) during the load and run
+        phases and print them per operation; events the kernel refuses to
+        count print as "-"
+*/
+
+#include "hash_table.h"
+#include "workload.h"
+#include "latency_histogram.h"
+#include "perf_counters.h"
+
+#include <stdlib.h>   // For malloc, free and strtol
+#include <stdio.h>    // For printf
+#include <string.h>   // For strchr
+#include <pthread.h>  // For threads and the table lock
+#include <time.h>     // For clock_gettime
+#include <unistd.h>   // For getopt
+
+
+/****************************************************************************
+* Benchmark Definitions
+***************************************************************************/
+/** The kinds of operation a workload mixes */
+enum { OP_READ, OP_UPDATE, OP_INSERT, OP_RMW, NUM_OPS };
+static const char* opNames[NUM_OPS] = { "read", "update", "insert", "rmw" };
+
+/** The key distributions */
+enum { DIST_UNIFORM, DIST_ZIPFIAN, DIST_HOTSPOT };
+
+/**
+ * A workload is a percentage for each kind of operation, plus whether reads
+ * favour the most recently inserted keys.
+ */
+typedef struct {
+  char name;
+  unsigned int percent[NUM_OPS];
+  int read_latest;
+} Workload;
+
+static const Workload workloads[] = {
+  { 'A', { 50, 50,  0,  0 }, 0 },
+  { 'B', { 95,  5,  0,  0 }, 0 },
+  { 'C', {100,  0,  0,  0 }, 0 },
+  { 'D', { 95,  0,  5,  0 }, 1 },
+  { 'E', { 20,  0, 80,  0 }, 0 },
+  { 'F', { 50,  0,  0, 50 }, 0 },
+};
+
+/** The layouts that can be selected, and their names */
+static const HashTableLayout layouts[] = {
+  HT_LAYOUT_CHAINED, HT_LAYOUT_COMPACT, HT_LAYOUT_UNROLLED, HT_LAYOUT_INLINE,
+  HT_LAYOUT_HOPSCOTCH, HT_LAYOUT_LINEAR, HT_LAYOUT_EXTENDIBLE
+};
+static const char* layoutNames[] = { "chained", "compact", "unrolled", "inline", "hopscotch",
+                                     "linear", "extendible" };
+#define NUM_LAYOUTS  (sizeof(layouts) / sizeof(layouts[0]))
+
+/** Settings shared by every thread of a run */
+typedef struct {
+  HashTable* table;
+  pthread_rwlock_t lock;
+  /** 1 if the driver has to serialise access through lock */
+  int locked;
+  const Workload* workload;
+  int distribution;
+  ZipfianGenerator* zipf;
+  unsigned long long records;
+  /** The number of records inserted so far; new keys are taken from it */
+  unsigned long long inserted;
+  unsigned long long ops_per_thread;
+} Run;
+
+/** What one thread did */
+typedef struct {
+  Run* run;
+  unsigned long long seed;
+  LatencyHistogram* latency[NUM_OPS];
+} Worker;
+
+/** The number of buckets of the table under test, read by bucketHash */
+static unsigned int numBuckets;
+
+/**
+ * bucketHash
+ *
+ * Keys are already scrambled ranks, so reducing them is enough.
+ */
+static unsigned int bucketHash(unsigned int key) {
+    return key % numBuckets;
+}
+
+/**
+ * nowNs
+ *
+ * @return the monotonic clock in nanoseconds
+ */
+static unsigned long long nowNs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long long)now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ * newValue
+ *
+ * Values are small heap blocks, since the table frees them on destroy.
+ */
+static void* newValue(unsigned long long payload) {
+    unsigned long long* value = (unsigned long long*)malloc(sizeof(unsigned long long));
+    *value = payload;
+    return value;
+}
+
+/**
+ * lockTable
+ *
+ * Take the driver lock, shared or exclusive, if the layout needs it.
+ */
+static void lockTable(Run* run, int exclusive) {
+    if (!run->locked) return;
+    if (exclusive) pthread_rwlock_wrlock(&run->lock);
+    else pthread_rwlock_rdlock(&run->lock);
+}
+
+/**
+ * unlockTable
+ */
+static void unlockTable(Run* run) {
+    if (run->locked) pthread_rwlock_unlock(&run->lock);
+}
+
+/**
+ * chooseRank
+ *
+ * Pick the rank of an existing record according to the run's distribution.
+ */
+static unsigned long long chooseRank(Run* run, unsigned long long* seed) {
+    unsigned long long inserted = __atomic_load_n(&run->inserted, __ATOMIC_RELAXED);
+    unsigned long long rank;
+    switch (run->distribution) {
+    case DIST_UNIFORM:
+        rank = nextRandom(seed) % inserted;
+        break;
+    case DIST_HOTSPOT:
+        rank = nextHotspot(inserted, 0.2, 0.8, seed);
+        break;
+    default:
+        // the generator was built for the loaded records; inserts past
+        // those are only reachable through the latest distribution
+        rank = nextZipfian(run->zipf, seed);
+        break;
+    }
+    if (run->workload->read_latest) {
+        // count back from the newest record
+        rank = inserted - 1 - (rank % inserted);
+    }
+    return rank;
+}
+
+/**
+ * workerMain
+ *
+ * Thread body: issue operations until the thread's share is done.
+ */
+static void* workerMain(void* argument) {
+    Worker* worker = (Worker*)argument;
+    Run* run = worker->run;
+    unsigned long long i;
+    for (i = 0; i < run->ops_per_thread; ++i) {
+        // pick the kind of operation
+        unsigned int dice = nextRandom(&worker->seed) % 100;
+        int op = 0;
+        while (dice >= run->workload->percent[op]) dice -= run->workload->percent[op++];
+
+        unsigned long long start = nowNs();
+        if (op == OP_INSERT) {
+            unsigned long long rank = __atomic_fetch_add(&run->inserted, 1, __ATOMIC_RELAXED);
+            void* value = newValue(rank);
+            lockTable(run, 1);
+            insertItem(run->table, scrambleKey(rank), value);
+            unlockTable(run);
+        } else {
+            unsigned int key = scrambleKey(chooseRank(run, &worker->seed));
+            if (op == OP_READ) {
+                lockTable(run, 0);
+                getItem(run->table, key);
+                unlockTable(run);
+            } else if (op == OP_UPDATE) {
+                void* value = newValue(i);
+                lockTable(run, 1);
+                void* old = insertItem(run->table, key, value);
+                unlockTable(run);
+                free(old);
+            } else {
+                // read, then write back a modified copy; without the driver
+                // lock the current value may be freed under us, so only its
+                // presence is read
+                lockTable(run, 1);
+                unsigned long long* current = (unsigned long long*)getItem(run->table, key);
+                unsigned long long payload = !current ? 0 : run->locked ? *current + 1 : i;
+                void* old = insertItem(run->table, key, newValue(payload));
+                unlockTable(run);
+                free(old);
+            }
+        }
+        recordLatency(worker->latency[op], nowNs() - start);
+    }
+    return NULL;
+}
+
+/**
+ * runWorkload
+ *
+ * Load a fresh table, run one workload with the given number of threads and
+ * print one line per kind of operation. With counters, also print the
+ * hardware events per operation of the load and run phases.
+ */
+static void runWorkload(const Workload* workload, int distribution, double theta,
+                        int threads, unsigned long long records,
+                        unsigned long long operations, unsigned int buckets,
+                        HashTableLayout layout, PerfCounters* counters) {
+    PerfSample loadSample, runSample;
+    Run run;
+    numBuckets = buckets;
+    run.table = createHashTableWithLayout(bucketHash, numBuckets, layout);
+    pthread_rwlock_init(&run.lock, NULL);
+    run.locked = layout != HT_LAYOUT_HOPSCOTCH;
+    run.workload = workload;
+    run.distribution = distribution;
+    run.zipf = distribution == DIST_ZIPFIAN ? createZipfian(records, theta) : NULL;
+    run.records = records;
+    run.ops_per_thread = operations / threads;
+
+    // load phase
+    if (counters) startPerfCounters(counters);
+    unsigned long long rank;
+    for (rank = 0; rank < records; ++rank) {
+        insertItem(run.table, scrambleKey(rank), newValue(rank));
+    }
+    run.inserted = records;
+    if (counters) stopPerfCounters(counters, &loadSample);
+
+    // run phase
+    Worker* workers = (Worker*)malloc(threads * sizeof(Worker));
+    pthread_t* ids = (pthread_t*)malloc(threads * sizeof(pthread_t));
+    int t, op;
+    for (t = 0; t < threads; ++t) {
+        workers[t].run = &run;
+        workers[t].seed = 0x9E3779B97F4A7C15ULL * (t + 1);
+        for (op = 0; op < NUM_OPS; ++op) workers[t].latency[op] = createLatencyHistogram();
+    }
+    // the workers inherit the counters, and their counts are folded in
+    // once they have been joined
+    if (counters) startPerfCounters(counters);
+    unsigned long long start = nowNs();
+    for (t = 0; t < threads; ++t) pthread_create(&ids[t], NULL, workerMain, &workers[t]);
+    for (t = 0; t < threads; ++t) pthread_join(ids[t], NULL);
+    double seconds = (nowNs() - start) / 1e9;
+    if (counters) stopPerfCounters(counters, &runSample);
+
+    // merge the per-thread histograms and report
+    double total = (double)run.ops_per_thread * threads;
+    printf("%c  %7s  %3d  %10.3f", workload->name,
+           distribution == DIST_UNIFORM ? "uniform" :
+           distribution == DIST_HOTSPOT ? "hotspot" : "zipfian",
+           threads, total / seconds / 1e6);
+    int first = 1;
+    for (op = 0; op < NUM_OPS; ++op) {
+        LatencyHistogram* merged = createLatencyHistogram();
+        for (t = 0; t < threads; ++t) mergeLatencyHistogram(merged, workers[t].latency[op]);
+        if (latencyCount(merged)) {
+            if (!first) printf("%c  %7s  %3s  %10s", ' ', "", "", "");
+            printf("  %-6s %8llu %8llu %8llu %8llu %10llu\n", opNames[op],
+                   latencyPercentile(merged, 50), latencyPercentile(merged, 90),
+                   latencyPercentile(merged, 99), latencyPercentile(merged, 99.9),
+                   latencyMax(merged));
+            first = 0;
+        }
+        destroyLatencyHistogram(merged);
+    }
+    if (counters) {
+        printf("%27s  %-6s ", "", "load");
+        printPerfSample(stdout, &loadSample, records);
+        printf("%27s  %-6s ", "", "run");
+        printPerfSample(stdout, &runSample, run.ops_per_thread * threads);
+    }
+
+    for (t = 0; t < threads; ++t) {
+        for (op = 0; op < NUM_OPS; ++op) destroyLatencyHistogram(workers[t].latency[op]);
+    }
+    free(workers);
+    free(ids);
+    if (run.zipf) destroyZipfian(run.zipf);
+    pthread_rwlock_destroy(&run.lock);
+    destroyHashTable(run.table);
+}
+
+int main(int argc, char** argv) {
+    const char* names = "ABCDEF";
+    int distribution = DIST_ZIPFIAN;
+    double theta = 0.99;
+    const char* threadList = "1,2,4";
+    unsigned long long records = 1000000;
+    unsigned long long operations = 2000000;
+    unsigned int buckets = 0;
+    HashTableLayout layout = HT_LAYOUT_CHAINED;
+    PerfCounters* counters = NULL;
+    size_t l;
+
+    int option;
+    while ((option = getopt(argc, argv, "w:d:z:t:r:o:b:l:p")) != -1) {
+        switch (option) {
+        case 'w': names = optarg; break;
+        case 'd':
+            if (strcmp(optarg, "uniform") == 0) distribution = DIST_UNIFORM;
+            else if (strcmp(optarg, "hotspot") == 0) distribution = DIST_HOTSPOT;
+            else if (strcmp(optarg, "zipfian") == 0) distribution = DIST_ZIPFIAN;
+            else { printf("Unknown distribution %s\n", optarg); return 1; }
+            break;
+        case 'z': theta = atof(optarg); break;
+        case 't': threadList = optarg; break;
+        case 'r': records = strtoull(optarg, NULL, 10); break;
+        case 'o': operations = strtoull(optarg, NULL, 10); break;
+        case 'b': buckets = (unsigned int)strtoul(optarg, NULL, 10); break;
+        case 'l':
+            for (l = 0; l < NUM_LAYOUTS && strcmp(optarg, layoutNames[l]) != 0; ++l) {}
+            if (l == NUM_LAYOUTS) { printf("Unknown layout %s\n", optarg); return 1; }
+            layout = layouts[l];
+            break;
+        case 'p': if (!counters) counters = createPerfCounters(); break;
+        default:
+            printf("Usage: %s [-w WORKLOADS] [-d uniform|zipfian|hotspot] [-z THETA] "
+                   "[-t THREADS,...] [-r RECORDS] [-o OPERATIONS] [-b BUCKETS] "
+                   "[-l LAYOUT] [-p]\n",
+                   argv[0]);
+            return 1;
+        }
+    }
+    if (records == 0 || (distribution == DIST_ZIPFIAN && (theta <= 0 || theta >= 1))) {
+        printf("Need at least one record and a Zipfian theta in (0, 1)\n");
+        return 1;
+    }
+    if (buckets == 0) buckets = (unsigned int)records;
+
+    for (l = 0; layouts[l] != layout; ++l) {}
+    printf("records %llu, operations %llu, buckets %u, layout %s, latencies in ns\n\n",
+           records, operations, buckets, layoutNames[l]);
+    if (counters) {
+        if (perfCountersAvailable(counters) < PERF_NUM_EVENTS) {
+            printf("only %d of %d hardware events can be counted here\n",
+                   perfCountersAvailable(counters), PERF_NUM_EVENTS);
+        }
+        printf("hardware events per operation, by phase:\n%30s  %-6s ", "", "phase");
+        printPerfHeader(stdout);
+        printf("\n");
+    }
+    printf("W  %7s  %3s  %10s  %-6s %8s %8s %8s %8s %10s\n", "dist", "thr", "Mops/s",
+           "op", "p50", "p90", "p99", "p99.9", "max");
+
+    const char* name;
+    for (name = names; *name; ++name) {
+        size_t w;
+        for (w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w) {
+            if (workloads[w].name != *name) continue;
+            const char* list = threadList;
+            while (*list) {
+                int threads = (int)strtol(list, NULL, 10);
+                if (threads > 0) {
+                    runWorkload(&workloads[w], distribution, theta, threads,
+                                records, operations, buckets, layout, counters);
+                }
+                const char* comma = strchr(list, ',');
+                if (!comma) break;
+                list = comma + 1;
+            }
+        }
+    }
+    if (counters) destroyPerfCounters(counters);
+    return 0;
+}